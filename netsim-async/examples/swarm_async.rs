@@ -80,7 +80,7 @@ impl BusyBee {
         let size = self.sample_size().await;
 
         let msg = Msg::new(size);
-        self.writer.send_to(to, msg).unwrap()
+        self.writer.send_to(to, msg).unwrap();
     }
 
     async fn handle_inbound(&mut self, _from: SimId, msg: Msg) {
@@ -1,15 +1,20 @@
 mod sim_context;
 mod sim_link;
+mod sim_stream;
 
 pub use self::sim_context::SimContext;
 pub(crate) use self::sim_link::{link, SimDownLink, SimUpLink};
+pub use self::sim_stream::{SimStreamReader, SimStreamWriter};
 use anyhow::Result;
-use netsim_core::BusSender;
-pub(crate) use netsim_core::Msg;
 pub use netsim_core::{
-    Bandwidth, Edge, EdgePolicy, HasBytesSize, Latency, NodePolicy, PacketLoss, SimConfiguration,
-    SimId,
+    Bandwidth, CapacityTrace, Constellation, DelayTrace, Delivery, Edge, EdgePolicy, EdgeTrace,
+    FailureProcess, HasBytesSize, Latency, LatencyDistribution, Lifetime, Location, Movement, Msg,
+    MsgId, MsgMeta, NodePolicy, OnDrop, Orbit, PacketLoss, Phantom, PropagationReport, Relay,
+    Segment, SendCompletion, SimClock, SimConfiguration, SimEvent, SimId, StreamId, Timer,
+    Topology, UtilisationSampler,
 };
+use netsim_core::{BusSender, StreamWriter};
+use std::time::Duration;
 
 pub struct SimSocket<T>
 where
@@ -22,14 +27,21 @@ where
 pub struct SimSocketReadHalf<T> {
     id: SimId,
     down: SimDownLink<T>,
+    clock: SimClock,
 }
 
+/// The writing end of a socket
+///
+/// The handles are cheap to clone and can be moved to other threads, so
+/// several threads can send from the same socket. All the handles of a
+/// context share the same queue to the multiplexer.
 pub struct SimSocketWriteHalf<T>
 where
     T: HasBytesSize,
 {
     id: SimId,
     up: BusSender<SimUpLink<T>>,
+    clock: SimClock,
 }
 
 impl<T> SimSocket<T>
@@ -40,9 +52,18 @@ where
         id: SimId,
         to_bus: BusSender<SimUpLink<T>>,
         receiver: SimDownLink<T>,
+        clock: SimClock,
     ) -> Self {
-        let reader = SimSocketReadHalf { id, down: receiver };
-        let writer = SimSocketWriteHalf { id, up: to_bus };
+        let reader = SimSocketReadHalf {
+            id,
+            down: receiver,
+            clock: clock.clone(),
+        };
+        let writer = SimSocketWriteHalf {
+            id,
+            up: to_bus,
+            clock,
+        };
 
         Self { reader, writer }
     }
@@ -51,6 +72,12 @@ where
         self.reader.id()
     }
 
+    /// a new handle on the writing end of the socket, see
+    /// [`SimSocketWriteHalf`]
+    pub fn writer(&self) -> SimSocketWriteHalf<T> {
+        self.writer.clone()
+    }
+
     pub fn into_split(self) -> (SimSocketReadHalf<T>, SimSocketWriteHalf<T>) {
         let Self { reader, writer } = self;
         (reader, writer)
@@ -61,13 +88,102 @@ impl<T> SimSocket<T>
 where
     T: HasBytesSize,
 {
-    pub fn send_to(&self, to: SimId, msg: T) -> Result<()> {
+    pub fn send_to(&self, to: SimId, msg: T) -> Result<MsgId> {
         self.writer.send_to(to, msg)
     }
 
+    /// send a message and be notified once it has left this socket,
+    /// see [`SimSocketWriteHalf::send_to_notify`]
+    pub fn send_to_notify(&self, to: SimId, msg: T, token: u64) -> Result<MsgId> {
+        self.writer.send_to_notify(to, msg, token)
+    }
+
+    /// send a message that may be cancelled, see
+    /// [`SimSocketWriteHalf::send_to_cancellable`]
+    pub fn send_to_cancellable(&self, to: SimId, msg: T) -> Result<MsgId> {
+        self.writer.send_to_cancellable(to, msg)
+    }
+
+    /// send a message that is dropped if not delivered in time,
+    /// see [`SimSocketWriteHalf::send_to_with_timeout`]
+    pub fn send_to_with_timeout(&self, to: SimId, msg: T, timeout: Duration) -> Result<MsgId> {
+        self.writer.send_to_with_timeout(to, msg, timeout)
+    }
+
+    /// send a message that is part of a propagation, see
+    /// [`SimSocketWriteHalf::send_to_tracked`]
+    pub fn send_to_tracked(&self, to: SimId, msg: T, propagation: u64) -> Result<MsgId> {
+        self.writer.send_to_tracked(to, msg, propagation)
+    }
+
+    /// cancel a message, see [`SimSocketWriteHalf::cancel`]
+    pub fn cancel(&self, id: MsgId) -> Result<()> {
+        self.writer.cancel(id)
+    }
+
+    /// the current time of the simulation (see [`SimClock::now`])
+    pub fn now(&self) -> Duration {
+        self.writer.now()
+    }
+
+    /// request a timer, see [`SimSocketWriteHalf::timer_after`]
+    pub fn timer_after(&self, delay: Duration, token: u64) -> Result<()> {
+        self.writer.timer_after(delay, token)
+    }
+
+    /// open a stream to another node, see [`SimSocketWriteHalf::open_stream`]
+    pub fn open_stream(&self, to: SimId, window: u64) -> Result<SimStreamWriter<T>> {
+        self.writer.open_stream(to, window)
+    }
+
     pub async fn recv(&mut self) -> Option<(SimId, T)> {
         self.reader.recv().await
     }
+
+    /// receive the next message along with the timing of its journey
+    /// through the simulated network (see [`MsgMeta`])
+    pub async fn recv_with_meta(&mut self) -> Option<(SimId, T, MsgMeta)> {
+        self.reader.recv_with_meta().await
+    }
+
+    pub async fn recv_event(&mut self) -> Option<SimEvent<T>> {
+        self.reader.recv_event().await
+    }
+}
+
+impl<T> SimSocket<T>
+where
+    T: HasBytesSize + Clone,
+{
+    /// broadcast a message on a shared segment, see
+    /// [`SimSocketWriteHalf::broadcast`]
+    pub fn broadcast(&self, segment: u32, msg: T) -> Result<MsgId> {
+        self.writer.broadcast(segment, msg)
+    }
+}
+
+impl<T> SimSocket<T>
+where
+    T: HasBytesSize + From<Phantom>,
+{
+    /// send a message that only has a size, see
+    /// [`SimSocketWriteHalf::send_sized`]
+    pub fn send_sized(&self, to: SimId, size: u64, tag: u64) -> Result<MsgId> {
+        self.writer.send_sized(to, size, tag)
+    }
+}
+
+impl<T> Clone for SimSocketWriteHalf<T>
+where
+    T: HasBytesSize,
+{
+    fn clone(&self) -> Self {
+        Self {
+            id: self.id,
+            up: self.up.clone(),
+            clock: self.clock.clone(),
+        }
+    }
 }
 
 impl<T> SimSocketWriteHalf<T>
@@ -83,10 +199,133 @@ impl<T> SimSocketWriteHalf<T>
 where
     T: HasBytesSize,
 {
-    pub fn send_to(&self, to: SimId, msg: T) -> Result<()> {
+    pub fn send_to(&self, to: SimId, msg: T) -> Result<MsgId> {
         let msg = Msg::new(self.id, to, msg);
         self.up.send_msg(msg)
     }
+
+    /// send a message and be notified once its last byte has left this
+    /// socket (i.e. the upload of the message is complete)
+    ///
+    /// The notification is delivered back to this socket as a
+    /// [`SimEvent::SendCompletion`] with the given `token`. Use
+    /// [`SimSocket::recv_event`] to receive it.
+    pub fn send_to_notify(&self, to: SimId, msg: T, token: u64) -> Result<MsgId> {
+        let msg = Msg::new(self.id, to, msg).with_send_completion(token);
+        self.up.send_msg(msg)
+    }
+
+    /// send a message that may be cancelled with
+    /// [`SimSocketWriteHalf::cancel`] while it is in flight
+    pub fn send_to_cancellable(&self, to: SimId, msg: T) -> Result<MsgId> {
+        let msg = Msg::new(self.id, to, msg).with_cancellation();
+        self.up.send_msg(msg)
+    }
+
+    /// send a message that must be delivered within `timeout` of
+    /// simulated time
+    ///
+    /// If the message is still in flight once the timeout has elapsed it
+    /// is dropped (see [`SimConfiguration::on_drop`]). It may also be
+    /// cancelled with [`SimSocketWriteHalf::cancel`].
+    ///
+    /// [`SimConfiguration::on_drop`]: crate::SimConfiguration::on_drop
+    pub fn send_to_with_timeout(&self, to: SimId, msg: T, timeout: Duration) -> Result<MsgId> {
+        let deadline = self.clock.instant(self.clock.now() + timeout);
+        let msg = Msg::new(self.id, to, msg)
+            .with_deadline(deadline)
+            .with_cancellation();
+        self.up.send_msg(msg)
+    }
+
+    /// send a message that is part of the propagation `propagation`
+    /// (a block or a transaction relayed from node to node)
+    ///
+    /// The multiplexer records the first delivery of the propagation to
+    /// every node: use [`SimContext::propagation_report`] to know how long
+    /// it took to reach the nodes.
+    ///
+    /// [`SimContext::propagation_report`]: crate::SimContext::propagation_report
+    pub fn send_to_tracked(&self, to: SimId, msg: T, propagation: u64) -> Result<MsgId> {
+        let msg = Msg::new(self.id, to, msg).with_propagation(propagation);
+        self.up.send_msg(msg)
+    }
+
+    /// cancel a message previously sent by this socket with
+    /// [`SimSocketWriteHalf::send_to_cancellable`] or
+    /// [`SimSocketWriteHalf::send_to_with_timeout`]
+    ///
+    /// If the message is still in flight it is dropped (see
+    /// [`SimConfiguration::on_drop`]) and stops consuming the bandwidth
+    /// of the network. Nothing happens if it was already delivered, if it
+    /// was sent by another node or if it was not sent cancellable.
+    ///
+    /// [`SimConfiguration::on_drop`]: crate::SimConfiguration::on_drop
+    pub fn cancel(&self, id: MsgId) -> Result<()> {
+        self.up.send_cancel(self.id, id)
+    }
+
+    /// open an ordered byte stream to the node `to`
+    ///
+    /// The recipient receives the reading end of the stream as a
+    /// [`SimEvent::Stream`] (use [`SimSocket::recv_event`]). The stream is
+    /// accounted by the multiplexer as a single flow, sharing the bandwidth
+    /// of the network with the messages.
+    ///
+    /// `window` is the maximum number of bytes written but not yet read
+    /// by the recipient: once it is reached the writes wait until the
+    /// recipient reads from the stream.
+    pub fn open_stream(&self, to: SimId, window: u64) -> Result<SimStreamWriter<T>> {
+        let inner = StreamWriter::open(self.up.clone(), self.id, to, window)?;
+        Ok(SimStreamWriter::new(inner))
+    }
+
+    /// the current time of the simulation (see [`SimClock::now`])
+    pub fn now(&self) -> Duration {
+        self.clock.now()
+    }
+
+    /// request a timer that will expire after `delay` of simulated time
+    ///
+    /// The timer is kept by the multiplexer (it does not cost a task)
+    /// and is delivered back to this socket as a [`SimEvent::Timer`]
+    /// with the given `token`. Use [`SimSocket::recv_event`] to receive it.
+    pub fn timer_after(&self, delay: Duration, token: u64) -> Result<()> {
+        let deadline = self.clock.instant(self.clock.now() + delay);
+        self.up.send_timer(Timer::new(self.id, token, deadline))
+    }
+}
+
+impl<T> SimSocketWriteHalf<T>
+where
+    T: HasBytesSize + Clone,
+{
+    /// broadcast a message on the shared segment this socket is a member
+    /// of (see [`Segment`]): it is transmitted once and delivered to all
+    /// the other members of the segment
+    ///
+    /// The message is dropped if this socket is not a member of the
+    /// segment.
+    ///
+    /// [`Segment`]: netsim_core::Segment
+    pub fn broadcast(&self, segment: u32, msg: T) -> Result<MsgId> {
+        let msg = Msg::new(self.id, self.id, msg);
+        self.up.send_broadcast(segment, msg, T::clone)
+    }
+}
+
+impl<T> SimSocketWriteHalf<T>
+where
+    T: HasBytesSize + From<Phantom>,
+{
+    /// send a message of `size` bytes that carries a `tag` instead of a
+    /// payload (see [`Phantom`])
+    ///
+    /// The network charges `size` bytes, but only the tag is kept while
+    /// the message is in flight.
+    pub fn send_sized(&self, to: SimId, size: u64, tag: u64) -> Result<MsgId> {
+        self.send_to(to, T::from(Phantom { size, tag }))
+    }
 }
 
 impl<T> SimSocketReadHalf<T> {
@@ -99,9 +338,37 @@ impl<T> SimSocketReadHalf<T>
 where
     T: HasBytesSize,
 {
+    /// receive the next message from the network
+    ///
+    /// Other events (timers, send completions, streams) are discarded, use
+    /// [`SimSocketReadHalf::recv_event`] to receive them.
     pub async fn recv(&mut self) -> Option<(SimId, T)> {
-        let msg = self.down.recv().await?;
+        let msg = self.recv_msg().await?;
 
         Some((msg.from(), msg.into_content()))
     }
+
+    /// receive the next message from the network along with the timing
+    /// of its journey through the simulated network
+    ///
+    /// Other events (timers, send completions, streams) are discarded.
+    pub async fn recv_with_meta(&mut self) -> Option<(SimId, T, MsgMeta)> {
+        let msg = self.recv_msg().await?;
+        let meta = msg.meta(&self.clock);
+
+        Some((msg.from(), msg.into_content(), meta))
+    }
+
+    async fn recv_msg(&mut self) -> Option<Msg<T>> {
+        loop {
+            if let Some(msg) = self.recv_event().await?.into_msg() {
+                return Some(msg);
+            }
+        }
+    }
+
+    /// receive the next event (message, timer, send completion or stream)
+    pub async fn recv_event(&mut self) -> Option<SimEvent<T>> {
+        self.down.recv().await
+    }
 }
@@ -1,6 +1,6 @@
-use crate::{HasBytesSize, Msg};
+use crate::HasBytesSize;
 use anyhow::{anyhow, Result};
-use netsim_core::sim_context::Link;
+use netsim_core::{sim_context::Link, SimEvent};
 use tokio::sync::mpsc;
 
 pub fn link<T>() -> (SimUpLink<T>, SimDownLink<T>) {
@@ -17,31 +17,47 @@ where
     T: HasBytesSize,
 {
     type Msg = T;
-    fn send(&self, msg: Msg<T>) -> Result<()> {
-        self.sender.send(msg).map_err(|error| {
-            anyhow!(
+    fn send(&self, event: SimEvent<T>) -> Result<()> {
+        self.sender.send(event).map_err(|error| match error.0 {
+            SimEvent::Msg(msg) => anyhow!(
                 "Failed to send Msg ({size} bytes) from {from}, to {to}",
-                from = error.0.from(),
-                to = error.0.to(),
-                size = error.0.content().bytes_size(),
-            )
+                from = msg.from(),
+                to = msg.to(),
+                size = msg.content().bytes_size(),
+            ),
+            SimEvent::Timer(timer) => anyhow!(
+                "Failed to send Timer ({token}) to {to}",
+                token = timer.token(),
+                to = timer.node(),
+            ),
+            SimEvent::SendCompletion(completion) => anyhow!(
+                "Failed to send SendCompletion ({token}) to {to}",
+                token = completion.token(),
+                to = completion.from(),
+            ),
+            SimEvent::Stream(stream) => anyhow!(
+                "Failed to send Stream ({id}) from {from}, to {to}",
+                id = stream.id(),
+                from = stream.from(),
+                to = stream.to(),
+            ),
         })
     }
 }
 
 pub struct SimUpLink<T> {
-    sender: mpsc::UnboundedSender<Msg<T>>,
+    sender: mpsc::UnboundedSender<SimEvent<T>>,
 }
 
 pub struct SimDownLink<T> {
-    receiver: mpsc::UnboundedReceiver<Msg<T>>,
+    receiver: mpsc::UnboundedReceiver<SimEvent<T>>,
 }
 
 impl<T> SimDownLink<T>
 where
     T: HasBytesSize,
 {
-    pub async fn recv(&mut self) -> Option<Msg<T>> {
+    pub async fn recv(&mut self) -> Option<SimEvent<T>> {
         self.receiver.recv().await
     }
 }
@@ -0,0 +1,108 @@
+use crate::{HasBytesSize, SimId, SimUpLink};
+use netsim_core::{StreamId, StreamReader, StreamWriter};
+use std::{
+    io,
+    pin::Pin,
+    task::{Context, Poll},
+};
+use tokio::io::{AsyncRead, AsyncWrite, ReadBuf};
+
+/// The writing end of an ordered byte stream, see [`SimSocket::open_stream`]
+///
+/// Dropping the writer (or shutting it down) closes the stream.
+///
+/// [`SimSocket::open_stream`]: crate::SimSocket::open_stream
+pub struct SimStreamWriter<T>
+where
+    T: HasBytesSize,
+{
+    inner: StreamWriter<SimUpLink<T>>,
+}
+
+/// The reading end of an ordered byte stream
+///
+/// It is received by the recipient of the stream as a
+/// [`SimEvent::Stream`]: convert it with [`SimStreamReader::from`].
+///
+/// [`SimEvent::Stream`]: crate::SimEvent::Stream
+pub struct SimStreamReader {
+    inner: StreamReader,
+}
+
+impl<T> SimStreamWriter<T>
+where
+    T: HasBytesSize,
+{
+    pub(crate) fn new(inner: StreamWriter<SimUpLink<T>>) -> Self {
+        Self { inner }
+    }
+
+    pub fn id(&self) -> StreamId {
+        self.inner.id()
+    }
+
+    /// the recipient of the stream
+    pub fn to(&self) -> SimId {
+        self.inner.to()
+    }
+}
+
+impl<T> AsyncWrite for SimStreamWriter<T>
+where
+    T: HasBytesSize,
+{
+    fn poll_write(
+        self: Pin<&mut Self>,
+        cx: &mut Context<'_>,
+        buf: &[u8],
+    ) -> Poll<io::Result<usize>> {
+        self.get_mut().inner.poll_write(cx, buf)
+    }
+
+    fn poll_flush(self: Pin<&mut Self>, _cx: &mut Context<'_>) -> Poll<io::Result<()>> {
+        // the bytes are sent to the multiplexer on write
+        Poll::Ready(Ok(()))
+    }
+
+    fn poll_shutdown(self: Pin<&mut Self>, _cx: &mut Context<'_>) -> Poll<io::Result<()>> {
+        Poll::Ready(self.get_mut().inner.close())
+    }
+}
+
+impl SimStreamReader {
+    pub fn id(&self) -> StreamId {
+        self.inner.id()
+    }
+
+    /// the node that opened the stream
+    pub fn from(&self) -> SimId {
+        self.inner.from()
+    }
+}
+
+impl From<StreamReader> for SimStreamReader {
+    fn from(inner: StreamReader) -> Self {
+        Self { inner }
+    }
+}
+
+impl AsyncRead for SimStreamReader {
+    fn poll_read(
+        self: Pin<&mut Self>,
+        cx: &mut Context<'_>,
+        buf: &mut ReadBuf<'_>,
+    ) -> Poll<io::Result<()>> {
+        let len = match self
+            .get_mut()
+            .inner
+            .poll_read(cx, buf.initialize_unfilled())
+        {
+            Poll::Ready(Ok(len)) => len,
+            Poll::Ready(Err(error)) => return Poll::Ready(Err(error)),
+            Poll::Pending => return Poll::Pending,
+        };
+
+        buf.advance(len);
+        Poll::Ready(Ok(()))
+    }
+}
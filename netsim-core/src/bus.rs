@@ -1,16 +1,56 @@
-use crate::{sim_context::Link, Edge, EdgePolicy, Msg, NodePolicy, SimId};
+use crate::{
+    constellation::Constellation,
+    distribution::LatencyDistribution,
+    failure::FailureProcess,
+    mobility::Track,
+    segment::Segment,
+    sim_context::Link,
+    stream::{Flow, StreamId},
+    trace::EdgeTrace,
+    Edge, EdgePolicy, Msg, MsgId, NodePolicy, PropagationReport, Relay, SimId, Timer, Topology,
+    UtilisationSampler,
+};
 use anyhow::{anyhow, Result};
 use std::sync::mpsc;
 
 pub enum BusMessage<UpLink: Link> {
     Message(Msg<UpLink::Msg>),
+    Broadcast(u32, Msg<UpLink::Msg>, fn(&UpLink::Msg) -> UpLink::Msg),
+    Cancel(SimId, MsgId),
+    Timer(Timer),
+    StreamOpen(Flow),
+    StreamData(StreamId, Box<[u8]>),
+    StreamClose(StreamId),
     NodeAdd(UpLink, mpsc::SyncSender<SimId>),
+    NodesAdd(Vec<UpLink>, mpsc::SyncSender<SimId>),
     NodePolicyDefault(NodePolicy),
     NodePolicySet(SimId, NodePolicy),
     NodePolicyReset(SimId),
     EdgePolicyDefault(EdgePolicy),
     EdgePolicySet(Edge, EdgePolicy),
     EdgePolicyReset(Edge),
+    EdgeTraceSet(Edge, EdgeTrace),
+    EdgeTraceReset(Edge),
+    EdgeDistributionSet(Edge, LatencyDistribution),
+    EdgeDistributionReset(Edge),
+    NodeRegionSet(SimId, u32),
+    RegionDistributionSet((u32, u32), LatencyDistribution),
+    EdgeFailuresSet(Box<[Edge]>, FailureProcess),
+    EdgeFailuresReset(Box<[Edge]>),
+    SegmentSet(u32, Segment),
+    SegmentReset(u32),
+    NodeMovementSet(SimId, Box<Track>),
+    NodeMovementReset(SimId),
+    ConstellationSet(Box<Constellation>),
+    ConstellationReset,
+    TopologySet(Box<Topology>),
+    TopologyReset,
+    PropagationReport(u64, mpsc::SyncSender<Option<PropagationReport>>),
+    UtilisationSamplerSet(Box<UtilisationSampler>),
+    UtilisationSamplerReset,
+    RelayDefault(Option<Relay>, fn(&UpLink::Msg) -> UpLink::Msg),
+    RelaySet(SimId, Option<Relay>, fn(&UpLink::Msg) -> UpLink::Msg),
+    RelayReset(SimId),
     Shutdown,
     Disconnected,
 }
@@ -39,14 +79,58 @@ impl<UpLink: Link> BusSender<UpLink> {
             .map_err(|error| anyhow!("failed to send message: {error}"))
     }
 
-    pub fn send_msg(&self, msg: Msg<UpLink::Msg>) -> Result<()> {
-        self.send(BusMessage::Message(msg))
+    /// send the message to the multiplexer, returns the [`MsgId`] of the
+    /// message so that it can be cancelled with [`BusSender::send_cancel`]
+    /// (if sent with [`Msg::with_cancellation`])
+    pub fn send_msg(&self, msg: Msg<UpLink::Msg>) -> Result<MsgId> {
+        let id = msg.id();
+        self.send(BusMessage::Message(msg))?;
+        Ok(id)
+    }
+
+    /// broadcast the message on the shared `segment`, `copy` makes the
+    /// copies of the content for the members of the segment
+    pub fn send_broadcast(
+        &self,
+        segment: u32,
+        msg: Msg<UpLink::Msg>,
+        copy: fn(&UpLink::Msg) -> UpLink::Msg,
+    ) -> Result<MsgId> {
+        let id = msg.id();
+        self.send(BusMessage::Broadcast(segment, msg, copy))?;
+        Ok(id)
+    }
+
+    pub fn send_cancel(&self, from: SimId, id: MsgId) -> Result<()> {
+        self.send(BusMessage::Cancel(from, id))
+    }
+
+    pub fn send_timer(&self, timer: Timer) -> Result<()> {
+        self.send(BusMessage::Timer(timer))
+    }
+
+    pub(crate) fn send_stream_open(&self, flow: Flow) -> Result<()> {
+        self.send(BusMessage::StreamOpen(flow))
+    }
+
+    pub(crate) fn send_stream_data(&self, id: StreamId, data: Box<[u8]>) -> Result<()> {
+        self.send(BusMessage::StreamData(id, data))
+    }
+
+    pub(crate) fn send_stream_close(&self, id: StreamId) -> Result<()> {
+        self.send(BusMessage::StreamClose(id))
     }
 
     pub fn send_node_add(&self, link: UpLink, reply: mpsc::SyncSender<SimId>) -> Result<()> {
         self.send(BusMessage::NodeAdd(link, reply))
     }
 
+    /// add all the `links` at once, the reply is the [`SimId`] of the
+    /// first one (the others follow in order)
+    pub fn send_nodes_add(&self, links: Vec<UpLink>, reply: mpsc::SyncSender<SimId>) -> Result<()> {
+        self.send(BusMessage::NodesAdd(links, reply))
+    }
+
     pub fn send_node_policy_default(&self, policy: NodePolicy) -> Result<()> {
         self.send(BusMessage::NodePolicyDefault(policy))
     }
@@ -71,6 +155,116 @@ impl<UpLink: Link> BusSender<UpLink> {
         self.send(BusMessage::EdgePolicyReset(id))
     }
 
+    pub fn send_edge_trace_set(&self, id: Edge, trace: EdgeTrace) -> Result<()> {
+        self.send(BusMessage::EdgeTraceSet(id, trace))
+    }
+
+    pub fn send_edge_trace_reset(&self, id: Edge) -> Result<()> {
+        self.send(BusMessage::EdgeTraceReset(id))
+    }
+
+    pub fn send_edge_distribution_set(
+        &self,
+        id: Edge,
+        distribution: LatencyDistribution,
+    ) -> Result<()> {
+        self.send(BusMessage::EdgeDistributionSet(id, distribution))
+    }
+
+    pub fn send_edge_distribution_reset(&self, id: Edge) -> Result<()> {
+        self.send(BusMessage::EdgeDistributionReset(id))
+    }
+
+    pub fn send_node_region_set(&self, id: SimId, region: u32) -> Result<()> {
+        self.send(BusMessage::NodeRegionSet(id, region))
+    }
+
+    pub fn send_region_distribution_set(
+        &self,
+        regions: (u32, u32),
+        distribution: LatencyDistribution,
+    ) -> Result<()> {
+        self.send(BusMessage::RegionDistributionSet(regions, distribution))
+    }
+
+    pub fn send_edge_failures_set(&self, ids: Box<[Edge]>, process: FailureProcess) -> Result<()> {
+        self.send(BusMessage::EdgeFailuresSet(ids, process))
+    }
+
+    pub fn send_edge_failures_reset(&self, ids: Box<[Edge]>) -> Result<()> {
+        self.send(BusMessage::EdgeFailuresReset(ids))
+    }
+
+    pub(crate) fn send_node_movement_set(&self, id: SimId, track: Track) -> Result<()> {
+        self.send(BusMessage::NodeMovementSet(id, Box::new(track)))
+    }
+
+    pub fn send_node_movement_reset(&self, id: SimId) -> Result<()> {
+        self.send(BusMessage::NodeMovementReset(id))
+    }
+
+    pub fn send_constellation_set(&self, constellation: Constellation) -> Result<()> {
+        self.send(BusMessage::ConstellationSet(Box::new(constellation)))
+    }
+
+    pub fn send_constellation_reset(&self) -> Result<()> {
+        self.send(BusMessage::ConstellationReset)
+    }
+
+    pub fn send_segment_set(&self, id: u32, segment: Segment) -> Result<()> {
+        self.send(BusMessage::SegmentSet(id, segment))
+    }
+
+    pub fn send_segment_reset(&self, id: u32) -> Result<()> {
+        self.send(BusMessage::SegmentReset(id))
+    }
+
+    pub fn send_topology_set(&self, topology: Topology) -> Result<()> {
+        self.send(BusMessage::TopologySet(Box::new(topology)))
+    }
+
+    pub fn send_topology_reset(&self) -> Result<()> {
+        self.send(BusMessage::TopologyReset)
+    }
+
+    pub fn send_propagation_report(
+        &self,
+        id: u64,
+        reply: mpsc::SyncSender<Option<PropagationReport>>,
+    ) -> Result<()> {
+        self.send(BusMessage::PropagationReport(id, reply))
+    }
+
+    pub fn send_utilisation_sampler_set(&self, sampler: UtilisationSampler) -> Result<()> {
+        self.send(BusMessage::UtilisationSamplerSet(Box::new(sampler)))
+    }
+
+    pub fn send_utilisation_sampler_reset(&self) -> Result<()> {
+        self.send(BusMessage::UtilisationSamplerReset)
+    }
+
+    /// `copy` makes the copies of the content relayed to the neighbours
+    pub fn send_relay_default(
+        &self,
+        relay: Option<Relay>,
+        copy: fn(&UpLink::Msg) -> UpLink::Msg,
+    ) -> Result<()> {
+        self.send(BusMessage::RelayDefault(relay, copy))
+    }
+
+    pub fn send_relay_set(
+        &self,
+        id: SimId,
+        relay: Option<Relay>,
+        copy: fn(&UpLink::Msg) -> UpLink::Msg,
+    ) -> Result<()> {
+        self.send(BusMessage::RelaySet(id, relay, copy))
+    }
+
+    pub fn send_relay_reset(&self, id: SimId) -> Result<()> {
+        self.send(BusMessage::RelayReset(id))
+    }
+
     pub(crate) fn send_shutdown(&self) -> Result<()> {
         self.send(BusMessage::Shutdown)
     }
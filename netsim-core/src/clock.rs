@@ -0,0 +1,89 @@
+use std::{
+    sync::{
+        atomic::{AtomicU64, Ordering},
+        Arc,
+    },
+    time::{Duration, Instant},
+};
+
+/// The clock of a simulation
+///
+/// This is the time as seen by the multiplexer: it is moved forward by the
+/// multiplexer at every step, so the time read by the nodes is the time
+/// at which the network events and the timers are processed. Nodes should
+/// use this clock rather than [`Instant::now`] so that their protocol timers
+/// line up with the simulated network.
+///
+/// The time is expressed as the [`Duration`] elapsed since the start of the
+/// simulation (the creation of the context).
+#[derive(Clone)]
+pub struct SimClock {
+    inner: Arc<ClockInner>,
+}
+
+struct ClockInner {
+    epoch: Instant,
+    /// nanoseconds elapsed since `epoch` at the last step of the multiplexer
+    elapsed: AtomicU64,
+}
+
+impl SimClock {
+    pub(crate) fn new() -> Self {
+        Self {
+            inner: Arc::new(ClockInner {
+                epoch: Instant::now(),
+                elapsed: AtomicU64::new(0),
+            }),
+        }
+    }
+
+    /// the current time of the simulation
+    #[inline]
+    pub fn now(&self) -> Duration {
+        Duration::from_nanos(self.inner.elapsed.load(Ordering::Acquire))
+    }
+
+    /// convert a time of the simulation into the [`Instant`] used by the
+    /// multiplexer
+    #[inline]
+    pub fn instant(&self, time: Duration) -> Instant {
+        self.inner.epoch + time
+    }
+
+    /// convert an [`Instant`] used by the multiplexer into a time of the
+    /// simulation. Instants prior to the start of the simulation are
+    /// mapped to [`Duration::ZERO`].
+    #[inline]
+    pub fn time(&self, instant: Instant) -> Duration {
+        instant.saturating_duration_since(self.inner.epoch)
+    }
+
+    /// move the clock forward to the given `time`
+    ///
+    /// The clock never goes backward: if `time` is prior to the current
+    /// time of the clock nothing happens.
+    pub(crate) fn advance(&self, time: Instant) {
+        let elapsed = self.time(time).as_nanos().min(u64::MAX as u128) as u64;
+        self.inner.elapsed.fetch_max(elapsed, Ordering::AcqRel);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn advance() {
+        let clock = SimClock::new();
+        assert_eq!(clock.now(), Duration::ZERO);
+
+        let time = clock.instant(Duration::from_millis(10));
+        clock.advance(time);
+        assert_eq!(clock.now(), Duration::from_millis(10));
+        assert_eq!(clock.time(time), Duration::from_millis(10));
+
+        // the clock does not go backward
+        clock.advance(clock.instant(Duration::from_millis(5)));
+        assert_eq!(clock.now(), Duration::from_millis(10));
+    }
+}
@@ -1,56 +1,117 @@
 use std::{
     cmp,
-    collections::{HashMap, VecDeque},
+    collections::{BTreeMap, BTreeSet, HashMap},
     time::{Duration, Instant},
 };
 
-use crate::{sim_context::SimLinks, Bandwidth, Edge, HasBytesSize, Msg, Policy, SimId};
+use crate::{
+    msg::MsgId,
+    sim_context::SimLinks,
+    stream::{Flow, Flows, StreamId},
+    trace::TraceCursor,
+    utilisation::Activity,
+    Bandwidth, Edge, HasBytesSize, Msg, Policy, SendCompletion, SimId,
+};
 
 /// used to keep track of how much of a packet has been sent through
 /// one of the network components (sender, link and receiver).
+///
+/// The bandwidth is accounted per window of one second: up to the
+/// bandwidth's worth of bytes go through during a window.
 #[derive(Debug, PartialEq, Eq, Clone, Copy, Hash)]
 struct BufferCounter {
     counter: u64,
+    /// the start of the current window
     since: Instant,
 }
 
 /// envelop the message [`Msg`] with additional data
 /// that we will use to track the message's journey
 /// through the simulated network
+///
+/// The latency of the journey is the scheduled time of the message
+/// (see [`Msg::scheduled`]), it is not copied in the envelop.
 pub struct Envelop<T> {
     msg: Msg<T>,
 
-    // the latency on the packet's journey between the sender and the receiver
-    // (through the link).
-    latency: Instant,
+    progress: Progress,
+}
+
+/// the number of bytes of a message (or of a stream) that went through
+/// each of the network components: the sender, the link and the receiver.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub(crate) struct Progress {
+    pub(crate) sender: u64,
+    pub(crate) link: u64,
+    pub(crate) receiver: u64,
+}
 
-    sender: u64,
-    link: u64,
-    receiver: u64,
+/// a message broadcast on a shared segment, it is transmitted once and
+/// copied to all the members of the segment once transmitted
+struct Broadcast<T> {
+    msg: Msg<T>,
+    segment: u32,
+    copy: fn(&T) -> T,
+    progress: Progress,
 }
 
 #[derive(Debug)]
 struct Usage {
     upload: BufferCounter,
     download: BufferCounter,
+    /// the position in the capacity trace of the edge, if any
+    trace: TraceCursor,
 }
 
 pub struct CongestionQueue<T> {
-    // TODO: the only utilisation we have are two fold:
-    //
-    // 1. we append at the end only
-    // 2. when we iterate through it we remove decide to remove the
-    //    entry or not.
-    //
-    // we can replace the VecDeque by a linked list and remove the
-    // entry as we go a long. All we need is to keep a pointer
-    // to the head and a weak pointer to the tail (so that we can)
-    // safely happen in O(1).
-    //
-    queue: VecDeque<Envelop<T>>,
+    // the messages are keyed by the order the multiplexer received them
+    // (the [`MsgId`] are allocated by the senders' threads, they do not
+    // follow that order), so iterating the map visits the messages in
+    // order and a message can be removed in `O(log n)` when it is
+    // delivered, cancelled or expired.
+    queue: BTreeMap<u64, Envelop<T>>,
+
+    /// the opened streams, each accounted as a single flow of bytes
+    flows: Flows,
+
+    /// the broadcasts in flight, see [`Segment`](crate::Segment)
+    broadcasts: BTreeMap<u64, Broadcast<T>>,
+
+    /// the key of the next message pushed in the queue
+    sequence: u64,
+    /// the key of the cancellable messages or broadcasts in flight (see
+    /// [`Msg::with_cancellation`]), the others are not indexed
+    keys: HashMap<MsgId, u64>,
+    /// the deadline and the key of the messages in the queue with a
+    /// deadline, earliest first (see [`Msg::with_deadline`])
+    deadlines: BTreeSet<(Instant, u64)>,
 
     nodes_usage: HashMap<SimId, Usage>,
     edge_usage: HashMap<Edge, Usage>,
+    /// the airtime of the shared segments
+    segment_usage: HashMap<u32, BufferCounter>,
+
+    /// the bytes that went through the network since the last sample,
+    /// only recorded while sampling (see [`UtilisationSampler`])
+    ///
+    /// [`UtilisationSampler`]: crate::UtilisationSampler
+    activity: Option<Activity>,
+
+    /// the messages that have finished uploading and requested
+    /// to notify their sender (see [`Msg::with_send_completion`])
+    completions: Vec<SendCompletion>,
+
+    /// the messages that have reached their deadline before being
+    /// delivered (see [`Msg::with_deadline`])
+    expired: Vec<Msg<T>>,
+
+    /// the time of the previous call to [`CongestionQueue::pop_many`], the
+    /// previous step of the multiplexer
+    previous_step: Option<Instant>,
+
+    /// reusable buffer of the keys of the messages to visit in
+    /// [`CongestionQueue::pop_many`]
+    visit: Vec<u64>,
 }
 
 impl BufferCounter {
@@ -69,7 +130,8 @@ impl BufferCounter {
         // lesser or equal to `time` given in parameter
         let upload_elased = time.duration_since(self.since);
         if upload_elased >= Duration::from_secs(1) {
-            self.counter = 0
+            self.counter = 0;
+            self.since = time;
         }
     }
 
@@ -77,12 +139,13 @@ impl BufferCounter {
     ///
     /// return the number of bytes actually consummed
     pub fn consume(&mut self, time: Instant, bw: Bandwidth, size: u64) -> u64 {
+        debug_assert!(self.since <= time, "the window starts before its use");
+
         // compute the remaining available data bandwidth
         let remaining = bw.into_inner().saturating_sub(self.counter);
 
         let usage = cmp::min(remaining, size);
 
-        self.since = time;
         self.counter = self.counter.saturating_add(usage);
 
         usage
@@ -94,6 +157,7 @@ impl Usage {
         Self {
             upload: BufferCounter::new(time),
             download: BufferCounter::new(time),
+            trace: TraceCursor::default(),
         }
     }
 
@@ -110,13 +174,11 @@ impl<T> Envelop<T>
 where
     T: HasBytesSize,
 {
-    pub fn new(min_time: Instant, msg: Msg<T>) -> Self {
+    pub fn new(min_time: Instant, mut msg: Msg<T>) -> Self {
+        msg.set_scheduled(min_time);
         Self {
             msg,
-            latency: min_time,
-            sender: 0,
-            link: 0,
-            receiver: 0,
+            progress: Progress::default(),
         }
     }
 }
@@ -127,15 +189,124 @@ where
 {
     pub fn new() -> Self {
         Self {
-            queue: VecDeque::new(),
+            queue: BTreeMap::new(),
+            flows: Flows::new(),
+            broadcasts: BTreeMap::new(),
+            sequence: 0,
+            keys: HashMap::new(),
+            deadlines: BTreeSet::new(),
             nodes_usage: HashMap::new(),
             edge_usage: HashMap::new(),
+            segment_usage: HashMap::new(),
+            activity: None,
+            completions: Vec::new(),
+            expired: Vec::new(),
+            previous_step: None,
+            visit: Vec::new(),
         }
     }
 
     pub fn push(&mut self, min_time: Instant, msg: Msg<T>) {
-        let envelop = Envelop::new(min_time, msg);
-        self.queue.push_back(envelop)
+        let key = self.key(&msg);
+        if let Some(deadline) = msg.deadline() {
+            self.deadlines.insert((deadline, key));
+        }
+        self.queue.insert(key, Envelop::new(min_time, msg));
+    }
+
+    /// the key of a new message, in the order of the calls
+    fn key(&mut self, msg: &Msg<T>) -> u64 {
+        let key = self.sequence;
+        self.sequence += 1;
+        if msg.is_cancellable() {
+            let _previous = self.keys.insert(msg.id(), key);
+            debug_assert!(_previous.is_none(), "The MsgId are unique");
+        }
+        key
+    }
+
+    /// the message left the queue (delivered, cancelled or expired)
+    fn forget(&mut self, key: u64, msg: &Msg<T>) {
+        if msg.is_cancellable() {
+            self.keys.remove(&msg.id());
+        }
+        if let Some(deadline) = msg.deadline() {
+            self.deadlines.remove(&(deadline, key));
+        }
+    }
+
+    /// broadcast the message on the shared `segment`, `copy` makes the
+    /// copies of the content for the members of the segment
+    pub fn push_broadcast(
+        &mut self,
+        min_time: Instant,
+        segment: u32,
+        mut msg: Msg<T>,
+        copy: fn(&T) -> T,
+    ) {
+        let key = self.key(&msg);
+        msg.set_scheduled(min_time);
+        let broadcast = Broadcast {
+            msg,
+            segment,
+            copy,
+            progress: Progress::default(),
+        };
+        self.broadcasts.insert(key, broadcast);
+    }
+
+    /// remove the message sent by `from` from the queue, it will not
+    /// consume any more of the network's bandwidth.
+    ///
+    /// Returns `None` if the message is not in the queue (it was already
+    /// delivered or dropped) or if it was not sent by `from`.
+    pub fn cancel(&mut self, from: SimId, id: MsgId) -> Option<Msg<T>> {
+        let key = *self.keys.get(&id)?;
+        let sender = match self.queue.get(&key) {
+            Some(envelop) => envelop.msg.from(),
+            None => self.broadcasts.get(&key)?.msg.from(),
+        };
+        if sender != from {
+            return None;
+        }
+
+        let msg = self
+            .queue
+            .remove(&key)
+            .map(|envelop| envelop.msg)
+            .or_else(|| self.broadcasts.remove(&key).map(|broadcast| broadcast.msg))?;
+        self.forget(key, &msg);
+        Some(msg)
+    }
+
+    /// register a new stream
+    pub fn open_flow(&mut self, flow: Flow) {
+        self.flows.insert(flow.id(), flow);
+    }
+
+    pub fn flow_mut(&mut self, id: StreamId) -> Option<&mut Flow> {
+        self.flows.get_mut(&id)
+    }
+
+    /// the writer has closed the stream, the flow is removed once all
+    /// its bytes are delivered
+    pub fn close_flow(&mut self, id: StreamId) {
+        let Some(flow) = self.flows.get_mut(&id) else {
+            return;
+        };
+
+        flow.close();
+        if flow.is_finished() {
+            flow.deliver();
+            self.flows.remove(&id);
+        }
+    }
+
+    /// abruptly stop a stream, the bytes in flight are lost
+    pub fn abort_flow(&mut self, id: StreamId) {
+        if let Some(flow) = self.flows.remove(&id) {
+            flow.abort()
+        }
     }
 
     fn pop<UpLink>(
@@ -143,71 +314,245 @@ where
         time: Instant,
         nodes: &SimLinks<UpLink>,
         policy: &Policy,
-        index: usize,
+        key: u64,
     ) -> Option<Msg<T>> {
-        let envelop = self.queue.get_mut(index)?;
-        if envelop.latency > time {
+        let envelop = self.queue.get_mut(&key)?;
+
+        if envelop.msg.scheduled() > time {
             // we ignore messages that are still meant to be delayed
             // by the operation of the latency
             return None;
         }
 
         let message_size = envelop.msg.content().bytes_size();
+        let from = envelop.msg.from();
+        let to = envelop.msg.to();
+        let before = envelop.progress;
 
-        // compute the sender's remaining buffer size
-        let s = self
-            .nodes_usage
-            .entry(envelop.msg.from())
-            .and_modify(|u| u.refresh(time))
-            .or_insert_with(|| Usage::new(time));
-        let s_policy = nodes[envelop.msg.from().into_index()]
-            .policy()
-            .unwrap_or_else(|| policy.default_node_policy());
-        let remaining_size = message_size - envelop.sender;
-        let used = s
-            .upload
-            .consume(time, s_policy.bandwidth_up, remaining_size);
-        envelop.sender += used;
-
-        let edge = Edge::new((envelop.msg.from(), envelop.msg.to()));
-        let l = self
-            .edge_usage
-            .entry(edge)
-            .and_modify(|u| u.refresh(time))
-            .or_insert_with(|| Usage::new(time));
-        let l_policy = policy
-            .get_edge_policy(edge)
-            .unwrap_or_else(|| policy.default_edge_policy());
-        let remaining_size = envelop.sender - envelop.link;
-        let used = l
-            .upload
-            .consume(time, l_policy.bandwidth_up, remaining_size);
-        envelop.link += used;
-
-        let r = self
-            .nodes_usage
-            .entry(envelop.msg.to())
+        Self::transfer(
+            &mut self.nodes_usage,
+            &mut self.edge_usage,
+            &mut self.segment_usage,
+            (self.previous_step, time),
+            nodes,
+            policy,
+            (from, to),
+            message_size,
+            &mut envelop.progress,
+        );
+        if let Some(activity) = self.activity.as_mut() {
+            activity.transfer((from, to), before, envelop.progress);
+        }
+
+        if envelop.progress.sender == message_size {
+            if let Some(token) = envelop.msg.take_send_completion() {
+                self.completions.push(SendCompletion::new(from, to, token));
+            }
+        }
+
+        if message_size == envelop.progress.receiver {
+            let entry = self.queue.remove(&key)?.msg;
+            self.forget(key, &entry);
+            Some(entry)
+        } else {
+            None
+        }
+    }
+
+    /// drop the messages that reached their deadline by `time`, without
+    /// visiting the others
+    fn expire(&mut self, time: Instant) {
+        while let Some(&(deadline, key)) = self.deadlines.first() {
+            if deadline > time {
+                break;
+            }
+            self.deadlines.pop_first();
+            if let Some(envelop) = self.queue.remove(&key) {
+                if envelop.msg.is_cancellable() {
+                    self.keys.remove(&envelop.msg.id());
+                }
+                self.expired.push(envelop.msg);
+            }
+        }
+    }
+
+    /// move the bytes of a message (or a flow) through the network
+    ///
+    /// `available` is the number of bytes that are past the latency of
+    /// the edge: they go through the sender's upload, then the edge (or
+    /// the segment shared by the nodes) and finally the recipient's
+    /// download, each limited by its bandwidth.
+    #[allow(clippy::too_many_arguments)]
+    fn transfer<UpLink>(
+        nodes_usage: &mut HashMap<SimId, Usage>,
+        edge_usage: &mut HashMap<Edge, Usage>,
+        segment_usage: &mut HashMap<u32, BufferCounter>,
+        (previous, time): (Option<Instant>, Instant),
+        nodes: &SimLinks<UpLink>,
+        policy: &Policy,
+        (from, to): (SimId, SimId),
+        available: u64,
+        progress: &mut Progress,
+    ) {
+        progress.sender += Self::upload(
+            nodes_usage,
+            time,
+            nodes,
+            policy,
+            from,
+            available - progress.sender,
+        );
+
+        let edge = Edge::new((from, to));
+        let remaining_size = progress.sender - progress.link;
+        let used = if let Some((id, segment)) = policy.shared_segment(edge) {
+            Self::airtime(segment_usage, time, (id, segment.capacity), remaining_size)
+        } else {
+            let l = edge_usage
+                .entry(edge)
+                .and_modify(|u| u.refresh(time))
+                .or_insert_with(|| Usage::new(time));
+            let l_policy = policy
+                .get_edge_policy(edge)
+                .unwrap_or_else(|| policy.default_edge_policy());
+            match policy.edge_capacity_trace(edge) {
+                Some(trace) => l.trace.consume((previous, time), trace, remaining_size),
+                None => l
+                    .upload
+                    .consume(time, l_policy.bandwidth_up, remaining_size),
+            }
+        };
+        progress.link += used;
+
+        let r = nodes_usage
+            .entry(to)
             .and_modify(|u| u.refresh(time))
             .or_insert_with(|| Usage::new(time));
-        let r_policy = nodes[envelop.msg.to().into_index()]
-            .policy()
-            .unwrap_or_else(|| policy.default_node_policy());
-        let remaining_size = envelop.link - envelop.receiver;
+        let r_policy = policy.node_policy(to, nodes[to.into_index()].policy());
+        let remaining_size = progress.link - progress.receiver;
         let used = r
             .download
             .consume(time, r_policy.bandwidth_down, remaining_size);
-        envelop.receiver += used;
+        progress.receiver += used;
 
-        // at all time `size >= sender >= link >= receiver`
-        debug_assert!(message_size >= envelop.sender);
-        debug_assert!(envelop.sender >= envelop.link);
-        debug_assert!(envelop.link >= envelop.receiver);
+        // at all time `available >= sender >= link >= receiver`
+        debug_assert!(available >= progress.sender);
+        debug_assert!(progress.sender >= progress.link);
+        debug_assert!(progress.link >= progress.receiver);
+    }
 
-        if message_size == envelop.receiver {
-            let entry = self.queue.remove(index)?.msg;
-            Some(entry)
-        } else {
-            None
+    /// consume up to `size` bytes of the upload of the sender
+    fn upload<UpLink>(
+        nodes_usage: &mut HashMap<SimId, Usage>,
+        time: Instant,
+        nodes: &SimLinks<UpLink>,
+        policy: &Policy,
+        from: SimId,
+        size: u64,
+    ) -> u64 {
+        let s = nodes_usage
+            .entry(from)
+            .and_modify(|u| u.refresh(time))
+            .or_insert_with(|| Usage::new(time));
+        let s_policy = policy.node_policy(from, nodes[from.into_index()].policy());
+
+        s.upload.consume(time, s_policy.bandwidth_up, size)
+    }
+
+    /// consume up to `size` bytes of the airtime of the segment
+    fn airtime(
+        segment_usage: &mut HashMap<u32, BufferCounter>,
+        time: Instant,
+        (id, capacity): (u32, Bandwidth),
+        size: u64,
+    ) -> u64 {
+        let medium = segment_usage
+            .entry(id)
+            .and_modify(|u| u.refresh(time))
+            .or_insert_with(|| BufferCounter::new(time));
+
+        medium.consume(time, capacity, size)
+    }
+
+    /// transmit the broadcasts, the ones fully transmitted are copied to
+    /// the members of their segment (the messages of the segments that
+    /// were removed are expired)
+    ///
+    /// A broadcast goes through the sender's upload and the airtime of the
+    /// segment once, whatever the number of members.
+    fn pop_broadcasts<UpLink>(
+        &mut self,
+        time: Instant,
+        nodes: &SimLinks<UpLink>,
+        policy: &Policy,
+        msgs: &mut Vec<Msg<T>>,
+    ) {
+        let mut orphans = false;
+        self.broadcasts.retain(|_, broadcast| {
+            if broadcast.msg.scheduled() > time {
+                return true;
+            }
+            let Some(segment) = policy.segment(broadcast.segment) else {
+                orphans = true;
+                return true;
+            };
+
+            let size = broadcast.msg.content().bytes_size();
+            let before = broadcast.progress;
+            let progress = &mut broadcast.progress;
+            progress.sender += Self::upload(
+                &mut self.nodes_usage,
+                time,
+                nodes,
+                policy,
+                broadcast.msg.from(),
+                size - progress.sender,
+            );
+            progress.link += Self::airtime(
+                &mut self.segment_usage,
+                time,
+                (broadcast.segment, segment.capacity),
+                progress.sender - progress.link,
+            );
+            if let Some(activity) = self.activity.as_mut() {
+                let from = broadcast.msg.from();
+                activity.broadcast(from, broadcast.segment, before, *progress);
+            }
+            if progress.link < size {
+                return true;
+            }
+
+            let from = broadcast.msg.from();
+            if broadcast.msg.is_cancellable() {
+                self.keys.remove(&broadcast.msg.id());
+            }
+            msgs.extend(
+                segment
+                    .members
+                    .iter()
+                    .filter(|member| **member != from)
+                    .map(|member| {
+                        let content = (broadcast.copy)(broadcast.msg.content());
+                        broadcast.msg.copy_to(*member, content)
+                    }),
+            );
+            false
+        });
+
+        // the segment was removed while the message was in flight
+        if orphans {
+            let orphans: Vec<u64> = self
+                .broadcasts
+                .iter()
+                .filter(|(_, broadcast)| policy.segment(broadcast.segment).is_none())
+                .map(|(key, _)| *key)
+                .collect();
+            for key in orphans {
+                if let Some(broadcast) = self.broadcasts.remove(&key) {
+                    self.forget(key, &broadcast.msg);
+                    self.expired.push(broadcast.msg);
+                }
+            }
         }
     }
 
@@ -217,25 +562,86 @@ where
         nodes: &SimLinks<UpLink>,
         policy: &Policy,
     ) -> Vec<Msg<T>> {
+        span!("mux.pop_many", queued = self.queue.len());
+
         let mut msgs = Vec::new();
 
-        let mut index = 0usize;
-        // we aren't using a for loop here because the sequence `0..queue.len()`
-        // is larger or equal to the the actual len we will be exploring
-        //
-        // indeed, for every loop we will be removing an entry at a given index
-        // which means that when we remove an entry we won't increase the `index`
-        // but the size is still reduced because the queue has an entry less
-        while index < self.queue.len() {
-            if let Some(entry) = self.pop(time, nodes, policy, index) {
+        if !self.deadlines.is_empty() {
+            self.expire(time);
+        }
+
+        // the entries are removed from the queue as we go, so we first
+        // take a snapshot of the keys to visit (in order)
+        let mut visit = std::mem::take(&mut self.visit);
+        visit.extend(self.queue.keys().copied());
+
+        for key in visit.drain(..) {
+            if let Some(entry) = self.pop(time, nodes, policy, key) {
                 msgs.push(entry);
-            } else {
-                index += 1;
             }
         }
 
+        self.visit = visit;
+
+        if !self.broadcasts.is_empty() {
+            self.pop_broadcasts(time, nodes, policy, &mut msgs);
+        }
+
+        self.flows.retain(|_, flow| {
+            if flow.is_active(time) {
+                let ready = flow.ready(time);
+                let before = flow.progress;
+                Self::transfer(
+                    &mut self.nodes_usage,
+                    &mut self.edge_usage,
+                    &mut self.segment_usage,
+                    (self.previous_step, time),
+                    nodes,
+                    policy,
+                    (flow.from(), flow.to()),
+                    ready,
+                    &mut flow.progress,
+                );
+                if let Some(activity) = self.activity.as_mut() {
+                    activity.transfer((flow.from(), flow.to()), before, flow.progress);
+                }
+                flow.deliver();
+            }
+
+            !flow.is_finished()
+        });
+
+        self.previous_step = Some(time);
         msgs
     }
+
+    /// take the [`SendCompletion`] of the messages that have finished
+    /// uploading during the previous calls to [`CongestionQueue::pop_many`]
+    pub fn take_completions(&mut self) -> Vec<SendCompletion> {
+        std::mem::take(&mut self.completions)
+    }
+
+    /// start (or stop) recording the bytes that go through the network,
+    /// see [`CongestionQueue::activity_mut`]
+    pub fn record_activity(&mut self, record: bool) {
+        match (record, self.activity.is_some()) {
+            (true, false) => self.activity = Some(Activity::default()),
+            (false, true) => self.activity = None,
+            _ => (),
+        }
+    }
+
+    /// the bytes that went through the network since they were last
+    /// taken, if recording
+    pub fn activity_mut(&mut self) -> Option<&mut Activity> {
+        self.activity.as_mut()
+    }
+
+    /// take the messages that have reached their deadline during the
+    /// previous calls to [`CongestionQueue::pop_many`]
+    pub fn take_expired(&mut self) -> Vec<Msg<T>> {
+        std::mem::take(&mut self.expired)
+    }
 }
 
 impl<T: HasBytesSize> Default for CongestionQueue<T> {
@@ -248,7 +654,10 @@ impl<T: HasBytesSize> Default for CongestionQueue<T> {
 mod tests {
     use std::str::FromStr;
 
-    use crate::{sim_context::SimLink, EdgePolicy, Latency, NodePolicy, PacketLoss};
+    use crate::{
+        sim_context::SimLink, CapacityTrace, EdgePolicy, EdgeTrace, Latency, NodePolicy,
+        PacketLoss, Segment,
+    };
 
     use super::*;
 
@@ -295,9 +704,33 @@ mod tests {
     const ALICE: SimId = SimId::new(0);
     const BOB: SimId = SimId::new(1);
 
+    /// the links of `ALICE` and `BOB`, without their own policy
+    fn two_nodes() -> SimLinks<()> {
+        vec![SimLink::new(()), SimLink::new(())]
+    }
+
+    /// a policy without latency, with the given bandwidth for the nodes
+    /// (upload and download) and for the edges
+    fn bandwidth(node: &str, edge: &str) -> Policy {
+        let mut policy = Policy::new();
+        policy.set_default_node_policy(NodePolicy {
+            bandwidth_down: node.parse().unwrap(),
+            bandwidth_up: node.parse().unwrap(),
+            location: None,
+        });
+        policy.set_default_edge_policy(EdgePolicy {
+            bandwidth_down: edge.parse().unwrap(),
+            bandwidth_up: edge.parse().unwrap(),
+            latency: Latency::new(Duration::ZERO),
+            packet_loss: PacketLoss::NONE,
+        });
+        policy
+    }
+
     macro_rules! test_pop_message {
         ($cq:ident, $nodes:ident, $policy:ident, t: $time:expr, $sender:ident : $s:expr, $link:ident: $l:expr, $receiver:ident : $r:expr $(,)?) => {
-            assert!($cq.pop($time, &$nodes, &$policy, 0).is_none());
+            let id = *$cq.queue.keys().next().unwrap();
+            assert!($cq.pop($time, &$nodes, &$policy, id).is_none());
             let sender = $cq.nodes_usage.get(&$sender).unwrap();
             assert_eq!(
                 sender.upload.counter,
@@ -334,31 +767,19 @@ mod tests {
     }
 
     #[test]
-    #[allow(clippy::vec_init_then_push, non_snake_case)]
+    #[allow(non_snake_case)]
     fn congestion_queue_pop() {
         let ALICE_BOB: Edge = Edge::new((ALICE, BOB));
 
-        let mut policy = Policy::new();
-        policy.set_default_node_policy(NodePolicy {
-            bandwidth_down: "100bps".parse().unwrap(),
-            bandwidth_up: "100bps".parse().unwrap(),
-            location: None,
-        });
-        policy.set_default_edge_policy(EdgePolicy {
-            bandwidth_down: "10bps".parse().unwrap(),
-            bandwidth_up: "10bps".parse().unwrap(),
-            latency: Latency::new(Duration::ZERO),
-            packet_loss: PacketLoss::NONE,
-        });
-
-        let mut nodes = SimLinks::<()>::new();
-        nodes.push(SimLink::new(()));
-        nodes.push(SimLink::new(()));
+        let policy = bandwidth("100bps", "10bps");
+        let nodes = two_nodes();
 
         let mut cq = CongestionQueue::<Event>::new();
 
         let time = Instant::now();
-        cq.push(time, Msg::new(ALICE, BOB, Event));
+        let msg = Msg::new(ALICE, BOB, Event);
+        cq.push(time, msg);
+        let key = *cq.queue.keys().next().unwrap();
 
         // First we will need to do 10 iterations to clear alice's buffer
         for i in 0..10 {
@@ -386,7 +807,309 @@ mod tests {
 
         // it should take 100 iteration to pop the message
         assert!(cq
-            .pop(time + Duration::from_secs(99), &nodes, &policy, 0)
+            .pop(time + Duration::from_secs(99), &nodes, &policy, key)
             .is_some());
     }
+
+    #[test]
+    fn congestion_queue_send_completion() {
+        let policy = bandwidth("100bps", "10bps");
+        let nodes = two_nodes();
+
+        let mut cq = CongestionQueue::<Event>::new();
+
+        let time = Instant::now();
+        cq.push(time, Msg::new(ALICE, BOB, Event).with_send_completion(42));
+        cq.push(time, Msg::new(BOB, ALICE, Event));
+
+        // it takes 10 iterations to clear alice's upload buffer
+        for i in 0..9 {
+            assert!(cq
+                .pop_many(time + Duration::from_secs(i), &nodes, &policy)
+                .is_empty());
+            assert!(cq.take_completions().is_empty());
+        }
+
+        assert!(cq
+            .pop_many(time + Duration::from_secs(9), &nodes, &policy)
+            .is_empty());
+        assert_eq!(
+            cq.take_completions(),
+            vec![SendCompletion::new(ALICE, BOB, 42)]
+        );
+
+        // only notified once
+        assert!(cq
+            .pop_many(time + Duration::from_secs(10), &nodes, &policy)
+            .is_empty());
+        assert!(cq.take_completions().is_empty());
+    }
+
+    #[test]
+    fn congestion_queue_cancel_and_deadline() {
+        let policy = bandwidth("100bps", "10bps");
+        let nodes = two_nodes();
+
+        let mut cq = CongestionQueue::<Event>::new();
+
+        let time = Instant::now();
+        let cancelled = Msg::new(ALICE, BOB, Event).with_cancellation();
+        let cancelled_id = cancelled.id();
+        let expiring = Msg::new(BOB, ALICE, Event).with_deadline(time + Duration::from_secs(2));
+        let expiring_id = expiring.id();
+        cq.push(time, cancelled);
+        cq.push(time, expiring);
+        // only the cancellable messages are indexed
+        assert_eq!(cq.keys.len(), 1);
+        assert_eq!(cq.deadlines.len(), 1);
+
+        assert!(cq.pop_many(time, &nodes, &policy).is_empty());
+        assert!(cq.cancel(BOB, expiring_id).is_none(), "not cancellable");
+        assert!(cq.cancel(BOB, cancelled_id).is_none(), "not the sender");
+        assert!(cq.cancel(ALICE, cancelled_id).is_some());
+        assert!(
+            cq.cancel(ALICE, cancelled_id).is_none(),
+            "already cancelled"
+        );
+
+        // a cancelled message no longer consumes the sender's bandwidth
+        let time = time + Duration::from_secs(1);
+        assert!(cq.pop_many(time, &nodes, &policy).is_empty());
+        assert_eq!(cq.nodes_usage.get(&ALICE).unwrap().upload.counter, 0);
+        assert!(cq.take_expired().is_empty());
+
+        let time = time + Duration::from_secs(1);
+        assert!(cq.pop_many(time, &nodes, &policy).is_empty());
+        let expired = cq.take_expired();
+        assert_eq!(expired.len(), 1);
+        assert_eq!(expired[0].id(), expiring_id);
+        assert!(cq.queue.is_empty());
+        assert!(cq.keys.is_empty());
+        assert!(cq.deadlines.is_empty());
+    }
+
+    #[test]
+    fn congestion_queue_push_order() {
+        let policy = Policy::new();
+        let nodes = two_nodes();
+
+        let mut cq = CongestionQueue::<Event>::new();
+
+        // the identifiers are allocated by the senders' threads, the
+        // message created first may reach the multiplexer last
+        let time = Instant::now();
+        let first = Msg::new(ALICE, BOB, Event).with_cancellation();
+        let second = Msg::new(BOB, ALICE, Event).with_cancellation();
+        let (first_id, second_id) = (first.id(), second.id());
+        cq.push(time, second);
+        cq.push(time, first);
+
+        let msgs = cq.pop_many(time + Duration::from_secs(1), &nodes, &policy);
+        let ids: Vec<MsgId> = msgs.iter().map(Msg::id).collect();
+        assert_eq!(ids, vec![second_id, first_id]);
+        assert!(cq.keys.is_empty());
+    }
+
+    #[test]
+    fn congestion_queue_capacity_trace() {
+        let policy_time = Instant::now();
+        let trace = CapacityTrace::read_mahimahi("1\n2\n".as_bytes()).unwrap();
+        let mut policy = Policy::new();
+        policy.set_edge_trace(
+            Edge::new((ALICE, BOB)),
+            EdgeTrace {
+                capacity: Some(trace),
+                delay: None,
+            },
+            policy_time,
+        );
+
+        let nodes = two_nodes();
+        let mut cq = CongestionQueue::<Event>::new();
+
+        let time = policy_time;
+        cq.push(time, Msg::new(ALICE, BOB, Event));
+        cq.push(time, Msg::new(ALICE, BOB, Event));
+        assert!(cq.pop_many(time, &nodes, &policy).is_empty());
+
+        // one opportunity (1500 bytes) per millisecond
+        let time = time + Duration::from_millis(1);
+        assert_eq!(cq.pop_many(time, &nodes, &policy).len(), 1);
+        let time = time + Duration::from_millis(1);
+        assert_eq!(cq.pop_many(time, &nodes, &policy).len(), 1);
+
+        // the opportunities of the steps the edge is idle are lost, they
+        // do not let a burst through afterward
+        let mut time = time;
+        for _ in 0..10 {
+            time += Duration::from_millis(1);
+            assert!(cq.pop_many(time, &nodes, &policy).is_empty());
+        }
+        for _ in 0..3 {
+            cq.push(time, Msg::new(ALICE, BOB, Event));
+        }
+        let time = time + Duration::from_millis(1);
+        assert_eq!(cq.pop_many(time, &nodes, &policy).len(), 1);
+    }
+
+    #[test]
+    fn congestion_queue_segment() {
+        const CAROL: SimId = SimId::new(2);
+        let mut policy = Policy::new();
+        policy.set_segment(
+            7,
+            Segment {
+                capacity: Bandwidth::bits_per_second(1_000),
+                latency: Latency::new(Duration::ZERO),
+                members: vec![ALICE, BOB, CAROL],
+            },
+        );
+
+        let nodes: SimLinks<()> = vec![SimLink::new(()), SimLink::new(()), SimLink::new(())];
+        let mut cq = CongestionQueue::<Event>::new();
+
+        // the broadcast costs the airtime of one message and reaches all
+        // the other members
+        let time = Instant::now();
+        cq.push_broadcast(time, 7, Msg::new(ALICE, ALICE, Event), |_| Event);
+        let msgs = cq.pop_many(time, &nodes, &policy);
+        let recipients: Vec<SimId> = msgs.iter().map(|msg| msg.to()).collect();
+        assert_eq!(recipients, vec![BOB, CAROL]);
+        assert_eq!(cq.segment_usage.get(&7).unwrap().counter, 1_000);
+        assert!(cq.edge_usage.is_empty());
+
+        // the airtime is shared with the messages between the members
+        cq.push(time, Msg::new(BOB, CAROL, Event));
+        assert!(cq.pop_many(time, &nodes, &policy).is_empty());
+        let time = time + Duration::from_secs(1);
+        assert_eq!(cq.pop_many(time, &nodes, &policy).len(), 1);
+        assert!(cq.edge_usage.is_empty());
+
+        // the broadcasts of a removed segment are dropped
+        cq.push_broadcast(time, 7, Msg::new(ALICE, ALICE, Event), |_| Event);
+        policy.reset_segment(7);
+        assert!(cq.pop_many(time, &nodes, &policy).is_empty());
+        assert_eq!(cq.take_expired().len(), 1);
+    }
+
+    /// a message of `.0` bytes
+    struct Bytes(u64);
+    impl HasBytesSize for Bytes {
+        fn bytes_size(&self) -> u64 {
+            self.0
+        }
+    }
+
+    /// step the queue every `step` until all the messages are delivered,
+    /// returns the time each message was delivered since `start`
+    fn deliveries<T: HasBytesSize>(
+        cq: &mut CongestionQueue<T>,
+        nodes: &SimLinks<()>,
+        policy: &Policy,
+        start: Instant,
+        step: Duration,
+    ) -> Vec<(MsgId, Duration)> {
+        let mut deliveries = Vec::new();
+        let mut elapsed = Duration::ZERO;
+
+        while !cq.queue.is_empty() {
+            assert!(elapsed < Duration::from_secs(60), "the messages are stuck");
+            for msg in cq.pop_many(start + elapsed, nodes, policy) {
+                deliveries.push((msg.id(), elapsed));
+            }
+            elapsed += step;
+        }
+
+        deliveries
+    }
+
+    /// the time to transfer `size` bytes at `bandwidth` (fluid model)
+    fn transfer_time(size: u64, bandwidth: &str) -> Duration {
+        let bandwidth: Bandwidth = bandwidth.parse().unwrap();
+        Duration::from_secs_f64(size as f64 / bandwidth.into_inner() as f64)
+    }
+
+    #[test]
+    fn fidelity_bottleneck() {
+        let policy = bandwidth("1kbps", "1gbps");
+        let nodes = two_nodes();
+
+        // many windows of bandwidth, polled far more often than the
+        // windows refresh
+        for size in [100, 1_024, 5_000, 20_000] {
+            let mut cq = CongestionQueue::new();
+            let start = Instant::now();
+            cq.push(start, Msg::new(ALICE, BOB, Bytes(size)));
+
+            let delivered = deliveries(&mut cq, &nodes, &policy, start, Duration::from_millis(1));
+            let expected = transfer_time(size, "1kbps");
+            let (_, actual) = delivered[0];
+
+            // the bandwidth is accounted per window of one second, so the
+            // transfer is ahead of the fluid model by a window at most
+            assert!(actual <= expected, "{size}: {actual:?} > {expected:?}");
+            assert!(
+                expected - actual <= Duration::from_secs(1),
+                "{size}: {actual:?} too early, expecting {expected:?}"
+            );
+        }
+    }
+
+    #[test]
+    fn fidelity_shared_link() {
+        const CAROL: SimId = SimId::new(2);
+        const DAVE: SimId = SimId::new(3);
+        const ERIN: SimId = SimId::new(4);
+        let policy = bandwidth("1kbps", "1gbps");
+        let nodes: SimLinks<()> = (0..5).map(|_| SimLink::new(())).collect();
+
+        // the flows share the download of the recipient (each sender
+        // uploads at the same rate): the last one completes once all the
+        // bytes went through
+        let senders = [BOB, CAROL, DAVE, ERIN];
+        let mut cq = CongestionQueue::new();
+        let start = Instant::now();
+        for sender in senders {
+            cq.push(start, Msg::new(sender, ALICE, Bytes(2_000)));
+        }
+
+        let delivered = deliveries(&mut cq, &nodes, &policy, start, Duration::from_millis(1));
+        assert_eq!(delivered.len(), senders.len());
+
+        let expected = transfer_time(2_000 * senders.len() as u64, "1kbps");
+        let (_, last) = delivered[senders.len() - 1];
+        assert!(last <= expected, "{last:?} > {expected:?}");
+        assert!(
+            expected - last <= Duration::from_secs(1),
+            "{last:?} too early"
+        );
+    }
+
+    #[test]
+    fn fidelity_latency() {
+        let policy = bandwidth("1gbps", "1gbps");
+        let nodes = two_nodes();
+        let step = Duration::from_micros(300);
+
+        // without congestion a message is delivered at the first step
+        // past its latency
+        for millis in [1, 5, 12, 40] {
+            let latency = Duration::from_millis(millis);
+            let mut cq = CongestionQueue::new();
+            let start = Instant::now();
+            cq.push(start + latency, Msg::new(ALICE, BOB, Bytes(1_000)));
+
+            let (_, actual) = deliveries(&mut cq, &nodes, &policy, start, step)[0];
+            assert!(actual >= latency, "{actual:?} < {latency:?}");
+            assert!(actual - latency < step, "{actual:?} late for {latency:?}");
+        }
+    }
+
+    #[test]
+    fn phantom_footprint() {
+        // the envelop of a phantom message in flight: the header of the
+        // message, its tag and size and its progress (168 bytes on Linux),
+        // the queue adds about as much again in the nodes of its tree
+        assert!(std::mem::size_of::<Envelop<crate::Phantom>>() <= 168);
+    }
 }
@@ -0,0 +1,411 @@
+use crate::{
+    defaults::DEFAULT_MOBILITY_INTERVAL,
+    geo::{self, Location, Point, EARTH_RADIUS},
+    Edge, SimId,
+};
+use anyhow::{ensure, Result};
+use std::{
+    collections::{HashMap, HashSet},
+    time::{Duration, Instant},
+};
+
+/// the lowest altitude (meter) a link between two satellites may cross,
+/// below it the atmosphere blocks the link
+const GRAZING_ALTITUDE: f64 = 80_000.0;
+
+/// A circular orbit, the angles are in degrees
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Orbit {
+    /// above the surface of the earth, in meter
+    pub altitude: f64,
+    pub inclination: f64,
+    /// the right ascension of the ascending node
+    pub ascending_node: f64,
+    /// the position on the orbit (argument of latitude) when the
+    /// constellation starts
+    pub phase: f64,
+}
+
+impl Orbit {
+    fn check(&self) -> Result<()> {
+        ensure!(
+            self.altitude > 0.0 && self.altitude.is_finite(),
+            "Invalid altitude: {}m",
+            self.altitude
+        );
+        ensure!(
+            [self.inclination, self.ascending_node, self.phase]
+                .iter()
+                .all(|angle| angle.is_finite()),
+            "Invalid orbit: {self:?}"
+        );
+        Ok(())
+    }
+}
+
+/// A constellation of satellites in low earth orbit and its ground
+/// stations, see `SimContext::set_constellation`
+///
+/// Every update interval the positions of the satellites are computed,
+/// then the links that exist at that time: between a ground station and
+/// the satellites above its minimum elevation and between satellites in
+/// range of each other (and not hidden by the earth). The latency of a
+/// link is its length at the speed of light.
+///
+/// The neighbours are found with a spatial grid whose cells are as large
+/// as the longest link: only the satellites of the adjacent cells are
+/// considered, so updating thousands of satellites stays cheap.
+#[derive(Debug, Clone, PartialEq)]
+pub struct Constellation {
+    satellites: Vec<(SimId, Orbit)>,
+    ground_stations: Vec<(SimId, Point)>,
+    members: HashMap<SimId, Member>,
+
+    /// radian
+    min_elevation: f64,
+    /// meter
+    isl_range: f64,
+    interval: Duration,
+
+    /// the time the constellation started and of the last update
+    epoch: Option<Instant>,
+    updated: Option<Instant>,
+
+    positions: Vec<Point>,
+    grid: HashMap<Cell, Vec<u32>>,
+    links: HashMap<Edge, Duration>,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq)]
+enum Member {
+    Satellite,
+    GroundStation,
+}
+
+type Cell = (i32, i32, i32);
+
+impl Orbit {
+    fn radius(&self) -> f64 {
+        EARTH_RADIUS + self.altitude
+    }
+
+    fn position(&self, elapsed: f64) -> Point {
+        geo::circular_orbit(
+            self.radius(),
+            self.inclination.to_radians(),
+            self.ascending_node.to_radians(),
+            self.phase.to_radians(),
+            elapsed,
+        )
+    }
+}
+
+impl Constellation {
+    /// a constellation whose ground stations see the satellites above
+    /// `min_elevation` (degrees) and whose satellites have links with the
+    /// satellites up to `isl_range` (meter) away
+    pub fn new(min_elevation: f64, isl_range: f64) -> Result<Self> {
+        ensure!(
+            (0.0..90.0).contains(&min_elevation),
+            "The minimum elevation must be within 0 and 90 degrees: {min_elevation}"
+        );
+        ensure!(
+            isl_range >= 0.0 && isl_range.is_finite(),
+            "Invalid range of the inter satellite links: {isl_range}m"
+        );
+
+        Ok(Self {
+            satellites: Vec::new(),
+            ground_stations: Vec::new(),
+            members: HashMap::new(),
+            min_elevation: min_elevation.to_radians(),
+            isl_range,
+            interval: DEFAULT_MOBILITY_INTERVAL,
+            epoch: None,
+            updated: None,
+            positions: Vec::new(),
+            grid: HashMap::new(),
+            links: HashMap::new(),
+        })
+    }
+
+    /// the links are recomputed at most once per `interval`
+    pub fn set_update_interval(&mut self, interval: Duration) {
+        self.interval = interval;
+    }
+
+    pub fn add_satellite(&mut self, node: SimId, orbit: Orbit) -> Result<()> {
+        orbit.check()?;
+        self.add_member(node, Member::Satellite)?;
+
+        self.satellites.push((node, orbit));
+        Ok(())
+    }
+
+    /// add a Walker delta constellation of `nodes.len()` satellites: the
+    /// satellites are spread evenly on `planes` orbital planes, the
+    /// satellites of adjacent planes are shifted by `phasing` (the `F`
+    /// of the Walker notation `i: t/p/F`)
+    ///
+    /// Nothing is added if one of the satellites cannot be added.
+    pub fn add_walker_delta(
+        &mut self,
+        nodes: &[SimId],
+        planes: usize,
+        phasing: usize,
+        altitude: f64,
+        inclination: f64,
+    ) -> Result<()> {
+        let total = nodes.len();
+        ensure!(
+            total.checked_rem(planes) == Some(0),
+            "The {total} satellites cannot be spread on {planes} planes"
+        );
+        let per_plane = total / planes;
+
+        let mut orbits = Vec::with_capacity(total);
+        let mut added = HashSet::with_capacity(total);
+        for (index, node) in nodes.iter().copied().enumerate() {
+            ensure!(
+                !self.contains(node) && added.insert(node),
+                "{node} is already part of the constellation"
+            );
+
+            let (plane, slot) = (index / per_plane, index % per_plane);
+            let orbit = Orbit {
+                altitude,
+                inclination,
+                ascending_node: 360.0 * plane as f64 / planes as f64,
+                phase: 360.0 * slot as f64 / per_plane as f64
+                    + 360.0 * (phasing * plane) as f64 / total as f64,
+            };
+            orbit.check()?;
+            orbits.push((node, orbit));
+        }
+
+        for (node, orbit) in orbits {
+            self.members.insert(node, Member::Satellite);
+            self.satellites.push((node, orbit));
+        }
+
+        Ok(())
+    }
+
+    pub fn add_ground_station(&mut self, node: SimId, location: Location) -> Result<()> {
+        let [x, y, z] = geo::unit_point(location)?;
+        self.add_member(node, Member::GroundStation)?;
+
+        self.ground_stations
+            .push((node, [x * EARTH_RADIUS, y * EARTH_RADIUS, z * EARTH_RADIUS]));
+        Ok(())
+    }
+
+    fn add_member(&mut self, node: SimId, member: Member) -> Result<()> {
+        ensure!(
+            !self.contains(node),
+            "{node} is already part of the constellation"
+        );
+        self.members.insert(node, member);
+        Ok(())
+    }
+
+    /// the satellites and the ground stations
+    #[inline]
+    pub fn contains(&self, node: SimId) -> bool {
+        self.members.contains_key(&node)
+    }
+
+    /// the latency of the link between the nodes, if they are linked
+    #[inline]
+    pub fn latency(&self, a: SimId, b: SimId) -> Option<Duration> {
+        self.links.get(&Edge::new((a, b))).copied()
+    }
+
+    /// the links and their latencies
+    pub fn links(&self) -> impl Iterator<Item = (Edge, Duration)> + '_ {
+        self.links.iter().map(|(edge, latency)| (*edge, *latency))
+    }
+
+    /// update the links if the last update is older than the interval
+    pub(crate) fn update(&mut self, time: Instant) {
+        if self
+            .updated
+            .is_some_and(|updated| time.saturating_duration_since(updated) < self.interval)
+        {
+            return;
+        }
+        let epoch = *self.epoch.get_or_insert(time);
+        self.updated = Some(time);
+
+        self.propagate(time.saturating_duration_since(epoch));
+    }
+
+    /// compute the links `elapsed` after the start of the constellation
+    pub fn propagate(&mut self, elapsed: Duration) {
+        let elapsed = elapsed.as_secs_f64();
+
+        self.positions.clear();
+        self.positions.extend(
+            self.satellites
+                .iter()
+                .map(|(_, orbit)| orbit.position(elapsed)),
+        );
+
+        // the slant range to the highest satellite at the minimum elevation
+        let highest = self
+            .satellites
+            .iter()
+            .map(|(_, orbit)| orbit.radius())
+            .fold(EARTH_RADIUS, f64::max);
+        let (sin, cos) = self.min_elevation.sin_cos();
+        let ground_range =
+            (highest.powi(2) - (EARTH_RADIUS * cos).powi(2)).sqrt() - EARTH_RADIUS * sin;
+        let size = self.isl_range.max(ground_range).max(1.0);
+
+        for cell in self.grid.values_mut() {
+            cell.clear();
+        }
+        for (index, position) in self.positions.iter().enumerate() {
+            self.grid
+                .entry(cell(*position, size))
+                .or_default()
+                .push(index as u32);
+        }
+
+        self.links.clear();
+        let grazing = EARTH_RADIUS + GRAZING_ALTITUDE;
+        for (index, (node, _)) in self.satellites.iter().enumerate() {
+            let position = self.positions[index];
+            for other in neighbours(&self.grid, position, size) {
+                let other = other as usize;
+                if other <= index {
+                    continue;
+                }
+                let other_position = self.positions[other];
+                if geo::distance(position, other_position) > self.isl_range
+                    || closest_to_center(position, other_position) < grazing
+                {
+                    continue;
+                }
+
+                let edge = Edge::new((*node, self.satellites[other].0));
+                let latency = geo::free_space_latency(position, other_position);
+                self.links.insert(edge, latency);
+            }
+        }
+
+        for (node, station) in self.ground_stations.iter() {
+            for satellite in neighbours(&self.grid, *station, size) {
+                let position = self.positions[satellite as usize];
+                if geo::elevation(*station, position) < self.min_elevation {
+                    continue;
+                }
+
+                let edge = Edge::new((*node, self.satellites[satellite as usize].0));
+                let latency = geo::free_space_latency(*station, position);
+                self.links.insert(edge, latency);
+            }
+        }
+    }
+}
+
+/// the positions are never NaN (the orbits are validated)
+impl Eq for Constellation {}
+
+fn cell(point: Point, size: f64) -> Cell {
+    let [x, y, z] = point.map(|c| (c / size).floor() as i32);
+    (x, y, z)
+}
+
+/// the satellites in the cell of the point and the adjacent cells
+fn neighbours(
+    grid: &HashMap<Cell, Vec<u32>>,
+    point: Point,
+    size: f64,
+) -> impl Iterator<Item = u32> + '_ {
+    let (x, y, z) = cell(point, size);
+
+    (-1..=1)
+        .flat_map(move |dx| (-1..=1).flat_map(move |dy| (-1..=1).map(move |dz| (dx, dy, dz))))
+        .filter_map(move |(dx, dy, dz)| grid.get(&(x + dx, y + dy, z + dz)))
+        .flatten()
+        .copied()
+}
+
+/// the distance between the center of the earth and the segment `a b`
+fn closest_to_center(a: Point, b: Point) -> f64 {
+    let ab = [b[0] - a[0], b[1] - a[1], b[2] - a[2]];
+    let length = ab.iter().map(|c| c * c).sum::<f64>();
+    if length == 0.0 {
+        return geo::distance(a, [0.0; 3]);
+    }
+    let t = (-(0..3).map(|i| a[i] * ab[i]).sum::<f64>() / length).clamp(0.0, 1.0);
+
+    geo::distance([0, 1, 2].map(|i| a[i] + t * ab[i]), [0.0; 3])
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn walker() {
+        let satellites: Vec<SimId> = (0..66).map(SimId::new).collect();
+        let station = SimId::new(66);
+        let mut constellation = Constellation::new(10.0, 5_000_000.0).unwrap();
+        constellation
+            .add_walker_delta(&satellites, 6, 1, 550_000.0, 53.0)
+            .unwrap();
+        constellation.add_ground_station(station, (0, 0)).unwrap();
+        assert!(constellation
+            .add_ground_station(satellites[0], (0, 0))
+            .is_err());
+        assert!(constellation
+            .add_walker_delta(&[SimId::new(100); 7], 6, 1, 550_000.0, 53.0)
+            .is_err());
+        assert_eq!(constellation.members[&satellites[0]], Member::Satellite);
+
+        // a failed constellation leaves the constellation unchanged
+        let others: Vec<SimId> = (100..106).map(SimId::new).collect();
+        let duplicate = [&others[..5], &[satellites[3]]].concat();
+        let twice = [&others[..5], &[others[0]]].concat();
+        for (nodes, altitude) in [
+            (&duplicate, 550_000.0),
+            (&twice, 550_000.0),
+            (&others, -1.0),
+            (&others, f64::NAN),
+        ] {
+            assert!(constellation
+                .add_walker_delta(nodes, 6, 1, altitude, 53.0)
+                .is_err());
+            assert_eq!(constellation.satellites.len(), 66);
+            assert_eq!(constellation.members.len(), 67);
+            assert!(others.iter().all(|node| !constellation.contains(*node)));
+        }
+
+        for minute in 0..10 {
+            constellation.propagate(Duration::from_secs(60 * minute));
+
+            // the links found with the grid are all the valid links
+            for (i, a) in satellites.iter().enumerate() {
+                for b in satellites.iter().skip(i + 1) {
+                    let (pa, pb) = (
+                        constellation.positions[i],
+                        constellation.positions[b.into_index()],
+                    );
+                    let linked = geo::distance(pa, pb) <= 5_000_000.0
+                        && closest_to_center(pa, pb) >= EARTH_RADIUS + GRAZING_ALTITUDE;
+                    assert_eq!(constellation.latency(*a, *b).is_some(), linked);
+                }
+            }
+            // at 550km a satellite 10 degrees above the horizon is at most
+            // ~1,800km away
+            for (edge, latency) in constellation.links() {
+                if edge.larger_id == station {
+                    assert!(latency < Duration::from_millis(7));
+                    assert!(latency >= Duration::from_micros(1_834));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,208 @@
+use crate::{
+    lines::{for_each_line, open, split_row},
+    rng::SimRng,
+    Latency,
+};
+use anyhow::{ensure, Context as _, Result};
+use std::{fmt, io::BufRead, path::Path, str::FromStr, sync::Arc, time::Duration};
+
+/// An empirical distribution of the latency of a link
+///
+/// The distribution is built from a measured CDF: a list of latencies and
+/// the probability for the latency to be lower or equal. The latency of
+/// every message sent on an edge using the distribution is drawn from it,
+/// the latencies in between two points of the CDF are linearly
+/// interpolated.
+///
+/// The CDF is turned into an alias table when it is loaded so drawing a
+/// latency is `O(1)` whatever the number of points. The table is cheap to
+/// clone and share: a single distribution can be used by all the edges
+/// between two regions (see [`Policy::set_region_distribution`]).
+///
+/// [`Policy::set_region_distribution`]: crate::Policy::set_region_distribution
+#[derive(Clone)]
+pub struct LatencyDistribution {
+    inner: Arc<AliasTable>,
+}
+
+/// Walker's alias table over the bins of the CDF (Vose's construction)
+struct AliasTable {
+    /// the lowest latency (in nanoseconds) of the bin and its width
+    bins: Box<[(u64, u64)]>,
+    /// the probability to keep the drawn bin rather than its alias
+    keep: Box<[f64]>,
+    alias: Box<[u32]>,
+}
+
+impl LatencyDistribution {
+    /// build the distribution from the points of a CDF
+    ///
+    /// The latencies must be increasing and the probabilities non
+    /// decreasing. The probabilities are normalised by the last one (so
+    /// they may be given as percentages). The probability of the first
+    /// point is the probability of its exact latency.
+    pub fn from_cdf(points: &[(Duration, f64)]) -> Result<Self> {
+        ensure!(!points.is_empty(), "Expecting at least one point");
+        for window in points.windows(2) {
+            let ((a, p), (b, q)) = (window[0], window[1]);
+            ensure!(a < b, "The latencies must be increasing ({a:?} >= {b:?})");
+            ensure!(p <= q, "The probabilities must not decrease ({p} > {q})");
+        }
+        let total = points[points.len() - 1].1;
+        ensure!(
+            points[0].1 >= 0.0 && total > 0.0 && total.is_finite(),
+            "Invalid probabilities"
+        );
+
+        let nanos = |latency: Duration| latency.as_nanos().min(u64::MAX as u128) as u64;
+        let mut bins = Vec::with_capacity(points.len());
+        let mut weights = Vec::with_capacity(points.len());
+        bins.push((nanos(points[0].0), 0));
+        weights.push(points[0].1 / total);
+        for window in points.windows(2) {
+            let ((a, p), (b, q)) = (window[0], window[1]);
+            bins.push((nanos(a), nanos(b) - nanos(a)));
+            weights.push((q - p) / total);
+        }
+
+        let (keep, alias) = alias_table(&weights);
+        Ok(Self {
+            inner: Arc::new(AliasTable {
+                bins: bins.into(),
+                keep,
+                alias,
+            }),
+        })
+    }
+
+    /// read a CSV CDF of `<latency>,<probability>` rows, the latency is
+    /// either a duration (`20ms`) or a number of milliseconds
+    pub fn read_cdf<R: BufRead>(reader: R) -> Result<Self> {
+        let mut points = Vec::new();
+        for_each_line(reader, |line| {
+            let (latency, probability) = split_row(line)?;
+            let latency = match latency.parse::<f64>() {
+                Ok(millis) => {
+                    ensure!(
+                        millis.is_finite() && millis >= 0.0,
+                        "Invalid latency: {millis}ms"
+                    );
+                    Duration::try_from_secs_f64(millis / 1_000.0)
+                        .with_context(|| format!("Invalid latency: {millis}ms"))?
+                }
+                Err(_) => Latency::from_str(latency)?.to_duration(),
+            };
+            points.push((latency, probability.parse()?));
+            Ok(())
+        })?;
+
+        Self::from_cdf(&points)
+    }
+
+    /// read the CSV CDF at the given path, see [`Self::read_cdf`]
+    pub fn open_cdf(path: impl AsRef<Path>) -> Result<Self> {
+        Self::read_cdf(open(path.as_ref())?)
+    }
+
+    /// draw a latency from the distribution
+    #[inline]
+    pub(crate) fn sample(&self, rng: &mut SimRng) -> Duration {
+        let AliasTable { bins, keep, alias } = self.inner.as_ref();
+
+        let bin = rng.below(bins.len() as u64) as usize;
+        let bin = if rng.next_f64() < keep[bin] {
+            bin
+        } else {
+            alias[bin] as usize
+        };
+
+        let (low, width) = bins[bin];
+        let offset = (width as f64 * rng.next_f64()) as u64;
+        Duration::from_nanos(low + offset)
+    }
+}
+
+/// build the alias table of the given (normalised) weights
+fn alias_table(weights: &[f64]) -> (Box<[f64]>, Box<[u32]>) {
+    let n = weights.len();
+    let mut keep: Vec<f64> = weights.iter().map(|weight| weight * n as f64).collect();
+    let mut alias: Vec<u32> = (0..n as u32).collect();
+
+    let (mut small, mut large): (Vec<usize>, Vec<usize>) = (0..n).partition(|i| keep[*i] < 1.0);
+    while let (Some(s), Some(l)) = (small.pop(), large.last().copied()) {
+        alias[s] = l as u32;
+        keep[l] -= 1.0 - keep[s];
+        if keep[l] < 1.0 {
+            large.pop();
+            small.push(l);
+        }
+    }
+    // the remaining bins are (up to rounding errors) always kept
+    for i in small.into_iter().chain(large) {
+        keep[i] = 1.0;
+    }
+
+    (keep.into(), alias.into())
+}
+
+/// two distributions are equal if they share the same table
+impl PartialEq for LatencyDistribution {
+    fn eq(&self, other: &Self) -> bool {
+        Arc::ptr_eq(&self.inner, &other.inner)
+    }
+}
+impl Eq for LatencyDistribution {}
+
+impl fmt::Debug for LatencyDistribution {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("LatencyDistribution")
+            .field("bins", &self.inner.bins.len())
+            .finish()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const MS: Duration = Duration::from_millis(1);
+
+    #[test]
+    fn alias() {
+        let (keep, alias) = alias_table(&[0.5, 0.25, 0.125, 0.125]);
+
+        // the probability of every bin is restored from the table
+        let mut probabilities = [0.0; 4];
+        for i in 0..4 {
+            probabilities[i] += keep[i] / 4.0;
+            probabilities[alias[i] as usize] += (1.0 - keep[i]) / 4.0;
+        }
+        assert_eq!(probabilities, [0.5, 0.25, 0.125, 0.125]);
+    }
+
+    #[test]
+    fn sample() {
+        let distribution =
+            LatencyDistribution::read_cdf("# latency,cdf\n10,0\n20,50\n100,100\n".as_bytes())
+                .unwrap();
+        let mut rng = SimRng::new(42);
+
+        let samples: Vec<Duration> = (0..10_000).map(|_| distribution.sample(&mut rng)).collect();
+        assert!(samples.iter().all(|s| (10 * MS..100 * MS).contains(s)));
+
+        // half of the samples are between 10ms and 20ms
+        let below = samples.iter().filter(|s| **s < 20 * MS).count();
+        assert!((4_500..5_500).contains(&below), "{below}");
+
+        assert!(LatencyDistribution::read_cdf("20,0.5\n10,1\n".as_bytes()).is_err());
+        assert!(LatencyDistribution::read_cdf("10,0.5\n20,0.4\n".as_bytes()).is_err());
+        // malformed latencies are errors, not panics
+        for latency in ["inf", "NaN", "-1", "1e300"] {
+            let cdf = format!("{latency},0.5\n1e301,1\n");
+            assert!(
+                LatencyDistribution::read_cdf(cdf.as_bytes()).is_err(),
+                "{latency}"
+            );
+        }
+    }
+}
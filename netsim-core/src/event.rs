@@ -0,0 +1,70 @@
+use crate::{stream::StreamReader, timer::Timer, Msg, SimId};
+
+/// An event delivered by the multiplexer to a node (through its [`Link`])
+///
+/// [`Link`]: crate::sim_context::Link
+pub enum SimEvent<T> {
+    /// a message sent by a node through the simulated network
+    Msg(Msg<T>),
+    /// a timer requested by the node has expired
+    Timer(Timer),
+    /// a message sent by the node has finished uploading
+    SendCompletion(SendCompletion),
+    /// another node has opened a stream to the node
+    Stream(StreamReader),
+}
+
+/// Notification that the last byte of a message has left the sender
+///
+/// This is only delivered for the messages that requested it (see
+/// [`Msg::with_send_completion`]). The message may still be in flight:
+/// it has consumed all of the sender's upload bandwidth it needs but
+/// it may still be waiting on the link or the recipient's download
+/// bandwidth.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct SendCompletion {
+    from: SimId,
+    to: SimId,
+    token: u64,
+}
+
+impl<T> SimEvent<T> {
+    /// the node the event is delivered to
+    pub fn to(&self) -> SimId {
+        match self {
+            Self::Msg(msg) => msg.to(),
+            Self::Timer(timer) => timer.node(),
+            Self::SendCompletion(completion) => completion.from(),
+            Self::Stream(stream) => stream.to(),
+        }
+    }
+
+    /// returns the message if the event is a [`SimEvent::Msg`]
+    pub fn into_msg(self) -> Option<Msg<T>> {
+        match self {
+            Self::Msg(msg) => Some(msg),
+            Self::Timer(_) | Self::SendCompletion(_) | Self::Stream(_) => None,
+        }
+    }
+}
+
+impl SendCompletion {
+    pub fn new(from: SimId, to: SimId, token: u64) -> Self {
+        Self { from, to, token }
+    }
+
+    /// the sender of the message (and the recipient of the notification)
+    pub fn from(&self) -> SimId {
+        self.from
+    }
+
+    /// the recipient of the message
+    pub fn to(&self) -> SimId {
+        self.to
+    }
+
+    /// the user's value given when sending the message
+    pub fn token(&self) -> u64 {
+        self.token
+    }
+}
@@ -0,0 +1,253 @@
+use crate::{rng::SimRng, Edge};
+use anyhow::{ensure, Result};
+use std::{
+    cmp::Reverse,
+    collections::{BinaryHeap, HashMap, HashSet},
+    time::{Duration, Instant},
+};
+
+/// The distribution of the time a link stays up (or down)
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Lifetime(Kind);
+
+#[derive(Debug, Clone, Copy, PartialEq)]
+enum Kind {
+    Exponential { mean: f64 },
+    Weibull { shape: f64, scale: f64 },
+}
+
+/// The failure process of a link: it stays up for a time drawn from `up`
+/// (the time between failures), then it is down for a time drawn from
+/// `down` (the time to repair) and so on
+///
+/// The same process can be set on a whole class of edges, each edge fails
+/// and recovers independently.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct FailureProcess {
+    pub up: Lifetime,
+    pub down: Lifetime,
+}
+
+/// The links failing and recovering, ordered by the time of their next
+/// change of state
+///
+/// Only the links whose state changes are processed during a step of the
+/// multiplexer: setting a failure process on many links with rare failures
+/// costs nothing until they fail.
+pub(crate) struct FailureQueue {
+    links: HashMap<Edge, Link>,
+    /// the links currently down
+    down: HashSet<Edge>,
+    /// the next change of state of the links, may contain outdated entries
+    /// (of the links whose process was reset)
+    flips: BinaryHeap<Reverse<(Instant, Edge)>>,
+    rng: SimRng,
+}
+
+/// the stream of the generator of the failures, see [`crate::Policy::set_seed`]
+pub(crate) const RNG_STREAM: u64 = 1;
+
+struct Link {
+    process: FailureProcess,
+    /// the time of the next change of state, if any
+    next: Option<Instant>,
+}
+
+impl Lifetime {
+    /// exponentially distributed lifetimes (the link fails at a constant
+    /// rate), with the given mean (the MTBF or the MTTR)
+    pub fn exponential(mean: Duration) -> Result<Self> {
+        ensure!(!mean.is_zero(), "The mean must be a positive duration");
+
+        Ok(Self(Kind::Exponential {
+            mean: mean.as_secs_f64(),
+        }))
+    }
+
+    /// Weibull distributed lifetimes: a `shape` lower than `1` models
+    /// early failures, greater than `1` models wear out (`1` is the
+    /// exponential distribution with a mean of `scale`)
+    pub fn weibull(shape: f64, scale: Duration) -> Result<Self> {
+        ensure!(
+            shape > 0.0 && shape.is_finite(),
+            "The shape must be a positive number: {shape}"
+        );
+        ensure!(!scale.is_zero(), "The scale must be a positive duration");
+
+        Ok(Self(Kind::Weibull {
+            shape,
+            scale: scale.as_secs_f64(),
+        }))
+    }
+
+    /// draw a lifetime (inverse transform sampling), at least a
+    /// nanosecond so the state of a link changes once per instant
+    fn sample(&self, rng: &mut SimRng) -> Duration {
+        // in `(0, 1]` so the logarithm is finite
+        let uniform = 1.0 - rng.next_f64();
+
+        let secs = match self.0 {
+            Kind::Exponential { mean } => -mean * uniform.ln(),
+            Kind::Weibull { shape, scale } => scale * (-uniform.ln()).powf(shape.recip()),
+        };
+        Duration::try_from_secs_f64(secs)
+            .unwrap_or(Duration::MAX)
+            .max(Duration::from_nanos(1))
+    }
+}
+
+impl FailureQueue {
+    pub fn new(rng: SimRng) -> Self {
+        Self {
+            links: HashMap::new(),
+            down: HashSet::new(),
+            flips: BinaryHeap::new(),
+            rng,
+        }
+    }
+
+    /// start the failure process of the edge at the given `time`, the
+    /// edge starts up
+    pub fn set(&mut self, time: Instant, edge: Edge, process: FailureProcess) {
+        self.down.remove(&edge);
+        let next = self.schedule(time, edge, process.up);
+        self.links.insert(edge, Link { process, next });
+    }
+
+    /// stop the failure process of the edge, it is up again
+    pub fn reset(&mut self, edge: Edge) {
+        self.down.remove(&edge);
+        // the scheduled change of state is ignored once popped
+        self.links.remove(&edge);
+    }
+
+    #[inline]
+    pub fn is_down(&self, edge: Edge) -> bool {
+        !self.down.is_empty() && self.down.contains(&edge)
+    }
+
+    /// apply the changes of state up to the given `time`
+    pub fn advance(&mut self, time: Instant) {
+        while let Some(Reverse((at, edge))) = self.flips.peek().copied() {
+            if at > time {
+                break;
+            }
+            self.flips.pop();
+
+            let Some(link) = self.links.get(&edge) else {
+                continue;
+            };
+            if link.next != Some(at) {
+                continue;
+            }
+            let process = link.process;
+
+            // draw the next lifetime from the time of the change (not the
+            // time of the step) so the late steps do not bias the process
+            let lifetime = if self.down.remove(&edge) {
+                process.up
+            } else {
+                self.down.insert(edge);
+                process.down
+            };
+            let next = self.schedule(at, edge, lifetime);
+            if let Some(link) = self.links.get_mut(&edge) {
+                link.next = next;
+            }
+        }
+    }
+
+    fn schedule(&mut self, time: Instant, edge: Edge, lifetime: Lifetime) -> Option<Instant> {
+        // the state is kept forever if the lifetime overflows
+        let next = time.checked_add(lifetime.sample(&mut self.rng))?;
+        self.flips.push(Reverse((next, edge)));
+        Some(next)
+    }
+}
+
+impl Default for FailureQueue {
+    fn default() -> Self {
+        Self::new(SimRng::default())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{Policy, SimId};
+
+    #[test]
+    fn lifetimes() {
+        let mut rng = SimRng::new(42);
+        let mean = |lifetime: Lifetime, rng: &mut SimRng| {
+            (0..10_000)
+                .map(|_| lifetime.sample(rng).as_secs_f64())
+                .sum::<f64>()
+                / 10_000.0
+        };
+
+        let exponential = Lifetime::exponential(Duration::from_secs(10)).unwrap();
+        assert!((9.5..10.5).contains(&mean(exponential, &mut rng)));
+        // the mean of Weibull(2, 10s) is 10s * Γ(1.5) ≈ 8.86s
+        let weibull = Lifetime::weibull(2.0, Duration::from_secs(10)).unwrap();
+        assert!((8.6..9.1).contains(&mean(weibull, &mut rng)));
+
+        assert!(Lifetime::weibull(0.0, Duration::from_secs(1)).is_err());
+        // a zero lifetime would flip the link forever at the same instant
+        assert!(Lifetime::exponential(Duration::ZERO).is_err());
+        assert!(Lifetime::weibull(1.0, Duration::ZERO).is_err());
+
+        let tiny = Lifetime::exponential(Duration::from_nanos(1)).unwrap();
+        assert!((0..1_000).all(|_| !tiny.sample(&mut rng).is_zero()));
+    }
+
+    #[test]
+    fn flips() {
+        let time = Instant::now();
+        let edge = Edge::new((SimId::new(0), SimId::new(1)));
+        let other = Edge::new((SimId::new(1), SimId::new(2)));
+        let process = FailureProcess {
+            up: Lifetime::exponential(Duration::from_secs(1)).unwrap(),
+            down: Lifetime::exponential(Duration::from_secs(1)).unwrap(),
+        };
+
+        let mut failures = FailureQueue::default();
+        failures.set(time, edge, process);
+        assert!(!failures.is_down(edge));
+
+        // roughly half of the time down, and the other edge always up
+        let mut down = 0;
+        for step in 1..=1_000 {
+            failures.advance(time + Duration::from_millis(100) * step);
+            down += failures.is_down(edge) as u32;
+            assert!(!failures.is_down(other));
+        }
+        assert!((300..700).contains(&down), "{down}");
+
+        failures.reset(edge);
+        assert!(!failures.is_down(edge));
+        failures.advance(time + Duration::from_secs(1_000));
+        assert!(!failures.is_down(edge));
+        assert!(failures.flips.is_empty());
+    }
+
+    #[test]
+    fn seeded() {
+        let time = Instant::now();
+        let edge = Edge::new((SimId::new(0), SimId::new(1)));
+        let process = FailureProcess {
+            up: Lifetime::exponential(Duration::from_secs(1)).unwrap(),
+            down: Lifetime::exponential(Duration::from_secs(1)).unwrap(),
+        };
+        let next_flip = |seed: u64| {
+            let mut policy = Policy::new();
+            policy.set_seed(seed);
+            let mut failures = FailureQueue::new(policy.rng(RNG_STREAM));
+            failures.set(time, edge, process);
+            failures.links[&edge].next
+        };
+
+        assert_eq!(next_flip(42), next_flip(42));
+        assert_ne!(next_flip(42), next_flip(7));
+    }
+}
@@ -0,0 +1,471 @@
+use crate::{defaults::DEFAULT_LATENCY, geo, rng::SimRng, EdgePolicy, Topology};
+use anyhow::{bail, ensure, Result};
+use std::{collections::HashSet, ops::Range, thread};
+
+/// the number of nodes processed at once by a thread, each chunk draws
+/// from its own random stream so the generated topology does not depend
+/// on the number of threads
+const CHUNK: usize = 4_096;
+
+/// Generate random [`Topology`]s
+///
+/// The generation is reproducible: the same `seed` and parameters always
+/// generate the same topology, whatever the number of threads used. The
+/// generators that can be split (everything but Barabási–Albert and the
+/// random regular graphs, that are sequential by nature) run on all the
+/// threads.
+///
+/// The generated topology can be set on the context in one operation with
+/// `SimContext::set_topology`.
+#[derive(Debug, Clone, Copy)]
+pub struct TopologyGenerator {
+    nodes: usize,
+    seed: u64,
+    threads: usize,
+}
+
+impl TopologyGenerator {
+    /// generate topologies of `nodes` nodes
+    ///
+    /// By default all the available threads are used.
+    pub fn new(nodes: usize, seed: u64) -> Self {
+        let threads = thread::available_parallelism()
+            .map(|threads| threads.get())
+            .unwrap_or(1);
+
+        Self {
+            nodes,
+            seed,
+            threads,
+        }
+    }
+
+    pub fn with_threads(self, threads: usize) -> Self {
+        Self {
+            threads: threads.max(1),
+            ..self
+        }
+    }
+
+    /// Erdős–Rényi `G(n, p)`: every pair of nodes is an edge with the
+    /// probability `p`
+    pub fn erdos_renyi(&self, p: f64) -> Result<Topology> {
+        self.check()?;
+        ensure!((0.0..=1.0).contains(&p), "Expecting a probability, got {p}");
+        let n = self.nodes as u64;
+
+        let edges = self.par_chunks(|nodes, rng, edges| {
+            if p == 0.0 {
+                return;
+            }
+            // draw the gaps between two edges rather than testing all the
+            // pairs (Batagelj and Brandes)
+            let log_q = (1.0 - p).ln();
+            for a in nodes {
+                let mut b = a as u64;
+                loop {
+                    let skip = if p == 1.0 {
+                        0
+                    } else {
+                        ((1.0 - rng.next_f64()).ln() / log_q) as u64
+                    };
+                    b = b.saturating_add(skip.saturating_add(1));
+                    if b >= n {
+                        break;
+                    }
+                    edges.push((a as u32, b as u32));
+                }
+            }
+        });
+
+        Ok(Topology::from_pairs(self.nodes, edges))
+    }
+
+    /// Barabási–Albert preferential attachment: every new node attaches to
+    /// `m` existing nodes, chosen proportionally to their degree
+    ///
+    /// The first `m + 1` nodes form a clique.
+    pub fn barabasi_albert(&self, m: usize) -> Result<Topology> {
+        self.check()?;
+        ensure!(m > 0, "Expecting at least one edge per node");
+        ensure!(
+            self.nodes > m,
+            "Expecting more than {m} nodes, got {}",
+            self.nodes
+        );
+        let mut rng = SimRng::new(self.seed);
+
+        let mut edges = Vec::with_capacity(self.nodes * m);
+        // every node appears once per edge: picking uniformly from it
+        // is picking proportionally to the degree
+        let mut endpoints = Vec::with_capacity(2 * self.nodes * m);
+        for a in 0..=m as u32 {
+            for b in a + 1..=m as u32 {
+                edges.push((a, b));
+                endpoints.extend([a, b]);
+            }
+        }
+
+        let mut targets = Vec::with_capacity(m);
+        for a in m as u32 + 1..self.nodes as u32 {
+            targets.clear();
+            while targets.len() < m {
+                let b = endpoints[rng.below(endpoints.len() as u64) as usize];
+                if !targets.contains(&b) {
+                    targets.push(b);
+                }
+            }
+
+            for b in targets.iter().copied() {
+                edges.push((a, b));
+                endpoints.extend([a, b]);
+            }
+        }
+
+        Ok(Topology::from_pairs(self.nodes, edges))
+    }
+
+    /// random `k`-regular graph: every node has exactly `k` neighbours
+    ///
+    /// The stubs of the nodes are paired at random (configuration model),
+    /// the self loops and duplicated edges are then fixed with random edge
+    /// switches.
+    pub fn random_regular(&self, k: usize) -> Result<Topology> {
+        self.check()?;
+        ensure!(
+            k < self.nodes,
+            "Expecting less than {} neighbours per node, got {k}",
+            self.nodes
+        );
+        ensure!(
+            (self.nodes * k) & 1 == 0,
+            "The number of nodes times the degree must be even"
+        );
+        let mut rng = SimRng::new(self.seed);
+
+        let key = |a: u32, b: u32| (a.min(b) as u64) << 32 | a.max(b) as u64;
+        let pair = |key: u64| ((key >> 32) as u32, key as u32);
+
+        let mut stubs: Vec<u32> = (0..self.nodes as u32)
+            .flat_map(|node| (0..k).map(move |_| node))
+            .collect();
+        rng.shuffle(&mut stubs);
+
+        let mut edges = Vec::with_capacity(stubs.len() / 2);
+        let mut existing = HashSet::with_capacity(stubs.len() / 2);
+        let mut invalid = Vec::new();
+        for stub in stubs.chunks_exact(2) {
+            let (a, b) = (stub[0], stub[1]);
+            if a != b && existing.insert(key(a, b)) {
+                edges.push(key(a, b));
+            } else {
+                invalid.push((a, b));
+            }
+        }
+
+        // replace an invalid `a - b` and a valid `c - d` with `a - c` and
+        // `b - d`: the degrees are unchanged
+        let attempts = 1_000 + 100 * self.nodes;
+        for (a, b) in invalid {
+            let mut attempt = 0;
+            loop {
+                if attempt == attempts || edges.is_empty() {
+                    bail!(
+                        "Failed to generate a {k}-regular graph of {} nodes",
+                        self.nodes
+                    )
+                }
+                attempt += 1;
+
+                let index = rng.below(edges.len() as u64) as usize;
+                let (c, d) = pair(edges[index]);
+                let (c, d) = if rng.next_u64() & 1 == 0 {
+                    (c, d)
+                } else {
+                    (d, c)
+                };
+                if a == c
+                    || b == d
+                    || key(a, c) == key(b, d)
+                    || existing.contains(&key(a, c))
+                    || existing.contains(&key(b, d))
+                {
+                    continue;
+                }
+
+                existing.remove(&edges[index]);
+                existing.insert(key(a, c));
+                existing.insert(key(b, d));
+                edges[index] = key(a, c);
+                edges.push(key(b, d));
+                break;
+            }
+        }
+
+        Ok(Topology::from_pairs(
+            self.nodes,
+            edges.into_iter().map(pair).collect(),
+        ))
+    }
+
+    /// Watts–Strogatz small world: a ring where every node is connected to
+    /// its `k` closest nodes (`k / 2` on each side), each edge is then
+    /// rewired to a random node with the probability `beta`
+    ///
+    /// A rewired edge that happens to duplicate an existing edge is merged
+    /// with it.
+    pub fn watts_strogatz(&self, k: usize, beta: f64) -> Result<Topology> {
+        self.check()?;
+        ensure!(
+            k & 1 == 0 && k < self.nodes,
+            "Expecting an even number of neighbours, lower than {}, got {k}",
+            self.nodes
+        );
+        ensure!(
+            (0.0..=1.0).contains(&beta),
+            "Expecting a probability, got {beta}"
+        );
+        let n = self.nodes as u64;
+
+        let edges = self.par_chunks(|nodes, rng, edges| {
+            for a in nodes {
+                let a = a as u64;
+                for offset in 1..=k as u64 / 2 {
+                    let mut b = (a + offset) % n;
+                    if rng.next_f64() < beta {
+                        b = rng.below(n - 1);
+                        if b >= a {
+                            b += 1;
+                        }
+                    }
+                    edges.push((a as u32, b as u32));
+                }
+            }
+        });
+
+        Ok(Topology::from_pairs(self.nodes, edges))
+    }
+
+    /// geographically clustered graph: the nodes are spread amongst
+    /// `clusters` regions of the globe (node `n` is in the cluster
+    /// `n % clusters`) and every node picks `k` random neighbours, from
+    /// its own cluster or with the probability `inter` from any cluster
+    ///
+    /// The latency of every edge is set from the distance between its
+    /// nodes. The locations of the nodes are returned alongside the
+    /// topology (see [`NodePolicy::location`]).
+    ///
+    /// [`NodePolicy::location`]: crate::NodePolicy::location
+    pub fn geo_clustered(
+        &self,
+        clusters: usize,
+        k: usize,
+        inter: f64,
+    ) -> Result<(Topology, Vec<(i64, u64)>)> {
+        self.check()?;
+        ensure!(
+            clusters > 0 && self.nodes >= 2 * clusters,
+            "Expecting at least 2 nodes per cluster"
+        );
+        ensure!(
+            (0.0..=1.0).contains(&inter),
+            "Expecting a probability, got {inter}"
+        );
+        let n = self.nodes as u64;
+        let c = clusters as u64;
+
+        // the centers of the clusters, within the latitudes of the
+        // inhabited world
+        let mut rng = SimRng::new(self.seed);
+        let centers: Vec<(i64, u64)> = (0..clusters)
+            .map(|_| {
+                let latitude = rng.below(120_0000) as i64 - 60_0000;
+                let longitude = 2_0000 + rng.below(176_0000);
+                (latitude, longitude)
+            })
+            .collect();
+        // nodes are within 2 degrees of the center of their cluster
+        let locations: Vec<(i64, u64)> = (0..self.nodes)
+            .map(|node| {
+                let (latitude, longitude) = centers[node % clusters];
+                let latitude = latitude + rng.below(4_0000) as i64 - 2_0000;
+                let longitude = longitude + rng.below(4_0000) - 2_0000;
+                (latitude, longitude)
+            })
+            .collect();
+
+        let edges = self.par_chunks(|nodes, rng, edges| {
+            for a in nodes {
+                let a = a as u64;
+                let cluster = a % c;
+                // the number of nodes in the cluster of `a`
+                let size = (n - cluster).div_ceil(c);
+                for _ in 0..k {
+                    let b = loop {
+                        let b = if rng.next_f64() < inter {
+                            rng.below(n)
+                        } else {
+                            cluster + c * rng.below(size)
+                        };
+                        if b != a {
+                            break b;
+                        }
+                    };
+                    edges.push((a as u32, b as u32));
+                }
+            }
+        });
+
+        let mut topology = Topology::from_pairs(self.nodes, edges);
+        topology.set_edge_policies_with(self.threads, |a, b| {
+            let latency = geo::latency_between_locations(
+                locations[a.into_index()],
+                locations[b.into_index()],
+                1.0,
+            )
+            .unwrap_or(DEFAULT_LATENCY);
+
+            Some(EdgePolicy {
+                latency,
+                ..EdgePolicy::default()
+            })
+        });
+
+        Ok((topology, locations))
+    }
+
+    fn check(&self) -> Result<()> {
+        ensure!(
+            self.nodes < u32::MAX as usize,
+            "A topology supports at most {} nodes",
+            u32::MAX - 1
+        );
+        Ok(())
+    }
+
+    /// generate the edges of the nodes in parallel, by chunks of [`CHUNK`]
+    /// nodes
+    fn par_chunks<F>(&self, generate: F) -> Vec<(u32, u32)>
+    where
+        F: Fn(Range<usize>, &mut SimRng, &mut Vec<(u32, u32)>) + Sync,
+    {
+        let chunks = self.nodes.div_ceil(CHUNK);
+        let threads = self.threads.min(chunks).max(1);
+        let generate = &generate;
+
+        let mut outputs: Vec<Vec<Vec<(u32, u32)>>> = thread::scope(|scope| {
+            let handles: Vec<_> = (0..threads)
+                .map(|thread| {
+                    scope.spawn(move || {
+                        (thread..chunks)
+                            .step_by(threads)
+                            .map(|chunk| {
+                                let start = chunk * CHUNK;
+                                let end = (start + CHUNK).min(self.nodes);
+                                let mut rng = SimRng::stream(self.seed, chunk as u64);
+                                let mut edges = Vec::new();
+                                generate(start..end, &mut rng, &mut edges);
+                                edges
+                            })
+                            .collect()
+                    })
+                })
+                .collect();
+
+            handles
+                .into_iter()
+                .map(|handle| handle.join().expect("topology generator panicked"))
+                .collect()
+        });
+
+        let mut edges = Vec::new();
+        for chunk in 0..chunks {
+            edges.append(&mut outputs[chunk % threads][chunk / threads]);
+        }
+        edges
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::SimId;
+
+    fn degrees(topology: &Topology) -> Vec<usize> {
+        (0..topology.nodes() as u64)
+            .map(|node| topology.degree(SimId::new(node)))
+            .collect()
+    }
+
+    #[test]
+    fn reproducible_across_threads() {
+        let generator = TopologyGenerator::new(10_000, 42);
+
+        let one = generator.with_threads(1).erdos_renyi(0.001).unwrap();
+        let many = generator.with_threads(4).erdos_renyi(0.001).unwrap();
+        assert_eq!(one, many);
+
+        // about `p * n * (n - 1) / 2` edges
+        assert!((45_000..55_000).contains(&one.edges()), "{}", one.edges());
+
+        let other = TopologyGenerator::new(10_000, 43)
+            .erdos_renyi(0.001)
+            .unwrap();
+        assert_ne!(one, other);
+    }
+
+    #[test]
+    fn barabasi_albert() {
+        let topology = TopologyGenerator::new(1_000, 1).barabasi_albert(3).unwrap();
+
+        assert_eq!(topology.edges(), 6 + 3 * (1_000 - 4));
+        let degrees = degrees(&topology);
+        assert!(degrees.iter().all(|degree| *degree >= 3));
+        // preferential attachment grows hubs
+        assert!(*degrees.iter().max().unwrap() > 30);
+    }
+
+    #[test]
+    fn random_regular() {
+        let topology = TopologyGenerator::new(1_001, 1).random_regular(6).unwrap();
+
+        assert!(degrees(&topology).iter().all(|degree| *degree == 6));
+        assert!(TopologyGenerator::new(11, 1).random_regular(3).is_err());
+    }
+
+    #[test]
+    fn watts_strogatz() {
+        let ring = TopologyGenerator::new(100, 1)
+            .watts_strogatz(4, 0.0)
+            .unwrap();
+        assert!(degrees(&ring).iter().all(|degree| *degree == 4));
+        assert!(ring.connected(SimId::new(99), SimId::new(1)));
+
+        let rewired = TopologyGenerator::new(10_000, 1)
+            .watts_strogatz(4, 0.2)
+            .unwrap();
+        // only the rewired edges that collide are merged
+        assert!(rewired.edges() > 19_900 && rewired.edges() <= 20_000);
+        assert!(degrees(&rewired).iter().any(|degree| *degree != 4));
+    }
+
+    #[test]
+    fn geo_clustered() {
+        let (topology, locations) = TopologyGenerator::new(1_000, 1)
+            .geo_clustered(4, 3, 0.0)
+            .unwrap();
+        assert_eq!(locations.len(), 1_000);
+
+        let (a, b) = (
+            SimId::new(0),
+            topology.neighbours(SimId::new(0)).next().unwrap(),
+        );
+        // no inter cluster edges
+        assert_eq!(b.into_index() % 4, 0);
+        let policy = topology.edge_policy(crate::Edge::new((a, b))).unwrap();
+        assert_eq!(
+            Some(policy.latency),
+            geo::latency_between_locations(locations[0], locations[b.into_index()], 1.0)
+        );
+    }
+}
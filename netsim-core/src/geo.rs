@@ -1,8 +1,24 @@
 use crate::Latency;
+use anyhow::{ensure, Result};
+use std::time::Duration;
 
 /// Location using Latitude and Longitude
 pub type Location = (i64, u64);
 
+pub const SPEED_OF_LIGHT: f64 = 299_792_458.0; // meter per second
+const SPEED_OF_FIBER: f64 = SPEED_OF_LIGHT * 0.69; // light travels 31% slower in fiber optics
+
+/// mean radius of the earth in meter
+pub const EARTH_RADIUS: f64 = 6_371_008.8;
+/// standard gravitational parameter of the earth (m³/s²)
+pub const EARTH_MU: f64 = 3.986_004_418e14;
+/// rotation rate of the earth (radian per second)
+pub const EARTH_ROTATION: f64 = 7.292_115_9e-5;
+
+/// A point in space, in an earth centered frame (in meter or, for the
+/// points on the surface of the sphere, in earth radius)
+pub type Point = [f64; 3];
+
 fn location_to_radian((latitude, longitude): (i64, u64)) -> (f64, f64) {
     // latitude is between 90 South and 90 North with a precision of 4 digits
     // longitude is between 0 and 180 degres with a precision of 4 digits
@@ -170,9 +186,6 @@ impl SpheroidDistanceAlgorithm for VincentyInverse {
 }
 
 pub fn latency_between_locations(p1: Location, p2: Location, sol_fo: f64) -> Option<Latency> {
-    const SPEED_OF_LIGHT: f64 = 299_792_458.0; // meter per second
-    const SPEED_OF_FIBER: f64 = SPEED_OF_LIGHT * 0.69; // light travels 31% slower in fiber optics
-
     let sol_fo = if sol_fo < 0.01 {
         0.01
     } else if sol_fo > 1.0 {
@@ -188,3 +201,147 @@ pub fn latency_between_locations(p1: Location, p2: Location, sol_fo: f64) -> Opt
         ))
     })
 }
+
+/// the location on the unit sphere (the earth is approximated by a sphere)
+pub fn unit_point((latitude, longitude): Location) -> Result<Point> {
+    ensure!(
+        (-90_0000..=90_0000).contains(&latitude) && longitude <= 180_0000,
+        "Invalid location: ({latitude}, {longitude})"
+    );
+    let (latitude, longitude) = location_to_radian((latitude, longitude));
+
+    Ok([
+        latitude.cos() * longitude.cos(),
+        latitude.cos() * longitude.sin(),
+        latitude.sin(),
+    ])
+}
+
+/// the unit vector tangent to the unit sphere at `point`, toward the
+/// `heading` (in degrees, clockwise from the north)
+pub fn tangent(point: Point, heading: f64) -> Point {
+    let [x, y, z] = point;
+    let horizontal = x.hypot(y);
+    // the east and north unit vectors (any frame will do at the poles)
+    let (east, north) = if horizontal > 1e-12 {
+        (
+            [-y / horizontal, x / horizontal, 0.0],
+            [-z * x / horizontal, -z * y / horizontal, horizontal],
+        )
+    } else {
+        ([0.0, 1.0, 0.0], [-z.signum(), 0.0, 0.0])
+    };
+    let (sin, cos) = heading.to_radians().sin_cos();
+
+    [0, 1, 2].map(|i| sin * east[i] + cos * north[i])
+}
+
+/// the angle (in radian) between two points of the unit sphere
+#[inline]
+pub fn central_angle(a: Point, b: Point) -> f64 {
+    2.0 * (distance(a, b) / 2.0).min(1.0).asin()
+}
+
+/// the latency of a fiber following the great circle between two points
+/// of the unit sphere
+#[inline]
+pub fn great_circle_latency(a: Point, b: Point) -> Duration {
+    Duration::from_secs_f64(central_angle(a, b) * EARTH_RADIUS / SPEED_OF_FIBER)
+}
+
+/// the straight line distance between two points (in meter)
+#[inline]
+pub fn distance(a: Point, b: Point) -> f64 {
+    ((a[0] - b[0]).powi(2) + (a[1] - b[1]).powi(2) + (a[2] - b[2]).powi(2)).sqrt()
+}
+
+/// the latency of a radio (or laser) link in free space between two
+/// points (in meter)
+#[inline]
+pub fn free_space_latency(a: Point, b: Point) -> Duration {
+    Duration::from_secs_f64(distance(a, b) / SPEED_OF_LIGHT)
+}
+
+/// the elevation (radian) of `target` above the horizon of `observer`,
+/// on the surface of the earth (both in meter)
+#[inline]
+pub fn elevation(observer: Point, target: Point) -> f64 {
+    let range = distance(observer, target);
+    let up = distance(observer, [0.0; 3]);
+    let dot = (0..3)
+        .map(|i| (target[i] - observer[i]) * observer[i])
+        .sum::<f64>();
+
+    (dot / (range * up)).clamp(-1.0, 1.0).asin()
+}
+
+/// the position (meter, earth centered and earth fixed frame) of a
+/// circular orbit after `elapsed` seconds
+///
+/// `radius` is the distance from the center of the earth, the angles (in
+/// radian) are the inclination, the right ascension of the ascending node
+/// and the argument of latitude at the time `0` (the earth fixed frame is
+/// aligned with the inertial frame at the time `0`).
+#[inline]
+pub fn circular_orbit(
+    radius: f64,
+    inclination: f64,
+    ascending_node: f64,
+    phase: f64,
+    elapsed: f64,
+) -> Point {
+    let motion = (EARTH_MU / radius.powi(3)).sqrt();
+    let (sin_u, cos_u) = (phase + motion * elapsed).sin_cos();
+    let (sin_o, cos_o) = (ascending_node - EARTH_ROTATION * elapsed).sin_cos();
+    let (sin_i, cos_i) = inclination.sin_cos();
+
+    [
+        radius * (cos_u * cos_o - sin_u * cos_i * sin_o),
+        radius * (cos_u * sin_o + sin_u * cos_i * cos_o),
+        radius * sin_u * sin_i,
+    ]
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::f64::consts::FRAC_PI_2;
+
+    #[test]
+    fn great_circle() {
+        let (paris, berlin) = ((48_8566, 2_3522), (52_5200, 13_4050));
+
+        // close to the distance on the spheroid
+        let vincenty = distance_between(paris, berlin).unwrap();
+        let angle = central_angle(unit_point(paris).unwrap(), unit_point(berlin).unwrap());
+        assert!((angle * EARTH_RADIUS - vincenty).abs() / vincenty < 0.005);
+
+        // a quarter of the equator going east
+        let start = unit_point((0, 0)).unwrap();
+        let east = tangent(start, 90.0);
+        assert!((east[1] - 1.0).abs() < 1e-12);
+        let north = tangent(start, 0.0);
+        assert!((north[2] - 1.0).abs() < 1e-12);
+
+        assert!(unit_point((90_0001, 0)).is_err());
+    }
+
+    #[test]
+    fn orbit() {
+        let radius = EARTH_RADIUS + 550_000.0;
+        let period = 2.0 * std::f64::consts::PI * (radius.powi(3) / EARTH_MU).sqrt();
+        // about 95 minutes at 550km
+        assert!((period / 60.0 - 95.6).abs() < 0.5);
+
+        // above the equator at the time 0, then above the north pole
+        let start = circular_orbit(radius, FRAC_PI_2, 0.0, 0.0, 0.0);
+        assert!(distance(start, [radius, 0.0, 0.0]) < 1e-6);
+        let pole = circular_orbit(radius, FRAC_PI_2, 0.0, 0.0, period / 4.0);
+        assert!((pole[2] - radius).abs() < 1e-3);
+
+        // straight above the observer
+        let observer = [EARTH_RADIUS, 0.0, 0.0];
+        assert!((elevation(observer, start) - FRAC_PI_2).abs() < 1e-9);
+        assert!(elevation(observer, pole) < 0.0);
+    }
+}
@@ -0,0 +1,726 @@
+/*!
+Import topologies from standard file formats
+
+The files are read in a single pass through a [`BufRead`]: only the
+current line (or XML tag) is held in memory while parsing, on top of the
+nodes and edges of the resulting [`Topology`].
+
+* [`graphml`]: GraphML files, as exported by the Internet Topology Zoo,
+  yEd, networkx, ...;
+* [`brite`]: the output of the BRITE topology generator;
+* [`edge_list`]: CAIDA AS relationships (`<as1>|<as2>|<relationship>`)
+  or any edge list with one edge per line.
+
+The nodes are numbered in the order they appear in the file: the node
+named `names[n]` in the file is the node of [`SimId`] `n` (the `n`-th node
+opened in the context).
+*/
+
+use crate::{
+    geo, lines::for_each_line, Bandwidth, Edge, EdgePolicy, Latency, NodePolicy, SimId, Topology,
+};
+use anyhow::{anyhow, bail, ensure, Context as _, Result};
+use std::{
+    collections::HashMap,
+    fs::File,
+    io::{BufRead, BufReader},
+    path::Path,
+    str::FromStr,
+    time::Duration,
+};
+
+/// the size of the buffer used to read the files
+const BUFFER_SIZE: usize = 1024 * 1024;
+
+/// The formats of the files that can be imported
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Format {
+    GraphMl,
+    Brite,
+    EdgeList,
+}
+
+/// A [`Topology`] imported from a file
+#[derive(Debug, Clone)]
+pub struct ImportedTopology {
+    pub topology: Topology,
+    /// the names of the nodes in the file, indexed by their [`SimId`]
+    pub names: Vec<String>,
+    /// the nodes whose location was ignored: a [`Location`](geo::Location)
+    /// is limited to the longitudes 0 to 180 degrees, the latency of their
+    /// edges is not computed from their location
+    pub unlocated: Vec<SimId>,
+}
+
+/// import the topology from the file at the given `path`
+pub fn file(path: impl AsRef<Path>, format: Format) -> Result<ImportedTopology> {
+    let path = path.as_ref();
+    let file = File::open(path).with_context(|| format!("Failed to open {}", path.display()))?;
+    let reader = BufReader::with_capacity(BUFFER_SIZE, file);
+
+    match format {
+        Format::GraphMl => graphml(reader),
+        Format::Brite => brite(reader),
+        Format::EdgeList => edge_list(reader),
+    }
+    .with_context(|| format!("Failed to import {}", path.display()))
+}
+
+/// import a GraphML topology
+///
+/// The `<data>` of the nodes and edges are mapped onto their policies by
+/// the (case insensitive) `attr.name` of their `<key>`:
+///
+/// * nodes: `bandwidth` (both ways), `bandwidth_up`, `bandwidth_down`,
+///   `latitude` and `longitude` (in degrees);
+/// * edges: `latency` or `delay`, `bandwidth` (both ways), `bandwidth_up`,
+///   `bandwidth_down` and `LinkSpeedRaw` (the Topology Zoo's bandwidth).
+///
+/// Latencies are either durations (`10ms`) or a number of milliseconds,
+/// bandwidths are either `100mbps` or a number of bits per second. The
+/// latency of the edges without one is computed from the location of
+/// their nodes, when known: the locations out of the longitudes 0 to 180
+/// degrees are not supported, their nodes are listed in
+/// [`ImportedTopology::unlocated`]. The other attributes are ignored.
+pub fn graphml<R: BufRead>(mut reader: R) -> Result<ImportedTopology> {
+    let mut builder = Builder::default();
+    let mut keys: HashMap<String, Attribute> = HashMap::new();
+
+    let mut element = Element::None;
+    let mut data: Option<(Attribute, String)> = None;
+
+    let mut text = Vec::new();
+    let mut tag = Vec::new();
+    loop {
+        text.clear();
+        reader.read_until(b'<', &mut text)?;
+        if text.pop() != Some(b'<') {
+            break;
+        }
+        if let Some((_, value)) = data.as_mut() {
+            value.push_str(std::str::from_utf8(&text)?);
+        }
+
+        tag.clear();
+        reader.read_until(b'>', &mut tag)?;
+        if tag.starts_with(b"!--") {
+            while !tag.ends_with(b"-->") {
+                ensure!(
+                    reader.read_until(b'>', &mut tag)? > 0,
+                    "Unterminated comment"
+                );
+            }
+            continue;
+        }
+        ensure!(tag.pop() == Some(b'>'), "Unterminated tag");
+        if tag.starts_with(b"?") || tag.starts_with(b"!") {
+            continue;
+        }
+
+        let tag = Tag::parse(std::str::from_utf8(&tag)?);
+        match (tag.name, tag.closing) {
+            ("key", false) => {
+                let id = tag.attribute("id").context("Expecting an id for the key")?;
+                let attribute = tag
+                    .attribute("attr.name")
+                    .map(|name| Attribute::new(&name))
+                    .unwrap_or(Attribute::Other);
+                keys.insert(id, attribute);
+            }
+            ("node", false) => {
+                let id = tag
+                    .attribute("id")
+                    .context("Expecting an id for the node")?;
+                let node = builder.node(&id);
+                element = if tag.empty {
+                    Element::None
+                } else {
+                    Element::Node(node, NodeAttributes::default())
+                };
+            }
+            ("node", true) => {
+                if let Element::Node(node, attributes) = std::mem::take(&mut element) {
+                    builder.node_attributes(node, attributes);
+                }
+            }
+            ("edge", false) => {
+                let source = tag
+                    .attribute("source")
+                    .context("Expecting an edge source")?;
+                let target = tag
+                    .attribute("target")
+                    .context("Expecting an edge target")?;
+                let a = builder.node(&source);
+                let b = builder.node(&target);
+                if tag.empty {
+                    builder.edge(a, b, EdgeAttributes::default());
+                } else {
+                    element = Element::Edge(a, b, EdgeAttributes::default());
+                }
+            }
+            ("edge", true) => {
+                if let Element::Edge(a, b, attributes) = std::mem::take(&mut element) {
+                    builder.edge(a, b, attributes);
+                }
+            }
+            ("data", false) if !tag.empty => {
+                let key = tag
+                    .attribute("key")
+                    .context("Expecting a key for the data")?;
+                let attribute = keys.get(&key).copied().unwrap_or(Attribute::Other);
+                data = Some((attribute, String::new()));
+            }
+            ("data", true) => {
+                if let Some((attribute, value)) = data.take() {
+                    element.set(attribute, &unescape(&value))?;
+                }
+            }
+            _ => (),
+        }
+    }
+
+    builder.build()
+}
+
+/// import a topology generated by BRITE
+///
+/// The delay (in milliseconds) and the bandwidth (in Mbps) of the edges
+/// are mapped onto their [`EdgePolicy`].
+pub fn brite<R: BufRead>(reader: R) -> Result<ImportedTopology> {
+    #[derive(PartialEq)]
+    enum Section {
+        Header,
+        Nodes,
+        Edges,
+    }
+
+    let mut builder = Builder::default();
+    let mut section = Section::Header;
+
+    for_each_line(reader, |line| {
+        if line.starts_with("Nodes:") {
+            section = Section::Nodes;
+            return Ok(());
+        } else if line.starts_with("Edges:") {
+            section = Section::Edges;
+            return Ok(());
+        }
+
+        let mut fields = line.split_whitespace();
+        match section {
+            Section::Header => (),
+            Section::Nodes => {
+                let id = fields.next().context("Expecting a node id")?;
+                builder.node(id);
+            }
+            Section::Edges => {
+                // <id> <from> <to> <length> <delay> <bandwidth> ...
+                let mut fields = fields.skip(1);
+                let mut field = |name| fields.next().with_context(|| format!("Expecting {name}"));
+                let a = builder.node(field("the edge source")?);
+                let b = builder.node(field("the edge target")?);
+                let _length = field("the edge length")?;
+                let delay: f64 = field("the edge delay")?.parse()?;
+                let bandwidth: f64 = field("the edge bandwidth")?.parse()?;
+
+                let bandwidth = Bandwidth::bits_per_second((bandwidth * 1_024.0 * 1_024.0) as u64);
+                builder.edge(
+                    a,
+                    b,
+                    EdgeAttributes {
+                        latency: Some(milliseconds(delay)?),
+                        bandwidth_up: Some(bandwidth),
+                        bandwidth_down: Some(bandwidth),
+                    },
+                );
+            }
+        }
+        Ok(())
+    })?;
+
+    builder.build()
+}
+
+/// import an edge list: one edge per line, the two nodes separated by a `|`
+/// (CAIDA's AS relationships format) or by white spaces
+///
+/// The fields after the two nodes (the AS relationship, ...) are ignored
+/// as well as the lines starting with `#`.
+pub fn edge_list<R: BufRead>(reader: R) -> Result<ImportedTopology> {
+    let mut builder = Builder::default();
+
+    for_each_line(reader, |line| {
+        let mut fields: Box<dyn Iterator<Item = &str>> = if line.contains('|') {
+            Box::new(line.split('|').map(str::trim))
+        } else {
+            Box::new(line.split_whitespace())
+        };
+
+        let a = fields.next().context("Expecting the edge source")?;
+        let b = fields.next().context("Expecting the edge target")?;
+        let a = builder.node(a);
+        let b = builder.node(b);
+        builder.edge(a, b, EdgeAttributes::default());
+        Ok(())
+    })?;
+
+    builder.build()
+}
+
+/// the topology being imported
+#[derive(Default)]
+struct Builder {
+    ids: HashMap<String, u32>,
+    names: Vec<String>,
+    edges: Vec<(u32, u32)>,
+    edge_attributes: HashMap<usize, EdgeAttributes>,
+    node_policies: HashMap<u32, NodePolicy>,
+    locations: HashMap<u32, (i64, u64)>,
+    unlocated: Vec<u32>,
+}
+
+impl Builder {
+    fn node(&mut self, name: &str) -> u32 {
+        if let Some(id) = self.ids.get(name) {
+            return *id;
+        }
+
+        let id = self.names.len() as u32;
+        self.ids.insert(name.to_owned(), id);
+        self.names.push(name.to_owned());
+        id
+    }
+
+    fn node_attributes(&mut self, node: u32, attributes: NodeAttributes) {
+        let NodeAttributes {
+            bandwidth_up,
+            bandwidth_down,
+            latitude,
+            longitude,
+        } = attributes;
+
+        if bandwidth_up.is_some() || bandwidth_down.is_some() {
+            let default = NodePolicy::default();
+            self.node_policies.insert(
+                node,
+                NodePolicy {
+                    bandwidth_up: bandwidth_up.unwrap_or(default.bandwidth_up),
+                    bandwidth_down: bandwidth_down.unwrap_or(default.bandwidth_down),
+                    location: None,
+                },
+            );
+        }
+
+        // the locations are limited to the longitudes 0 to 180 degrees, the
+        // others are reported in the imported topology
+        if let (Some(latitude), Some(longitude)) = (latitude, longitude) {
+            let latitude = (latitude * 10_000.0).round() as i64;
+            let longitude = (longitude * 10_000.0).round() as i64;
+            if !(-90_0000..=90_0000).contains(&latitude) || !(0..=180_0000).contains(&longitude) {
+                self.unlocated.push(node);
+            } else {
+                let location = (latitude, longitude as u64);
+                self.locations.insert(node, location);
+                if let Some(policy) = self.node_policies.get_mut(&node) {
+                    policy.location = Some(location);
+                } else {
+                    self.node_policies.insert(
+                        node,
+                        NodePolicy {
+                            location: Some(location),
+                            ..NodePolicy::default()
+                        },
+                    );
+                }
+            }
+        }
+    }
+
+    /// add an edge, the edges from a node to itself are ignored
+    fn edge(&mut self, a: u32, b: u32, attributes: EdgeAttributes) {
+        if a == b {
+            return;
+        }
+
+        if attributes != EdgeAttributes::default() {
+            self.edge_attributes.insert(self.edges.len(), attributes);
+        }
+        self.edges.push((a, b));
+    }
+
+    fn build(self) -> Result<ImportedTopology> {
+        let nodes = self.names.len();
+        ensure!(
+            nodes < u32::MAX as usize,
+            "A topology supports at most {} nodes",
+            u32::MAX - 1
+        );
+
+        let mut topology = Topology::from_pairs(nodes, self.edges.clone());
+
+        for (node, policy) in self.node_policies {
+            topology.set_node_policy(SimId::new(node as u64), policy)?;
+        }
+
+        for (index, (a, b)) in self.edges.into_iter().enumerate() {
+            let attributes = self.edge_attributes.get(&index).copied();
+            let location = |node| self.locations.get(&node).copied();
+            let geo_latency = || geo::latency_between_locations(location(a)?, location(b)?, 1.0);
+
+            let latency = attributes.and_then(|attributes| attributes.latency);
+            let latency = latency.or_else(geo_latency);
+            if attributes.is_none() && latency.is_none() {
+                continue;
+            }
+
+            let attributes = attributes.unwrap_or_default();
+            let default = EdgePolicy::default();
+            let policy = EdgePolicy {
+                latency: latency.unwrap_or(default.latency),
+                bandwidth_up: attributes.bandwidth_up.unwrap_or(default.bandwidth_up),
+                bandwidth_down: attributes.bandwidth_down.unwrap_or(default.bandwidth_down),
+                ..default
+            };
+            let edge = Edge::new((SimId::new(a as u64), SimId::new(b as u64)));
+            topology.set_edge_policy(edge, policy)?;
+        }
+
+        let mut unlocated = self.unlocated;
+        unlocated.sort_unstable();
+        unlocated.dedup();
+
+        Ok(ImportedTopology {
+            topology,
+            names: self.names,
+            unlocated: unlocated
+                .into_iter()
+                .map(|node| SimId::new(node as u64))
+                .collect(),
+        })
+    }
+}
+
+#[derive(Debug, Default, Clone, Copy, PartialEq)]
+struct NodeAttributes {
+    bandwidth_up: Option<Bandwidth>,
+    bandwidth_down: Option<Bandwidth>,
+    latitude: Option<f64>,
+    longitude: Option<f64>,
+}
+
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+struct EdgeAttributes {
+    latency: Option<Latency>,
+    bandwidth_up: Option<Bandwidth>,
+    bandwidth_down: Option<Bandwidth>,
+}
+
+/// the GraphML element whose data are being read
+#[derive(Default)]
+enum Element {
+    #[default]
+    None,
+    Node(u32, NodeAttributes),
+    Edge(u32, u32, EdgeAttributes),
+}
+
+/// the attributes of the nodes and edges known to the GraphML importer
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Attribute {
+    Latency,
+    Bandwidth,
+    BandwidthUp,
+    BandwidthDown,
+    Latitude,
+    Longitude,
+    Other,
+}
+
+impl Attribute {
+    fn new(name: &str) -> Self {
+        match name.to_ascii_lowercase().as_str() {
+            "latency" | "delay" => Self::Latency,
+            "bandwidth" | "linkspeedraw" => Self::Bandwidth,
+            "bandwidth_up" => Self::BandwidthUp,
+            "bandwidth_down" => Self::BandwidthDown,
+            "latitude" => Self::Latitude,
+            "longitude" => Self::Longitude,
+            _ => Self::Other,
+        }
+    }
+}
+
+impl Element {
+    fn set(&mut self, attribute: Attribute, value: &str) -> Result<()> {
+        let value = value.trim();
+        match (self, attribute) {
+            (_, Attribute::Other) | (Self::None, _) => (),
+            (Self::Node(_, node), attribute) => match attribute {
+                Attribute::Bandwidth => {
+                    node.bandwidth_up = Some(bandwidth(value)?);
+                    node.bandwidth_down = node.bandwidth_up;
+                }
+                Attribute::BandwidthUp => node.bandwidth_up = Some(bandwidth(value)?),
+                Attribute::BandwidthDown => node.bandwidth_down = Some(bandwidth(value)?),
+                Attribute::Latitude => node.latitude = Some(value.parse()?),
+                Attribute::Longitude => node.longitude = Some(value.parse()?),
+                Attribute::Latency | Attribute::Other => (),
+            },
+            (Self::Edge(_, _, edge), attribute) => match attribute {
+                Attribute::Latency => edge.latency = Some(latency(value)?),
+                Attribute::Bandwidth => {
+                    edge.bandwidth_up = Some(bandwidth(value)?);
+                    edge.bandwidth_down = edge.bandwidth_up;
+                }
+                Attribute::BandwidthUp => edge.bandwidth_up = Some(bandwidth(value)?),
+                Attribute::BandwidthDown => edge.bandwidth_down = Some(bandwidth(value)?),
+                Attribute::Latitude | Attribute::Longitude | Attribute::Other => (),
+            },
+        }
+        Ok(())
+    }
+}
+
+/// an XML tag, without its `<` and `>`
+struct Tag<'a> {
+    name: &'a str,
+    attributes: &'a str,
+    /// `</name>`
+    closing: bool,
+    /// `<name/>`
+    empty: bool,
+}
+
+impl<'a> Tag<'a> {
+    fn parse(tag: &'a str) -> Self {
+        let (closing, tag) = match tag.strip_prefix('/') {
+            Some(tag) => (true, tag),
+            None => (false, tag),
+        };
+        let (empty, tag) = match tag.strip_suffix('/') {
+            Some(tag) => (true, tag),
+            None => (false, tag),
+        };
+        let (name, attributes) = tag
+            .split_once(|c: char| c.is_ascii_whitespace())
+            .unwrap_or((tag, ""));
+
+        Self {
+            name,
+            attributes,
+            closing,
+            empty,
+        }
+    }
+
+    fn attribute(&self, key: &str) -> Option<String> {
+        let mut rest = self.attributes;
+        loop {
+            let (name, value) = rest.split_once('=')?;
+            let value = value.trim_start();
+            let quote = value.chars().next().filter(|c| *c == '"' || *c == '\'')?;
+            let (value, after) = value[quote.len_utf8()..].split_once(quote)?;
+            if name.trim() == key {
+                return Some(unescape(value));
+            }
+            rest = after;
+        }
+    }
+}
+
+fn unescape(value: &str) -> String {
+    if !value.contains('&') {
+        return value.to_owned();
+    }
+
+    value
+        .replace("&lt;", "<")
+        .replace("&gt;", ">")
+        .replace("&quot;", "\"")
+        .replace("&apos;", "'")
+        .replace("&amp;", "&")
+}
+
+/// parse a latency: a duration (`10ms`) or a number of milliseconds
+fn latency(value: &str) -> Result<Latency> {
+    match value.parse::<f64>() {
+        Ok(value) => milliseconds(value),
+        Err(_) => Latency::from_str(value),
+    }
+}
+
+fn milliseconds(value: f64) -> Result<Latency> {
+    ensure!(
+        value.is_finite() && value >= 0.0,
+        "Invalid latency: {value}ms"
+    );
+    Ok(Latency::new(Duration::from_secs_f64(value / 1_000.0)))
+}
+
+/// parse a bandwidth: `100mbps` or a number of bits per second
+fn bandwidth(value: &str) -> Result<Bandwidth> {
+    match value.parse::<f64>() {
+        Ok(bits) if bits.is_finite() && bits >= 0.0 => {
+            Ok(Bandwidth::bits_per_second(bits.round() as u64))
+        }
+        Ok(bits) => bail!("Invalid bandwidth: {bits}bps"),
+        Err(_) => Bandwidth::from_str(value).map_err(|error| anyhow!("{error}: {value}")),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn id(id: u64) -> SimId {
+        SimId::new(id)
+    }
+
+    #[test]
+    fn import_graphml() {
+        const GRAPHML: &str = r#"<?xml version="1.0" encoding="utf-8"?>
+<graphml xmlns="http://graphml.graphdrawing.org/xmlns">
+  <key attr.name="Latitude" attr.type="double" for="node" id="d0" />
+  <key attr.name="Longitude" attr.type="double" for="node" id="d1" />
+  <key attr.name="LinkSpeedRaw" attr.type="double" for="edge" id="d2" />
+  <key attr.name="delay" attr.type="string" for="edge" id="d3" />
+  <key attr.name="label" attr.type="string" for="node" id="d4" />
+  <graph edgedefault="undirected">
+    <!-- <node id="ignored"/> -->
+    <node id="paris">
+      <data key="d0">48.85</data>
+      <data key="d1">2.35</data>
+      <data key="d4">Paris &amp; co</data>
+    </node>
+    <node id="berlin">
+      <data key="d0">52.52</data>
+      <data key="d1">13.40</data>
+    </node>
+    <node id="madrid"/>
+    <edge source="paris" target="berlin">
+      <data key="d2">10000000.0</data>
+    </edge>
+    <edge source="paris" target="madrid"><data key="d3">12.5</data></edge>
+    <edge source="madrid" target="london"/>
+  </graph>
+</graphml>
+"#;
+
+        let ImportedTopology {
+            topology,
+            names,
+            unlocated,
+        } = graphml(GRAPHML.as_bytes()).unwrap();
+        assert_eq!(names, ["paris", "berlin", "madrid", "london"]);
+        assert!(unlocated.is_empty());
+        assert_eq!(topology.edges(), 3);
+        assert!(topology.connected(id(2), id(3)));
+
+        let paris = topology.node_policy(id(0)).unwrap();
+        assert_eq!(paris.location, Some((48_8500, 2_3500)));
+        assert!(topology.node_policy(id(2)).is_none());
+
+        // the latency is computed from the locations
+        let policy = topology.edge_policy(Edge::new((id(0), id(1)))).unwrap();
+        assert_eq!(policy.bandwidth_up, Bandwidth::bits_per_second(10_000_000));
+        assert_eq!(
+            Some(policy.latency),
+            geo::latency_between_locations((48_8500, 2_3500), (52_5200, 13_4000), 1.0)
+        );
+
+        let policy = topology.edge_policy(Edge::new((id(0), id(2)))).unwrap();
+        assert_eq!(policy.latency, milliseconds(12.5).unwrap());
+        assert!(topology.edge_policy(Edge::new((id(2), id(3)))).is_none());
+    }
+
+    #[test]
+    fn import_graphml_malformed() {
+        // the values of the attributes must be quoted
+        for node in [
+            r#"<node id=é/>"#,
+            r#"<node id=paris/>"#,
+            r#"<node id="paris/>"#,
+        ] {
+            let document = format!(r#"<graphml><graph>{node}</graph></graphml>"#);
+            assert!(graphml(document.as_bytes()).is_err(), "{node}");
+        }
+
+        let tag = Tag::parse("node id='paris'");
+        assert_eq!(tag.attribute("id").as_deref(), Some("paris"));
+    }
+
+    #[test]
+    fn import_graphml_unlocated() {
+        const GRAPHML: &str = r#"<graphml>
+  <key attr.name="Latitude" for="node" id="d0" />
+  <key attr.name="Longitude" for="node" id="d1" />
+  <graph>
+    <node id="paris"><data key="d0">48.85</data><data key="d1">2.35</data></node>
+    <node id="new york"><data key="d0">40.71</data><data key="d1">-74.01</data></node>
+    <node id="pole"><data key="d0">91</data><data key="d1">0</data></node>
+    <edge source="paris" target="new york"/>
+    <edge source="paris" target="pole"/>
+  </graph>
+</graphml>
+"#;
+
+        let imported = graphml(GRAPHML.as_bytes()).unwrap();
+        assert_eq!(imported.unlocated, [id(1), id(2)]);
+        assert!(imported.topology.node_policy(id(1)).is_none());
+        let edge = Edge::new((id(0), id(1)));
+        assert!(imported.topology.edge_policy(edge).is_none());
+    }
+
+    #[test]
+    fn import_brite() {
+        const BRITE: &str = "Topology: ( 3 Nodes, 2 Edges )
+Model (1 - RTWaxman):  3 100 10 1  2  0.15000000596046448 0.20000000298023224 1 1 10.0 1024.0
+
+Nodes: ( 3 )
+0	21.00	93.00	2	2	-1	RT_NODE
+1	48.00	55.00	2	2	-1	RT_NODE
+2	85.00	6.00	2	2	-1	RT_NODE
+
+Edges: ( 2 ):
+0	2	1	68.93	0.23	10.0	-1	-1	E_RT	U
+1	0	1	47.20	0.16	1.5	-1	-1	E_RT	U
+";
+
+        let ImportedTopology {
+            topology, names, ..
+        } = brite(BRITE.as_bytes()).unwrap();
+        assert_eq!(names, ["0", "1", "2"]);
+        assert_eq!(topology.edges(), 2);
+
+        let policy = topology.edge_policy(Edge::new((id(1), id(2)))).unwrap();
+        assert_eq!(policy.latency, milliseconds(0.23).unwrap());
+        let delay = policy.latency.to_duration().as_secs_f64();
+        assert!((delay - 0.000_23).abs() < 1e-9);
+        assert_eq!(
+            policy.bandwidth_down,
+            Bandwidth::bits_per_second(10 * 1_024 * 1_024)
+        );
+    }
+
+    #[test]
+    fn import_edge_list() {
+        const CAIDA: &str = "# source:topology|BGP
+1|11537|0|bgp
+1|21616|-1|bgp
+11537|1|0|bgp
+21616|21616|-1|bgp
+";
+
+        let ImportedTopology {
+            topology, names, ..
+        } = edge_list(CAIDA.as_bytes()).unwrap();
+        assert_eq!(names, ["1", "11537", "21616"]);
+        assert_eq!(topology.edges(), 2);
+        assert!(!topology.connected(id(1), id(2)));
+
+        let ImportedTopology { topology, .. } = edge_list("a b\nb c\n".as_bytes()).unwrap();
+        assert_eq!(topology.edges(), 2);
+
+        assert!(edge_list("a\n".as_bytes()).is_err());
+    }
+}
@@ -0,0 +1,28 @@
+//! Instrumentation of the multiplexer, compiled out unless enabled
+//!
+//! * the `tracing` feature enters [`tracing`] spans (at the `TRACE` level)
+//!   around the work of the multiplexer;
+//! * the `usdt` feature places USDT probes (provider `netsim`) where the
+//!   messages are enqueued, delivered and dropped, to be attached with
+//!   `bpftrace` or `perf`. A detached probe is a `nop`: its arguments are
+//!   only evaluated once attached.
+//!
+//! Without the features the macros expand to nothing.
+//!
+//! [`tracing`]: https://docs.rs/tracing
+
+/// enter a span for the rest of the enclosing scope
+macro_rules! span {
+    ($name:literal $(, $field:ident = $value:expr)* $(,)?) => {
+        #[cfg(feature = "tracing")]
+        let _span = ::tracing::trace_span!($name $(, $field = $value)*).entered();
+    };
+}
+
+/// fire the USDT probe `netsim:$name`, the arguments are integers
+macro_rules! usdt {
+    ($name:ident $(, $arg:expr)* $(,)?) => {
+        #[cfg(feature = "usdt")]
+        ::probe::probe_lazy!(netsim, $name $(, $arg)*);
+    };
+}
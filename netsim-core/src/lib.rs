@@ -1,47 +1,187 @@
+// the macros are declared first to be visible in all the modules
+#[macro_use]
+mod instrument;
+
 mod bus;
+mod clock;
 mod congestion_queue;
+mod constellation;
 pub mod defaults;
+mod distribution;
+mod event;
+mod failure;
+mod generator;
 mod geo;
+pub mod import;
+mod lines;
+mod mobility;
 mod msg;
 mod policy;
+mod propagation;
+mod relay;
+mod rng;
+mod segment;
 pub mod sim_context;
 mod sim_id;
+mod stream;
 pub mod time;
+mod timer;
+mod topology;
+mod trace;
+mod utilisation;
 
-use std::time::Duration;
+use std::{
+    sync::mpsc,
+    thread::{self, JoinHandle},
+    time::Duration,
+};
 
-use defaults::DEFAULT_IDLE;
+use defaults::{DEFAULT_IDLE, DEFAULT_PROPAGATION_EXPIRY};
 
 pub use self::{
     bus::BusSender,
-    msg::{HasBytesSize, Msg},
+    clock::SimClock,
+    constellation::{Constellation, Orbit},
+    distribution::LatencyDistribution,
+    event::{SendCompletion, SimEvent},
+    failure::{FailureProcess, Lifetime},
+    generator::TopologyGenerator,
+    geo::Location,
+    mobility::Movement,
+    msg::{HasBytesSize, Msg, MsgId, MsgMeta, Phantom},
     policy::{Bandwidth, Edge, EdgePolicy, Latency, NodePolicy, PacketLoss, Policy},
+    propagation::{Delivery, PropagationReport},
+    relay::Relay,
+    segment::Segment,
     sim_id::SimId,
+    stream::{StreamId, StreamReader, StreamWriter, SEGMENT_SIZE},
+    timer::Timer,
+    topology::Topology,
+    trace::{CapacityTrace, DelayTrace, EdgeTrace, MAHIMAHI_PACKET_SIZE},
+    utilisation::UtilisationSampler,
 };
 
+/// What to do with the content of the messages dropped by the network
+///
+/// Either a handler called by the multiplexer with every dropped message
+/// (see [`OnDrop::new`]), or a handler given the messages dropped during a
+/// step of the multiplexer on a dedicated thread (see [`OnDrop::batched`]).
 pub struct OnDrop<T> {
-    on_drop: extern "C" fn(T),
+    handler: Handler<T>,
+}
+
+enum Handler<T> {
+    Call(extern "C" fn(T)),
+    Closure(Box<dyn FnMut(T) + Send>),
+    Batch {
+        /// the values dropped during the current step
+        buffer: Vec<T>,
+        sender: Option<mpsc::Sender<Vec<T>>>,
+        dispatcher: Option<JoinHandle<()>>,
+    },
 }
+
 impl<T> OnDrop<T> {
-    pub(crate) fn handle(&self, value: T) {
-        (self.on_drop)(value)
+    pub(crate) fn handle(&mut self, value: T) {
+        match &mut self.handler {
+            Handler::Call(on_drop) => on_drop(value),
+            Handler::Closure(on_drop) => on_drop(value),
+            Handler::Batch { buffer, .. } => buffer.push(value),
+        }
+    }
+
+    /// hand the values dropped during the step over to the dispatcher
+    pub(crate) fn flush(&mut self) {
+        if let Handler::Batch {
+            buffer,
+            sender: Some(sender),
+            ..
+        } = &mut self.handler
+        {
+            if !buffer.is_empty() {
+                let _ = sender.send(std::mem::take(buffer));
+            }
+        }
+    }
+}
+impl<T> OnDrop<T>
+where
+    T: Send + 'static,
+{
+    /// `handler` is called by the multiplexer with every dropped value
+    pub fn new<F>(handler: F) -> Self
+    where
+        F: FnMut(T) + Send + 'static,
+    {
+        Self {
+            handler: Handler::Closure(Box::new(handler)),
+        }
+    }
+
+    /// the dropped values are collected by the multiplexer and given to
+    /// `handler` in batches, once per step, on a dedicated thread: a slow
+    /// handler (freeing the messages) does not slow down the simulation
+    pub fn batched<F>(mut handler: F) -> Self
+    where
+        F: FnMut(Vec<T>) + Send + 'static,
+    {
+        let (sender, receiver) = mpsc::channel::<Vec<T>>();
+        let dispatcher = thread::spawn(move || {
+            for batch in receiver {
+                handler(batch)
+            }
+        });
+
+        Self {
+            handler: Handler::Batch {
+                buffer: Vec::new(),
+                sender: Some(sender),
+                dispatcher: Some(dispatcher),
+            },
+        }
     }
 }
 impl<T> From<extern "C" fn(T)> for OnDrop<T> {
     fn from(value: extern "C" fn(T)) -> Self {
-        Self { on_drop: value }
+        Self {
+            handler: Handler::Call(value),
+        }
     }
 }
-unsafe impl<T> Send for OnDrop<T> {}
 impl<T> Drop for OnDrop<T> {
     fn drop(&mut self) {
-        // Do nothing, this is a pointer that is expected to live all the way
+        // the function is a pointer that is expected to live all the way,
+        // the batches are all handled before the multiplexer stops
+        self.flush();
+        if let Handler::Batch {
+            sender, dispatcher, ..
+        } = &mut self.handler
+        {
+            sender.take();
+            if let Some(dispatcher) = dispatcher.take() {
+                let _ = dispatcher.join();
+            }
+        }
     }
 }
 
 pub struct SimConfiguration<T> {
     pub policy: policy::Policy,
 
+    /// called with the content of the messages dropped by the network
+    /// instead of being delivered:
+    ///
+    /// * the messages cancelled by their sender;
+    /// * the messages that missed their deadline;
+    /// * the messages sent on an edge that is down (see
+    ///   [`FailureProcess`]);
+    /// * the messages between nodes that are not neighbours in the
+    ///   [`Topology`], or between satellites of the [`Constellation`]
+    ///   without a line of sight;
+    /// * the broadcasts of a node that is not a member of the segment, or
+    ///   on a segment removed while they were in flight (see [`Segment`]);
+    /// * the messages of the propagations consumed by the nodes that
+    ///   relay them (see [`Relay`]), the first delivery and the duplicates.
     pub on_drop: Option<OnDrop<T>>,
 
     /// set the maximum IDLE duration time. This is the time the Multiplexer
@@ -70,6 +210,16 @@ pub struct SimConfiguration<T> {
     /// The default settings should allow for hundreds of nodes to work with a
     /// submilliseconds granularity precision on a recent computer.
     pub idle_duration: Duration,
+
+    /// how long the propagations (see `SimSocket::send_to_tracked`) that
+    /// never complete are followed after their start, `None` to follow
+    /// them until the end of the simulation
+    ///
+    /// An expired propagation is no longer reported and its late messages
+    /// are delivered to the nodes as any other message (the relays no
+    /// longer consume them). By default the value is set to
+    /// [DEFAULT_PROPAGATION_EXPIRY].
+    pub propagation_expiry: Option<Duration>,
 }
 
 impl<T> Default for SimConfiguration<T> {
@@ -78,6 +228,33 @@ impl<T> Default for SimConfiguration<T> {
             policy: policy::Policy::new(),
             on_drop: None,
             idle_duration: DEFAULT_IDLE,
+            propagation_expiry: Some(DEFAULT_PROPAGATION_EXPIRY),
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::{Arc, Mutex};
+
+    #[test]
+    fn on_drop_batched() {
+        let batches = Arc::new(Mutex::new(Vec::new()));
+        let mut on_drop = OnDrop::batched({
+            let batches = Arc::clone(&batches);
+            move |batch: Vec<u32>| batches.lock().unwrap().push(batch)
+        });
+
+        on_drop.handle(1);
+        on_drop.handle(2);
+        on_drop.flush();
+        // nothing to hand over
+        on_drop.flush();
+        on_drop.handle(3);
+        // the last batch is handled before the drop returns
+        drop(on_drop);
+
+        assert_eq!(*batches.lock().unwrap(), vec![vec![1, 2], vec![3]]);
+    }
+}
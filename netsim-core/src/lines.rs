@@ -0,0 +1,47 @@
+use anyhow::{bail, Context as _, Result};
+use std::{
+    fs::File,
+    io::{BufRead, BufReader},
+    path::Path,
+};
+
+/// call `f` with every line of the reader, but the empty lines and the
+/// comments (starting with `#`)
+///
+/// The lines are read one at a time, the errors are reported with the
+/// number of the line.
+pub(crate) fn for_each_line<R, F>(mut reader: R, mut f: F) -> Result<()>
+where
+    R: BufRead,
+    F: FnMut(&str) -> Result<()>,
+{
+    let mut line = String::new();
+    let mut number = 0;
+    loop {
+        line.clear();
+        if reader.read_line(&mut line)? == 0 {
+            return Ok(());
+        }
+        number += 1;
+
+        let line = line.trim();
+        if line.is_empty() || line.starts_with('#') {
+            continue;
+        }
+        f(line).with_context(|| format!("Failed to parse line {number}: {line}"))?;
+    }
+}
+
+/// split a `<key>,<value>` row of a CSV file
+pub(crate) fn split_row(line: &str) -> Result<(&str, &str)> {
+    let Some((key, value)) = line.split_once(',') else {
+        bail!("Expecting a `<key>,<value>` row")
+    };
+    Ok((key.trim(), value.trim()))
+}
+
+pub(crate) fn open(path: &Path) -> Result<BufReader<File>> {
+    File::open(path)
+        .map(BufReader::new)
+        .with_context(|| format!("Failed to open {}", path.display()))
+}
@@ -0,0 +1,400 @@
+use crate::{
+    defaults::DEFAULT_MOBILITY_INTERVAL,
+    geo::{self, Location, Point, EARTH_RADIUS},
+    SimId,
+};
+use anyhow::{ensure, Result};
+use std::{
+    collections::HashMap,
+    f64::consts::PI,
+    time::{Duration, Instant},
+};
+
+/// the central angle (radian) under which two waypoints are too close to
+/// antipodal to interpolate between them (about 6 meters)
+const ANTIPODAL: f64 = 1e-6;
+
+/// How a node moves, see `SimContext::set_node_movement`
+///
+/// The nodes move on the surface of the earth (approximated by a sphere)
+/// following the great circles.
+#[derive(Debug, Clone, PartialEq)]
+pub enum Movement {
+    /// the node does not move, but its latencies to the moving nodes are
+    /// computed from its location
+    Fixed(Location),
+    /// the node goes from waypoint to waypoint at `speed` (meter per
+    /// second), back to the first waypoint after the last one (two
+    /// consecutive waypoints cannot be antipodal)
+    Waypoints {
+        waypoints: Vec<Location>,
+        speed: f64,
+    },
+    /// the node goes straight ahead from `start` toward `heading` (degrees,
+    /// clockwise from the north) at `speed` (meter per second)
+    Velocity {
+        start: Location,
+        heading: f64,
+        speed: f64,
+    },
+}
+
+/// A [`Movement`] prepared for the multiplexer
+#[derive(Debug, Clone, PartialEq)]
+pub(crate) enum Track {
+    Fixed(Point),
+    Tour(Tour),
+    Straight {
+        start: Point,
+        tangent: Point,
+        /// radian per second
+        rate: f64,
+    },
+}
+
+#[derive(Debug, Clone, PartialEq)]
+pub(crate) struct Tour {
+    /// the waypoints, the first one repeated at the end
+    points: Box<[Point]>,
+    /// the angle travelled (radian) when reaching each waypoint
+    angles: Box<[f64]>,
+    /// radian per second
+    rate: f64,
+}
+
+/// The positions of the moving nodes
+///
+/// The positions are updated in batch, at most once per `interval`: the
+/// nodes going straight ahead (the most common case) are kept in flat
+/// arrays so the update is a tight loop over them, the fixed nodes are
+/// never updated. The latency of an edge is computed from the positions
+/// when a message is sent, so only the edges actually used cost some work.
+#[derive(Debug, Clone, PartialEq)]
+pub(crate) struct Mobility {
+    interval: Duration,
+    /// the reference of the times below
+    epoch: Option<Instant>,
+    /// the time of the last update of the positions
+    updated: f64,
+
+    slots: HashMap<SimId, usize>,
+    /// the slots of the removed nodes
+    free: Vec<usize>,
+    /// the positions, by slot
+    x: Vec<f64>,
+    y: Vec<f64>,
+    z: Vec<f64>,
+
+    straight: Straight,
+    tours: Vec<(usize, Tour, f64)>,
+}
+
+/// the nodes going straight ahead (see [`Track::Straight`])
+#[derive(Debug, Default, Clone, PartialEq)]
+struct Straight {
+    slots: Vec<usize>,
+    start: [Vec<f64>; 3],
+    tangent: [Vec<f64>; 3],
+    rate: Vec<f64>,
+    since: Vec<f64>,
+}
+
+impl Movement {
+    pub(crate) fn track(&self) -> Result<Track> {
+        let rate = |speed: f64| -> Result<f64> {
+            ensure!(
+                speed >= 0.0 && speed.is_finite(),
+                "Invalid speed: {speed}m/s"
+            );
+            Ok(speed / EARTH_RADIUS)
+        };
+
+        match self {
+            Self::Fixed(location) => Ok(Track::Fixed(geo::unit_point(*location)?)),
+            Self::Waypoints { waypoints, speed } => {
+                ensure!(!waypoints.is_empty(), "Expecting at least one waypoint");
+                let mut points = waypoints
+                    .iter()
+                    .map(|location| geo::unit_point(*location))
+                    .collect::<Result<Vec<_>>>()?;
+                points.push(points[0]);
+
+                let mut angle = 0.0;
+                let mut angles = vec![0.0];
+                for window in points.windows(2) {
+                    let leg = geo::central_angle(window[0], window[1]);
+                    // there is no single great circle between antipodal
+                    // points to follow
+                    ensure!(
+                        leg < PI - ANTIPODAL,
+                        "Consecutive waypoints cannot be antipodal"
+                    );
+                    angle += leg;
+                    angles.push(angle);
+                }
+
+                Ok(Track::Tour(Tour {
+                    points: points.into(),
+                    angles: angles.into(),
+                    rate: rate(*speed)?,
+                }))
+            }
+            Self::Velocity {
+                start,
+                heading,
+                speed,
+            } => {
+                ensure!(heading.is_finite(), "Invalid heading: {heading}");
+                let start = geo::unit_point(*start)?;
+
+                Ok(Track::Straight {
+                    start,
+                    tangent: geo::tangent(start, *heading),
+                    rate: rate(*speed)?,
+                })
+            }
+        }
+    }
+}
+
+impl Tour {
+    /// the position after `elapsed` seconds
+    fn position(&self, elapsed: f64) -> Point {
+        let total = self.angles[self.angles.len() - 1];
+        if total <= 0.0 {
+            return self.points[0];
+        }
+
+        let angle = (self.rate * elapsed) % total;
+        let leg = self.angles.partition_point(|a| *a <= angle).max(1) - 1;
+        let (a, b) = (self.points[leg], self.points[leg + 1]);
+        let length = self.angles[leg + 1] - self.angles[leg];
+        if length <= 0.0 {
+            return a;
+        }
+
+        // spherical interpolation along the leg
+        let travelled = angle - self.angles[leg];
+        let sin = length.sin();
+        let (wa, wb) = ((length - travelled).sin() / sin, travelled.sin() / sin);
+        [0, 1, 2].map(|i| wa * a[i] + wb * b[i])
+    }
+}
+
+impl Mobility {
+    pub fn new() -> Self {
+        Self {
+            interval: DEFAULT_MOBILITY_INTERVAL,
+            epoch: None,
+            updated: 0.0,
+            slots: HashMap::new(),
+            free: Vec::new(),
+            x: Vec::new(),
+            y: Vec::new(),
+            z: Vec::new(),
+            straight: Straight::default(),
+            tours: Vec::new(),
+        }
+    }
+
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.slots.is_empty()
+    }
+
+    pub fn set_interval(&mut self, interval: Duration) {
+        self.interval = interval;
+    }
+
+    /// the seconds since the epoch
+    fn seconds(&mut self, time: Instant) -> f64 {
+        let epoch = *self.epoch.get_or_insert(time);
+        time.saturating_duration_since(epoch).as_secs_f64()
+    }
+
+    /// the node starts following the track at the given `time`
+    pub fn set(&mut self, time: Instant, node: SimId, track: Track) {
+        self.reset(node);
+        let now = self.seconds(time);
+
+        let slot = match self.free.pop() {
+            Some(slot) => slot,
+            None => {
+                self.x.push(0.0);
+                self.y.push(0.0);
+                self.z.push(0.0);
+                self.x.len() - 1
+            }
+        };
+        self.slots.insert(node, slot);
+
+        let position = match track {
+            Track::Fixed(point) => point,
+            Track::Tour(tour) => {
+                let position = tour.position(0.0);
+                self.tours.push((slot, tour, now));
+                position
+            }
+            Track::Straight {
+                start,
+                tangent,
+                rate,
+            } => {
+                let straight = &mut self.straight;
+                straight.slots.push(slot);
+                for i in 0..3 {
+                    straight.start[i].push(start[i]);
+                    straight.tangent[i].push(tangent[i]);
+                }
+                straight.rate.push(rate);
+                straight.since.push(now);
+                start
+            }
+        };
+        [self.x[slot], self.y[slot], self.z[slot]] = position;
+    }
+
+    /// the node no longer moves (nor has a position)
+    pub fn reset(&mut self, node: SimId) {
+        let Some(slot) = self.slots.remove(&node) else {
+            return;
+        };
+        self.free.push(slot);
+
+        self.tours.retain(|(s, _, _)| *s != slot);
+        let straight = &mut self.straight;
+        if let Some(i) = straight.slots.iter().position(|s| *s == slot) {
+            straight.slots.swap_remove(i);
+            for j in 0..3 {
+                straight.start[j].swap_remove(i);
+                straight.tangent[j].swap_remove(i);
+            }
+            straight.rate.swap_remove(i);
+            straight.since.swap_remove(i);
+        }
+    }
+
+    /// update the positions if the last update is older than the interval
+    pub fn update(&mut self, time: Instant) {
+        if self.is_empty() {
+            return;
+        }
+        let now = self.seconds(time);
+        if now - self.updated < self.interval.as_secs_f64() {
+            return;
+        }
+        self.updated = now;
+
+        let Straight {
+            slots,
+            start: [sx, sy, sz],
+            tangent: [tx, ty, tz],
+            rate,
+            since,
+        } = &self.straight;
+        for i in 0..slots.len() {
+            let (sin, cos) = (rate[i] * (now - since[i])).sin_cos();
+            let slot = slots[i];
+            self.x[slot] = cos * sx[i] + sin * tx[i];
+            self.y[slot] = cos * sy[i] + sin * ty[i];
+            self.z[slot] = cos * sz[i] + sin * tz[i];
+        }
+
+        for (slot, tour, since) in self.tours.iter() {
+            [self.x[*slot], self.y[*slot], self.z[*slot]] = tour.position(now - since);
+        }
+    }
+
+    #[inline]
+    pub fn position(&self, node: SimId) -> Option<Point> {
+        let slot = *self.slots.get(&node)?;
+        Some([self.x[slot], self.y[slot], self.z[slot]])
+    }
+}
+
+/// the positions are never NaN (the tracks are validated)
+impl Eq for Mobility {}
+
+impl Default for Mobility {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn straight() {
+        let time = Instant::now();
+        let node = SimId::new(0);
+        // a quarter of the equator in 10s
+        let speed = EARTH_RADIUS * std::f64::consts::FRAC_PI_2 / 10.0;
+
+        let mut mobility = Mobility::new();
+        let movement = Movement::Velocity {
+            start: (0, 0),
+            heading: 90.0,
+            speed,
+        };
+        mobility.set(time, node, movement.track().unwrap());
+        assert_eq!(mobility.position(node), Some([1.0, 0.0, 0.0]));
+
+        // not updated before the end of the interval
+        mobility.update(time + Duration::from_millis(50));
+        assert_eq!(mobility.position(node), Some([1.0, 0.0, 0.0]));
+
+        mobility.update(time + Duration::from_secs(10));
+        let [x, y, z] = mobility.position(node).unwrap();
+        assert!(x.abs() < 1e-9 && (y - 1.0).abs() < 1e-9 && z.abs() < 1e-9);
+
+        mobility.reset(node);
+        assert!(mobility.is_empty());
+        assert_eq!(mobility.position(node), None);
+    }
+
+    #[test]
+    fn waypoints() {
+        let time = Instant::now();
+        let node = SimId::new(3);
+        let (a, b) = ((0, 0), (0, 90_0000));
+        // a quarter of the equator in 1s, back to `a` in 2s
+        let speed = EARTH_RADIUS * std::f64::consts::FRAC_PI_2;
+        let movement = Movement::Waypoints {
+            waypoints: vec![a, b],
+            speed,
+        };
+
+        let mut mobility = Mobility::new();
+        mobility.set(time, node, movement.track().unwrap());
+        let position = |mobility: &Mobility| mobility.position(node).unwrap();
+        let close = |p: Point, q: Point| geo::central_angle(p, q) < 1e-9;
+
+        mobility.update(time + Duration::from_millis(500));
+        let midway = geo::unit_point((0, 45_0000)).unwrap();
+        assert!(close(position(&mobility), midway));
+        mobility.update(time + Duration::from_millis(1_000));
+        assert!(close(position(&mobility), geo::unit_point(b).unwrap()));
+        mobility.update(time + Duration::from_millis(2_000));
+        assert!(close(position(&mobility), geo::unit_point(a).unwrap()));
+
+        let invalid = Movement::Waypoints {
+            waypoints: vec![a],
+            speed: -1.0,
+        };
+        assert!(invalid.track().is_err());
+
+        let antipodal = Movement::Waypoints {
+            waypoints: vec![(0, 0), (0, 180_0000)],
+            speed,
+        };
+        assert!(antipodal.track().is_err());
+        // from pole to pole through the equator, and back
+        let poles = Movement::Waypoints {
+            waypoints: vec![(90_0000, 0), (0, 0), (-90_0000, 0), (0, 90_0000)],
+            speed,
+        };
+        assert!(poles.track().is_ok());
+    }
+}
@@ -1,5 +1,9 @@
-use crate::SimId;
-use std::time::Instant;
+use crate::{SimClock, SimId};
+use std::{
+    fmt,
+    sync::atomic::{AtomicU64, Ordering},
+    time::{Duration, Instant},
+};
 
 /// Trait for message content that will be sent via
 /// [`send_to`] and [`recv`] function of the [`SimSocket`].
@@ -16,23 +20,110 @@ pub trait HasBytesSize: Send + 'static {
     fn bytes_size(&self) -> u64;
 }
 
+/// The identifier of a message sent in the SimNetwork
+///
+/// Every [`Msg`] is given a unique identifier on creation, it is
+/// returned by `send_to` and can be used to cancel the message while
+/// it is still in flight if it was sent cancellable (see
+/// [`Msg::with_cancellation`]).
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash)]
+#[repr(C)]
+pub struct MsgId(u64);
+
+/// the next available [`MsgId`], shared by all the contexts of the process
+static NEXT_MSG_ID: AtomicU64 = AtomicU64::new(0);
+
+impl MsgId {
+    fn next() -> Self {
+        Self(NEXT_MSG_ID.fetch_add(1, Ordering::Relaxed))
+    }
+}
+
+impl From<MsgId> for u64 {
+    /// the numerical value of the identifier, as exposed to the C bindings
+    #[inline(always)]
+    fn from(id: MsgId) -> Self {
+        id.0
+    }
+}
+
+impl fmt::Display for MsgId {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        self.0.fmt(f)
+    }
+}
+
+/// The content of a message that only has a size: the network charges
+/// `size` bytes but no payload is stored, the recipient receives the `tag`
+///
+/// Use it to model traffic whose content does not matter (capacity
+/// planning): a context of `Phantom` messages, or of any content
+/// implementing `From<Phantom>`, can send them with `send_sized`.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct Phantom {
+    pub size: u64,
+    pub tag: u64,
+}
+
 pub struct Msg<T> {
+    id: MsgId,
     from: SimId,
     to: SimId,
     time: Instant,
+    scheduled: Instant,
+    delivered: Instant,
+    /// token of the [`SendCompletion`] requested by the sender, if any
+    ///
+    /// [`SendCompletion`]: crate::SendCompletion
+    send_completion: Option<u64>,
+    /// the message is dropped if it has not been delivered by this time
+    deadline: Option<Instant>,
+    /// the propagation the message is part of, if any
+    propagation: Option<u64>,
+    /// the sender may cancel the message, the multiplexer indexes it
+    cancellable: bool,
     content: T,
 }
 
+/// Timing of the journey of a [`Msg`] through the simulated network
+///
+/// All the times are times of the simulation (see [`SimClock::now`]).
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash)]
+pub struct MsgMeta {
+    /// the time the message was sent
+    pub sent: Duration,
+    /// the earliest time the message could be delivered: the time the
+    /// multiplexer received the message plus the latency of the edge
+    pub scheduled: Duration,
+    /// the time the multiplexer delivered the message to the recipient
+    ///
+    /// Any difference with `scheduled` is due to the congestion of the
+    /// network and the precision of the multiplexer (its idle duration).
+    pub delivered: Duration,
+}
+
 impl<T> Msg<T> {
     pub fn new(from: SimId, to: SimId, content: T) -> Self {
+        let time = Instant::now();
         Self {
+            id: MsgId::next(),
             from,
             to,
-            time: Instant::now(),
+            time,
+            scheduled: time,
+            delivered: time,
+            send_completion: None,
+            deadline: None,
+            propagation: None,
+            cancellable: false,
             content,
         }
     }
 
+    pub fn id(&self) -> MsgId {
+        self.id
+    }
+
     pub fn from(&self) -> SimId {
         self.from
     }
@@ -45,6 +136,141 @@ impl<T> Msg<T> {
         self.time
     }
 
+    /// the earliest time the message could be delivered, see
+    /// [`MsgMeta::scheduled`]
+    ///
+    /// This is only set once the message was received by the multiplexer.
+    pub fn scheduled(&self) -> Instant {
+        self.scheduled
+    }
+
+    /// the time the message was delivered by the multiplexer
+    ///
+    /// This is only set once the message was delivered.
+    pub fn delivered(&self) -> Instant {
+        self.delivered
+    }
+
+    /// the timing of the message in the time of the simulation
+    pub fn meta(&self, clock: &SimClock) -> MsgMeta {
+        MsgMeta {
+            sent: clock.time(self.time),
+            scheduled: clock.time(self.scheduled),
+            delivered: clock.time(self.delivered),
+        }
+    }
+
+    /// request a [`SendCompletion`] to be delivered to the sender once
+    /// the last byte of the message has left the sender's upload link
+    ///
+    /// [`SendCompletion`]: crate::SendCompletion
+    pub fn with_send_completion(mut self, token: u64) -> Self {
+        self.send_completion = Some(token);
+        self
+    }
+
+    /// the token of the requested [`SendCompletion`], if any
+    ///
+    /// [`SendCompletion`]: crate::SendCompletion
+    pub fn send_completion(&self) -> Option<u64> {
+        self.send_completion
+    }
+
+    /// set the time by which the message must be delivered
+    ///
+    /// If the message is still in flight (waiting for its latency or
+    /// for the bandwidth of the network) by then, it is dropped (see
+    /// [`SimConfiguration::on_drop`]).
+    ///
+    /// [`SimConfiguration::on_drop`]: crate::SimConfiguration::on_drop
+    pub fn with_deadline(mut self, deadline: Instant) -> Self {
+        self.deadline = Some(deadline);
+        self
+    }
+
+    /// the time by which the message must be delivered, if any
+    pub fn deadline(&self) -> Option<Instant> {
+        self.deadline
+    }
+
+    /// make the message part of the propagation `id`: the multiplexer
+    /// records the first delivery of the propagation to every node (see
+    /// [`PropagationReport`])
+    ///
+    /// [`PropagationReport`]: crate::PropagationReport
+    pub fn with_propagation(mut self, id: u64) -> Self {
+        self.propagation = Some(id);
+        self
+    }
+
+    /// the propagation the message is part of, if any
+    pub fn propagation(&self) -> Option<u64> {
+        self.propagation
+    }
+
+    /// allow the sender to cancel the message while it is in flight (see
+    /// `SimSocket::cancel`)
+    ///
+    /// Only the cancellable messages are indexed by their [`MsgId`] in the
+    /// multiplexer, the others cost nothing to look up.
+    pub fn with_cancellation(mut self) -> Self {
+        self.cancellable = true;
+        self
+    }
+
+    /// the sender may cancel the message, see [`Msg::with_cancellation`]
+    pub fn is_cancellable(&self) -> bool {
+        self.cancellable
+    }
+
+    pub(crate) fn take_send_completion(&mut self) -> Option<u64> {
+        self.send_completion.take()
+    }
+
+    pub(crate) fn set_scheduled(&mut self, time: Instant) {
+        self.scheduled = time;
+    }
+
+    pub(crate) fn set_delivered(&mut self, time: Instant) {
+        self.delivered = time;
+    }
+
+    /// a copy of the message to another recipient (of a broadcast), with
+    /// the same identifier and timing
+    pub(crate) fn copy_to(&self, to: SimId, content: T) -> Self {
+        Self {
+            id: self.id,
+            from: self.from,
+            to,
+            time: self.time,
+            scheduled: self.scheduled,
+            delivered: self.delivered,
+            send_completion: None,
+            deadline: None,
+            propagation: self.propagation,
+            cancellable: false,
+            content,
+        }
+    }
+
+    /// a copy of the message relayed by its recipient to `to`, sent at
+    /// `time` (see [`crate::Relay`])
+    pub(crate) fn relay_to(&self, to: SimId, content: T, time: Instant) -> Self {
+        Self {
+            id: MsgId::next(),
+            from: self.to,
+            to,
+            time,
+            scheduled: time,
+            delivered: time,
+            send_completion: None,
+            deadline: None,
+            propagation: self.propagation,
+            cancellable: false,
+            content,
+        }
+    }
+
     pub fn content(&self) -> &T {
         &self.content
     }
@@ -54,6 +280,11 @@ impl<T> Msg<T> {
     }
 }
 
+impl HasBytesSize for Phantom {
+    fn bytes_size(&self) -> u64 {
+        self.size
+    }
+}
 impl HasBytesSize for [u8] {
     fn bytes_size(&self) -> u64 {
         self.len() as u64
@@ -1,21 +1,29 @@
 use crate::geo;
 use crate::{
+    constellation::Constellation,
     defaults::{
         DEFAULT_DOWNLOAD_BANDWIDTH, DEFAULT_LATENCY, DEFAULT_PACKET_LOSS, DEFAULT_UPLOAD_BANDWIDTH,
     },
-    HasBytesSize, Msg, SimId,
+    distribution::LatencyDistribution,
+    mobility::{Mobility, Track},
+    rng::SimRng,
+    segment::Segment,
+    sim_context::{SimLink, SimLinks},
+    trace::{CapacityTrace, EdgeTrace},
+    HasBytesSize, Msg, SimId, Topology,
 };
 use anyhow::{bail, ensure};
 use logos::{Lexer, Logos};
-use std::{collections::HashMap, fmt::Display, str::FromStr, time::Duration};
+use std::{
+    collections::HashMap,
+    fmt::Display,
+    str::FromStr,
+    time::{Duration, Instant},
+};
 
 pub enum PolicyOutcome {
-    //TODO(nicolasdp): implement the drop strategy
-    #[allow(unused)]
     Drop,
-    Delay {
-        delay: Duration,
-    },
+    Delay { delay: Duration },
 }
 
 #[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash)]
@@ -51,8 +59,8 @@ pub struct PacketLoss {
 
 #[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash)]
 pub struct Edge {
-    smaller_id: SimId,
-    larger_id: SimId,
+    pub(crate) smaller_id: SimId,
+    pub(crate) larger_id: SimId,
 }
 
 #[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
@@ -76,6 +84,36 @@ pub struct Policy {
     default_edge_policy: EdgePolicy,
 
     edge_policies: HashMap<Edge, EdgePolicy>,
+
+    /// when set, the edge policies are kept in the topology
+    topology: Option<Topology>,
+
+    /// the traces played on the edges and the time they started
+    edge_traces: HashMap<Edge, (EdgeTrace, Instant)>,
+
+    distributions: Distributions,
+    /// the seed of the generators of the simulation, see
+    /// [`Policy::set_seed`]
+    seed: u64,
+    /// draws the latencies from the distributions
+    rng: SimRng,
+
+    /// the positions of the moving nodes
+    mobility: Mobility,
+
+    constellation: Option<Box<Constellation>>,
+
+    segments: HashMap<u32, Segment>,
+    node_segments: HashMap<SimId, u32>,
+}
+
+/// the latency distributions of the edges and of the pairs of regions
+#[derive(Debug, Default, Clone, PartialEq, Eq)]
+struct Distributions {
+    edges: HashMap<Edge, LatencyDistribution>,
+    node_regions: HashMap<SimId, u32>,
+    /// keyed by the smaller region first
+    regions: HashMap<(u32, u32), LatencyDistribution>,
 }
 
 impl Bandwidth {
@@ -84,6 +122,11 @@ impl Bandwidth {
     pub const fn bits_per(bits: u64, duration: Duration) -> Self {
         Self(bits * duration.as_millis() as u64)
     }
+
+    /// the bandwidth as parsed from `"<bits>bps"`
+    pub const fn bits_per_second(bits: u64) -> Self {
+        Self(bits)
+    }
 }
 
 impl Latency {
@@ -188,6 +231,16 @@ impl Policy {
         self.default_edge_policy
     }
 
+    /// the policy of the node: the policy set on the node itself
+    /// (`node_policy`), then the one of the [`Topology`] and then the
+    /// default policy
+    #[inline]
+    pub(crate) fn node_policy(&self, node: SimId, node_policy: Option<NodePolicy>) -> NodePolicy {
+        node_policy
+            .or_else(|| self.topology.as_ref()?.node_policy(node))
+            .unwrap_or(self.default_node_policy)
+    }
+
     pub fn set_default_node_policy(&mut self, default_node_policy: NodePolicy) {
         self.default_node_policy = default_node_policy;
     }
@@ -197,25 +250,305 @@ impl Policy {
     }
 
     pub fn get_edge_policy(&self, edge: Edge) -> Option<EdgePolicy> {
-        self.edge_policies.get(&edge).copied()
+        match self.topology.as_ref() {
+            Some(topology) => topology.edge_policy(edge),
+            None => self.edge_policies.get(&edge).copied(),
+        }
     }
 
+    /// set the policy of the edge
+    ///
+    /// When a [`Topology`] is set, the policies of the edges that are not
+    /// part of the topology are ignored: no messages can go through them.
     pub fn set_edge_policy(&mut self, edge: Edge, policy: EdgePolicy) {
-        self.edge_policies.insert(edge, policy);
+        match self.topology.as_mut() {
+            Some(topology) => {
+                // not an edge of the topology, see above
+                let _ = topology.set_edge_policy(edge, policy);
+            }
+            None => {
+                self.edge_policies.insert(edge, policy);
+            }
+        }
     }
 
     pub fn reset_edge_policy(&mut self, edge: Edge) {
-        self.edge_policies.remove(&edge);
+        match self.topology.as_mut() {
+            Some(topology) => topology.reset_edge_policy(edge),
+            None => {
+                self.edge_policies.remove(&edge);
+            }
+        }
     }
 
-    fn message_delay<T>(&self, msg: &Msg<T>) -> Duration
-    where
-        T: HasBytesSize,
-    {
-        let from = msg.from();
-        let to = msg.to();
+    pub fn topology(&self) -> Option<&Topology> {
+        self.topology.as_ref()
+    }
 
+    /// restrict the network to the edges of the given [`Topology`]
+    ///
+    /// The messages sent between nodes that are not neighbours in the
+    /// topology are dropped. The edge policies of the topology are used,
+    /// the policies already set are kept for the other edges of the
+    /// topology and discarded for the edges that are not in the topology.
+    pub fn set_topology(&mut self, mut topology: Topology) {
+        for (edge, policy) in self.take_edge_policies() {
+            if topology.edge_policy(edge).is_none() {
+                let _ = topology.set_edge_policy(edge, policy);
+            }
+        }
+
+        self.topology = Some(topology);
+    }
+
+    /// remove the [`Topology`]: all the nodes may exchange messages again
+    pub fn reset_topology(&mut self) {
+        self.edge_policies = self.take_edge_policies();
+    }
+
+    /// take all the edge policies, removing the topology if any
+    fn take_edge_policies(&mut self) -> HashMap<Edge, EdgePolicy> {
+        let mut edge_policies = std::mem::take(&mut self.edge_policies);
+        if let Some(topology) = self.topology.take() {
+            edge_policies.extend(topology.edge_policies());
+        }
+        edge_policies
+    }
+
+    /// play the [`EdgeTrace`] on the edge, starting at the given `time`
+    pub(crate) fn set_edge_trace(&mut self, edge: Edge, trace: EdgeTrace, time: Instant) {
+        self.edge_traces.insert(edge, (trace, time));
+    }
+
+    pub(crate) fn reset_edge_trace(&mut self, edge: Edge) {
+        self.edge_traces.remove(&edge);
+    }
+
+    /// the capacity trace played on the edge and the time it started
+    #[inline]
+    pub(crate) fn edge_capacity_trace(&self, edge: Edge) -> Option<(&CapacityTrace, Instant)> {
+        if self.edge_traces.is_empty() {
+            return None;
+        }
+
+        let (trace, since) = self.edge_traces.get(&edge)?;
+        Some((trace.capacity.as_ref()?, *since))
+    }
+
+    /// seed the generators drawing the latencies from the
+    /// [`LatencyDistribution`]s and the lifetimes of the
+    /// [`FailureProcess`]es and the peers of the [`Relay::Random`]
+    /// relays, for reproducible simulations
+    ///
+    /// The failures and the relays are seeded when the context is created.
+    ///
+    /// [`Relay::Random`]: crate::Relay::Random
+    ///
+    /// [`FailureProcess`]: crate::FailureProcess
+    pub fn set_seed(&mut self, seed: u64) {
+        self.seed = seed;
+        self.rng = SimRng::new(seed);
+    }
+
+    /// an independent generator of the seed of the policy, see
+    /// [`SimRng::stream`]
+    pub(crate) fn rng(&self, stream: u64) -> SimRng {
+        SimRng::stream(self.seed, stream)
+    }
+
+    /// draw the latency of the edge from the [`LatencyDistribution`]
+    ///
+    /// It takes precedence over the latency of the [`EdgePolicy`] and the
+    /// distribution of the regions of the nodes. The latencies drawn are
+    /// the one-way latencies of the messages: halve the latencies of a
+    /// round trip time CDF.
+    pub fn set_edge_distribution(&mut self, edge: Edge, distribution: LatencyDistribution) {
+        self.distributions.edges.insert(edge, distribution);
+    }
+
+    pub fn reset_edge_distribution(&mut self, edge: Edge) {
+        self.distributions.edges.remove(&edge);
+    }
+
+    /// set the region of the node, see [`Self::set_region_distribution`]
+    pub fn set_node_region(&mut self, node: SimId, region: u32) {
+        self.distributions.node_regions.insert(node, region);
+    }
+
+    pub fn reset_node_region(&mut self, node: SimId) {
+        self.distributions.node_regions.remove(&node);
+    }
+
+    /// draw the latency of the edges between the nodes of the regions `a`
+    /// and `b` from the [`LatencyDistribution`] (`a` and `b` may be the
+    /// same region)
+    ///
+    /// The single distribution is shared by all the edges between the
+    /// regions. It takes precedence over the latency of the [`EdgePolicy`]
+    /// of the edges but not over the distribution of an edge (see
+    /// [`Self::set_edge_distribution`]).
+    pub fn set_region_distribution(&mut self, a: u32, b: u32, distribution: LatencyDistribution) {
+        self.distributions
+            .regions
+            .insert((a.min(b), a.max(b)), distribution);
+    }
+
+    pub fn reset_region_distribution(&mut self, a: u32, b: u32) {
+        self.distributions.regions.remove(&(a.min(b), a.max(b)));
+    }
+
+    /// the positions of the moving nodes are updated at most once per
+    /// `interval` (see [`DEFAULT_MOBILITY_INTERVAL`])
+    ///
+    /// [`DEFAULT_MOBILITY_INTERVAL`]: crate::defaults::DEFAULT_MOBILITY_INTERVAL
+    pub fn set_mobility_interval(&mut self, interval: Duration) {
+        self.mobility.set_interval(interval)
+    }
+
+    /// the node follows the track from the given `time`
+    pub(crate) fn set_node_movement(&mut self, time: Instant, node: SimId, track: Track) {
+        self.mobility.set(time, node, track)
+    }
+
+    pub(crate) fn reset_node_movement(&mut self, node: SimId) {
+        self.mobility.reset(node)
+    }
+
+    /// update the positions of the moving nodes and the links of the
+    /// constellation (once per interval)
+    #[inline]
+    pub(crate) fn update_positions(&mut self, time: Instant) {
+        self.mobility.update(time);
+        if let Some(constellation) = self.constellation.as_mut() {
+            constellation.update(time);
+        }
+    }
+
+    pub fn constellation(&self) -> Option<&Constellation> {
+        self.constellation.as_deref()
+    }
+
+    /// the messages between two members of the [`Constellation`] (its
+    /// satellites and ground stations) go through the link between them,
+    /// with its latency, or are dropped if there is no such link
+    ///
+    /// The messages between a member and another node are not affected.
+    pub fn set_constellation(&mut self, constellation: Constellation) {
+        self.constellation = Some(Box::new(constellation));
+    }
+
+    pub fn reset_constellation(&mut self) {
+        self.constellation = None;
+    }
+
+    /// the latency of the edge from the positions of its nodes, if one of
+    /// them moves
+    ///
+    /// The position of a node that does not move is the location of its
+    /// policy (the one set on the node, then the one of the [`Topology`]).
+    #[inline]
+    fn mobile_latency<UpLink>(&self, edge: Edge, nodes: &SimLinks<UpLink>) -> Option<Duration> {
+        if self.mobility.is_empty() {
+            return None;
+        }
+        let a = self.mobility.position(edge.smaller_id);
+        let b = self.mobility.position(edge.larger_id);
+        if a.is_none() && b.is_none() {
+            return None;
+        }
+
+        let location = |node: SimId| {
+            let node_policy = nodes.get(node.into_index()).and_then(SimLink::policy);
+            let location = self.node_policy(node, node_policy).location?;
+            geo::unit_point(location).ok()
+        };
+        let a = a.or_else(|| location(edge.smaller_id))?;
+        let b = b.or_else(|| location(edge.larger_id))?;
+        Some(geo::great_circle_latency(a, b))
+    }
+
+    pub fn segment(&self, id: u32) -> Option<&Segment> {
+        self.segments.get(&id)
+    }
+
+    /// set the shared medium `id`, replacing the previous one with the same
+    /// identifier
+    ///
+    /// The members of the segment are removed from their previous segment.
+    pub fn set_segment(&mut self, id: u32, mut segment: Segment) {
+        self.reset_segment(id);
+        segment.members.sort_unstable();
+        segment.members.dedup();
+
+        for member in segment.members.iter().copied() {
+            if let Some(previous) = self.node_segments.insert(member, id) {
+                if let Some(previous) = self.segments.get_mut(&previous) {
+                    previous.members.retain(|node| *node != member);
+                }
+            }
+        }
+        self.segments.insert(id, segment);
+    }
+
+    pub fn reset_segment(&mut self, id: u32) {
+        if let Some(segment) = self.segments.remove(&id) {
+            for member in segment.members {
+                self.node_segments.remove(&member);
+            }
+        }
+    }
+
+    /// the segment of the node, if any
+    #[inline]
+    pub(crate) fn node_segment(&self, node: SimId) -> Option<u32> {
+        if self.node_segments.is_empty() {
+            return None;
+        }
+        self.node_segments.get(&node).copied()
+    }
+
+    /// the segment shared by the two ends of the edge, if any
+    #[inline]
+    pub(crate) fn shared_segment(&self, edge: Edge) -> Option<(u32, &Segment)> {
+        let id = self.node_segment(edge.smaller_id)?;
+        if self.node_segment(edge.larger_id)? != id {
+            return None;
+        }
+        Some((id, self.segments.get(&id)?))
+    }
+
+    fn edge_delay<UpLink>(
+        &mut self,
+        time: Instant,
+        from: SimId,
+        to: SimId,
+        nodes: &SimLinks<UpLink>,
+    ) -> Duration {
         let edge = Edge::new((from, to));
+        // the members of a segment share its medium, for the latency as
+        // for the capacity
+        if let Some((_, segment)) = self.shared_segment(edge) {
+            return segment.latency.to_duration();
+        }
+
+        if let Some((
+            EdgeTrace {
+                delay: Some(delay), ..
+            },
+            since,
+        )) = self.edge_traces.get(&edge)
+        {
+            return delay.delay_at(time.saturating_duration_since(*since));
+        }
+
+        if let Some(distribution) = self.distributions.get(edge) {
+            return distribution.sample(&mut self.rng);
+        }
+
+        if let Some(latency) = self.mobile_latency(edge, nodes) {
+            return latency;
+        }
+
         let edge_policy = self
             .get_edge_policy(edge)
             .unwrap_or_else(|| self.default_edge_policy());
@@ -223,16 +556,68 @@ impl Policy {
         edge_policy.latency.to_duration()
     }
 
-    pub(crate) fn process<T>(&mut self, msg: &Msg<T>) -> PolicyOutcome
+    pub(crate) fn process<T, UpLink>(
+        &mut self,
+        time: Instant,
+        msg: &Msg<T>,
+        nodes: &SimLinks<UpLink>,
+    ) -> PolicyOutcome
     where
         T: HasBytesSize,
     {
+        self.process_edge(time, msg.from(), msg.to(), nodes)
+    }
+
+    /// process the bytes sent from `from` to `to` (a message or a segment
+    /// of a stream)
+    ///
+    /// The bytes are dropped if the nodes are not neighbours in the
+    /// [`Topology`].
+    pub(crate) fn process_edge<UpLink>(
+        &mut self,
+        time: Instant,
+        from: SimId,
+        to: SimId,
+        nodes: &SimLinks<UpLink>,
+    ) -> PolicyOutcome {
+        if let Some(topology) = self.topology.as_ref() {
+            if !topology.connected(from, to) {
+                return PolicyOutcome::Drop;
+            }
+        }
+
+        if let Some(constellation) = self.constellation.as_deref() {
+            if constellation.contains(from) && constellation.contains(to) {
+                return match constellation.latency(from, to) {
+                    Some(delay) => PolicyOutcome::Delay { delay },
+                    None => PolicyOutcome::Drop,
+                };
+            }
+        }
+
         PolicyOutcome::Delay {
-            delay: self.message_delay(msg),
+            delay: self.edge_delay(time, from, to, nodes),
         }
     }
 }
 
+impl Distributions {
+    /// the latency distribution of the edge, if any
+    #[inline]
+    fn get(&self, edge: Edge) -> Option<&LatencyDistribution> {
+        if let Some(distribution) = self.edges.get(&edge) {
+            return Some(distribution);
+        }
+        if self.regions.is_empty() {
+            return None;
+        }
+
+        let a = *self.node_regions.get(&edge.smaller_id)?;
+        let b = *self.node_regions.get(&edge.larger_id)?;
+        self.regions.get(&(a.min(b), a.max(b)))
+    }
+}
+
 impl Bandwidth {
     pub fn into_inner(self) -> u64 {
         self.0
@@ -307,6 +692,11 @@ impl FromStr for Bandwidth {
 #[cfg(test)]
 mod tests {
     use super::*;
+    use crate::Movement;
+
+    /// the links of the nodes, for the tests that do not set policies
+    /// on the nodes
+    const NO_LINKS: SimLinks<()> = Vec::new();
 
     #[test]
     fn parse_bandwidth() {
@@ -340,4 +730,168 @@ mod tests {
         assert_bandwidth!((12_345 * K) == "12345kbps");
         assert_bandwidth!((12_345 * M) == "12345mbps");
     }
+
+    #[test]
+    fn topology() {
+        let time = Instant::now();
+        let (a, b, c) = (SimId::new(0), SimId::new(1), SimId::new(2));
+        let latency = Latency::new(Duration::from_millis(42));
+        let edge_policy = EdgePolicy {
+            latency,
+            ..EdgePolicy::default()
+        };
+
+        let mut policy = Policy::new();
+        policy.set_edge_policy(Edge::new((a, b)), edge_policy);
+        policy.set_edge_policy(Edge::new((a, c)), edge_policy);
+        assert!(matches!(
+            policy.process_edge(time, b, c, &NO_LINKS),
+            PolicyOutcome::Delay { .. }
+        ));
+
+        // `a - b` is kept, `a - c` is not an edge of the topology
+        policy.set_topology(Topology::new(3, [(a, b), (b, c)]).unwrap());
+        assert_eq!(policy.get_edge_policy(Edge::new((b, a))), Some(edge_policy));
+        assert_eq!(policy.get_edge_policy(Edge::new((a, c))), None);
+        assert!(matches!(
+            policy.process_edge(time, a, c, &NO_LINKS),
+            PolicyOutcome::Drop
+        ));
+        assert!(matches!(
+            policy.process_edge(time, b, a, &NO_LINKS),
+            PolicyOutcome::Delay { delay } if delay == latency.to_duration()
+        ));
+
+        policy.set_edge_policy(Edge::new((b, c)), edge_policy);
+        policy.reset_edge_policy(Edge::new((a, b)));
+        assert_eq!(policy.get_edge_policy(Edge::new((a, b))), None);
+        assert_eq!(policy.get_edge_policy(Edge::new((c, b))), Some(edge_policy));
+
+        policy.reset_topology();
+        assert!(matches!(
+            policy.process_edge(time, a, c, &NO_LINKS),
+            PolicyOutcome::Delay { .. }
+        ));
+        assert_eq!(policy.get_edge_policy(Edge::new((b, c))), Some(edge_policy));
+        assert_eq!(policy.get_edge_policy(Edge::new((a, b))), None);
+    }
+
+    #[test]
+    fn distributions() {
+        let time = Instant::now();
+        let (a, b, c) = (SimId::new(0), SimId::new(1), SimId::new(2));
+        let ms = Duration::from_millis;
+        let fixed = |latency| LatencyDistribution::from_cdf(&[(ms(latency), 1.0)]).unwrap();
+        let delay =
+            |policy: &mut Policy, from, to| match policy.process_edge(time, from, to, &NO_LINKS) {
+                PolicyOutcome::Delay { delay } => delay,
+                PolicyOutcome::Drop => panic!("not expecting the message to be dropped"),
+            };
+
+        let mut policy = Policy::new();
+        policy.set_node_region(a, 1);
+        policy.set_node_region(b, 2);
+        policy.set_node_region(c, 2);
+        policy.set_region_distribution(2, 1, fixed(100));
+        assert_eq!(delay(&mut policy, a, b), ms(100));
+        assert_eq!(delay(&mut policy, c, a), ms(100));
+        assert_eq!(delay(&mut policy, b, c), DEFAULT_LATENCY.to_duration());
+
+        // the distribution of the edge takes precedence over the regions'
+        policy.set_edge_distribution(Edge::new((a, b)), fixed(5));
+        assert_eq!(delay(&mut policy, b, a), ms(5));
+        policy.reset_edge_distribution(Edge::new((a, b)));
+        assert_eq!(delay(&mut policy, b, a), ms(100));
+    }
+
+    #[test]
+    fn mobility() {
+        let time = Instant::now();
+        let (a, b, c) = (SimId::new(0), SimId::new(1), SimId::new(2));
+        let (paris, berlin) = ((48_8566, 2_3522), (52_5200, 13_4050));
+        let mut nodes: SimLinks<()> = (0..3).map(|_| SimLink::new(())).collect();
+        let delay = |policy: &mut Policy, nodes: &SimLinks<()>, from, to| match policy
+            .process_edge(time, from, to, nodes)
+        {
+            PolicyOutcome::Delay { delay } => delay,
+            PolicyOutcome::Drop => panic!("not expecting the message to be dropped"),
+        };
+
+        let mut policy = Policy::new();
+        let mut topology = Topology::new(3, [(a, b), (a, c), (b, c)]).unwrap();
+        topology
+            .set_node_policy(
+                c,
+                NodePolicy {
+                    location: Some(berlin),
+                    ..NodePolicy::default()
+                },
+            )
+            .unwrap();
+        policy.set_topology(topology);
+
+        let movement = Movement::Velocity {
+            start: paris,
+            heading: 180.0,
+            speed: 100.0,
+        };
+        policy.set_node_movement(time, a, movement.track().unwrap());
+        let latency = geo::great_circle_latency(
+            geo::unit_point(paris).unwrap(),
+            geo::unit_point(berlin).unwrap(),
+        );
+        assert_eq!(delay(&mut policy, &nodes, c, a), latency);
+        // `b` has no position
+        assert_eq!(
+            delay(&mut policy, &nodes, a, b),
+            DEFAULT_LATENCY.to_duration()
+        );
+        // until its policy has a location (set on the node, not in the
+        // topology)
+        nodes[1] = SimLink::with_policy(
+            (),
+            NodePolicy {
+                location: Some(berlin),
+                ..NodePolicy::default()
+            },
+        );
+        assert_eq!(delay(&mut policy, &nodes, a, b), latency);
+
+        // going south, away from Berlin
+        policy.update_positions(time + Duration::from_secs(60));
+        assert!(delay(&mut policy, &nodes, a, c) > latency);
+
+        policy.reset_node_movement(a);
+        assert_eq!(
+            delay(&mut policy, &nodes, a, c),
+            DEFAULT_LATENCY.to_duration()
+        );
+    }
+
+    #[test]
+    fn segment() {
+        let time = Instant::now();
+        let (a, b, c) = (SimId::new(0), SimId::new(1), SimId::new(2));
+        let latency = Duration::from_millis(3);
+        let delay =
+            |policy: &mut Policy, from, to| match policy.process_edge(time, from, to, &NO_LINKS) {
+                PolicyOutcome::Delay { delay } => delay,
+                PolicyOutcome::Drop => panic!("not expecting the message to be dropped"),
+            };
+
+        let mut policy = Policy::new();
+        policy.set_segment(
+            7,
+            Segment {
+                capacity: Bandwidth::bits_per_second(1_000),
+                latency: Latency::new(latency),
+                members: vec![a, b],
+            },
+        );
+
+        // the messages between two members take the latency of the segment
+        assert_eq!(delay(&mut policy, a, b), latency);
+        assert_eq!(delay(&mut policy, b, a), latency);
+        assert_eq!(delay(&mut policy, a, c), DEFAULT_LATENCY.to_duration());
+    }
 }
@@ -0,0 +1,324 @@
+use crate::{SimClock, SimId};
+use std::{
+    collections::{HashMap, VecDeque},
+    time::{Duration, Instant},
+};
+
+/// the number of forgotten propagations remembered to ignore their late
+/// messages, the oldest are dropped first
+pub(crate) const MAX_FORGOTTEN: usize = 65_536;
+
+/// The first delivery of a propagation to a node: an edge of the
+/// propagation tree
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Delivery {
+    pub node: SimId,
+    /// the node that delivered the propagation to `node` first
+    pub from: SimId,
+    /// the time since the start of the propagation
+    pub elapsed: Duration,
+}
+
+/// How a message (a block, a transaction...) propagated through the
+/// network, see `SimContext::propagation_report`
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct PropagationReport {
+    pub id: u64,
+    /// the node that sent the first message of the propagation
+    pub origin: SimId,
+    /// the time the first message was sent (see [`SimClock::now`])
+    pub start: Duration,
+    /// the number of nodes of the network, the origin included
+    pub nodes: usize,
+    /// the first delivery to every node reached, in order of arrival
+    pub deliveries: Vec<Delivery>,
+}
+
+/// The propagations followed by the multiplexer
+///
+/// A propagation starts with the first message sent with its identifier,
+/// then every first delivery to a node is recorded: a bit in the bitmap
+/// of the nodes reached and an entry in the log of deliveries (so the
+/// nodes never need to share a state to measure the propagation).
+///
+/// A propagation is forgotten once reported complete, or `expiry` after
+/// its start (see `SimConfiguration::propagation_expiry`); only the last
+/// [`MAX_FORGOTTEN`] forgotten identifiers are remembered so the state
+/// stays bounded.
+pub(crate) struct Propagations {
+    tracked: HashMap<u64, Propagation>,
+    /// `None` for the incomplete propagations to be followed until the end
+    expiry: Option<Duration>,
+    /// the tracked propagations in order of start, to expire them
+    started: VecDeque<(Instant, u64)>,
+    /// the propagations reported complete or expired, they are not
+    /// started again by their late messages
+    forgotten: HashMap<u64, Forgotten>,
+    /// `forgotten` in order of insertion, to cap it
+    order: VecDeque<u64>,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Forgotten {
+    /// all the nodes were reached, the late messages (nodes relaying to
+    /// nodes already reached) are duplicates
+    Complete,
+    /// the propagation was still in progress
+    Expired,
+}
+
+struct Propagation {
+    origin: SimId,
+    start: Instant,
+    /// one bit per node reached, the origin included
+    reached: Vec<u64>,
+    deliveries: Vec<Delivery>,
+}
+
+impl PropagationReport {
+    /// all the nodes of the network were reached
+    #[inline]
+    pub fn is_complete(&self) -> bool {
+        self.deliveries.len() + 1 >= self.nodes
+    }
+
+    /// the time to reach `fraction` (within `0` and `1`) of the nodes of
+    /// the network, the origin included, if reached
+    pub fn time_to_coverage(&self, fraction: f64) -> Option<Duration> {
+        let nodes = (fraction.clamp(0.0, 1.0) * self.nodes as f64).ceil() as usize;
+
+        match nodes.checked_sub(2) {
+            None => Some(Duration::ZERO),
+            Some(index) => self.deliveries.get(index).map(|delivery| delivery.elapsed),
+        }
+    }
+
+    /// the node that delivered the propagation to `node` first, if reached
+    pub fn parent(&self, node: SimId) -> Option<SimId> {
+        self.deliveries
+            .iter()
+            .find(|delivery| delivery.node == node)
+            .map(|delivery| delivery.from)
+    }
+}
+
+impl Propagations {
+    pub fn new(expiry: Option<Duration>) -> Self {
+        Self {
+            tracked: HashMap::new(),
+            expiry,
+            started: VecDeque::new(),
+            forgotten: HashMap::new(),
+            order: VecDeque::new(),
+        }
+    }
+
+    /// a message of the propagation `id` was sent, at the given `time`
+    pub fn send(&mut self, id: u64, from: SimId, time: Instant) {
+        if self.forgotten.contains_key(&id) || self.tracked.contains_key(&id) {
+            return;
+        }
+
+        self.expire(time);
+
+        let mut propagation = Propagation {
+            origin: from,
+            start: time,
+            reached: Vec::new(),
+            deliveries: Vec::new(),
+        };
+        propagation.reach(from);
+        self.tracked.insert(id, propagation);
+        if self.expiry.is_some() {
+            self.started.push_back((time, id));
+        }
+    }
+
+    /// forget the propagations started `expiry` before `time`
+    fn expire(&mut self, time: Instant) {
+        let Some(expiry) = self.expiry else {
+            return;
+        };
+
+        while let Some(&(start, id)) = self.started.front() {
+            if time.saturating_duration_since(start) < expiry {
+                break;
+            }
+            self.started.pop_front();
+            if self.tracked.remove(&id).is_some() {
+                self.forget(id, Forgotten::Expired);
+            }
+        }
+    }
+
+    /// remember `id` to ignore its late messages, within [`MAX_FORGOTTEN`]
+    fn forget(&mut self, id: u64, forgotten: Forgotten) {
+        if self.forgotten.insert(id, forgotten).is_some() {
+            return;
+        }
+        self.order.push_back(id);
+        if self.order.len() > MAX_FORGOTTEN {
+            if let Some(oldest) = self.order.pop_front() {
+                self.forgotten.remove(&oldest);
+            }
+        }
+    }
+
+    /// a message of the propagation `id` was delivered to `to`, returns
+    /// `Some(true)` if it is the first delivery of the propagation to `to`
+    /// and `Some(false)` for a duplicate (including the late messages of a
+    /// complete propagation)
+    ///
+    /// Returns `None` if the propagation is not followed (unknown or
+    /// expired): the message is not part of a measured propagation.
+    pub fn deliver(&mut self, id: u64, from: SimId, to: SimId, time: Instant) -> Option<bool> {
+        let Some(propagation) = self.tracked.get_mut(&id) else {
+            return match self.forgotten.get(&id) {
+                Some(Forgotten::Complete) => Some(false),
+                Some(Forgotten::Expired) | None => None,
+            };
+        };
+
+        let first = propagation.reach(to);
+        if first {
+            propagation.deliveries.push(Delivery {
+                node: to,
+                from,
+                elapsed: time.saturating_duration_since(propagation.start),
+            });
+        }
+        Some(first)
+    }
+
+    /// the report of the propagation `id` in a network of `nodes`
+    ///
+    /// The propagation is forgotten once reported complete (or expired).
+    pub fn report(&mut self, id: u64, nodes: usize, clock: &SimClock) -> Option<PropagationReport> {
+        let propagation = self.tracked.get(&id)?;
+        let report = PropagationReport {
+            id,
+            origin: propagation.origin,
+            start: clock.time(propagation.start),
+            nodes,
+            deliveries: propagation.deliveries.clone(),
+        };
+
+        if report.is_complete() {
+            self.tracked.remove(&id);
+            self.forget(id, Forgotten::Complete);
+        }
+        Some(report)
+    }
+}
+
+impl Propagation {
+    /// mark the node reached, returns `false` if it was already reached
+    fn reach(&mut self, node: SimId) -> bool {
+        let index = node.into_index();
+        let (word, bit) = (index / 64, 1 << (index % 64));
+        if word >= self.reached.len() {
+            self.reached.resize(word + 1, 0);
+        }
+
+        let reached = self.reached[word] & bit != 0;
+        self.reached[word] |= bit;
+        !reached
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn coverage() {
+        let clock = SimClock::new();
+        let start = Instant::now();
+        let ms = Duration::from_millis;
+        let nodes: Vec<SimId> = (0..4).map(SimId::new).collect();
+
+        let mut propagations = Propagations::new(None);
+        propagations.send(7, nodes[0], start);
+        propagations.deliver(7, nodes[0], nodes[1], start + ms(10));
+        // relayed back to the origin, and twice to the same node
+        propagations.send(7, nodes[1], start + ms(10));
+        propagations.deliver(7, nodes[1], nodes[0], start + ms(20));
+        propagations.deliver(7, nodes[1], nodes[2], start + ms(20));
+        propagations.deliver(7, nodes[0], nodes[2], start + ms(25));
+        // not tracked
+        assert_eq!(
+            propagations.deliver(8, nodes[0], nodes[3], start + ms(25)),
+            None
+        );
+
+        let report = propagations.report(7, nodes.len(), &clock).unwrap();
+        assert!(!report.is_complete());
+        assert_eq!(report.origin, nodes[0]);
+        assert_eq!(report.time_to_coverage(0.5), Some(ms(10)));
+        assert_eq!(report.time_to_coverage(0.75), Some(ms(20)));
+        assert_eq!(report.time_to_coverage(1.0), None);
+        assert_eq!(report.parent(nodes[2]), Some(nodes[1]));
+        assert_eq!(propagations.report(8, nodes.len(), &clock), None);
+
+        propagations.deliver(7, nodes[2], nodes[3], start + ms(40));
+        let report = propagations.report(7, nodes.len(), &clock).unwrap();
+        assert!(report.is_complete());
+        assert_eq!(report.time_to_coverage(1.0), Some(ms(40)));
+
+        // forgotten once reported complete, the late messages are ignored
+        propagations.send(7, nodes[3], start + ms(40));
+        assert_eq!(propagations.report(7, nodes.len(), &clock), None);
+        assert_eq!(
+            propagations.deliver(7, nodes[3], nodes[1], start + ms(50)),
+            Some(false)
+        );
+    }
+
+    #[test]
+    fn retention() {
+        let clock = SimClock::new();
+        let start = Instant::now();
+        let expiry = Duration::from_secs(60);
+        let nodes: Vec<SimId> = (0..4).map(SimId::new).collect();
+
+        // never complete (a partition...): expired by a later propagation
+        let mut propagations = Propagations::new(Some(expiry));
+        propagations.send(1, nodes[0], start);
+        assert_eq!(
+            propagations.deliver(1, nodes[0], nodes[1], start),
+            Some(true)
+        );
+        propagations.send(2, nodes[0], start + expiry / 2);
+        assert!(propagations.report(1, nodes.len(), &clock).is_some());
+        propagations.send(3, nodes[0], start + expiry);
+        assert_eq!(propagations.report(1, nodes.len(), &clock), None);
+        assert!(propagations.report(2, nodes.len(), &clock).is_some());
+        assert_eq!(propagations.tracked.len(), 2);
+
+        // the late messages of the expired propagation do not start it
+        // again, and are no longer part of a propagation
+        propagations.send(1, nodes[1], start + expiry);
+        assert_eq!(propagations.report(1, nodes.len(), &clock), None);
+        assert_eq!(
+            propagations.deliver(1, nodes[1], nodes[2], start + expiry),
+            None
+        );
+
+        // only the last forgotten propagations are remembered
+        for id in 0..(MAX_FORGOTTEN as u64 + 10) {
+            propagations.forget(id + 100, Forgotten::Complete);
+        }
+        assert_eq!(propagations.forgotten.len(), MAX_FORGOTTEN);
+        assert_eq!(propagations.order.len(), MAX_FORGOTTEN);
+        assert!(!propagations.forgotten.contains_key(&1));
+        assert!(propagations
+            .forgotten
+            .contains_key(&(MAX_FORGOTTEN as u64 + 109)));
+
+        // followed until the end without an expiry
+        let mut propagations = Propagations::new(None);
+        propagations.send(1, nodes[0], start);
+        propagations.send(2, nodes[0], start + expiry * 1_000);
+        assert!(propagations.report(1, nodes.len(), &clock).is_some());
+    }
+}
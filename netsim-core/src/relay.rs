@@ -0,0 +1,206 @@
+use crate::{rng::SimRng, SimId, Topology};
+use std::collections::{HashMap, HashSet};
+
+/// How a node relays the propagations inside the multiplexer (see
+/// `SimContext::set_default_relay`)
+///
+/// A node that relays does not receive the messages of the propagations
+/// (see `SimSocket::send_to_tracked`): on the first delivery of a
+/// propagation the multiplexer sends a copy of the message to the
+/// node's neighbours (the nodes of the [`Topology`] or all the nodes),
+/// the later deliveries are dropped. The propagation runs without the
+/// application of the nodes and is measured with the
+/// [`PropagationReport`].
+///
+/// [`PropagationReport`]: crate::PropagationReport
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Relay {
+    /// to all the neighbours but the node it received the message from
+    Flood,
+    /// to the given number of neighbours picked at random, the node it
+    /// received the message from excluded (gossip)
+    Random(usize),
+}
+
+/// the stream of the generator of the relays, see [`crate::Policy::set_seed`]
+pub(crate) const RNG_STREAM: u64 = 2;
+
+/// the function copying the messages the nodes relay
+pub(crate) type CopyFn<T> = fn(&T) -> T;
+
+/// The relays of the nodes and how to copy the messages
+pub(crate) struct Relays<T> {
+    default: Option<Relay>,
+    /// the nodes that do not relay as the default, `None` for the nodes
+    /// that do not relay at all
+    nodes: HashMap<SimId, Option<Relay>>,
+    copy: Option<CopyFn<T>>,
+    rng: SimRng,
+}
+
+impl<T> Relays<T> {
+    pub fn new(rng: SimRng) -> Self {
+        Self {
+            default: None,
+            nodes: HashMap::new(),
+            copy: None,
+            rng,
+        }
+    }
+
+    pub fn set_default(&mut self, relay: Option<Relay>, copy: CopyFn<T>) {
+        self.default = relay;
+        self.copy = Some(copy);
+    }
+
+    pub fn set(&mut self, node: SimId, relay: Option<Relay>, copy: CopyFn<T>) {
+        self.nodes.insert(node, relay);
+        self.copy = Some(copy);
+    }
+
+    pub fn reset(&mut self, node: SimId) {
+        self.nodes.remove(&node);
+    }
+
+    /// how the node relays, with the function copying the messages
+    pub fn relay(&self, node: SimId) -> Option<(Relay, CopyFn<T>)> {
+        let relay = self.nodes.get(&node).copied().unwrap_or(self.default)?;
+        Some((relay, self.copy?))
+    }
+
+    /// the nodes `node` relays the message it received from `from` to,
+    /// its neighbours in the `topology` or all the `nodes`
+    pub fn recipients(
+        &mut self,
+        relay: Relay,
+        node: SimId,
+        from: SimId,
+        nodes: usize,
+        topology: Option<&Topology>,
+    ) -> Vec<SimId> {
+        let candidate = |peer: &SimId| *peer != node && *peer != from;
+
+        if let (Relay::Random(fanout), None) = (relay, topology) {
+            // the excluded nodes among all the `nodes`
+            let excluded = usize::from(node.into_index() < nodes)
+                + usize::from(from != node && from.into_index() < nodes);
+            let candidates = nodes - excluded;
+            // a few picks out of many nodes: drawn directly, rejecting the
+            // excluded and already picked nodes, without listing the nodes
+            if fanout.saturating_mul(2) <= candidates {
+                return self.sample(fanout, nodes, candidate);
+            }
+        }
+
+        let mut peers: Vec<SimId> = match topology {
+            Some(topology) => topology.neighbours(node).filter(candidate).collect(),
+            None => (0..nodes as u64)
+                .map(SimId::new)
+                .filter(candidate)
+                .collect(),
+        };
+
+        if let Relay::Random(fanout) = relay {
+            // a partial shuffle: the first `fanout` peers are picked at
+            // random among all of them
+            let fanout = fanout.min(peers.len());
+            for i in 0..fanout {
+                let j = i + self.rng.below((peers.len() - i) as u64) as usize;
+                peers.swap(i, j);
+            }
+            peers.truncate(fanout);
+        }
+
+        peers
+    }
+
+    /// `fanout` distinct nodes among all the `nodes` picked at random,
+    /// there must be at least twice as many `candidate` nodes
+    fn sample(
+        &mut self,
+        fanout: usize,
+        nodes: usize,
+        candidate: impl Fn(&SimId) -> bool,
+    ) -> Vec<SimId> {
+        let mut picked = HashSet::with_capacity(fanout);
+        let mut peers = Vec::with_capacity(fanout);
+        while peers.len() < fanout {
+            let peer = SimId::new(self.rng.below(nodes as u64));
+            if candidate(&peer) && picked.insert(peer) {
+                peers.push(peer);
+            }
+        }
+        peers
+    }
+}
+
+impl<T> Default for Relays<T> {
+    fn default() -> Self {
+        Self::new(SimRng::default())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn id(id: u64) -> SimId {
+        SimId::new(id)
+    }
+
+    #[test]
+    fn recipients() {
+        let mut relays = Relays::<u8>::default();
+        assert!(relays.relay(id(1)).is_none());
+
+        relays.set_default(Some(Relay::Flood), u8::clone);
+        relays.set(id(2), None, u8::clone);
+        relays.set(id(3), Some(Relay::Random(2)), u8::clone);
+        assert_eq!(
+            relays.relay(id(1)).map(|(relay, _)| relay),
+            Some(Relay::Flood)
+        );
+        assert!(relays.relay(id(2)).is_none());
+        relays.reset(id(2));
+        assert!(relays.relay(id(2)).is_some());
+
+        // all the nodes but the relay and the sender
+        let peers = relays.recipients(Relay::Flood, id(1), id(0), 5, None);
+        assert_eq!(peers, vec![id(2), id(3), id(4)]);
+
+        let topology = Topology::new(5, [(id(1), id(0)), (id(1), id(3)), (id(1), id(4))]).unwrap();
+        let peers = relays.recipients(Relay::Flood, id(1), id(0), 5, Some(&topology));
+        assert_eq!(peers, vec![id(3), id(4)]);
+
+        for _ in 0..100 {
+            let mut peers = relays.recipients(Relay::Random(2), id(1), id(0), 100, None);
+            assert_eq!(peers.len(), 2);
+            assert!(peers.iter().all(|peer| *peer != id(1) && *peer != id(0)));
+            peers.sort();
+            peers.dedup();
+            assert_eq!(peers.len(), 2);
+        }
+        // more than half of the nodes: picked among the list of the nodes
+        for _ in 0..100 {
+            let mut peers = relays.recipients(Relay::Random(3), id(1), id(0), 5, None);
+            peers.sort();
+            peers.dedup();
+            assert_eq!(peers, vec![id(2), id(3), id(4)]);
+        }
+        let peers = relays.recipients(Relay::Random(8), id(1), id(0), 5, Some(&topology));
+        assert_eq!(peers.len(), 2);
+    }
+
+    #[test]
+    fn seeded() {
+        let picks = |seed| {
+            let mut policy = crate::Policy::new();
+            policy.set_seed(seed);
+            let mut relays = Relays::<u8>::new(policy.rng(RNG_STREAM));
+            relays.recipients(Relay::Random(4), id(1), id(0), 1_000_000, None)
+        };
+
+        assert_eq!(picks(7), picks(7));
+        assert_ne!(picks(7), picks(8));
+    }
+}
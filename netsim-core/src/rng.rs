@@ -0,0 +1,125 @@
+/// A small, seedable, pseudo random number generator (xoshiro256++)
+///
+/// The simulation uses its own generator so the randomness it draws
+/// (the generated topologies, ...) is reproducible from a seed, across
+/// platforms and regardless of the number of threads used: independent
+/// generators are derived from the same seed with [`SimRng::stream`].
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub(crate) struct SimRng {
+    s: [u64; 4],
+}
+
+/// the SplitMix64 step, used to expand the seeds
+fn split_mix(state: &mut u64) -> u64 {
+    *state = state.wrapping_add(0x9E37_79B9_7F4A_7C15);
+    let mut z = *state;
+    z = (z ^ (z >> 30)).wrapping_mul(0xBF58_476D_1CE4_E5B9);
+    z = (z ^ (z >> 27)).wrapping_mul(0x94D0_49BB_1331_11EB);
+    z ^ (z >> 31)
+}
+
+/// seeded with `0`: the simulations are reproducible unless seeded otherwise
+impl Default for SimRng {
+    fn default() -> Self {
+        Self::new(0)
+    }
+}
+
+impl SimRng {
+    pub fn new(seed: u64) -> Self {
+        let mut state = seed;
+        Self {
+            s: [
+                split_mix(&mut state),
+                split_mix(&mut state),
+                split_mix(&mut state),
+                split_mix(&mut state),
+            ],
+        }
+    }
+
+    /// the generator of the given `stream` of the `seed`
+    pub fn stream(seed: u64, stream: u64) -> Self {
+        let mut state = stream;
+        Self::new(seed ^ split_mix(&mut state))
+    }
+
+    pub fn next_u64(&mut self) -> u64 {
+        let result = (self.s[0].wrapping_add(self.s[3]))
+            .rotate_left(23)
+            .wrapping_add(self.s[0]);
+
+        let t = self.s[1] << 17;
+        self.s[2] ^= self.s[0];
+        self.s[3] ^= self.s[1];
+        self.s[1] ^= self.s[2];
+        self.s[0] ^= self.s[3];
+        self.s[2] ^= t;
+        self.s[3] = self.s[3].rotate_left(45);
+
+        result
+    }
+
+    /// a uniformly distributed value in `0..n`
+    ///
+    /// `n` must not be `0`.
+    pub fn below(&mut self, n: u64) -> u64 {
+        debug_assert!(n > 0);
+
+        // Lemire's nearly divisionless method
+        let mut m = self.next_u64() as u128 * n as u128;
+        if (m as u64) < n {
+            let threshold = n.wrapping_neg() % n;
+            while (m as u64) < threshold {
+                m = self.next_u64() as u128 * n as u128;
+            }
+        }
+        (m >> 64) as u64
+    }
+
+    /// a uniformly distributed value in `[0, 1)`
+    pub fn next_f64(&mut self) -> f64 {
+        (self.next_u64() >> 11) as f64 * (1.0 / (1u64 << 53) as f64)
+    }
+
+    /// shuffle the slice in place (Fisher-Yates)
+    pub fn shuffle<T>(&mut self, slice: &mut [T]) {
+        for i in (1..slice.len()).rev() {
+            let j = self.below(i as u64 + 1) as usize;
+            slice.swap(i, j);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn reproducible() {
+        let mut a = SimRng::new(42);
+        let mut b = SimRng::new(42);
+        let mut c = SimRng::stream(42, 1);
+
+        for _ in 0..100 {
+            let value = a.next_u64();
+            assert_eq!(value, b.next_u64());
+            assert_ne!(value, c.next_u64());
+        }
+    }
+
+    #[test]
+    fn ranges() {
+        let mut rng = SimRng::new(7);
+        let mut seen = [false; 10];
+
+        for _ in 0..1_000 {
+            let value = rng.below(10) as usize;
+            seen[value] = true;
+
+            let value = rng.next_f64();
+            assert!((0.0..1.0).contains(&value));
+        }
+        assert!(seen.iter().all(|seen| *seen));
+    }
+}
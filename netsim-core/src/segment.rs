@@ -0,0 +1,18 @@
+use crate::{Bandwidth, Latency, SimId};
+
+/// A shared medium: a Wi-Fi network or a LAN segment
+///
+/// The airtime of the medium is a single resource shared by all its
+/// members: the messages between two members consume the `capacity` of
+/// the segment instead of the bandwidth of their edge, and are delivered
+/// after the `latency` of the segment. A broadcast (see
+/// `SimSocket::broadcast`) is transmitted once, consuming the airtime
+/// once, and reaches all the other members after the same latency.
+///
+/// A node is a member of one segment at most.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Segment {
+    pub capacity: Bandwidth,
+    pub latency: Latency,
+    pub members: Vec<SimId>,
+}
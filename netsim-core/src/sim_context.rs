@@ -1,11 +1,22 @@
 use crate::{
     bus::{open_bus, BusMessage, BusReceiver, BusSender},
     congestion_queue::CongestionQueue,
+    failure::{self, FailureQueue},
     policy::PolicyOutcome,
-    Edge, EdgePolicy, HasBytesSize, Msg, NodePolicy, Policy, SimConfiguration, SimId,
+    propagation::Propagations,
+    relay::{self, Relays},
+    stream::StreamId,
+    timer::TimerQueue,
+    Constellation, Edge, EdgePolicy, EdgeTrace, FailureProcess, HasBytesSize, LatencyDistribution,
+    Movement, Msg, MsgId, NodePolicy, Policy, PropagationReport, Relay, Segment, SimClock,
+    SimConfiguration, SimEvent, SimId, Topology, UtilisationSampler,
 };
 use anyhow::{bail, Context, Result};
-use std::{sync::mpsc, thread, time::Instant};
+use std::{
+    sync::mpsc,
+    thread,
+    time::{Duration, Instant},
+};
 
 /// the collections of up links to other sockets
 ///
@@ -15,7 +26,8 @@ pub(crate) type SimLinks<UpLink> = Vec<SimLink<UpLink>>;
 pub trait Link {
     type Msg: HasBytesSize;
 
-    fn send(&self, msg: Msg<Self::Msg>) -> Result<()>;
+    /// deliver an event (a message or an expired timer) to the node
+    fn send(&self, event: SimEvent<Self::Msg>) -> Result<()>;
 }
 
 pub(crate) struct SimLink<UpLink> {
@@ -32,6 +44,8 @@ pub(crate) struct SimLink<UpLink> {
 pub struct SimContextCore<UpLink: Link> {
     bus: BusSender<UpLink>,
 
+    clock: SimClock,
+
     mux_handler: thread::JoinHandle<Result<()>>,
 }
 
@@ -45,6 +59,19 @@ pub struct SimMuxCore<UpLink: Link> {
     links: SimLinks<UpLink>,
 
     msgs: CongestionQueue<UpLink::Msg>,
+
+    timers: TimerQueue,
+
+    failures: FailureQueue,
+
+    propagations: Propagations,
+
+    /// the sampler of the utilisation of the network, if any
+    sampler: Option<UtilisationSampler>,
+
+    relays: Relays<UpLink::Msg>,
+
+    clock: SimClock,
 }
 
 impl<UpLink> SimLink<UpLink> {
@@ -52,6 +79,14 @@ impl<UpLink> SimLink<UpLink> {
         Self { link, policy: None }
     }
 
+    #[cfg(test)]
+    pub(crate) fn with_policy(link: UpLink, policy: NodePolicy) -> Self {
+        Self {
+            link,
+            policy: Some(policy),
+        }
+    }
+
     pub(crate) fn policy(&self) -> Option<NodePolicy> {
         self.policy
     }
@@ -84,13 +119,15 @@ where
     ///
     pub fn with_config(configuration: SimConfiguration<UpLink::Msg>) -> Self {
         let (sender, receiver) = open_bus();
+        let clock = SimClock::new();
 
-        let mux = SimMuxCore::<UpLink>::new(configuration, receiver);
+        let mux = SimMuxCore::<UpLink>::new(configuration, receiver, clock.clone());
 
         let mux_handler = thread::spawn(|| run_mux(mux));
 
         Self {
             bus: sender,
+            clock,
             mux_handler,
         }
     }
@@ -139,11 +176,190 @@ where
         self.bus().send_node_policy_reset(node)
     }
 
+    /// Play the [`EdgeTrace`] on the edge: the capacity and the delay of the
+    /// edge follow the traces (they replace the bandwidth and the latency of
+    /// the [`EdgePolicy`]). The traces start playing now and loop forever.
+    ///
+    /// The same trace can be shared between many edges, each edge plays
+    /// it independently.
+    ///
+    #[inline]
+    pub fn set_edge_trace(&mut self, edge: Edge, trace: EdgeTrace) -> Result<()> {
+        self.bus().send_edge_trace_set(edge, trace)
+    }
+
+    /// Stop playing the traces of the edge, the [`EdgePolicy`] is used again.
+    ///
+    #[inline]
+    pub fn reset_edge_trace(&mut self, edge: Edge) -> Result<()> {
+        self.bus().send_edge_trace_reset(edge)
+    }
+
+    /// Draw the latency of the messages sent on the edge from the
+    /// [`LatencyDistribution`] (instead of using the latency of the
+    /// [`EdgePolicy`]). The latencies drawn are one-way latencies.
+    ///
+    #[inline]
+    pub fn set_edge_distribution(
+        &mut self,
+        edge: Edge,
+        distribution: LatencyDistribution,
+    ) -> Result<()> {
+        self.bus().send_edge_distribution_set(edge, distribution)
+    }
+
+    /// Stop drawing the latency of the edge from its distribution.
+    ///
+    #[inline]
+    pub fn reset_edge_distribution(&mut self, edge: Edge) -> Result<()> {
+        self.bus().send_edge_distribution_reset(edge)
+    }
+
+    /// Set the region of the node, see
+    /// [`SimContextCore::set_region_distribution`].
+    ///
+    #[inline]
+    pub fn set_node_region(&mut self, node: SimId, region: u32) -> Result<()> {
+        self.bus().send_node_region_set(node, region)
+    }
+
+    /// Draw the latency of the messages sent between the nodes of the
+    /// regions `a` and `b` from the [`LatencyDistribution`]. The single
+    /// distribution is shared by all the edges between the regions.
+    ///
+    /// The distribution set on an edge with
+    /// [`SimContextCore::set_edge_distribution`] takes precedence.
+    ///
+    #[inline]
+    pub fn set_region_distribution(
+        &mut self,
+        a: u32,
+        b: u32,
+        distribution: LatencyDistribution,
+    ) -> Result<()> {
+        self.bus()
+            .send_region_distribution_set((a, b), distribution)
+    }
+
+    /// Make the edges fail and recover randomly, following the
+    /// [`FailureProcess`]: the messages (and the bytes of the streams)
+    /// sent on an edge while it is down are dropped. The messages already
+    /// in flight when the edge fails are still delivered.
+    ///
+    /// Every edge of the class starts up and fails independently. Only the
+    /// edges that actually fail or recover cost some work to the
+    /// multiplexer.
+    ///
+    #[inline]
+    pub fn set_edge_failures(
+        &mut self,
+        edges: impl IntoIterator<Item = Edge>,
+        process: FailureProcess,
+    ) -> Result<()> {
+        self.bus()
+            .send_edge_failures_set(edges.into_iter().collect(), process)
+    }
+
+    /// Stop the failure process of the edges, they are up again.
+    ///
+    #[inline]
+    pub fn reset_edge_failures(&mut self, edges: impl IntoIterator<Item = Edge>) -> Result<()> {
+        self.bus()
+            .send_edge_failures_reset(edges.into_iter().collect())
+    }
+
+    /// Move the node following the [`Movement`]: the latency of the
+    /// messages between the node and the other nodes with a position (the
+    /// other moving nodes or the nodes located in the [`Topology`]) is
+    /// computed from their distance. It takes precedence over the latency
+    /// of the [`EdgePolicy`].
+    ///
+    /// The positions are updated periodically, see
+    /// [`Policy::set_mobility_interval`].
+    ///
+    #[inline]
+    pub fn set_node_movement(&mut self, node: SimId, movement: Movement) -> Result<()> {
+        self.bus().send_node_movement_set(node, movement.track()?)
+    }
+
+    /// Stop moving the node, the latency of its edges is no longer
+    /// computed from its position.
+    ///
+    #[inline]
+    pub fn reset_node_movement(&mut self, node: SimId) -> Result<()> {
+        self.bus().send_node_movement_reset(node)
+    }
+
+    /// Add the satellites and the ground stations of the [`Constellation`]
+    /// to the network: the messages between them go through the links of
+    /// the constellation at the time they are sent, or are dropped if the
+    /// nodes are not linked. The satellites start moving now.
+    ///
+    #[inline]
+    pub fn set_constellation(&mut self, constellation: Constellation) -> Result<()> {
+        self.bus().send_constellation_set(constellation)
+    }
+
+    /// Remove the [`Constellation`], its members are ordinary nodes again.
+    ///
+    #[inline]
+    pub fn reset_constellation(&mut self) -> Result<()> {
+        self.bus().send_constellation_reset()
+    }
+
+    /// Set the shared medium `id` (a Wi-Fi network or a LAN segment), see
+    /// [`Segment`]. It replaces the segment with the same identifier, if
+    /// any.
+    ///
+    #[inline]
+    pub fn set_segment(&mut self, id: u32, segment: Segment) -> Result<()> {
+        self.bus().send_segment_set(id, segment)
+    }
+
+    /// Remove the segment `id`, the broadcasts in flight on the segment are
+    /// dropped.
+    ///
+    #[inline]
+    pub fn reset_segment(&mut self, id: u32) -> Result<()> {
+        self.bus().send_segment_reset(id)
+    }
+
+    /// Restrict the network to the edges of the given [`Topology`]: the
+    /// messages sent to a node that is not a neighbour are dropped.
+    ///
+    /// The nodes of the topology are the [`SimId`]s `0..topology.nodes()`,
+    /// the topology may be set before the nodes are opened.
+    ///
+    #[inline]
+    pub fn set_topology(&mut self, topology: Topology) -> Result<()> {
+        self.bus().send_topology_set(topology)
+    }
+
+    /// Remove the [`Topology`], all the nodes can send messages to each
+    /// others again.
+    ///
+    #[inline]
+    pub fn reset_topology(&mut self) -> Result<()> {
+        self.bus().send_topology_reset()
+    }
+
     #[inline]
     pub fn bus(&self) -> BusSender<UpLink> {
         self.bus.clone()
     }
 
+    /// the clock of the simulation, shared with the multiplexer
+    #[inline]
+    pub fn clock(&self) -> SimClock {
+        self.clock.clone()
+    }
+
+    /// the current time of the simulation (see [`SimClock::now`])
+    #[inline]
+    pub fn now(&self) -> Duration {
+        self.clock.now()
+    }
+
     #[inline]
     pub fn new_link(&mut self, link: UpLink) -> Result<SimId> {
         let (send_reply, reply) = mpsc::sync_channel(1);
@@ -154,6 +370,87 @@ where
             .context("Failed to receive reply from the Routing thread")
     }
 
+    /// add all the `links` with a single request to the multiplexer
+    ///
+    /// Returns the [`SimId`] of the first link, the others have the
+    /// following identifiers in order. This is the way to create large
+    /// networks: [`SimContextCore::new_link`] waits for the multiplexer
+    /// for every node.
+    pub fn new_links(&mut self, links: Vec<UpLink>) -> Result<SimId> {
+        let (send_reply, reply) = mpsc::sync_channel(1);
+        self.bus().send_nodes_add(links, send_reply)?;
+
+        reply
+            .recv()
+            .context("Failed to receive reply from the Routing thread")
+    }
+
+    /// the report of the propagation `id`: the time each node received its
+    /// first message of the propagation, and from which node
+    ///
+    /// The propagation starts with the first message sent with its
+    /// identifier (see `SimSocket::send_to_tracked`). The report of a
+    /// propagation in progress is a snapshot, the propagation is
+    /// forgotten once reported complete (all the nodes were reached), or
+    /// if it never completes, [`SimConfiguration::propagation_expiry`]
+    /// after its start.
+    /// Returns `None` if the propagation is unknown.
+    pub fn propagation_report(&self, id: u64) -> Result<Option<PropagationReport>> {
+        let (send_reply, reply) = mpsc::sync_channel(1);
+        self.bus().send_propagation_report(id, send_reply)?;
+
+        reply
+            .recv()
+            .context("Failed to receive reply from the Routing thread")
+    }
+
+    /// sample the utilisation of the network (the bytes sent and received
+    /// by every node and the bytes that went through every edge and
+    /// segment) periodically, see [`UtilisationSampler`]
+    ///
+    /// Replaces the previous sampler, if any: its last samples are
+    /// written first.
+    pub fn set_utilisation_sampler(&mut self, sampler: UtilisationSampler) -> Result<()> {
+        self.bus().send_utilisation_sampler_set(sampler)
+    }
+
+    /// stop sampling the utilisation of the network, the last samples are
+    /// written once the multiplexer processes the request
+    pub fn reset_utilisation_sampler(&mut self) -> Result<()> {
+        self.bus().send_utilisation_sampler_reset()
+    }
+
+    /// relay the propagations inside the multiplexer from every node (but
+    /// the nodes with their own relay, see
+    /// [`SimContextCore::set_node_relay`]), `None` for the nodes to
+    /// receive the propagations instead, see [`Relay`]
+    ///
+    /// `copy` makes the copies of the content relayed to the neighbours.
+    pub fn set_default_relay(
+        &mut self,
+        relay: Option<Relay>,
+        copy: fn(&UpLink::Msg) -> UpLink::Msg,
+    ) -> Result<()> {
+        self.bus().send_relay_default(relay, copy)
+    }
+
+    /// relay the propagations inside the multiplexer from the node `id`,
+    /// `None` for the node to receive the propagations instead of the
+    /// default relay
+    pub fn set_node_relay(
+        &mut self,
+        id: SimId,
+        relay: Option<Relay>,
+        copy: fn(&UpLink::Msg) -> UpLink::Msg,
+    ) -> Result<()> {
+        self.bus().send_relay_set(id, relay, copy)
+    }
+
+    /// the node `id` relays as the default relay again
+    pub fn reset_node_relay(&mut self, id: SimId) -> Result<()> {
+        self.bus().send_relay_reset(id)
+    }
+
     /// Shutdown the context. All remaining opened [SimSocket] will become
     /// non functional and will return a `Disconnected` error when trying
     /// to receive messages or when trying to send messages
@@ -178,8 +475,16 @@ impl<UpLink> SimMuxCore<UpLink>
 where
     UpLink: Link,
 {
-    fn new(configuration: SimConfiguration<UpLink::Msg>, bus: BusReceiver<UpLink>) -> Self {
+    fn new(
+        configuration: SimConfiguration<UpLink::Msg>,
+        bus: BusReceiver<UpLink>,
+        clock: SimClock,
+    ) -> Self {
         let msgs = CongestionQueue::new();
+        let timers = TimerQueue::new();
+        let failures = FailureQueue::new(configuration.policy.rng(failure::RNG_STREAM));
+        let relays = Relays::new(configuration.policy.rng(relay::RNG_STREAM));
+        let propagations = Propagations::new(configuration.propagation_expiry);
         let next_sim_id = SimId::ZERO; // Starts at 0
         let links = Vec::new();
         Self {
@@ -188,6 +493,12 @@ where
             links,
             bus,
             msgs,
+            timers,
+            failures,
+            propagations,
+            sampler: None,
+            relays,
+            clock,
         }
     }
 
@@ -196,18 +507,108 @@ where
     /// The message propagation speed will be computed based on
     /// the upload, download and general link speed between
     pub fn inbound_message(&mut self, time: Instant, msg: Msg<UpLink::Msg>) -> Result<()> {
-        match self.configuration.policy.process(&msg) {
-            PolicyOutcome::Drop => {
-                if let Some(on_drop) = self.configuration.on_drop.as_ref() {
-                    on_drop.handle(msg.into_content())
-                }
+        span!("mux.inbound_message", id = u64::from(msg.id()));
+
+        if let Some(id) = msg.propagation() {
+            self.propagations.send(id, msg.from(), msg.time());
+        }
+        if self.failures.is_down(Edge::new((msg.from(), msg.to()))) {
+            self.drop_msg(msg);
+            return Ok(());
+        }
+
+        match self.configuration.policy.process(time, &msg, &self.links) {
+            PolicyOutcome::Drop => self.drop_msg(msg),
+            PolicyOutcome::Delay { delay } => {
+                usdt!(
+                    enqueue,
+                    u64::from(msg.id()),
+                    u64::from(msg.from()),
+                    u64::from(msg.to()),
+                    msg.content().bytes_size(),
+                    delay.as_nanos() as u64,
+                );
+                self.msgs.push(time + delay, msg)
             }
-            PolicyOutcome::Delay { delay } => self.msgs.push(time + delay, msg),
         }
 
         Ok(())
     }
 
+    /// process a message broadcast on a shared segment
+    ///
+    /// The message is dropped if the sender is not a member of the segment.
+    fn inbound_broadcast(
+        &mut self,
+        time: Instant,
+        segment: u32,
+        msg: Msg<UpLink::Msg>,
+        copy: fn(&UpLink::Msg) -> UpLink::Msg,
+    ) {
+        if let Some(id) = msg.propagation() {
+            self.propagations.send(id, msg.from(), msg.time());
+        }
+
+        let policy = &self.configuration.policy;
+        let latency = match policy.segment(segment) {
+            Some(medium) if policy.node_segment(msg.from()) == Some(segment) => {
+                medium.latency.to_duration()
+            }
+            _ => return self.drop_msg(msg),
+        };
+
+        self.msgs.push_broadcast(time + latency, segment, msg, copy)
+    }
+
+    /// cancel an in flight message sent by `from`, it is dropped (see
+    /// [`SimConfiguration::on_drop`]) and no longer consumes the network's
+    /// bandwidth
+    ///
+    /// Nothing happens if the message was already delivered or dropped,
+    /// if it was sent by another node or if it is not cancellable (see
+    /// [`Msg::with_cancellation`]).
+    pub fn cancel_message(&mut self, from: SimId, id: MsgId) {
+        if let Some(msg) = self.msgs.cancel(from, id) {
+            self.drop_msg(msg)
+        }
+    }
+
+    /// process bytes written on a stream
+    ///
+    /// Unlike the messages, the bytes of a stream are not queued
+    /// individually: they are appended to the stream's flow.
+    fn inbound_stream_data(&mut self, time: Instant, id: StreamId, data: Box<[u8]>) {
+        let Some(flow) = self.msgs.flow_mut(id) else {
+            // the stream was aborted
+            return;
+        };
+        if self.failures.is_down(Edge::new((flow.from(), flow.to()))) {
+            self.msgs.abort_flow(id);
+            return;
+        }
+
+        match self
+            .configuration
+            .policy
+            .process_edge(time, flow.from(), flow.to(), &self.links)
+        {
+            PolicyOutcome::Drop => self.msgs.abort_flow(id),
+            PolicyOutcome::Delay { delay } => flow.push(time + delay, data),
+        }
+    }
+
+    fn drop_msg(&mut self, msg: Msg<UpLink::Msg>) {
+        usdt!(
+            drop,
+            u64::from(msg.id()),
+            u64::from(msg.from()),
+            u64::from(msg.to()),
+        );
+        if let Some(on_drop) = self.configuration.on_drop.as_mut() {
+            on_drop.handle(msg.into_content())
+        }
+    }
+
     /// function to returns all the outbound messages
     ///
     /// these are the messages that are due to be sent.
@@ -225,22 +626,97 @@ where
     /// to forward
     pub fn earliest_outbound_time(&self) -> Option<Instant> {
         // self.msgs.time_to_next_msg()
-        None
+        self.timers.next_deadline()
     }
 
     fn propagate_msgs(&mut self, time: Instant) -> Result<()> {
-        for msg in self.outbound_messages(time)? {
+        span!("mux.propagate_msgs");
+
+        let msgs = self.outbound_messages(time)?;
+
+        for msg in self.msgs.take_expired() {
+            self.drop_msg(msg);
+        }
+
+        // the senders are notified first: the upload completes
+        // before (or at the same time as) the delivery
+        for completion in self.msgs.take_completions() {
+            self.deliver(SimEvent::SendCompletion(completion))?;
+        }
+
+        for mut msg in msgs {
+            msg.set_delivered(time);
+            usdt!(
+                deliver,
+                u64::from(msg.id()),
+                u64::from(msg.from()),
+                u64::from(msg.to()),
+                time.saturating_duration_since(msg.time()).as_nanos() as u64,
+            );
+            let delivery = msg
+                .propagation()
+                .and_then(|id| self.propagations.deliver(id, msg.from(), msg.to(), time));
+            // the relays consume the messages of the propagations followed,
+            // the content is given back through `on_drop` (the messages of
+            // the unknown or expired propagations are delivered as usual)
+            if let Some(first) = delivery {
+                if let Some((relay, copy)) = self.relays.relay(msg.to()) {
+                    if first {
+                        self.relay_msg(time, relay, copy, &msg)?;
+                    }
+                    self.drop_msg(msg);
+                    continue;
+                }
+            }
             self.propagate_msg(msg)?;
         }
 
         Ok(())
     }
 
+    /// the recipient of the message relays it to its neighbours, see
+    /// [`Relay`]
+    fn relay_msg(
+        &mut self,
+        time: Instant,
+        relay: Relay,
+        copy: fn(&UpLink::Msg) -> UpLink::Msg,
+        msg: &Msg<UpLink::Msg>,
+    ) -> Result<()> {
+        let peers = self.relays.recipients(
+            relay,
+            msg.to(),
+            msg.from(),
+            self.links.len(),
+            self.configuration.policy.topology(),
+        );
+
+        for peer in peers {
+            let content = copy(msg.content());
+            self.inbound_message(time, msg.relay_to(peer, content, time))?;
+        }
+
+        Ok(())
+    }
+
     fn propagate_msg(&mut self, msg: Msg<UpLink::Msg>) -> Result<()> {
-        let dst = msg.to();
+        self.deliver(SimEvent::Msg(msg))
+    }
+
+    /// deliver the expired timers to their nodes
+    fn expire_timers(&mut self, time: Instant) -> Result<()> {
+        while let Some(timer) = self.timers.pop(time) {
+            self.deliver(SimEvent::Timer(timer))?;
+        }
+
+        Ok(())
+    }
+
+    fn deliver(&mut self, event: SimEvent<UpLink::Msg>) -> Result<()> {
+        let dst = event.to();
 
         if let Some(sim_link) = self.links.get_mut(dst.into_index()) {
-            let _error = sim_link.link.send(msg);
+            let _error = sim_link.link.send(event);
             Ok(())
         } else {
             panic!("We shouldn't have any recipient of messages with an index that is not valid")
@@ -248,12 +724,41 @@ where
     }
 
     fn step(&mut self, time: Instant) -> Result<MuxOutcome> {
+        span!("mux.step");
+
+        self.clock.advance(time);
+        self.failures.advance(time);
+        self.configuration.policy.update_positions(time);
+
         while let Some(bus_message) = self.bus.try_receive() {
             match bus_message {
                 BusMessage::Disconnected | BusMessage::Shutdown => {
+                    self.reset_sampler(time)?;
                     return Ok(MuxOutcome::Shutdown);
                 }
                 BusMessage::Message(msg) => self.inbound_message(time, msg)?,
+                BusMessage::Broadcast(segment, msg, copy) => {
+                    self.inbound_broadcast(time, segment, msg, copy)
+                }
+                BusMessage::Cancel(from, id) => self.cancel_message(from, id),
+                BusMessage::StreamOpen(flow) => {
+                    debug_assert!(
+                        flow.to().into_index() < self.links.len(),
+                        "We should always have a node for any given ID"
+                    );
+                    let reader = flow.reader();
+                    self.msgs.open_flow(flow);
+                    self.deliver(SimEvent::Stream(reader))?;
+                }
+                BusMessage::StreamData(id, data) => self.inbound_stream_data(time, id, data),
+                BusMessage::StreamClose(id) => self.msgs.close_flow(id),
+                BusMessage::Timer(timer) => {
+                    debug_assert!(
+                        timer.node().into_index() < self.links.len(),
+                        "We should always have a node for any given ID"
+                    );
+                    self.timers.push(timer)
+                }
 
                 BusMessage::NodeAdd(link, reply) => {
                     let id = self.next_sim_id;
@@ -272,6 +777,20 @@ where
                     }
                 }
 
+                BusMessage::NodesAdd(links, reply) => {
+                    let id = self.next_sim_id;
+
+                    // the nodes are often added once, do not leave room
+                    // for as many again
+                    self.links.reserve_exact(links.len());
+                    self.links.extend(links.into_iter().map(SimLink::new));
+                    self.next_sim_id = SimId::new(self.links.len() as u64);
+
+                    if let Err(error) = reply.send(id) {
+                        bail!("Failed to reply to a new nodes creation request: {error:?}")
+                    }
+                }
+
                 BusMessage::NodePolicyDefault(policy) => {
                     self.configuration.policy.set_default_node_policy(policy)
                 }
@@ -300,14 +819,101 @@ where
                     self.configuration.policy.set_edge_policy(id, policy)
                 }
                 BusMessage::EdgePolicyReset(id) => self.configuration.policy.reset_edge_policy(id),
+                BusMessage::EdgeTraceSet(id, trace) => {
+                    self.configuration.policy.set_edge_trace(id, trace, time)
+                }
+                BusMessage::EdgeTraceReset(id) => self.configuration.policy.reset_edge_trace(id),
+                BusMessage::EdgeDistributionSet(id, distribution) => self
+                    .configuration
+                    .policy
+                    .set_edge_distribution(id, distribution),
+                BusMessage::EdgeDistributionReset(id) => {
+                    self.configuration.policy.reset_edge_distribution(id)
+                }
+                BusMessage::NodeRegionSet(id, region) => {
+                    self.configuration.policy.set_node_region(id, region)
+                }
+                BusMessage::RegionDistributionSet((a, b), distribution) => self
+                    .configuration
+                    .policy
+                    .set_region_distribution(a, b, distribution),
+                BusMessage::EdgeFailuresSet(edges, process) => {
+                    for edge in edges.iter().copied() {
+                        self.failures.set(time, edge, process)
+                    }
+                }
+                BusMessage::EdgeFailuresReset(edges) => {
+                    for edge in edges.iter().copied() {
+                        self.failures.reset(edge)
+                    }
+                }
+                BusMessage::SegmentSet(id, segment) => {
+                    self.configuration.policy.set_segment(id, segment)
+                }
+                BusMessage::SegmentReset(id) => self.configuration.policy.reset_segment(id),
+                BusMessage::NodeMovementSet(id, track) => self
+                    .configuration
+                    .policy
+                    .set_node_movement(time, id, *track),
+                BusMessage::NodeMovementReset(id) => {
+                    self.configuration.policy.reset_node_movement(id)
+                }
+                BusMessage::ConstellationSet(constellation) => {
+                    let policy = &mut self.configuration.policy;
+                    policy.set_constellation(*constellation);
+                    // the links exist for the messages of this step
+                    policy.update_positions(time);
+                }
+                BusMessage::ConstellationReset => self.configuration.policy.reset_constellation(),
+                BusMessage::TopologySet(topology) => {
+                    self.configuration.policy.set_topology(*topology)
+                }
+                BusMessage::TopologyReset => self.configuration.policy.reset_topology(),
+                BusMessage::PropagationReport(id, reply) => {
+                    let report = self.propagations.report(id, self.links.len(), &self.clock);
+                    // the requester may have given up waiting
+                    let _ = reply.send(report);
+                }
+                BusMessage::UtilisationSamplerSet(sampler) => {
+                    self.reset_sampler(time)?;
+                    self.msgs.record_activity(true);
+                    self.sampler = Some(*sampler);
+                }
+                BusMessage::UtilisationSamplerReset => self.reset_sampler(time)?,
+                BusMessage::RelayDefault(relay, copy) => self.relays.set_default(relay, copy),
+                BusMessage::RelaySet(id, relay, copy) => self.relays.set(id, relay, copy),
+                BusMessage::RelayReset(id) => self.relays.reset(id),
             }
         }
 
+        self.expire_timers(time)?;
         self.propagate_msgs(time)?;
 
+        if let (Some(sampler), Some(activity)) = (self.sampler.as_mut(), self.msgs.activity_mut()) {
+            sampler.sample(time, &self.clock, activity);
+        }
+
+        if let Some(on_drop) = self.configuration.on_drop.as_mut() {
+            on_drop.flush();
+        }
+
         Ok(MuxOutcome::Continue)
     }
 
+    /// stop sampling the utilisation of the network, the activity since
+    /// the last sample is written before the sampler is dropped
+    fn reset_sampler(&mut self, time: Instant) -> Result<()> {
+        let Some(mut sampler) = self.sampler.take() else {
+            return Ok(());
+        };
+
+        if let Some(activity) = self.msgs.activity_mut() {
+            sampler.flush(time, &self.clock, activity);
+        }
+        self.msgs.record_activity(false);
+        sampler.finish()
+    }
+
     pub(crate) fn sleep_time(&mut self, current_time: Instant) -> Instant {
         let Some(time) = self.earliest_outbound_time() else {
             return current_time + self.configuration.idle_duration;
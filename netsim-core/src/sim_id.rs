@@ -14,8 +14,10 @@ impl SimId {
         Self(id)
     }
 
+    /// the identifier following this one (the nodes added at once have
+    /// consecutive identifiers)
     #[must_use = "function does not modify the current value"]
-    pub(crate) fn next(self) -> Self {
+    pub fn next(self) -> Self {
         Self::new(self.0 + 1)
     }
 
@@ -26,6 +28,14 @@ impl SimId {
     }
 }
 
+impl From<SimId> for u64 {
+    /// the numerical value of the identifier, as exposed to the C bindings
+    #[inline(always)]
+    fn from(id: SimId) -> Self {
+        id.0
+    }
+}
+
 impl str::FromStr for SimId {
     type Err = anyhow::Error;
     fn from_str(s: &str) -> Result<Self, Self::Err> {
@@ -0,0 +1,696 @@
+/*!
+Ordered byte streams between two nodes
+
+A stream is opened by a node (the writer) to another node (the reader).
+The bytes written are sent through the multiplexer where the stream is
+accounted for as a single flow: the bytes in flight consume the bandwidth
+of the sender, the edge and the recipient the same way the messages do,
+but there is one entry in the multiplexer per stream rather than one per
+message.
+
+The stream has a window: the maximum number of bytes written but not
+yet read by the reader. Once the window is full the writer is blocked
+until the reader consumes the bytes (backpressure of the receive buffer).
+
+*/
+
+use crate::{bus::BusSender, congestion_queue::Progress, sim_context::Link, SimId};
+use std::{
+    collections::{BTreeMap, VecDeque},
+    fmt, io,
+    sync::{
+        atomic::{AtomicU64, Ordering},
+        Arc, Condvar, Mutex, MutexGuard,
+    },
+    task::{Context, Poll, Waker},
+    time::Instant,
+};
+
+/// the maximum number of bytes sent to the multiplexer in one write
+///
+/// Larger writes are split so that the recipient receives the beginning
+/// of the data before all of it has made its way through the network.
+pub const SEGMENT_SIZE: usize = 64 * 1024;
+
+/// The identifier of a stream in the SimNetwork
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash)]
+#[repr(C)]
+pub struct StreamId(u64);
+
+/// the next available [`StreamId`], shared by all the contexts of the process
+static NEXT_STREAM_ID: AtomicU64 = AtomicU64::new(0);
+
+/// The writing end of a stream, see [`StreamWriter::open`]
+///
+/// Dropping the writer closes the stream: the reader reads the end of
+/// the stream once all the bytes have been delivered. If the network
+/// drops the stream (or the multiplexer shuts down) first, the reader
+/// fails to read with [`io::ErrorKind::ConnectionReset`] instead.
+pub struct StreamWriter<UpLink: Link> {
+    shared: Arc<Shared>,
+    bus: BusSender<UpLink>,
+    closed: bool,
+}
+
+/// The reading end of a stream, delivered to the recipient of the stream
+/// as a [`SimEvent::Stream`].
+///
+/// Dropping the reader closes the stream: the writer fails to write with
+/// [`io::ErrorKind::BrokenPipe`].
+///
+/// [`SimEvent::Stream`]: crate::SimEvent::Stream
+pub struct StreamReader {
+    shared: Arc<Shared>,
+}
+
+/// state of the stream shared between the writer, the reader and the
+/// multiplexer
+struct Shared {
+    id: StreamId,
+    from: SimId,
+    to: SimId,
+    window: u64,
+    state: Mutex<State>,
+    readable: Condvar,
+    writable: Condvar,
+}
+
+#[derive(Default)]
+struct State {
+    /// the bytes delivered by the multiplexer, not yet read
+    buffer: VecDeque<u8>,
+    /// bytes written but not yet read
+    outstanding: u64,
+    /// the writer closed the stream and all the bytes were delivered
+    eof: bool,
+    /// the reader was dropped
+    reader_closed: bool,
+    /// the stream was aborted by the network or the multiplexer shut down
+    /// before the end of the stream, `eof` is set too
+    broken: bool,
+
+    read_waker: Option<Waker>,
+    write_waker: Option<Waker>,
+}
+
+/// A stream as seen by the multiplexer: the bytes in flight between the
+/// two nodes.
+///
+/// All the counters are offsets in the stream (in bytes) and at all time
+/// `queued >= ready >= progress.sender`.
+pub struct Flow {
+    shared: Arc<Shared>,
+    segments: VecDeque<Segment>,
+    /// the index in `segments` of the first segment that is still
+    /// delayed by the latency of the edge
+    delayed: usize,
+
+    queued: u64,
+    ready: u64,
+    pub(crate) progress: Progress,
+
+    /// the writer has closed the stream
+    closing: bool,
+}
+
+struct Segment {
+    /// the time the segment is past the latency of the edge
+    ready: Instant,
+    /// offset of the end of the segment in the stream
+    end: u64,
+    data: Box<[u8]>,
+}
+
+impl StreamId {
+    fn next() -> Self {
+        Self(NEXT_STREAM_ID.fetch_add(1, Ordering::Relaxed))
+    }
+}
+
+impl From<StreamId> for u64 {
+    #[inline(always)]
+    fn from(id: StreamId) -> Self {
+        id.0
+    }
+}
+
+impl fmt::Display for StreamId {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        self.0.fmt(f)
+    }
+}
+
+impl Shared {
+    fn lock(&self) -> MutexGuard<'_, State> {
+        // the lock is never held while calling user code so we
+        // can recover from a poisoned lock
+        self.state.lock().unwrap_or_else(|error| error.into_inner())
+    }
+
+    fn wake_reader(&self, mut state: MutexGuard<'_, State>) {
+        let waker = state.read_waker.take();
+        drop(state);
+        self.readable.notify_all();
+        if let Some(waker) = waker {
+            waker.wake()
+        }
+    }
+
+    fn wake_writer(&self, mut state: MutexGuard<'_, State>) {
+        let waker = state.write_waker.take();
+        drop(state);
+        self.writable.notify_all();
+        if let Some(waker) = waker {
+            waker.wake()
+        }
+    }
+}
+
+impl<UpLink: Link> StreamWriter<UpLink> {
+    /// open a new stream from `from` to `to` with the given `window`
+    ///
+    /// The recipient receives the [`StreamReader`] as a [`SimEvent::Stream`]
+    /// once the multiplexer has registered the stream.
+    ///
+    /// [`SimEvent::Stream`]: crate::SimEvent::Stream
+    pub fn open(bus: BusSender<UpLink>, from: SimId, to: SimId, window: u64) -> io::Result<Self> {
+        let shared = Arc::new(Shared {
+            id: StreamId::next(),
+            from,
+            to,
+            window: window.max(1),
+            state: Mutex::new(State::default()),
+            readable: Condvar::new(),
+            writable: Condvar::new(),
+        });
+
+        bus.send_stream_open(Flow::new(Arc::clone(&shared)))
+            .map_err(io::Error::other)?;
+
+        Ok(Self {
+            shared,
+            bus,
+            closed: false,
+        })
+    }
+
+    pub fn id(&self) -> StreamId {
+        self.shared.id
+    }
+
+    /// the recipient of the stream
+    pub fn to(&self) -> SimId {
+        self.shared.to
+    }
+
+    /// write up to `buf.len()` bytes to the stream, blocking until
+    /// there is room in the stream's window
+    ///
+    /// Returns the number of bytes written (at least one unless `buf`
+    /// is empty).
+    pub fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        if buf.is_empty() {
+            return Ok(0);
+        }
+
+        let mut state = self.shared.lock();
+        loop {
+            if let Some(len) = self.credit(&mut state, buf.len())? {
+                drop(state);
+                return self.send(&buf[..len]);
+            }
+
+            state = self
+                .shared
+                .writable
+                .wait(state)
+                .unwrap_or_else(|error| error.into_inner());
+        }
+    }
+
+    /// non blocking version of [`StreamWriter::write`]
+    ///
+    /// If the window is full the `cx`'s waker is woken once the reader
+    /// has consumed some of the bytes.
+    pub fn poll_write(&mut self, cx: &mut Context<'_>, buf: &[u8]) -> Poll<io::Result<usize>> {
+        if buf.is_empty() {
+            return Poll::Ready(Ok(0));
+        }
+
+        let mut state = self.shared.lock();
+        match self.credit(&mut state, buf.len()) {
+            Ok(Some(len)) => {
+                drop(state);
+                Poll::Ready(self.send(&buf[..len]))
+            }
+            Ok(None) => {
+                state.write_waker = Some(cx.waker().clone());
+                Poll::Pending
+            }
+            Err(error) => Poll::Ready(Err(error)),
+        }
+    }
+
+    /// close the stream, this is also done when the writer is dropped
+    pub fn close(&mut self) -> io::Result<()> {
+        if self.closed {
+            return Ok(());
+        }
+        self.closed = true;
+
+        self.bus
+            .send_stream_close(self.shared.id)
+            .map_err(io::Error::other)
+    }
+
+    /// reserve room in the window for up to `len` bytes
+    fn credit(&self, state: &mut State, len: usize) -> io::Result<Option<usize>> {
+        if self.closed || state.reader_closed || state.broken {
+            return Err(io::ErrorKind::BrokenPipe.into());
+        }
+
+        let available = self.shared.window.saturating_sub(state.outstanding);
+        if available == 0 {
+            return Ok(None);
+        }
+
+        let len = len.min(SEGMENT_SIZE).min(available as usize);
+        state.outstanding += len as u64;
+        Ok(Some(len))
+    }
+
+    fn send(&self, data: &[u8]) -> io::Result<usize> {
+        self.bus
+            .send_stream_data(self.shared.id, data.into())
+            .map_err(io::Error::other)?;
+
+        Ok(data.len())
+    }
+}
+
+impl<UpLink: Link> Drop for StreamWriter<UpLink> {
+    fn drop(&mut self) {
+        let _ = self.close();
+    }
+}
+
+impl StreamReader {
+    pub fn id(&self) -> StreamId {
+        self.shared.id
+    }
+
+    /// the node that opened the stream
+    pub fn from(&self) -> SimId {
+        self.shared.from
+    }
+
+    /// the node receiving the stream
+    pub fn to(&self) -> SimId {
+        self.shared.to
+    }
+
+    /// read up to `buf.len()` bytes from the stream, blocking until
+    /// some bytes are available
+    ///
+    /// Returns `0` once the stream is closed and all the bytes were read.
+    /// Fails with [`io::ErrorKind::ConnectionReset`] once the bytes
+    /// delivered were read if the stream was dropped by the network
+    /// before its end (a truncated stream).
+    pub fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        if buf.is_empty() {
+            return Ok(0);
+        }
+
+        let mut state = self.shared.lock();
+        while state.buffer.is_empty() && !state.eof {
+            state = self
+                .shared
+                .readable
+                .wait(state)
+                .unwrap_or_else(|error| error.into_inner());
+        }
+
+        self.consume(state, buf)
+    }
+
+    /// non blocking version of [`StreamReader::read`]
+    ///
+    /// If no bytes are available the `cx`'s waker is woken once the
+    /// multiplexer has delivered more bytes (or the end of the stream).
+    pub fn poll_read(&mut self, cx: &mut Context<'_>, buf: &mut [u8]) -> Poll<io::Result<usize>> {
+        if buf.is_empty() {
+            return Poll::Ready(Ok(0));
+        }
+
+        let mut state = self.shared.lock();
+        if state.buffer.is_empty() && !state.eof {
+            state.read_waker = Some(cx.waker().clone());
+            return Poll::Pending;
+        }
+
+        Poll::Ready(self.consume(state, buf))
+    }
+
+    fn consume(&self, mut state: MutexGuard<'_, State>, buf: &mut [u8]) -> io::Result<usize> {
+        if state.buffer.is_empty() && state.broken {
+            return Err(io::ErrorKind::ConnectionReset.into());
+        }
+
+        let len = buf.len().min(state.buffer.len());
+        for (dst, src) in buf.iter_mut().zip(state.buffer.drain(..len)) {
+            *dst = src;
+        }
+
+        if len > 0 {
+            state.outstanding -= len as u64;
+            self.shared.wake_writer(state);
+        }
+
+        Ok(len)
+    }
+}
+
+impl io::Read for StreamReader {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        StreamReader::read(self, buf)
+    }
+}
+
+impl Drop for StreamReader {
+    fn drop(&mut self) {
+        let mut state = self.shared.lock();
+        state.reader_closed = true;
+        state.buffer = VecDeque::new();
+        self.shared.wake_writer(state);
+    }
+}
+
+impl Flow {
+    fn new(shared: Arc<Shared>) -> Self {
+        Self {
+            shared,
+            segments: VecDeque::new(),
+            delayed: 0,
+            queued: 0,
+            ready: 0,
+            progress: Progress::default(),
+            closing: false,
+        }
+    }
+
+    pub(crate) fn id(&self) -> StreamId {
+        self.shared.id
+    }
+
+    pub(crate) fn from(&self) -> SimId {
+        self.shared.from
+    }
+
+    pub(crate) fn to(&self) -> SimId {
+        self.shared.to
+    }
+
+    /// the reader to deliver to the recipient of the stream
+    pub(crate) fn reader(&self) -> StreamReader {
+        StreamReader {
+            shared: Arc::clone(&self.shared),
+        }
+    }
+
+    /// queue bytes written by the writer, they will be ready to go
+    /// through the network at the `ready` time
+    pub(crate) fn push(&mut self, ready: Instant, data: Box<[u8]>) {
+        // the bytes of a stream are ordered: a segment cannot overtake
+        // the segments written before it (if the latency was reduced)
+        let ready = self
+            .segments
+            .back()
+            .map_or(ready, |last| std::cmp::max(last.ready, ready));
+
+        self.queued += data.len() as u64;
+        self.segments.push_back(Segment {
+            ready,
+            end: self.queued,
+            data,
+        });
+    }
+
+    pub(crate) fn close(&mut self) {
+        self.closing = true;
+    }
+
+    /// the network can no longer carry the stream: the reader fails to
+    /// read after the bytes already delivered and the writer fails to
+    /// write (see the `Drop` of the flow)
+    pub(crate) fn abort(self) {
+        drop(self)
+    }
+
+    /// the stream was closed and all its bytes delivered
+    pub(crate) fn is_finished(&self) -> bool {
+        self.closing && self.segments.is_empty()
+    }
+
+    /// returns `true` if the flow has bytes that may move forward at
+    /// the given `time`
+    pub(crate) fn is_active(&self, time: Instant) -> bool {
+        self.progress.receiver < self.ready
+            || self
+                .segments
+                .get(self.delayed)
+                .is_some_and(|segment| segment.ready <= time)
+    }
+
+    /// the number of bytes that are past the latency of the edge at the
+    /// given `time` (offset in the stream)
+    pub(crate) fn ready(&mut self, time: Instant) -> u64 {
+        while let Some(segment) = self.segments.get(self.delayed) {
+            if segment.ready > time {
+                break;
+            }
+            self.ready = segment.end;
+            self.delayed += 1;
+        }
+
+        self.ready
+    }
+
+    /// deliver to the reader the segments that have been fully received
+    pub(crate) fn deliver(&mut self) {
+        debug_assert!(self.queued >= self.ready);
+        debug_assert!(self.ready >= self.progress.sender);
+
+        let delivered = self
+            .segments
+            .iter()
+            .take_while(|segment| segment.end <= self.progress.receiver)
+            .count();
+        if delivered == 0 && !self.is_finished() {
+            return;
+        }
+
+        let mut state = self.shared.lock();
+        for segment in self.segments.drain(..delivered) {
+            if !state.reader_closed {
+                state.buffer.extend(segment.data.iter());
+            }
+        }
+        self.delayed -= delivered;
+
+        if self.is_finished() {
+            state.eof = true;
+        }
+
+        self.shared.wake_reader(state);
+    }
+}
+
+impl Drop for Flow {
+    /// a flow dropped before the end of its stream (aborted by the network
+    /// or the multiplexer shut down) breaks the stream, so neither the
+    /// reader nor the writer waits for it forever
+    fn drop(&mut self) {
+        let mut state = self.shared.lock();
+        if state.eof {
+            return;
+        }
+        state.eof = true;
+        state.broken = true;
+        self.shared.wake_reader(state);
+        self.shared.wake_writer(self.shared.lock());
+    }
+}
+
+/// the flows of the multiplexer, indexed by their [`StreamId`]
+pub(crate) type Flows = BTreeMap<StreamId, Flow>;
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{
+        congestion_queue::CongestionQueue,
+        sim_context::{SimContextCore, SimLink, SimLinks},
+        EdgePolicy, Latency, NodePolicy, PacketLoss, Policy, SimConfiguration, SimEvent,
+    };
+    use std::{sync::mpsc, thread, time::Duration};
+
+    const ALICE: SimId = SimId::new(0);
+    const BOB: SimId = SimId::new(1);
+
+    struct Noop;
+    impl std::task::Wake for Noop {
+        fn wake(self: Arc<Self>) {}
+    }
+
+    struct Up(mpsc::Sender<SimEvent<&'static str>>);
+    impl Link for Up {
+        type Msg = &'static str;
+        fn send(&self, event: SimEvent<Self::Msg>) -> anyhow::Result<()> {
+            Ok(self.0.send(event)?)
+        }
+    }
+
+    fn open(window: u64) -> (Flow, StreamReader) {
+        let shared = Arc::new(Shared {
+            id: StreamId::next(),
+            from: ALICE,
+            to: BOB,
+            window,
+            state: Mutex::new(State::default()),
+            readable: Condvar::new(),
+            writable: Condvar::new(),
+        });
+        let flow = Flow::new(shared);
+        let reader = flow.reader();
+        (flow, reader)
+    }
+
+    #[test]
+    #[allow(clippy::vec_init_then_push)]
+    fn flow_through_congestion_queue() {
+        let mut policy = Policy::new();
+        policy.set_default_node_policy(NodePolicy {
+            bandwidth_down: "100bps".parse().unwrap(),
+            bandwidth_up: "100bps".parse().unwrap(),
+            location: None,
+        });
+        policy.set_default_edge_policy(EdgePolicy {
+            bandwidth_down: "10bps".parse().unwrap(),
+            bandwidth_up: "10bps".parse().unwrap(),
+            latency: Latency::new(Duration::ZERO),
+            packet_loss: PacketLoss::NONE,
+        });
+
+        let mut nodes = SimLinks::<()>::new();
+        nodes.push(SimLink::new(()));
+        nodes.push(SimLink::new(()));
+
+        let mut cq = CongestionQueue::<&'static str>::new();
+        let (flow, mut reader) = open(1_000);
+        let id = flow.id();
+        cq.open_flow(flow);
+
+        let time = Instant::now();
+        // two segments of 15 bytes, the edge lets 10 bytes per second
+        reader.shared.lock().outstanding = 30;
+        cq.flow_mut(id).unwrap().push(time, vec![1; 15].into());
+        cq.flow_mut(id).unwrap().push(time, vec![2; 15].into());
+        cq.close_flow(id);
+
+        let mut buf = [0; 64];
+        let waker = Waker::from(Arc::new(Noop));
+        let poll = |reader: &mut StreamReader, buf: &mut [u8]| {
+            reader.poll_read(&mut Context::from_waker(&waker), buf)
+        };
+
+        // 10 bytes received
+        cq.pop_many(time, &nodes, &policy);
+        assert!(poll(&mut reader, &mut buf).is_pending());
+
+        // 20 bytes received: the first segment is delivered as soon as
+        // it is complete
+        cq.pop_many(time + Duration::from_secs(1), &nodes, &policy);
+        assert!(matches!(poll(&mut reader, &mut buf), Poll::Ready(Ok(15))));
+        assert_eq!(&buf[..15], &[1; 15]);
+
+        cq.pop_many(time + Duration::from_secs(2), &nodes, &policy);
+        assert!(matches!(poll(&mut reader, &mut buf), Poll::Ready(Ok(15))));
+        assert_eq!(&buf[..15], &[2; 15]);
+
+        // 30 bytes received: the stream was closed and all its bytes delivered
+        assert!(cq.flow_mut(id).is_none());
+        assert!(matches!(poll(&mut reader, &mut buf), Poll::Ready(Ok(0))));
+    }
+
+    #[test]
+    fn broken_stream() {
+        let (mut flow, mut reader) = open(1_000);
+        reader.shared.lock().outstanding = 10;
+        flow.push(Instant::now(), vec![1; 10].into());
+        flow.progress.receiver = 10;
+        flow.ready(Instant::now());
+        flow.deliver();
+        flow.abort();
+
+        // the bytes delivered are read, then the stream is truncated
+        let mut buf = [0; 64];
+        assert_eq!(reader.read(&mut buf).unwrap(), 10);
+        let error = reader.read(&mut buf).unwrap_err();
+        assert_eq!(error.kind(), io::ErrorKind::ConnectionReset);
+    }
+
+    #[test]
+    fn shutdown_while_blocked() {
+        // the bytes never make it through the edge
+        let mut policy = Policy::new();
+        policy.set_default_edge_policy(EdgePolicy {
+            bandwidth_down: "1bps".parse().unwrap(),
+            bandwidth_up: "1bps".parse().unwrap(),
+            latency: Latency::new(Duration::ZERO),
+            packet_loss: PacketLoss::NONE,
+        });
+        let mut context = SimContextCore::<Up>::with_config(SimConfiguration {
+            policy,
+            ..SimConfiguration::default()
+        });
+        let (alice, _) = mpsc::channel();
+        let (bob, events) = mpsc::channel();
+        let alice = context.new_link(Up(alice)).unwrap();
+        let bob = context.new_link(Up(bob)).unwrap();
+
+        let mut writer = StreamWriter::open(context.bus(), alice, bob, 10).unwrap();
+        let Ok(SimEvent::Stream(mut reader)) = events.recv_timeout(Duration::from_secs(5)) else {
+            panic!("the stream should have been opened")
+        };
+
+        let (done, results) = mpsc::channel();
+        let read = done.clone();
+        thread::spawn(move || {
+            let _ = read.send(("read", reader.read(&mut [0; 10]).map_err(|e| e.kind())));
+        });
+        thread::spawn(move || {
+            // the window is full after the first write
+            let _ = done.send(("write", writer.write(&[1; 10]).map_err(|e| e.kind())));
+            let _ = done.send(("write", writer.write(&[1; 10]).map_err(|e| e.kind())));
+        });
+        assert_eq!(
+            results.recv_timeout(Duration::from_secs(5)),
+            Ok(("write", Ok(10)))
+        );
+        thread::sleep(Duration::from_millis(50));
+
+        context.shutdown().unwrap();
+
+        let mut results: Vec<_> = (0..2)
+            .map(|_| results.recv_timeout(Duration::from_secs(5)).unwrap())
+            .collect();
+        results.sort();
+        assert_eq!(
+            results,
+            vec![
+                ("read", Err(io::ErrorKind::ConnectionReset)),
+                ("write", Err(io::ErrorKind::BrokenPipe)),
+            ]
+        );
+    }
+}
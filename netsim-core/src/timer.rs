@@ -0,0 +1,140 @@
+use crate::SimId;
+use std::{cmp::Ordering, collections::BinaryHeap, time::Instant};
+
+/// A timer requested by a node, see `timer_after` on the sockets.
+///
+/// Once the `deadline` is reached the multiplexer delivers the timer back
+/// to the node that requested it.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Timer {
+    node: SimId,
+    token: u64,
+    deadline: Instant,
+}
+
+/// The pending timers of all the nodes, ordered by deadline
+///
+/// Timers with the same deadline are delivered in the order they
+/// were requested.
+pub(crate) struct TimerQueue {
+    heap: BinaryHeap<Entry>,
+    next_seq: u64,
+}
+
+/// entry of the [`TimerQueue`], ordered so that the [`BinaryHeap`]
+/// (a max-heap) returns the earliest deadline first
+struct Entry {
+    seq: u64,
+    timer: Timer,
+}
+
+impl Timer {
+    pub fn new(node: SimId, token: u64, deadline: Instant) -> Self {
+        Self {
+            node,
+            token,
+            deadline,
+        }
+    }
+
+    /// the node that requested (and will receive) the timer
+    pub fn node(&self) -> SimId {
+        self.node
+    }
+
+    /// the user's value given when requesting the timer
+    pub fn token(&self) -> u64 {
+        self.token
+    }
+
+    /// the time at which the timer expires
+    pub fn deadline(&self) -> Instant {
+        self.deadline
+    }
+}
+
+impl TimerQueue {
+    pub fn new() -> Self {
+        Self {
+            heap: BinaryHeap::new(),
+            next_seq: 0,
+        }
+    }
+
+    pub fn push(&mut self, timer: Timer) {
+        let seq = self.next_seq;
+        self.next_seq += 1;
+
+        self.heap.push(Entry { seq, timer });
+    }
+
+    /// the deadline of the next timer to expire
+    pub fn next_deadline(&self) -> Option<Instant> {
+        self.heap.peek().map(|entry| entry.timer.deadline)
+    }
+
+    /// pop the next timer if it has expired at the given `time`
+    pub fn pop(&mut self, time: Instant) -> Option<Timer> {
+        if self.next_deadline()? > time {
+            return None;
+        }
+
+        self.heap.pop().map(|entry| entry.timer)
+    }
+}
+
+impl Entry {
+    fn key(&self) -> (Instant, u64) {
+        (self.timer.deadline, self.seq)
+    }
+}
+
+impl PartialEq for Entry {
+    fn eq(&self, other: &Self) -> bool {
+        self.key() == other.key()
+    }
+}
+impl Eq for Entry {}
+impl PartialOrd for Entry {
+    fn partial_cmp(&self, other: &Self) -> Option<Ordering> {
+        Some(self.cmp(other))
+    }
+}
+impl Ord for Entry {
+    fn cmp(&self, other: &Self) -> Ordering {
+        other.key().cmp(&self.key())
+    }
+}
+
+impl Default for TimerQueue {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::time::Duration;
+
+    #[test]
+    fn pop_in_order() {
+        let time = Instant::now();
+        let node = SimId::new(0);
+        let mut queue = TimerQueue::new();
+
+        queue.push(Timer::new(node, 2, time + Duration::from_millis(2)));
+        queue.push(Timer::new(node, 1, time + Duration::from_millis(1)));
+        queue.push(Timer::new(node, 3, time + Duration::from_millis(2)));
+
+        assert_eq!(queue.next_deadline(), Some(time + Duration::from_millis(1)));
+        assert!(queue.pop(time).is_none());
+
+        let time = time + Duration::from_millis(2);
+        assert_eq!(queue.pop(time).map(|t| t.token()), Some(1));
+        assert_eq!(queue.pop(time).map(|t| t.token()), Some(2));
+        assert_eq!(queue.pop(time).map(|t| t.token()), Some(3));
+        assert!(queue.pop(time).is_none());
+        assert!(queue.next_deadline().is_none());
+    }
+}
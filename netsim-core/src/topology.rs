@@ -0,0 +1,372 @@
+use crate::{Edge, EdgePolicy, NodePolicy, SimId};
+use anyhow::{anyhow, ensure, Result};
+
+/// A fixed, undirected graph of the nodes allowed to exchange messages
+///
+/// When a topology is set on the [`Policy`], the messages (and the streams)
+/// between two nodes that are not neighbours are dropped by the network.
+/// The nodes are identified by their [`SimId`]: the topology of `n` nodes
+/// covers the ids `0..n` (the order in which the nodes are opened), nodes
+/// beyond that have no neighbours.
+///
+/// The neighbours are stored in the compressed sparse row format (one
+/// sorted slice of neighbours per node). The rows with a lot of neighbours
+/// (where a bitset of all the nodes is smaller than the row itself) also
+/// get a bitset so the membership check is a single bit test. The other
+/// rows are binary searched, they are small by construction.
+///
+/// The topology also holds the policies of its edges (see
+/// [`Topology::set_edge_policy`]), they are only allocated for the edges
+/// that exist, and of its nodes (see [`Topology::set_node_policy`]). The
+/// policies set on the context take precedence.
+///
+/// [`Policy`]: crate::Policy
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Topology {
+    /// the neighbours of node `n` are `neighbours[offsets[n]..offsets[n + 1]]`
+    offsets: Box<[usize]>,
+    neighbours: Box<[u32]>,
+
+    /// the index of the node's row in `bits`, or [`Self::SPARSE`]
+    dense: Box<[u32]>,
+    /// the bitsets of the dense rows, `words` per row
+    bits: Box<[u64]>,
+    words: usize,
+
+    /// the policies of the edges, indexed by [`Self::edge_index`] (there
+    /// is one entry in each direction). Only allocated once a policy is set.
+    edge_policies: Vec<Option<EdgePolicy>>,
+    /// the policies of the nodes. Only allocated once a policy is set.
+    node_policies: Vec<Option<NodePolicy>>,
+}
+
+impl Topology {
+    const SPARSE: u32 = u32::MAX;
+
+    /// build the topology of `nodes` nodes from its undirected edges
+    ///
+    /// Duplicated edges (in either direction) are merged. Edges from a node
+    /// to itself and edges with a node out of `0..nodes` are rejected.
+    pub fn new<I>(nodes: usize, edges: I) -> Result<Self>
+    where
+        I: IntoIterator<Item = (SimId, SimId)>,
+    {
+        ensure!(
+            nodes < Self::SPARSE as usize,
+            "A topology supports at most {} nodes",
+            Self::SPARSE - 1
+        );
+
+        let mut pairs = Vec::new();
+        for (a, b) in edges {
+            let (a, b) = (u64::from(a), u64::from(b));
+            ensure!(
+                a < nodes as u64 && b < nodes as u64,
+                "Edge ({a}, {b}) is not in the topology of {nodes} nodes"
+            );
+            ensure!(a != b, "Node {a} cannot be its own neighbour");
+
+            pairs.push((a as u32, b as u32));
+        }
+
+        Ok(Self::from_pairs(nodes, pairs))
+    }
+
+    /// build the topology from valid undirected edges, the duplicates
+    /// are merged
+    pub(crate) fn from_pairs(nodes: usize, mut pairs: Vec<(u32, u32)>) -> Self {
+        let len = pairs.len();
+        pairs.reserve(len);
+        for i in 0..len {
+            let (a, b) = pairs[i];
+            pairs.push((b, a));
+        }
+        pairs.sort_unstable();
+        pairs.dedup();
+
+        let mut offsets = vec![0; nodes + 1];
+        for (a, _) in pairs.iter() {
+            offsets[*a as usize + 1] += 1;
+        }
+        for n in 0..nodes {
+            offsets[n + 1] += offsets[n];
+        }
+        let neighbours = pairs.into_iter().map(|(_, b)| b).collect();
+
+        Self::from_csr(offsets.into(), neighbours)
+    }
+
+    /// build the topology from rows that are already sorted and symmetric
+    fn from_csr(offsets: Box<[usize]>, neighbours: Box<[u32]>) -> Self {
+        let nodes = offsets.len() - 1;
+        let words = nodes.div_ceil(64);
+
+        let mut dense = vec![Self::SPARSE; nodes];
+        let mut bits = Vec::new();
+        for (n, row) in dense.iter_mut().enumerate() {
+            let start = offsets[n];
+            let end = offsets[n + 1];
+
+            // the bitset costs `nodes` bits, the row 32 bits per neighbour
+            if (end - start) * 32 < nodes {
+                continue;
+            }
+
+            *row = (bits.len() / words) as u32;
+            let base = bits.len();
+            bits.resize(base + words, 0);
+            for neighbour in &neighbours[start..end] {
+                let neighbour = *neighbour as usize;
+                bits[base + neighbour / 64] |= 1 << (neighbour % 64);
+            }
+        }
+
+        Self {
+            offsets,
+            neighbours,
+            dense: dense.into(),
+            bits: bits.into(),
+            words,
+            edge_policies: Vec::new(),
+            node_policies: Vec::new(),
+        }
+    }
+
+    /// the number of nodes of the topology
+    pub fn nodes(&self) -> usize {
+        self.offsets.len() - 1
+    }
+
+    /// the number of (undirected) edges of the topology
+    pub fn edges(&self) -> usize {
+        self.neighbours.len() / 2
+    }
+
+    /// the number of neighbours of the node
+    pub fn degree(&self, node: SimId) -> usize {
+        self.row(node).len()
+    }
+
+    /// the neighbours of the node, in increasing order
+    pub fn neighbours(&self, node: SimId) -> impl Iterator<Item = SimId> + '_ {
+        self.row(node)
+            .iter()
+            .map(|neighbour| SimId::new(*neighbour as u64))
+    }
+
+    /// check the nodes `a` and `b` are neighbours
+    #[inline]
+    pub fn connected(&self, a: SimId, b: SimId) -> bool {
+        let (Some(a), Some(b)) = (self.index(a), self.index(b)) else {
+            return false;
+        };
+
+        match self.dense[a] {
+            Self::SPARSE => self.row_at(a).binary_search(&(b as u32)).is_ok(),
+            row => {
+                let word = self.bits[row as usize * self.words + b / 64];
+                word & (1 << (b % 64)) != 0
+            }
+        }
+    }
+
+    /// the policy set on the node, if any
+    #[inline]
+    pub fn node_policy(&self, node: SimId) -> Option<NodePolicy> {
+        self.node_policies.get(node.into_index()).copied().flatten()
+    }
+
+    /// set the policy of a node of the topology
+    ///
+    /// Returns an error if the node is not part of the topology.
+    pub fn set_node_policy(&mut self, node: SimId, policy: NodePolicy) -> Result<()> {
+        let index = self
+            .index(node)
+            .ok_or_else(|| anyhow!("Node {node} is not part of the topology"))?;
+
+        if self.node_policies.is_empty() {
+            self.node_policies = vec![None; self.nodes()];
+        }
+        self.node_policies[index] = Some(policy);
+        Ok(())
+    }
+
+    /// the policy set on the edge, if any
+    pub fn edge_policy(&self, edge: Edge) -> Option<EdgePolicy> {
+        if self.edge_policies.is_empty() {
+            return None;
+        }
+
+        self.edge_index(edge.smaller_id, edge.larger_id)
+            .and_then(|index| self.edge_policies[index])
+    }
+
+    /// set the policy of an edge of the topology
+    ///
+    /// Returns an error if the edge is not part of the topology.
+    pub fn set_edge_policy(&mut self, edge: Edge, policy: EdgePolicy) -> Result<()> {
+        self.set_edge_policy_entry(edge, Some(policy))
+    }
+
+    /// remove the policy of the edge, the default [`EdgePolicy`] is used
+    pub fn reset_edge_policy(&mut self, edge: Edge) {
+        if !self.edge_policies.is_empty() {
+            let _ = self.set_edge_policy_entry(edge, None);
+        }
+    }
+
+    /// set the policies of all the edges of the topology at once
+    ///
+    /// `policy` is called with the two nodes of every edge, in both
+    /// directions: it is expected to be symmetric. The rows of the
+    /// topology are processed in parallel on `threads` threads.
+    pub fn set_edge_policies_with<F>(&mut self, threads: usize, policy: F)
+    where
+        F: Fn(SimId, SimId) -> Option<EdgePolicy> + Sync,
+    {
+        let mut edge_policies = vec![None; self.neighbours.len()];
+        let nodes = self.nodes();
+        let rows = nodes.div_ceil(threads.max(1)).max(1);
+
+        std::thread::scope(|scope| {
+            let mut remaining = edge_policies.as_mut_slice();
+            for start in (0..nodes).step_by(rows) {
+                let end = (start + rows).min(nodes);
+                let (chunk, rest) = remaining.split_at_mut(self.offsets[end] - self.offsets[start]);
+                remaining = rest;
+
+                let policy = &policy;
+                let topology = &*self;
+                scope.spawn(move || {
+                    let base = topology.offsets[start];
+                    for a in start..end {
+                        for position in topology.offsets[a]..topology.offsets[a + 1] {
+                            let b = topology.neighbours[position] as u64;
+                            chunk[position - base] = policy(SimId::new(a as u64), SimId::new(b));
+                        }
+                    }
+                });
+            }
+        });
+
+        self.edge_policies = edge_policies;
+    }
+
+    /// all the edge policies that are set
+    pub(crate) fn edge_policies(&self) -> impl Iterator<Item = (Edge, EdgePolicy)> + '_ {
+        (0..self.nodes()).flat_map(move |a| {
+            (self.offsets[a]..self.offsets[a + 1]).filter_map(move |position| {
+                let b = self.neighbours[position] as usize;
+                if a > b {
+                    return None;
+                }
+
+                let policy = self.edge_policies.get(position).copied().flatten()?;
+                let edge = Edge::new((SimId::new(a as u64), SimId::new(b as u64)));
+                Some((edge, policy))
+            })
+        })
+    }
+
+    fn set_edge_policy_entry(&mut self, edge: Edge, policy: Option<EdgePolicy>) -> Result<()> {
+        let (a, b) = (edge.smaller_id, edge.larger_id);
+        let not_an_edge = || anyhow!("Edge ({a}, {b}) is not part of the topology");
+        let ab = self.edge_index(a, b).ok_or_else(not_an_edge)?;
+        let ba = self.edge_index(b, a).ok_or_else(not_an_edge)?;
+
+        if self.edge_policies.is_empty() {
+            self.edge_policies = vec![None; self.neighbours.len()];
+        }
+        self.edge_policies[ab] = policy;
+        self.edge_policies[ba] = policy;
+        Ok(())
+    }
+
+    /// the position of `b` in the row of `a`, amongst all the neighbours
+    /// of the topology. This is used to index the state of the edges.
+    fn edge_index(&self, a: SimId, b: SimId) -> Option<usize> {
+        let a = self.index(a)?;
+        let b = u32::try_from(u64::from(b)).ok()?;
+
+        self.position(a, b)
+    }
+
+    #[inline]
+    fn position(&self, a: usize, b: u32) -> Option<usize> {
+        let position = self.row_at(a).binary_search(&b).ok()?;
+        Some(self.offsets[a] + position)
+    }
+
+    #[inline]
+    fn index(&self, node: SimId) -> Option<usize> {
+        let index = node.into_index();
+        (index < self.nodes()).then_some(index)
+    }
+
+    fn row(&self, node: SimId) -> &[u32] {
+        match self.index(node) {
+            Some(index) => self.row_at(index),
+            None => &[],
+        }
+    }
+
+    #[inline]
+    fn row_at(&self, index: usize) -> &[u32] {
+        &self.neighbours[self.offsets[index]..self.offsets[index + 1]]
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn id(id: u64) -> SimId {
+        SimId::new(id)
+    }
+
+    #[test]
+    fn sparse_and_dense_rows() {
+        // node 0 is connected to all the other nodes (dense row), the
+        // other nodes form a ring (sparse rows)
+        let nodes = 100;
+        let star = (1..nodes).map(|n| (id(0), id(n)));
+        let ring = (1..nodes).map(|n| (id(n), id(n % (nodes - 1) + 1)));
+        // duplicates in the other direction are merged
+        let duplicates = [(id(2), id(1)), (id(5), id(0))];
+
+        let topology = Topology::new(nodes as usize, star.chain(ring).chain(duplicates)).unwrap();
+
+        assert_eq!(topology.nodes(), 100);
+        assert_eq!(topology.edges(), 2 * 99);
+        assert_ne!(topology.dense[0], Topology::SPARSE);
+        assert_eq!(topology.dense[1], Topology::SPARSE);
+
+        assert_eq!(topology.degree(id(0)), 99);
+        assert_eq!(topology.degree(id(1)), 3);
+        assert_eq!(
+            topology.neighbours(id(1)).collect::<Vec<_>>(),
+            [id(0), id(2), id(99)]
+        );
+
+        assert!(topology.connected(id(0), id(42)));
+        assert!(topology.connected(id(42), id(0)));
+        assert!(topology.connected(id(42), id(43)));
+        assert!(!topology.connected(id(42), id(44)));
+        assert!(!topology.connected(id(0), id(0)));
+        // out of the topology
+        assert!(!topology.connected(id(0), id(100)));
+        assert!(!topology.connected(id(100), id(0)));
+        assert_eq!(topology.degree(id(100)), 0);
+
+        let index = topology.edge_index(id(1), id(2)).unwrap();
+        assert_eq!(topology.neighbours[index], 2);
+        assert!(topology.edge_index(id(1), id(3)).is_none());
+    }
+
+    #[test]
+    fn invalid_edges() {
+        assert!(Topology::new(2, [(id(0), id(2))]).is_err());
+        assert!(Topology::new(2, [(id(1), id(1))]).is_err());
+        assert!(Topology::new(0, []).is_ok());
+    }
+}
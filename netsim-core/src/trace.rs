@@ -0,0 +1,357 @@
+use crate::{
+    lines::{for_each_line, open, split_row},
+    Bandwidth, Latency,
+};
+use anyhow::{ensure, Result};
+use std::{
+    io::BufRead,
+    path::Path,
+    str::FromStr,
+    sync::Arc,
+    time::{Duration, Instant},
+};
+
+/// the number of bytes delivered by one opportunity of a Mahimahi trace
+pub const MAHIMAHI_PACKET_SIZE: u64 = 1_500;
+
+/// The traces played back on an edge, see `SimContext::set_edge_trace`
+///
+/// The traces replace the bandwidth and the latency of the edge's
+/// [`EdgePolicy`] while they are set. They start playing when they are
+/// set and loop forever.
+///
+/// [`EdgePolicy`]: crate::EdgePolicy
+#[derive(Debug, Default, Clone, PartialEq, Eq)]
+pub struct EdgeTrace {
+    pub capacity: Option<CapacityTrace>,
+    pub delay: Option<DelayTrace>,
+}
+
+/// A trace of the capacity of a link
+///
+/// The trace is loaded once and shared (it is cheap to clone) between all
+/// the edges that use it, each edge plays it back independently.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct CapacityTrace {
+    inner: Arc<Capacity>,
+}
+
+/// A trace of the delay of a link
+///
+/// Like the [`CapacityTrace`], it is cheap to clone and share.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct DelayTrace {
+    inner: Arc<Delay>,
+}
+
+#[derive(Debug, PartialEq, Eq)]
+enum Capacity {
+    /// the times (in nanoseconds) of the delivery opportunities, sorted
+    Opportunities { times: Box<[u64]>, period: u64 },
+    /// the times (in nanoseconds) at which the rate changes and the number
+    /// of bytes delivered until then
+    Rates {
+        points: Box<[(u64, u64)]>,
+        rates: Box<[Bandwidth]>,
+        period: u64,
+    },
+}
+
+#[derive(Debug, PartialEq, Eq)]
+struct Delay {
+    /// the times (in nanoseconds) at which the delay changes
+    points: Box<[(u64, Duration)]>,
+    period: u64,
+}
+
+impl CapacityTrace {
+    /// read a Mahimahi packet delivery trace: one line per opportunity to
+    /// deliver a packet of [`MAHIMAHI_PACKET_SIZE`] bytes, the time of the
+    /// opportunity in milliseconds
+    ///
+    /// The trace loops after the time of its last opportunity.
+    pub fn read_mahimahi<R: BufRead>(reader: R) -> Result<Self> {
+        let mut times = Vec::new();
+        for_each_line(reader, |line| {
+            let time = millis(line.parse()?);
+            if let Some(last) = times.last() {
+                ensure!(*last <= time, "The times must be increasing");
+            }
+            times.push(time);
+            Ok(())
+        })?;
+
+        let period = times.last().copied().unwrap_or_default();
+        ensure!(period > 0, "The trace must last at least one millisecond");
+
+        Ok(Self {
+            inner: Arc::new(Capacity::Opportunities {
+                times: times.into(),
+                period,
+            }),
+        })
+    }
+
+    /// read a CSV trace of `<time in ms>,<bandwidth>` rows: the bandwidth
+    /// (`10mbps` or a number of bits per second) holds from the time of
+    /// its row until the time of the next row
+    ///
+    /// The trace loops after the time of its last row (whose bandwidth is
+    /// not used).
+    pub fn read_csv<R: BufRead>(reader: R) -> Result<Self> {
+        let mut rows: Vec<(u64, Bandwidth)> = Vec::new();
+        for_each_line(reader, |line| {
+            let (time, bandwidth) = split_row(line)?;
+            let time = millis(time.parse()?);
+            let bandwidth = match bandwidth.parse::<u64>() {
+                Ok(bits) => Bandwidth::bits_per_second(bits),
+                Err(_) => Bandwidth::from_str(bandwidth)?,
+            };
+            if let Some((last, _)) = rows.last() {
+                ensure!(*last < time, "The times must be increasing");
+            }
+            rows.push((time, bandwidth));
+            Ok(())
+        })?;
+        ensure!(
+            rows.len() >= 2 && rows[0].0 == 0,
+            "Expecting at least 2 rows, starting at the time 0"
+        );
+
+        let mut points = Vec::with_capacity(rows.len());
+        let mut bytes = 0u64;
+        for window in rows.windows(2) {
+            let ((start, rate), (end, _)) = (window[0], window[1]);
+            points.push((start, bytes));
+            bytes = bytes.saturating_add(delivered(rate, end - start));
+        }
+        let (period, _) = rows[rows.len() - 1];
+        points.push((period, bytes));
+        let rates = rows.into_iter().map(|(_, rate)| rate).collect();
+
+        Ok(Self {
+            inner: Arc::new(Capacity::Rates {
+                points: points.into(),
+                rates,
+                period,
+            }),
+        })
+    }
+
+    /// read the Mahimahi trace at the given path
+    pub fn open_mahimahi(path: impl AsRef<Path>) -> Result<Self> {
+        Self::read_mahimahi(open(path.as_ref())?)
+    }
+
+    /// read the CSV trace at the given path
+    pub fn open_csv(path: impl AsRef<Path>) -> Result<Self> {
+        Self::read_csv(open(path.as_ref())?)
+    }
+
+    /// the number of bytes the link can deliver from the start of the
+    /// trace until `elapsed`
+    pub fn bytes_until(&self, elapsed: Duration) -> u64 {
+        let elapsed = elapsed.as_nanos().min(u64::MAX as u128) as u64;
+
+        match self.inner.as_ref() {
+            Capacity::Opportunities { times, period } => {
+                let (loops, elapsed) = (elapsed / period, elapsed % period);
+                let within = times.partition_point(|time| *time <= elapsed) as u64;
+
+                (loops * times.len() as u64 + within) * MAHIMAHI_PACKET_SIZE
+            }
+            Capacity::Rates {
+                points,
+                rates,
+                period,
+            } => {
+                let (loops, elapsed) = (elapsed / period, elapsed % period);
+                let (_, total) = points[points.len() - 1];
+                let index = points.partition_point(|(time, _)| *time <= elapsed) - 1;
+                let (start, bytes) = points[index];
+
+                loops
+                    .saturating_mul(total)
+                    .saturating_add(bytes)
+                    .saturating_add(delivered(rates[index], elapsed - start))
+            }
+        }
+    }
+}
+
+impl DelayTrace {
+    /// read a CSV trace of `<time in ms>,<delay>` rows: the delay (`20ms`
+    /// or a number of milliseconds) holds from the time of its row until
+    /// the time of the next row
+    ///
+    /// The trace loops after the time of its last row (whose delay is not
+    /// used).
+    pub fn read_csv<R: BufRead>(reader: R) -> Result<Self> {
+        let mut points: Vec<(u64, Duration)> = Vec::new();
+        for_each_line(reader, |line| {
+            let (time, delay) = split_row(line)?;
+            let time = millis(time.parse()?);
+            let delay = match delay.parse::<u64>() {
+                Ok(delay) => Duration::from_millis(delay),
+                Err(_) => Latency::from_str(delay)?.to_duration(),
+            };
+            if let Some((last, _)) = points.last() {
+                ensure!(*last < time, "The times must be increasing");
+            }
+            points.push((time, delay));
+            Ok(())
+        })?;
+        ensure!(
+            points.len() >= 2 && points[0].0 == 0,
+            "Expecting at least 2 rows, starting at the time 0"
+        );
+
+        let (period, _) = points.pop().unwrap();
+        Ok(Self {
+            inner: Arc::new(Delay {
+                points: points.into(),
+                period,
+            }),
+        })
+    }
+
+    /// read the CSV trace at the given path
+    pub fn open_csv(path: impl AsRef<Path>) -> Result<Self> {
+        Self::read_csv(open(path.as_ref())?)
+    }
+
+    /// the delay of the link after `elapsed` since the start of the trace
+    pub fn delay_at(&self, elapsed: Duration) -> Duration {
+        let Delay { points, period } = self.inner.as_ref();
+        let elapsed = (elapsed.as_nanos() % *period as u128) as u64;
+
+        let index = points.partition_point(|(time, _)| *time <= elapsed) - 1;
+        points[index].1
+    }
+}
+
+/// The position of an edge in its [`CapacityTrace`]
+///
+/// The opportunities of the trace that are not used during a step of the
+/// multiplexer are lost, as the link had nothing to deliver: a step can
+/// only use the opportunities since the previous step, even if the edge
+/// was idle for longer.
+#[derive(Debug, Default)]
+pub(crate) struct TraceCursor {
+    /// the start of the trace being played
+    since: Option<Instant>,
+    /// the time of the step
+    time: Option<Instant>,
+    /// the bytes of the trace until `time`
+    accrued: u64,
+    /// the bytes that can still be delivered during the step
+    budget: u64,
+}
+
+impl TraceCursor {
+    /// try to consume up to `size` bytes from the trace during the step
+    /// of the multiplexer at `time`, `previous` is the time of the
+    /// previous step (if any)
+    ///
+    /// return the number of bytes actually consumed
+    pub fn consume(
+        &mut self,
+        (previous, time): (Option<Instant>, Instant),
+        (trace, since): (&CapacityTrace, Instant),
+        size: u64,
+    ) -> u64 {
+        let accrued = trace.bytes_until(time.saturating_duration_since(since));
+
+        if self.since != Some(since) {
+            // the first step of the trace on this edge: the opportunities
+            // before it are lost
+            self.since = Some(since);
+            self.accrued = accrued;
+        }
+        if self.time != Some(time) {
+            self.time = Some(time);
+            self.budget = 0;
+            // the edge was idle since its last use: the opportunities
+            // until the previous step are lost
+            if let Some(previous) = previous.filter(|previous| *previous < time) {
+                let idle = trace.bytes_until(previous.saturating_duration_since(since));
+                self.accrued = self.accrued.max(idle);
+            }
+        }
+        self.budget += accrued.saturating_sub(self.accrued);
+        self.accrued = accrued;
+
+        let used = self.budget.min(size);
+        self.budget -= used;
+        used
+    }
+}
+
+/// the number of bytes delivered at the given `rate` in `nanos`
+fn delivered(rate: Bandwidth, nanos: u64) -> u64 {
+    (rate.into_inner() as u128 * nanos as u128 / 1_000_000_000) as u64
+}
+
+fn millis(millis: u64) -> u64 {
+    millis.saturating_mul(1_000_000)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const MS: Duration = Duration::from_millis(1);
+
+    #[test]
+    fn mahimahi() {
+        let trace = CapacityTrace::read_mahimahi("1\n1\n3\n4\n".as_bytes()).unwrap();
+
+        assert_eq!(trace.bytes_until(Duration::ZERO), 0);
+        assert_eq!(trace.bytes_until(MS), 2 * MAHIMAHI_PACKET_SIZE);
+        assert_eq!(trace.bytes_until(2 * MS), 2 * MAHIMAHI_PACKET_SIZE);
+        assert_eq!(trace.bytes_until(4 * MS), 4 * MAHIMAHI_PACKET_SIZE);
+        // the trace loops every 4ms
+        assert_eq!(trace.bytes_until(5 * MS), 6 * MAHIMAHI_PACKET_SIZE);
+
+        assert!(CapacityTrace::read_mahimahi("2\n1\n".as_bytes()).is_err());
+    }
+
+    #[test]
+    fn csv() {
+        let trace = CapacityTrace::read_csv("0,1000\n10,0\n20,0".as_bytes()).unwrap();
+
+        assert_eq!(trace.bytes_until(5 * MS), 5);
+        assert_eq!(trace.bytes_until(15 * MS), 10);
+        assert_eq!(trace.bytes_until(25 * MS), 15);
+
+        let trace = DelayTrace::read_csv("0,10\n# comment\n5,20\n10,0".as_bytes()).unwrap();
+        assert_eq!(trace.delay_at(4 * MS), 10 * MS);
+        assert_eq!(trace.delay_at(5 * MS), 20 * MS);
+        assert_eq!(trace.delay_at(12 * MS), 10 * MS);
+    }
+
+    #[test]
+    fn cursor() {
+        let trace = CapacityTrace::read_mahimahi("1\n2\n3\n4\n".as_bytes()).unwrap();
+        let since = Instant::now();
+        let mut cursor = TraceCursor::default();
+
+        // the opportunities before the first use are lost
+        let step = (None, since + 2 * MS);
+        assert_eq!(cursor.consume(step, (&trace, since), 10_000), 0);
+        // the budget of the step is shared
+        let step = (Some(since + 2 * MS), since + 4 * MS);
+        assert_eq!(cursor.consume(step, (&trace, since), 1_000), 1_000);
+        assert_eq!(cursor.consume(step, (&trace, since), 10_000), 2_000);
+        // the unused opportunities are lost
+        let step = (Some(since + 4 * MS), since + 5 * MS);
+        assert_eq!(cursor.consume(step, (&trace, since), 10), 10);
+        let step = (Some(since + 5 * MS), since + 6 * MS);
+        assert_eq!(cursor.consume(step, (&trace, since), 10_000), 1_500);
+
+        // the edge is idle during the steps until 20ms, the next step
+        // only gets the opportunities since the previous step
+        let step = (Some(since + 20 * MS), since + 21 * MS);
+        assert_eq!(cursor.consume(step, (&trace, since), 100_000), 1_500);
+    }
+}
@@ -0,0 +1,317 @@
+use crate::{congestion_queue::Progress, Edge, SimClock, SimId};
+use anyhow::{anyhow, ensure, Context as _, Result};
+use std::{
+    collections::HashMap,
+    fs::File,
+    io::{self, BufWriter, Write},
+    mem,
+    path::Path,
+    sync::mpsc,
+    thread::{self, JoinHandle},
+    time::{Duration, Instant},
+};
+
+/// Records the bytes sent and received by the nodes and the bytes that
+/// went through the edges and the shared segments, every interval, and
+/// streams them as CSV (see `SimContext::set_utilisation_sampler`)
+///
+/// The rows are `time_ns,kind,a,b,bytes` where `time_ns` is the end of
+/// the interval (see [`SimClock::now`]), a multiple of the interval
+/// except for the last rows written when the sampler is reset, and
+/// `kind` is one of:
+///
+/// * `sent` and `received`: the bytes uploaded and downloaded by the
+///   node `a`;
+/// * `edge`: the bytes that went through the edge between `a` and `b`;
+/// * `segment`: the bytes broadcast on the segment `a`.
+///
+/// Only the nodes, edges and segments that were active during the
+/// interval have a row, so the cost of the sampling is proportional to
+/// the traffic and not to the size of the network. The rows are written
+/// on a dedicated thread.
+pub struct UtilisationSampler {
+    interval: Duration,
+    /// the end of the current interval
+    next: Option<Instant>,
+    samples: Samples,
+    sender: Option<mpsc::Sender<Samples>>,
+    writer: Option<JoinHandle<io::Result<()>>>,
+}
+
+/// the bytes that went through the network since the last sample
+#[derive(Debug, Default)]
+pub(crate) struct Activity {
+    /// the bytes sent and received
+    nodes: HashMap<SimId, (u64, u64)>,
+    edges: HashMap<Edge, u64>,
+    segments: HashMap<u32, u64>,
+}
+
+/// the rows of the samples, by column
+#[derive(Debug, Default)]
+struct Samples {
+    time: Vec<u64>,
+    kind: Vec<Kind>,
+    a: Vec<u64>,
+    b: Vec<Option<u64>>,
+    bytes: Vec<u64>,
+}
+
+#[derive(Debug, Clone, Copy)]
+enum Kind {
+    Sent,
+    Received,
+    Edge,
+    Segment,
+}
+
+impl Activity {
+    /// the bytes of a message (or a flow) moved from `before` to `after`
+    pub fn transfer(&mut self, (from, to): (SimId, SimId), before: Progress, after: Progress) {
+        let sent = after.sender - before.sender;
+        let link = after.link - before.link;
+        let received = after.receiver - before.receiver;
+
+        if sent > 0 {
+            self.nodes.entry(from).or_default().0 += sent;
+        }
+        if link > 0 {
+            *self.edges.entry(Edge::new((from, to))).or_default() += link;
+        }
+        if received > 0 {
+            self.nodes.entry(to).or_default().1 += received;
+        }
+    }
+
+    /// the bytes of a broadcast moved from `before` to `after`
+    pub fn broadcast(&mut self, from: SimId, segment: u32, before: Progress, after: Progress) {
+        let sent = after.sender - before.sender;
+        let airtime = after.link - before.link;
+
+        if sent > 0 {
+            self.nodes.entry(from).or_default().0 += sent;
+        }
+        if airtime > 0 {
+            *self.segments.entry(segment).or_default() += airtime;
+        }
+    }
+}
+
+impl Samples {
+    fn push(&mut self, time: u64, kind: Kind, a: u64, b: Option<u64>, bytes: u64) {
+        self.time.push(time);
+        self.kind.push(kind);
+        self.a.push(a);
+        self.b.push(b);
+        self.bytes.push(bytes);
+    }
+
+    fn is_empty(&self) -> bool {
+        self.time.is_empty()
+    }
+
+    fn write_csv(&self, output: &mut impl Write) -> io::Result<()> {
+        for row in 0..self.time.len() {
+            let kind = match self.kind[row] {
+                Kind::Sent => "sent",
+                Kind::Received => "received",
+                Kind::Edge => "edge",
+                Kind::Segment => "segment",
+            };
+            write!(output, "{},{kind},{},", self.time[row], self.a[row])?;
+            if let Some(b) = self.b[row] {
+                write!(output, "{b}")?;
+            }
+            writeln!(output, ",{}", self.bytes[row])?;
+        }
+
+        Ok(())
+    }
+}
+
+impl UtilisationSampler {
+    /// sample every `interval` (of simulated time) and write the CSV to
+    /// `output`
+    pub fn new<W>(interval: Duration, mut output: W) -> Result<Self>
+    where
+        W: Write + Send + 'static,
+    {
+        ensure!(!interval.is_zero(), "The sampling interval cannot be zero");
+
+        let (sender, receiver) = mpsc::channel::<Samples>();
+        let writer = thread::spawn(move || {
+            writeln!(output, "time_ns,kind,a,b,bytes")?;
+            for samples in receiver {
+                samples.write_csv(&mut output)?;
+            }
+            output.flush()
+        });
+
+        Ok(Self {
+            interval,
+            next: None,
+            samples: Samples::default(),
+            sender: Some(sender),
+            writer: Some(writer),
+        })
+    }
+
+    /// sample every `interval` into the CSV file at `path`
+    pub fn create(interval: Duration, path: impl AsRef<Path>) -> Result<Self> {
+        let path = path.as_ref();
+        let file = File::create(path)
+            .with_context(|| format!("Failed to create the file {}", path.display()))?;
+
+        Self::new(interval, BufWriter::new(file))
+    }
+
+    /// take a sample of the activity if the interval has elapsed
+    ///
+    /// The sample is timed at the end of the interval, not at the step of
+    /// the multiplexer that passed it, and the intervals that elapsed
+    /// without a step are merged in the sample.
+    pub(crate) fn sample(&mut self, time: Instant, clock: &SimClock, activity: &mut Activity) {
+        let boundary = self.boundary(time, clock);
+        let next = *self.next.get_or_insert(boundary + self.interval);
+        if time < next {
+            return;
+        }
+        self.next = Some(boundary + self.interval);
+
+        self.flush(boundary, clock, activity)
+    }
+
+    /// the last end of an interval at or before `time`, the intervals
+    /// start with the simulation
+    fn boundary(&self, time: Instant, clock: &SimClock) -> Instant {
+        let interval = self.interval.as_nanos();
+        let elapsed = clock.time(time).as_nanos() / interval * interval;
+        clock.instant(Duration::from_nanos(elapsed.min(u64::MAX as u128) as u64))
+    }
+
+    /// take a sample of the activity and hand it over to the writer
+    pub(crate) fn flush(&mut self, time: Instant, clock: &SimClock, activity: &mut Activity) {
+        let time = clock.time(time).as_nanos().min(u64::MAX as u128) as u64;
+        let samples = &mut self.samples;
+
+        for (node, (sent, received)) in activity.nodes.drain() {
+            let node = u64::from(node);
+            if sent > 0 {
+                samples.push(time, Kind::Sent, node, None, sent);
+            }
+            if received > 0 {
+                samples.push(time, Kind::Received, node, None, received);
+            }
+        }
+        for (edge, bytes) in activity.edges.drain() {
+            let (a, b) = (edge.smaller_id.into(), edge.larger_id.into());
+            samples.push(time, Kind::Edge, a, Some(b), bytes);
+        }
+        for (segment, bytes) in activity.segments.drain() {
+            samples.push(time, Kind::Segment, segment.into(), None, bytes);
+        }
+
+        if !samples.is_empty() {
+            if let Some(sender) = self.sender.as_ref() {
+                let _ = sender.send(mem::take(samples));
+            }
+        }
+    }
+
+    /// wait for all the samples to be written
+    pub(crate) fn finish(&mut self) -> Result<()> {
+        self.sender.take();
+        let Some(writer) = self.writer.take() else {
+            return Ok(());
+        };
+
+        writer
+            .join()
+            .map_err(|error| anyhow!("The utilisation writer panicked: {error:?}"))?
+            .context("Failed to write the utilisation samples")
+    }
+}
+
+impl Drop for UtilisationSampler {
+    fn drop(&mut self) {
+        let _ = self.finish();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::{Arc, Mutex};
+
+    /// a `Write` whose content can be read once the writer is done
+    #[derive(Clone, Default)]
+    struct Shared(Arc<Mutex<Vec<u8>>>);
+
+    impl Write for Shared {
+        fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+            self.0.lock().unwrap().write(buf)
+        }
+        fn flush(&mut self) -> io::Result<()> {
+            Ok(())
+        }
+    }
+
+    #[test]
+    fn samples() {
+        let clock = SimClock::new();
+        let at = |millis| clock.instant(Duration::from_millis(millis));
+        let (a, b) = (SimId::new(1), SimId::new(2));
+        let output = Shared::default();
+        let mut sampler =
+            UtilisationSampler::new(Duration::from_millis(100), output.clone()).unwrap();
+        assert!(UtilisationSampler::new(Duration::ZERO, Shared::default()).is_err());
+
+        let mut activity = Activity::default();
+        let progress = |sender, link, receiver| Progress {
+            sender,
+            link,
+            receiver,
+        };
+        activity.transfer((a, b), progress(0, 0, 0), progress(100, 60, 10));
+        activity.transfer((b, a), progress(5, 5, 5), progress(5, 5, 5));
+
+        // the intervals start with the simulation, not with the first
+        // sample, and a late step is timed at the end of the interval
+        sampler.sample(at(3), &clock, &mut activity);
+        sampler.sample(at(50), &clock, &mut activity);
+        assert_eq!(activity.edges.len(), 1);
+        sampler.sample(at(130), &clock, &mut activity);
+        assert!(activity.edges.is_empty());
+
+        // the intervals without a step are merged in the next sample
+        activity.broadcast(a, 7, progress(0, 0, 0), progress(10, 10, 0));
+        sampler.sample(at(199), &clock, &mut activity);
+        sampler.sample(at(460), &clock, &mut activity);
+        assert!(activity.segments.is_empty());
+
+        activity.broadcast(b, 7, progress(0, 0, 0), progress(5, 5, 0));
+        sampler.sample(at(490), &clock, &mut activity);
+        sampler.flush(at(520), &clock, &mut activity);
+        sampler.finish().unwrap();
+
+        let csv = String::from_utf8(output.0.lock().unwrap().clone()).unwrap();
+        let mut lines: Vec<&str> = csv.lines().collect();
+        assert_eq!(lines.remove(0), "time_ns,kind,a,b,bytes");
+        // the rows are relative to the clock of the simulation
+        let rows: Vec<Vec<&str>> = lines.iter().map(|line| line.split(',').collect()).collect();
+        assert_eq!(rows.len(), 7);
+        assert!(rows.contains(&vec!["100000000", "sent", "1", "", "100"]));
+        assert!(rows.contains(&vec!["100000000", "received", "2", "", "10"]));
+        assert!(rows.contains(&vec!["100000000", "edge", "1", "2", "60"]));
+        assert!(rows.contains(&vec!["400000000", "sent", "1", "", "10"]));
+        assert!(rows.contains(&vec!["400000000", "segment", "7", "", "10"]));
+        assert!(rows.contains(&vec!["520000000", "sent", "2", "", "5"]));
+        assert!(rows.contains(&vec!["520000000", "segment", "7", "", "5"]));
+
+        // every sample is timed at a multiple of the interval
+        for row in &rows[..5] {
+            let time: u64 = row[0].parse().unwrap();
+            assert_eq!(time % 100_000_000, 0, "{row:?}");
+        }
+    }
+}
@@ -1,12 +1,300 @@
+#include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "netsim.h"
 
 static char* MSG = "Hello!";
 #define LEN 6
 
+static int DROPPED = 0;
+
 void no_drop(struct Message msg) {
     // Do nothing, we aren't allocating anything
+    DROPPED += 1;
+}
+
+void count_drops(void* user, const struct Message* msgs, uintptr_t len) {
+    // called on the dispatching thread, once per batch
+    *(uintptr_t*)user += len;
+}
+
+// the dropped messages are given to the batch callback once the
+// context is shut down at the latest
+SimError batched_drops() {
+    SimContext* context = NULL;
+    uintptr_t dropped = 0;
+    SimError error = netsim_context_new_ex(&context, count_drops, &dropped);
+    if (error != SimError_Success) { return error; }
+
+    SimSocket* net1;
+    SimSocket* net2;
+    SimId net2_id;
+    error = netsim_context_open(context, &net1);
+    if (error != SimError_Success) { goto cleanup_context; }
+    error = netsim_context_open(context, &net2);
+    if (error != SimError_Success) { goto cleanup_net1; }
+    error = netsim_socket_id(net2, &net2_id);
+    if (error != SimError_Success) { goto cleanup; }
+
+    struct Message msg = { (uint8_t*) MSG, LEN };
+    for (int i = 0; i < 3 && error == SimError_Success; i++) {
+        MsgId msg_id;
+        error = netsim_socket_send_to_ex(net1, net2_id, msg, 1, &msg_id);
+        if (error != SimError_Success) { break; }
+        error = netsim_socket_cancel(net1, msg_id);
+    }
+
+cleanup:
+    netsim_socket_release(net2);
+cleanup_net1:
+    netsim_socket_release(net1);
+cleanup_context:
+    netsim_context_shutdown(context);
+
+    if (error == SimError_Success && dropped != 3) {
+        // every message should have been dropped once
+        error = 53;
+    }
+    return error;
+}
+
+// the utilisation samples are written to the file once the context is
+// shut down at the latest
+SimError sampled_utilisation() {
+    const char* path = "utilisation.csv";
+    SimContext* context = NULL;
+    SimError error = netsim_context_new(&context, no_drop);
+    if (error != SimError_Success) { return error; }
+
+    SimSocket* net1;
+    SimSocket* net2;
+    SimId net2_id;
+    error = netsim_context_sample_utilisation(context, 100000000, path);
+    if (error != SimError_Success) { goto cleanup_context; }
+    error = netsim_context_open(context, &net1);
+    if (error != SimError_Success) { goto cleanup_context; }
+    error = netsim_context_open(context, &net2);
+    if (error != SimError_Success) { goto cleanup_net1; }
+    error = netsim_socket_id(net2, &net2_id);
+    if (error != SimError_Success) { goto cleanup; }
+
+    error = netsim_socket_send_sized(net1, net2_id, 1000, 1);
+    if (error != SimError_Success) { goto cleanup; }
+    Event event;
+    error = netsim_socket_recv_event(net2, &event);
+
+cleanup:
+    netsim_socket_release(net2);
+cleanup_net1:
+    netsim_socket_release(net1);
+cleanup_context:
+    netsim_context_shutdown(context);
+    if (error != SimError_Success) { return error; }
+
+    char line[64];
+    int rows = 0;
+    FILE* file = fopen(path, "r");
+    if (file == NULL) { return 57; }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (strstr(line, ",edge,0,1,1000") != NULL) { rows += 1; }
+    }
+    fclose(file);
+    remove(path);
+
+    if (rows != 1) {
+        // the bytes of the message should have been sampled on the edge
+        error = 57;
+    }
+    return error;
+}
+
+// the nodes of a mailbox share the receiving end, the events say which
+// node they are for
+SimError mailbox() {
+    SimContext* context = NULL;
+    SimError error = netsim_context_new(&context, no_drop);
+    if (error != SimError_Success) { return error; }
+
+    SimMailbox* mailbox;
+    SimId first;
+    error = netsim_context_open_mailbox(context, 1000, &mailbox, &first);
+    if (error != SimError_Success) { goto cleanup_context; }
+
+    SimWriter* writer;
+    error = netsim_mailbox_writer(mailbox, first, &writer);
+    if (error != SimError_Success) { goto cleanup; }
+    struct Message msg = { (uint8_t*) MSG, LEN };
+    error = netsim_writer_send_to(writer, first + 999, msg);
+    netsim_writer_release(writer);
+    if (error != SimError_Success) { goto cleanup; }
+
+    SimId to;
+    Event event;
+    error = netsim_mailbox_recv_event(mailbox, &to, &event);
+    if (error != SimError_Success) { goto cleanup; }
+    if (to != first + 999 || event.kind != EventKind_Message || event.from != first
+        || event.msg.pointer != (uint8_t*)MSG) {
+        // wrong message from the mailbox
+        error = 58;
+    }
+
+cleanup:
+    netsim_mailbox_release(mailbox);
+cleanup_context:
+    netsim_context_shutdown(context);
+    return error;
+}
+
+// the nodes relay the propagation inside the simulator, it reaches all
+// of them without any of them receiving it, and the message consumed by
+// the relays is given back to be released
+SimError relayed_propagation() {
+    SimContext* context = NULL;
+    uintptr_t dropped = 0;
+    SimError error = netsim_context_new_ex(&context, count_drops, &dropped);
+    if (error != SimError_Success) { return error; }
+
+    SimMailbox* mailbox;
+    SimId first;
+    SimSocket* observer;
+    error = netsim_context_relay(context, RelayKind_Flood, 0);
+    if (error != SimError_Success) { goto cleanup_context; }
+    error = netsim_context_open_mailbox(context, 100, &mailbox, &first);
+    if (error != SimError_Success) { goto cleanup_context; }
+    error = netsim_context_open(context, &observer);
+    if (error != SimError_Success) { goto cleanup_mailbox; }
+
+    SimWriter* writer;
+    error = netsim_mailbox_writer(mailbox, first, &writer);
+    if (error != SimError_Success) { goto cleanup; }
+    struct Message msg = { (uint8_t*) MSG, LEN };
+    error = netsim_writer_send_to_tracked(writer, first + 1, msg, 8);
+    netsim_writer_release(writer);
+    if (error != SimError_Success) { goto cleanup; }
+
+    PropagationCoverage coverage = { 0 };
+    for (int i = 0; i < 100 && coverage.reached < 101; i++) {
+        error = netsim_timer_after(observer, 10000000, 1);
+        if (error != SimError_Success) { break; }
+        Event event;
+        error = netsim_socket_recv_event(observer, &event);
+        if (error != SimError_Success) { break; }
+        if (event.kind != EventKind_Timer) {
+            // the relays should have consumed the propagation
+            error = 59;
+            break;
+        }
+        error = netsim_propagation(context, 8, &coverage);
+        if (error != SimError_Success) { break; }
+    }
+    if (error == SimError_Success && coverage.reached != 101) {
+        // the propagation should have reached all the nodes
+        error = 60;
+    }
+
+cleanup:
+    netsim_socket_release(observer);
+cleanup_mailbox:
+    netsim_mailbox_release(mailbox);
+cleanup_context:
+    netsim_context_shutdown(context);
+
+    if (error == SimError_Success && dropped != 1) {
+        // the message sent should have been dropped once, not the copies
+        error = 62;
+    }
+    return error;
+}
+
+#define WRITERS 4
+#define SENDS 100
+
+struct Sender {
+    SimWriter* writer;
+    SimId to;
+    uintptr_t index;
+    SimError error;
+};
+
+// send the messages `index * SENDS` to `index * SENDS + SENDS - 1`, the
+// number is the size of the message
+void* send_all(void* arg) {
+    struct Sender* sender = arg;
+    for (uintptr_t i = 0; i < SENDS && sender->error == SimError_Success; i++) {
+        struct Message msg = { (uint8_t*) MSG, sender->index * SENDS + i + 1 };
+        sender->error = netsim_writer_send_to(sender->writer, sender->to, msg);
+    }
+    return NULL;
+}
+
+// the writers of a socket send from several threads at once
+SimError concurrent_writers() {
+    SimContext* context = NULL;
+    SimError error = netsim_context_new(&context, no_drop);
+    if (error != SimError_Success) { return error; }
+
+    SimSocket* net1;
+    SimSocket* net2;
+    SimId net2_id;
+    error = netsim_context_open(context, &net1);
+    if (error != SimError_Success) { goto cleanup_context; }
+    error = netsim_context_open(context, &net2);
+    if (error != SimError_Success) { goto cleanup_net1; }
+    error = netsim_socket_id(net2, &net2_id);
+    if (error != SimError_Success) { goto cleanup; }
+
+    struct Sender senders[WRITERS];
+    pthread_t threads[WRITERS];
+    uintptr_t started = 0;
+    SimWriter* writer;
+    error = netsim_socket_writer(net1, &writer);
+    if (error != SimError_Success) { goto cleanup; }
+    for (; started < WRITERS; started++) {
+        struct Sender* sender = &senders[started];
+        sender->to = net2_id;
+        sender->index = started;
+        sender->error = netsim_writer_clone(writer, &sender->writer);
+        if (sender->error != SimError_Success) { break; }
+        if (pthread_create(&threads[started], NULL, send_all, sender) != 0) {
+            netsim_writer_release(sender->writer);
+            break;
+        }
+    }
+    netsim_writer_release(writer);
+
+    for (uintptr_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        netsim_writer_release(senders[i].writer);
+        if (error == SimError_Success) { error = senders[i].error; }
+    }
+    if (error == SimError_Success && started != WRITERS) {
+        // the threads could not be started
+        error = 61;
+    }
+
+    uint8_t seen[WRITERS * SENDS] = { 0 };
+    for (uintptr_t i = 0; i < WRITERS * SENDS && error == SimError_Success; i++) {
+        Message received;
+        SimId from;
+        error = netsim_socket_recv(net2, &received, &from);
+        if (error != SimError_Success) { break; }
+        if (received.size == 0 || received.size > WRITERS * SENDS || seen[received.size - 1]) {
+            // every message should be received once
+            error = 61;
+            break;
+        }
+        seen[received.size - 1] = 1;
+    }
+
+cleanup:
+    netsim_socket_release(net2);
+cleanup_net1:
+    netsim_socket_release(net1);
+cleanup_context:
+    netsim_context_shutdown(context);
+    return error;
 }
 
 int main() {
@@ -54,6 +342,180 @@ int main() {
         // wrong sender
         error = 44;
     }
+    if (error != SimError_Success) { goto cleanup; }
+
+    uint64_t before;
+    error = netsim_now(context, &before);
+    if (error != SimError_Success) { goto cleanup; }
+
+    error = netsim_timer_after(net1, 1000000, 7);
+    if (error != SimError_Success) { goto cleanup; }
+
+    Event event;
+    error = netsim_socket_recv_event(net1, &event);
+    if (error != SimError_Success) { goto cleanup; }
+
+    uint64_t after;
+    error = netsim_now(context, &after);
+    if (error != SimError_Success) { goto cleanup; }
+
+    if (event.kind != EventKind_Timer || event.token != 7) {
+        // wrong event
+        error = 45;
+    }
+    if (after < before + 1000000) {
+        // timer expired too early
+        error = 46;
+    }
+    if (error != SimError_Success) { goto cleanup; }
+
+    error = netsim_socket_send_to(net2, net1_id, msg);
+    if (error != SimError_Success) { goto cleanup; }
+
+    MessageMeta meta;
+    error = netsim_socket_recv_ex(net1, &new_msg, &from, &meta);
+    if (error != SimError_Success) { goto cleanup; }
+
+    if (from != net2_id || meta.sent > meta.scheduled || meta.scheduled > meta.delivered) {
+        // wrong message timing
+        error = 47;
+    }
+    if (error != SimError_Success) { goto cleanup; }
+
+    error = netsim_socket_send_to_notify(net1, net2_id, msg, 9);
+    if (error != SimError_Success) { goto cleanup; }
+
+    error = netsim_socket_recv_event(net1, &event);
+    if (error != SimError_Success) { goto cleanup; }
+
+    if (event.kind != EventKind_SendCompletion || event.token != 9 || event.from != net2_id) {
+        // wrong send completion
+        error = 48;
+    }
+    if (error != SimError_Success) { goto cleanup; }
+    error = netsim_socket_recv(net2, &new_msg, &from);
+    if (error != SimError_Success) { goto cleanup; }
+
+    // expires before it can be delivered
+    MsgId msg_id;
+    error = netsim_socket_send_to_ex(net1, net2_id, msg, 1, &msg_id);
+    if (error != SimError_Success) { goto cleanup; }
+    error = netsim_socket_cancel(net1, msg_id);
+    if (error != SimError_Success) { goto cleanup; }
+
+    error = netsim_socket_send_to_ex(net1, net2_id, msg, 0, &msg_id);
+    if (error != SimError_Success) { goto cleanup; }
+    error = netsim_socket_recv(net2, &new_msg, &from);
+    if (error != SimError_Success) { goto cleanup; }
+
+    if (DROPPED != 1) {
+        // the first message should have been dropped (and only once)
+        error = 49;
+    }
+    if (error != SimError_Success) { goto cleanup; }
+
+    SimStream* stream;
+    error = netsim_socket_stream_open(net1, net2_id, 64, &stream);
+    if (error != SimError_Success) { goto cleanup; }
+
+    uint64_t written = 0;
+    while (written < LEN) {
+        uint64_t len;
+        error = netsim_stream_write(stream, (uint8_t*)MSG + written, LEN - written, &len);
+        if (error != SimError_Success) { break; }
+        written += len;
+    }
+    netsim_stream_close(stream);
+    if (error != SimError_Success) { goto cleanup; }
+
+    error = netsim_socket_recv_event(net2, &event);
+    if (error != SimError_Success) { goto cleanup; }
+    if (event.kind != EventKind_Stream || event.from != net1_id) {
+        // wrong stream event
+        error = 50;
+        goto cleanup;
+    }
+
+    uint8_t buffer[LEN + 1];
+    uint64_t received = 0;
+    uint64_t len = 1;
+    while (len != 0 && received <= LEN) {
+        error = netsim_stream_reader_read(event.stream, buffer + received, LEN + 1 - received, &len);
+        if (error != SimError_Success) { break; }
+        received += len;
+    }
+    netsim_stream_reader_release(event.stream);
+    if (error != SimError_Success) { goto cleanup; }
+
+    if (received != LEN || memcmp(buffer, MSG, LEN) != 0) {
+        // wrong stream content
+        error = 51;
+    }
+    if (error != SimError_Success) { goto cleanup; }
+
+    SimWriter* writer;
+    error = netsim_socket_writer(net1, &writer);
+    if (error != SimError_Success) { goto cleanup; }
+
+    SimWriter* writer2;
+    error = netsim_writer_clone(writer, &writer2);
+    netsim_writer_release(writer);
+    if (error != SimError_Success) { goto cleanup; }
+
+    error = netsim_writer_send_to(writer2, net2_id, msg);
+    netsim_writer_release(writer2);
+    if (error != SimError_Success) { goto cleanup; }
+
+    error = netsim_socket_recv(net2, &new_msg, &from);
+    if (error != SimError_Success) { goto cleanup; }
+    if (from != net1_id || new_msg.pointer != (uint8_t*)MSG) {
+        // wrong message from the writer
+        error = 52;
+    }
+    if (error != SimError_Success) { goto cleanup; }
+
+    error = netsim_socket_send_sized(net1, net2_id, 1000000, 11);
+    if (error != SimError_Success) { goto cleanup; }
+    error = netsim_socket_recv_event(net2, &event);
+    if (error != SimError_Success) { goto cleanup; }
+    if (event.kind != EventKind_Sized || event.from != net1_id || event.token != 11
+        || event.msg.size != 1000000 || event.msg.pointer != NULL) {
+        // wrong phantom message
+        error = 54;
+        goto cleanup;
+    }
+
+    error = netsim_socket_send_to_tracked(net1, net2_id, msg, 5);
+    if (error != SimError_Success) { goto cleanup; }
+    error = netsim_socket_recv(net2, &new_msg, &from);
+    if (error != SimError_Success) { goto cleanup; }
+
+    PropagationCoverage coverage;
+    error = netsim_propagation(context, 5, &coverage);
+    if (error != SimError_Success) { goto cleanup; }
+    if (coverage.origin != net1_id || coverage.nodes != 2 || coverage.reached != 2
+        || coverage.p50 != 0 || coverage.p100 == UINT64_MAX) {
+        // wrong coverage
+        error = 55;
+        goto cleanup;
+    }
+    // forgotten once complete
+    error = netsim_propagation(context, 5, &coverage);
+    if (error != SimError_Success) { goto cleanup; }
+    if (coverage.reached != 0) {
+        error = 56;
+        goto cleanup;
+    }
+
+    error = batched_drops();
+    if (error != SimError_Success) { goto cleanup; }
+    error = sampled_utilisation();
+    if (error != SimError_Success) { goto cleanup; }
+    error = mailbox();
+    if (error != SimError_Success) { goto cleanup; }
+    error = relayed_propagation();
+    if (error != SimError_Success) { goto cleanup; }
+    error = concurrent_writers();
 
 cleanup:
     netsim_socket_release(net2);
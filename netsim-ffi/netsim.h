@@ -45,22 +45,179 @@ enum SimError
 };
 typedef uint32_t SimError;
 
+enum EventKind
+{
+  /**
+   * a message was received from another node
+   */
+  EventKind_Message = 0,
+  /**
+   * a timer requested with [`netsim_timer_after`] expired
+   */
+  EventKind_Timer = 1,
+  /**
+   * a message sent with [`netsim_socket_send_to_notify`] has left
+   * the socket
+   */
+  EventKind_SendCompletion = 2,
+  /**
+   * another node opened a stream with [`netsim_socket_stream_open`]
+   */
+  EventKind_Stream = 3,
+  /**
+   * a message was received from another node that sent it with
+   * [`netsim_socket_send_sized`]: it has no payload
+   */
+  EventKind_Sized = 4,
+};
+typedef uint32_t EventKind;
+
+/**
+ * How the nodes relay the propagations, see [`netsim_context_relay`]
+ */
+enum RelayKind
+{
+  /**
+   * the nodes receive the propagations
+   */
+  RelayKind_None = 0,
+  /**
+   * to all the neighbours but the node the message came from
+   */
+  RelayKind_Flood = 1,
+  /**
+   * to `fanout` neighbours picked at random
+   */
+  RelayKind_Random = 2,
+};
+typedef uint32_t RelayKind;
+
 typedef struct SimContext SimContext;
 
+typedef struct SimMailbox SimMailbox;
+
 typedef struct SimSocket SimSocket;
 
+typedef struct SimStream SimStream;
+
+typedef struct SimStreamReader SimStreamReader;
+
+typedef struct SimWriter SimWriter;
+
 typedef struct Message
 {
   void *pointer;
   uint64_t size;
 } Message;
 
+/**
+ * An event received with [`netsim_socket_recv_event`]
+ */
+typedef struct Event
+{
+  EventKind kind;
+  /**
+   * the sender of the message (the socket itself for a timer, the
+   * recipient of the sent message for a send completion)
+   */
+  SimId from;
+  /**
+   * the message received, only set for [`EventKind::Message`] (and
+   * the size only for [`EventKind::Sized`])
+   */
+  struct Message msg;
+  /**
+   * the token given to [`netsim_timer_after`] or to
+   * [`netsim_socket_send_to_notify`], or the tag given to
+   * [`netsim_socket_send_sized`], only set for [`EventKind::Timer`],
+   * [`EventKind::SendCompletion`] and [`EventKind::Sized`]
+   */
+  uint64_t token;
+  /**
+   * the reading end of the stream, only set for [`EventKind::Stream`].
+   * Call [`netsim_stream_reader_release`] to release the resource.
+   */
+  struct SimStreamReader *stream;
+} Event;
+
+/**
+ * The timing of a message's journey through the simulated network,
+ * received with [`netsim_socket_recv_ex`]
+ *
+ * All the times are in nanoseconds since the creation of the context
+ * (see [`netsim_now`]).
+ */
+typedef struct MessageMeta
+{
+  /**
+   * the time the message was sent by the sender
+   */
+  uint64_t sent;
+  /**
+   * the time the message was scheduled to be delivered, once it was
+   * given its latency by the network
+   */
+  uint64_t scheduled;
+  /**
+   * the time the message was actually delivered to the recipient,
+   * after the bandwidth limits of the sender and recipient
+   */
+  uint64_t delivered;
+} MessageMeta;
+
+/**
+ * The coverage of a propagation, received with [`netsim_propagation`]
+ *
+ * The times are in nanoseconds since the start of the propagation (the
+ * first message sent with its identifier), `u64::MAX` if the nodes were
+ * not reached yet.
+ */
+typedef struct PropagationCoverage
+{
+  /**
+   * the node that sent the first message of the propagation
+   */
+  SimId origin;
+  /**
+   * the time the propagation started, see [`netsim_now`]
+   */
+  uint64_t start;
+  /**
+   * the number of nodes of the network
+   */
+  uint64_t nodes;
+  /**
+   * the number of nodes reached, the origin included, `0` if the
+   * propagation is unknown (the other fields are then not set)
+   */
+  uint64_t reached;
+  /**
+   * the time to reach half of the nodes
+   */
+  uint64_t p50;
+  /**
+   * the time to reach 90% of the nodes
+   */
+  uint64_t p90;
+  /**
+   * the time to reach all the nodes
+   */
+  uint64_t p100;
+} PropagationCoverage;
+
 /**
  * Create a new NetSim Context
  *
  * This is configured so that messages of type Box<u8> can be shared through
  * the network between nodes.
  *
+ * `on_drop` is called with the messages dropped by the network instead of
+ * being delivered: cancelled by their sender, that missed their deadline,
+ * sent on an edge that is down or between nodes that are not neighbours
+ * in the topology (or satellites without a line of sight), broadcast by a
+ * node out of the segment (or on a segment removed in flight), or
+ * consumed by a relay.
+ *
  * # Safety
  *
  * This function allocate a pointer upon success and returns the pointer
@@ -70,6 +227,30 @@ typedef struct Message
 SimError netsim_context_new(struct SimContext **output,
                             void (*on_drop)(struct Message));
 
+/**
+ * Create a new NetSim Context releasing the dropped messages in batches
+ *
+ * Unlike [`netsim_context_new`], the messages dropped by the network
+ * (see the `on_drop` callback of [`netsim_context_new`]) are collected
+ * by the multiplexer and given to `on_drop_batch` once per step, on a
+ * dedicated thread, along with the `user` pointer: a slow release of the
+ * messages does not slow down the simulation. The array of messages is
+ * only valid for the duration of the call.
+ *
+ * # Safety
+ *
+ * This function allocate a pointer upon success and returns the pointer
+ * address. Call [`netsim_context_shutdown`] to release the resource, the
+ * last batch is given to `on_drop_batch` before it returns. `user` must
+ * be safe to use from the dispatching thread.
+ *
+ */
+SimError netsim_context_new_ex(struct SimContext **output,
+                               void (*on_drop_batch)(void*,
+                                                     const struct Message*,
+                                                     uintptr_t),
+                               void *user);
+
 /**
  * create a new [`SimSocket`] in the given context
  *
@@ -83,6 +264,66 @@ SimError netsim_context_new(struct SimContext **output,
 SimError netsim_context_open(struct SimContext *context,
                              struct SimSocket **output);
 
+/**
+ * create `nodes` light nodes sharing a single [`SimMailbox`] in the
+ * given context
+ *
+ * The nodes have consecutive identifiers, starting at `first`. Unlike
+ * the sockets of [`netsim_context_open`] they do not have their own
+ * channel: use [`netsim_mailbox_recv_event`] to receive the events of
+ * all the nodes and [`netsim_mailbox_writer`] to send from a node.
+ *
+ * # Safety
+ *
+ * This function allocate a pointer upon success and returns the pointer
+ * address. Call [`netsim_mailbox_release`] to release the resource.
+ *
+ */
+SimError netsim_context_open_mailbox(struct SimContext *context,
+                                     uintptr_t nodes,
+                                     struct SimMailbox **output,
+                                     SimId *first);
+
+/**
+ * Relay the propagations (see [`netsim_socket_send_to_tracked`]) inside
+ * the simulator: every node that receives a propagation for the first
+ * time sends it on to its neighbours, without the application
+ *
+ * The nodes that relay do not receive the messages of the propagations,
+ * use [`netsim_propagation`] to follow them. The relayed copies of the
+ * messages have the size of the message but not its content (they are
+ * received as [`EventKind::Sized`] by the nodes that do not relay). The
+ * messages consumed by the relays are given to the `on_drop` callback.
+ * `fanout` is used by [`RelayKind::Random`] only.
+ *
+ * # Safety
+ *
+ * The function checks for the context to be a nullpointer before trying
+ * to utilise it. However if the value points to a random value then
+ * the function may have unexpected behaviour.
+ *
+ */
+SimError netsim_context_relay(struct SimContext *context, RelayKind kind, uintptr_t fanout);
+
+/**
+ * Sample the bytes sent and received by the nodes and the bytes that
+ * went through the edges and the segments every `interval` nanoseconds
+ * into the CSV file at `path` (see [`UtilisationSampler`])
+ *
+ * The file is replaced if it exists. The sampling stops if `path` is
+ * null, the file is complete once the sampling stops or the context is
+ * shut down.
+ *
+ * # Safety
+ *
+ * The function checks the context to be non null before trying to
+ * utilise it. `path` must be null or a null terminated string.
+ *
+ */
+SimError netsim_context_sample_utilisation(struct SimContext *context,
+                                           uint64_t interval,
+                                           const char *path);
+
 /**
  * Shutdown a NetSim context and release assets
  *
@@ -95,6 +336,103 @@ SimError netsim_context_open(struct SimContext *context,
  */
 SimError netsim_context_shutdown(struct SimContext *context);
 
+/**
+ * Receive the next event of any node of the [`SimMailbox`], `to` is
+ * set to the node the event is for (see [`netsim_socket_recv_event`])
+ *
+ * # Safety
+ *
+ * The function checks the parameters to be non null before trying
+ * to utilise it. However if the pointers point to a random memory then
+ * the function may have unexpected behaviour.
+ *
+ */
+SimError netsim_mailbox_recv_event(struct SimMailbox *mailbox,
+                                   SimId *to,
+                                   struct Event *event);
+
+/**
+ * Release the [`SimMailbox`] resources
+ *
+ * The events not yet received are dropped, the nodes remain in the
+ * context but the events sent to them are dropped.
+ *
+ * # Safety
+ *
+ * The function checks for the mailbox to be a nullpointer before trying
+ * to utilise it. However if the value points to a random value then
+ * the function may have unexpected behaviour.
+ *
+ */
+SimError netsim_mailbox_release(struct SimMailbox *mailbox);
+
+/**
+ * Create a new handle sending from the `node` of the [`SimMailbox`]
+ *
+ * # Safety
+ *
+ * This function allocate a pointer upon success and returns the pointer
+ * address. Call [`netsim_writer_release`] to release the resource.
+ *
+ */
+SimError netsim_mailbox_writer(struct SimMailbox *mailbox,
+                               SimId node,
+                               struct SimWriter **output);
+
+/**
+ * Get the current time of the simulation, in nanoseconds since the
+ * creation of the context
+ *
+ * This is the clock of the multiplexer: use it instead of the system's
+ * clock so that the nodes' timers line up with the simulated network.
+ *
+ * # Safety
+ *
+ * The function checks for the context to be a nullpointer before trying
+ * to utilise it. However if the value points to a random value then
+ * the function may have unexpected behaviour.
+ *
+ */
+SimError netsim_now(struct SimContext *context, uint64_t *now);
+
+/**
+ * Get the coverage of the propagation `id`
+ *
+ * The coverage of a propagation in progress is a snapshot, the
+ * propagation is forgotten once its coverage is received complete (all
+ * the nodes were reached), or 10 minutes after its start if it never
+ * completes (its late messages are then delivered to the relays as any
+ * other message).
+ *
+ * # Safety
+ *
+ * The function checks the parameters to be non null before trying
+ * to utilise it. However if the pointers point to a random memory then
+ * the function may have unexpected behaviour.
+ *
+ */
+SimError netsim_propagation(struct SimContext *context,
+                            uint64_t id,
+                            struct PropagationCoverage *coverage);
+
+/**
+ * Cancel a message sent with [`netsim_socket_send_to_ex`]
+ *
+ * If the message is still in flight it is dropped (see the `on_drop`
+ * callback of [`netsim_context_new`]) and stops consuming the bandwidth
+ * of the simulated network. Nothing happens if the message was already
+ * delivered, or if it was not sent by this socket.
+ *
+ * # Safety
+ *
+ * The function checks for the socket to be a nullpointer before trying
+ * to utilise it. However if the value points to a random value then
+ * the function may have unexpected behaviour.
+ * This function returns immediately.
+ *
+ */
+SimError netsim_socket_cancel(struct SimSocket *socket, MsgId id);
+
 /**
  * Access the unique identifier of the [`SimSocket`]
  *
@@ -124,6 +462,52 @@ SimError netsim_socket_recv(struct SimSocket *socket,
                             struct Message *msg,
                             SimId *from);
 
+/**
+ * Receive the next event from the [`SimSocket`]
+ *
+ * On success the function populate the pointed value `event`. Unlike
+ * [`netsim_socket_recv`] every kind of event is received, the caller must
+ * handle all the kinds of [`EventKind`]:
+ *
+ * * [`EventKind::Message`]: a message from another node, in `msg`;
+ * * [`EventKind::Timer`]: an expired timer, its `token`;
+ * * [`EventKind::SendCompletion`]: a message sent with
+ *   [`netsim_socket_send_to_notify`] left the socket, its `token`;
+ * * [`EventKind::Stream`]: another node opened a stream, its reading end
+ *   in `stream`;
+ * * [`EventKind::Sized`]: a message without payload from another node,
+ *   its size in `msg.size` and its tag in `token`.
+ *
+ * # Safety
+ *
+ * The function checks the parameters to be non null before trying
+ * to utilise it. However if the pointers point to a random memory then
+ * the function may have unexpected behaviour.
+ *
+ */
+SimError netsim_socket_recv_event(struct SimSocket *socket,
+                                  struct Event *event);
+
+/**
+ * Receive a message from the [`SimSocket`] along with the timing of
+ * its journey through the simulated network
+ *
+ * This is similar to [`netsim_socket_recv`] but also fills `meta`, so
+ * the latency of a message can be measured without embedding a
+ * timestamp in the payload.
+ *
+ * # Safety
+ *
+ * The function checks the parameters to be non null before trying
+ * to utilise it. However if the pointers point to a random memory then
+ * the function may have unexpected behaviour.
+ *
+ */
+SimError netsim_socket_recv_ex(struct SimSocket *socket,
+                               struct Message *msg,
+                               SimId *from,
+                               struct MessageMeta *meta);
+
 /**
  * Release the new [`SimSocket`] resources
  *
@@ -136,6 +520,30 @@ SimError netsim_socket_recv(struct SimSocket *socket,
  */
 SimError netsim_socket_release(struct SimSocket *socket);
 
+/**
+ * Send a message of `size` bytes that carries a `tag` instead of a
+ * payload
+ *
+ * The simulated network charges `size` bytes but no payload is stored:
+ * there is nothing to allocate nor to release (the `on_drop` callback is
+ * not called for these messages). The recipient receives an event of kind
+ * [`EventKind::Sized`] with the `tag` as token (see
+ * [`netsim_socket_recv_event`]), [`netsim_socket_recv`] gives a message
+ * with a null pointer.
+ *
+ * # Safety
+ *
+ * The function checks for the socket to be a nullpointer before trying
+ * to utilise it. However if the value points to a random value then
+ * the function may have unexpected behaviour.
+ * This function returns immediately.
+ *
+ */
+SimError netsim_socket_send_sized(struct SimSocket *socket,
+                                  SimId to,
+                                  uint64_t size,
+                                  uint64_t tag);
+
 /**
  * Send a message to the [`SimSocket`]
  *
@@ -151,4 +559,297 @@ SimError netsim_socket_send_to(struct SimSocket *socket,
                                SimId to,
                                struct Message msg);
 
+/**
+ * Send a message to the [`SimSocket`], with an optional timeout
+ *
+ * On success the identifier of the message is written in `id`, it can be
+ * given to [`netsim_socket_cancel`] to abort the message while it is
+ * still in flight. If `timeout_ns` is not `0`, the message is dropped
+ * (see the `on_drop` callback of [`netsim_context_new`]) if it has not
+ * been delivered after `timeout_ns` nanoseconds of simulated time.
+ *
+ * # Safety
+ *
+ * The function checks the parameters to be non null before trying
+ * to utilise it. However if the pointers point to a random memory then
+ * the function may have unexpected behaviour.
+ * This function returns immediately.
+ *
+ */
+SimError netsim_socket_send_to_ex(struct SimSocket *socket,
+                                  SimId to,
+                                  struct Message msg,
+                                  uint64_t timeout_ns,
+                                  MsgId *id);
+
+/**
+ * Send a message to the [`SimSocket`] and be notified once it has left
+ * the socket
+ *
+ * Once the last byte of the message has been uploaded by the sender, an
+ * event of kind [`EventKind::SendCompletion`] with the given `token` is
+ * delivered back to the sending socket (see [`netsim_socket_recv_event`]).
+ * This allows to schedule the uploads the way a real node would: start
+ * sending to the next peer once the previous upload has completed.
+ *
+ * # Safety
+ *
+ * The function checks for the context to be a nullpointer before trying
+ * to utilise it. However if the value points to a random value then
+ * the function may have unexpected behaviour.
+ * This function returns immediately.
+ *
+ */
+SimError netsim_socket_send_to_notify(struct SimSocket *socket,
+                                      SimId to,
+                                      struct Message msg,
+                                      uint64_t token);
+
+/**
+ * Send a message to the [`SimSocket`] as part of the propagation
+ * `propagation` (a block or a transaction relayed from node to node)
+ *
+ * The simulated network records the first delivery of the propagation
+ * to every node, see [`netsim_propagation`].
+ *
+ * # Safety
+ *
+ * The function checks for the socket to be a nullpointer before trying
+ * to utilise it. However if the value points to a random value then
+ * the function may have unexpected behaviour.
+ * This function returns immediately.
+ *
+ */
+SimError netsim_socket_send_to_tracked(struct SimSocket *socket,
+                                       SimId to,
+                                       struct Message msg,
+                                       uint64_t propagation);
+
+/**
+ * Open an ordered byte stream from the [`SimSocket`] to the node `to`
+ *
+ * The recipient receives the reading end of the stream as an event of
+ * kind [`EventKind::Stream`] (see [`netsim_socket_recv_event`]). The
+ * stream is accounted by the multiplexer as a single flow, sharing the
+ * bandwidth of the network with the messages.
+ *
+ * `window` is the maximum number of bytes written but not yet read by
+ * the recipient: once it is reached [`netsim_stream_write`] blocks until
+ * the recipient reads from the stream.
+ *
+ * # Safety
+ *
+ * This function allocate a pointer upon success and returns the pointer
+ * address. Call [`netsim_stream_close`] to release the resource.
+ *
+ */
+SimError netsim_socket_stream_open(struct SimSocket *socket,
+                                   SimId to,
+                                   uint64_t window,
+                                   struct SimStream **output);
+
+/**
+ * Create a [`SimWriter`]: a handle to send messages from the
+ * [`SimSocket`] that can be used from another thread
+ *
+ * Unlike the [`SimSocket`], that must not be used by two threads at the
+ * same time, a [`SimWriter`] can be given to a thread while another
+ * thread receives from the socket. Use [`netsim_writer_clone`] to give a
+ * handle to each of the sending threads. The handles share the same
+ * queue to the multiplexer.
+ *
+ * # Safety
+ *
+ * This function allocate a pointer upon success and returns the pointer
+ * address. Call [`netsim_writer_release`] to release the resource.
+ *
+ */
+SimError netsim_socket_writer(struct SimSocket *socket,
+                              struct SimWriter **output);
+
+/**
+ * Close the [`SimStream`] and release its resources
+ *
+ * The recipient reads the end of the stream once all the bytes written
+ * have been delivered (see [`netsim_stream_reader_read`]).
+ *
+ * # Safety
+ *
+ * The function checks for the stream to be a nullpointer before trying
+ * to utilise it. However if the value points to a random value then
+ * the function may have unexpected behaviour.
+ *
+ */
+SimError netsim_stream_close(struct SimStream *stream);
+
+/**
+ * Read up to `len` bytes from the [`SimStreamReader`] into `buffer`
+ *
+ * The function blocks until some bytes are available and sets `read` to
+ * the number of bytes read. `read` is set to `0` once the stream is
+ * closed and all its bytes have been read. If the network dropped the
+ * stream before its end (or the context was shut down), the function
+ * returns [`SimError::SocketDisconnected`] once the bytes delivered
+ * have been read.
+ *
+ * # Safety
+ *
+ * The function checks the parameters to be non null before trying
+ * to utilise it. However if the pointers point to a random memory then
+ * the function may have unexpected behaviour. `buffer` must point to at
+ * least `len` bytes.
+ *
+ */
+SimError netsim_stream_reader_read(struct SimStreamReader *stream,
+                                   uint8_t *buffer,
+                                   uint64_t len,
+                                   uint64_t *read);
+
+/**
+ * Release the [`SimStreamReader`] resources
+ *
+ * The writer of the stream will fail to write any more bytes.
+ *
+ * # Safety
+ *
+ * The function checks for the stream to be a nullpointer before trying
+ * to utilise it. However if the value points to a random value then
+ * the function may have unexpected behaviour.
+ *
+ */
+SimError netsim_stream_reader_release(struct SimStreamReader *stream);
+
+/**
+ * Write up to `len` bytes of `data` to the [`SimStream`]
+ *
+ * The function blocks until there is room in the stream's window and
+ * sets `written` to the number of bytes written (at least one unless
+ * `len` is `0`).
+ *
+ * # Safety
+ *
+ * The function checks the parameters to be non null before trying
+ * to utilise it. However if the pointers point to a random memory then
+ * the function may have unexpected behaviour. `data` must point to at
+ * least `len` bytes.
+ *
+ */
+SimError netsim_stream_write(struct SimStream *stream,
+                             const uint8_t *data,
+                             uint64_t len,
+                             uint64_t *written);
+
+/**
+ * Request a timer on the [`SimSocket`]
+ *
+ * After `delay_ns` nanoseconds of simulated time, the timer is delivered
+ * to the socket as an event of kind [`EventKind::Timer`] with the given
+ * `token` (see [`netsim_socket_recv_event`]). The timers are kept by the
+ * multiplexer and do not cost a thread.
+ *
+ * # Safety
+ *
+ * The function checks for the socket to be a nullpointer before trying
+ * to utilise it. However if the value points to a random value then
+ * the function may have unexpected behaviour.
+ * This function returns immediately.
+ *
+ */
+SimError netsim_timer_after(struct SimSocket *socket,
+                            uint64_t delay_ns,
+                            uint64_t token);
+
+/**
+ * Create a new handle sending from the same socket as the [`SimWriter`]
+ *
+ * # Safety
+ *
+ * This function allocate a pointer upon success and returns the pointer
+ * address. Call [`netsim_writer_release`] to release the resource.
+ *
+ */
+SimError netsim_writer_clone(struct SimWriter *writer,
+                             struct SimWriter **output);
+
+/**
+ * Release the [`SimWriter`] resources
+ *
+ * The socket is still open, as well as the other handles.
+ *
+ * # Safety
+ *
+ * The function checks for the writer to be a nullpointer before trying
+ * to utilise it. However if the value points to a random value then
+ * the function may have unexpected behaviour.
+ *
+ */
+SimError netsim_writer_release(struct SimWriter *writer);
+
+/**
+ * Send a message of `size` bytes with the [`SimWriter`], see
+ * [`netsim_socket_send_sized`]
+ *
+ * # Safety
+ *
+ * The function checks for the writer to be a nullpointer before trying
+ * to utilise it. However if the value points to a random value then
+ * the function may have unexpected behaviour.
+ * This function returns immediately.
+ *
+ */
+SimError netsim_writer_send_sized(struct SimWriter *writer,
+                                  SimId to,
+                                  uint64_t size,
+                                  uint64_t tag);
+
+/**
+ * Send a message with the [`SimWriter`], see [`netsim_socket_send_to`]
+ *
+ * # Safety
+ *
+ * The function checks for the writer to be a nullpointer before trying
+ * to utilise it. However if the value points to a random value then
+ * the function may have unexpected behaviour.
+ * This function returns immediately.
+ *
+ */
+SimError netsim_writer_send_to(struct SimWriter *writer,
+                               SimId to,
+                               struct Message msg);
+
+/**
+ * Send a message with the [`SimWriter`], with an optional timeout, see
+ * [`netsim_socket_send_to_ex`]
+ *
+ * # Safety
+ *
+ * The function checks the parameters to be non null before trying
+ * to utilise it. However if the pointers point to a random memory then
+ * the function may have unexpected behaviour.
+ * This function returns immediately.
+ *
+ */
+SimError netsim_writer_send_to_ex(struct SimWriter *writer,
+                                  SimId to,
+                                  struct Message msg,
+                                  uint64_t timeout_ns,
+                                  MsgId *id);
+
+/**
+ * Send a message with the [`SimWriter`] as part of a propagation, see
+ * [`netsim_socket_send_to_tracked`]
+ *
+ * # Safety
+ *
+ * The function checks for the writer to be a nullpointer before trying
+ * to utilise it. However if the value points to a random value then
+ * the function may have unexpected behaviour.
+ * This function returns immediately.
+ *
+ */
+SimError netsim_writer_send_to_tracked(struct SimWriter *writer,
+                                       SimId to,
+                                       struct Message msg,
+                                       uint64_t propagation);
+
 #endif /* NETSIM_LIBC */
@@ -9,3 +9,6 @@
 
 // SimId is not exported by cbindgen
 typedef uint64_t SimId;
+
+// MsgId is not exported by cbindgen
+typedef uint64_t MsgId;
@@ -1,10 +1,17 @@
 use std::{
-    ffi::c_void,
+    ffi::{c_char, c_void, CStr},
+    io,
     ops::{Deref, DerefMut},
+    ptr, slice,
+    time::Duration,
 };
 
-pub use netsim::SimId;
-use netsim::{HasBytesSize, SimContext as OSimContext, SimSocket as OSimSocket};
+use netsim::{
+    HasBytesSize, OnDrop, Phantom, Relay, SimContext as OSimContext, SimEvent,
+    SimMailbox as OSimMailbox, SimSocket as OSimSocket, SimSocketWriteHalf as OSimSocketWriteHalf,
+    SimStreamReader as OSimStreamReader, SimStreamWriter as OSimStreamWriter, UtilisationSampler,
+};
+pub use netsim::{MsgId, SimId};
 
 #[repr(C)]
 pub struct Message {
@@ -15,14 +22,75 @@ pub struct Message {
 unsafe impl Send for Message {}
 unsafe impl Sync for Message {}
 
+impl Message {
+    const NULL: Self = Self {
+        pointer: ptr::null_mut(),
+        size: 0,
+    };
+}
+
 impl HasBytesSize for Message {
     fn bytes_size(&self) -> u64 {
         self.size
     }
 }
 
-pub struct SimContext(OSimContext<Message>);
-pub struct SimSocket(OSimSocket<Message>);
+/// the content of the messages: the C messages or the phantom messages
+/// sent with [`netsim_socket_send_sized`], that are never given to the
+/// `on_drop` callback
+pub enum Payload {
+    Message(Message),
+    Phantom(Phantom),
+}
+
+impl Payload {
+    /// the message, the pointer of a phantom message is null
+    fn into_message(self) -> Message {
+        match self {
+            Self::Message(msg) => msg,
+            Self::Phantom(phantom) => Message {
+                pointer: ptr::null_mut(),
+                size: phantom.size,
+            },
+        }
+    }
+}
+
+impl Payload {
+    /// the copy relayed by the multiplexer (see [`netsim_context_relay`]):
+    /// the copies of the C messages have their size only
+    fn relay(&self) -> Self {
+        match self {
+            Self::Message(msg) => Self::Phantom(Phantom {
+                size: msg.size,
+                tag: 0,
+            }),
+            Self::Phantom(phantom) => Self::Phantom(*phantom),
+        }
+    }
+}
+
+impl HasBytesSize for Payload {
+    fn bytes_size(&self) -> u64 {
+        match self {
+            Self::Message(msg) => msg.bytes_size(),
+            Self::Phantom(phantom) => phantom.bytes_size(),
+        }
+    }
+}
+
+impl From<Phantom> for Payload {
+    fn from(phantom: Phantom) -> Self {
+        Self::Phantom(phantom)
+    }
+}
+
+pub struct SimContext(OSimContext<Payload>);
+pub struct SimSocket(OSimSocket<Payload>);
+pub struct SimMailbox(OSimMailbox<Payload>);
+pub struct SimWriter(OSimSocketWriteHalf<Payload>);
+pub struct SimStream(OSimStreamWriter<Payload>);
+pub struct SimStreamReader(OSimStreamReader);
 
 #[repr(u32)]
 pub enum SimError {
@@ -43,11 +111,131 @@ pub enum SimError {
     SocketDisconnected = 5,
 }
 
+#[repr(u32)]
+pub enum EventKind {
+    /// a message was received from another node
+    Message = 0,
+    /// a timer requested with [`netsim_timer_after`] expired
+    Timer = 1,
+    /// a message sent with [`netsim_socket_send_to_notify`] has left
+    /// the socket
+    SendCompletion = 2,
+    /// another node opened a stream with [`netsim_socket_stream_open`]
+    Stream = 3,
+    /// a message was received from another node that sent it with
+    /// [`netsim_socket_send_sized`]: it has no payload
+    Sized = 4,
+}
+
+/// How the nodes relay the propagations, see [`netsim_context_relay`]
+#[repr(u32)]
+pub enum RelayKind {
+    /// the nodes receive the propagations
+    None = 0,
+    /// to all the neighbours but the node the message came from
+    Flood = 1,
+    /// to `fanout` neighbours picked at random
+    Random = 2,
+}
+
+impl RelayKind {
+    fn relay(self, fanout: usize) -> Option<Relay> {
+        match self {
+            Self::None => None,
+            Self::Flood => Some(Relay::Flood),
+            Self::Random => Some(Relay::Random(fanout)),
+        }
+    }
+}
+
+/// An event received with [`netsim_socket_recv_event`]
+#[repr(C)]
+pub struct Event {
+    pub kind: EventKind,
+    /// the sender of the message (the socket itself for a timer, the
+    /// recipient of the sent message for a send completion)
+    pub from: SimId,
+    /// the message received, only set for [`EventKind::Message`] (and
+    /// the size only for [`EventKind::Sized`])
+    pub msg: Message,
+    /// the token given to [`netsim_timer_after`] or to
+    /// [`netsim_socket_send_to_notify`], or the tag given to
+    /// [`netsim_socket_send_sized`], only set for [`EventKind::Timer`],
+    /// [`EventKind::SendCompletion`] and [`EventKind::Sized`]
+    pub token: u64,
+    /// the reading end of the stream, only set for [`EventKind::Stream`].
+    /// Call [`netsim_stream_reader_release`] to release the resource.
+    pub stream: *mut SimStreamReader,
+}
+
+/// The timing of a message's journey through the simulated network,
+/// received with [`netsim_socket_recv_ex`]
+///
+/// All the times are in nanoseconds since the creation of the context
+/// (see [`netsim_now`]).
+#[repr(C)]
+pub struct MessageMeta {
+    /// the time the message was sent by the sender
+    pub sent: u64,
+    /// the time the message was scheduled to be delivered, once it was
+    /// given its latency by the network
+    pub scheduled: u64,
+    /// the time the message was actually delivered to the recipient,
+    /// after the bandwidth limits of the sender and recipient
+    pub delivered: u64,
+}
+
+/// the user pointer given to the callbacks called from another thread
+struct UserData(*mut c_void);
+
+unsafe impl Send for UserData {}
+
+impl UserData {
+    fn get(&self) -> *mut c_void {
+        self.0
+    }
+}
+
+/// The coverage of a propagation, received with [`netsim_propagation`]
+///
+/// The times are in nanoseconds since the start of the propagation (the
+/// first message sent with its identifier), `u64::MAX` if the nodes were
+/// not reached yet.
+#[repr(C)]
+pub struct PropagationCoverage {
+    /// the node that sent the first message of the propagation
+    pub origin: SimId,
+    /// the time the propagation started, see [`netsim_now`]
+    pub start: u64,
+    /// the number of nodes of the network
+    pub nodes: u64,
+    /// the number of nodes reached, the origin included, `0` if the
+    /// propagation is unknown (the other fields are then not set)
+    pub reached: u64,
+    /// the time to reach half of the nodes
+    pub p50: u64,
+    /// the time to reach 90% of the nodes
+    pub p90: u64,
+    /// the time to reach all the nodes
+    pub p100: u64,
+}
+
+fn as_nanos(duration: Duration) -> u64 {
+    duration.as_nanos().min(u64::MAX as u128) as u64
+}
+
 /// Create a new NetSim Context
 ///
 /// This is configured so that messages of type Box<u8> can be shared through
 /// the network between nodes.
 ///
+/// `on_drop` is called with the messages dropped by the network instead of
+/// being delivered: cancelled by their sender, that missed their deadline,
+/// sent on an edge that is down or between nodes that are not neighbours
+/// in the topology (or satellites without a line of sight), broadcast by a
+/// node out of the segment (or on a segment removed in flight), or
+/// consumed by a relay.
+///
 /// # Safety
 ///
 /// This function allocate a pointer upon success and returns the pointer
@@ -63,7 +251,60 @@ pub unsafe extern "C" fn netsim_context_new(
     }
 
     let configuration = netsim::SimConfiguration {
-        on_drop: Some(on_drop.into()),
+        on_drop: Some(OnDrop::new(move |payload| {
+            if let Payload::Message(msg) = payload {
+                on_drop(msg)
+            }
+        })),
+        ..Default::default()
+    };
+    let context = Box::new(SimContext(OSimContext::with_config(configuration)));
+
+    *output = Box::into_raw(context);
+    SimError::Success
+}
+
+/// Create a new NetSim Context releasing the dropped messages in batches
+///
+/// Unlike [`netsim_context_new`], the messages dropped by the network
+/// (see the `on_drop` callback of [`netsim_context_new`]) are collected
+/// by the multiplexer and given to `on_drop_batch` once per step, on a
+/// dedicated thread, along with the `user` pointer: a slow release of the
+/// messages does not slow down the simulation. The array of messages is
+/// only valid for the duration of the call.
+///
+/// # Safety
+///
+/// This function allocate a pointer upon success and returns the pointer
+/// address. Call [`netsim_context_shutdown`] to release the resource, the
+/// last batch is given to `on_drop_batch` before it returns. `user` must
+/// be safe to use from the dispatching thread.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_context_new_ex(
+    output: *mut *mut SimContext,
+    on_drop_batch: extern "C" fn(*mut c_void, *const Message, usize),
+    user: *mut c_void,
+) -> SimError {
+    if output.is_null() {
+        return SimError::NullPointerArgument;
+    }
+
+    let user = UserData(user);
+    let on_drop = OnDrop::batched(move |batch: Vec<Payload>| {
+        let batch: Vec<Message> = batch
+            .into_iter()
+            .filter_map(|payload| match payload {
+                Payload::Message(msg) => Some(msg),
+                Payload::Phantom(_) => None,
+            })
+            .collect();
+        if !batch.is_empty() {
+            on_drop_batch(user.get(), batch.as_ptr(), batch.len())
+        }
+    });
+    let configuration = netsim::SimConfiguration {
+        on_drop: Some(on_drop),
         ..Default::default()
     };
     let context = Box::new(SimContext(OSimContext::with_config(configuration)));
@@ -72,6 +313,81 @@ pub unsafe extern "C" fn netsim_context_new(
     SimError::Success
 }
 
+/// Sample the bytes sent and received by the nodes and the bytes that
+/// went through the edges and the segments every `interval` nanoseconds
+/// into the CSV file at `path` (see [`UtilisationSampler`])
+///
+/// The file is replaced if it exists. The sampling stops if `path` is
+/// null, the file is complete once the sampling stops or the context is
+/// shut down.
+///
+/// # Safety
+///
+/// The function checks the context to be non null before trying to
+/// utilise it. `path` must be null or a null terminated string.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_context_sample_utilisation(
+    context: *mut SimContext,
+    interval: u64,
+    path: *const c_char,
+) -> SimError {
+    let Some(context) = context.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+
+    let result = if path.is_null() {
+        context.reset_utilisation_sampler()
+    } else {
+        let path = CStr::from_ptr(path).to_string_lossy();
+        UtilisationSampler::create(Duration::from_nanos(interval), path.as_ref())
+            .and_then(|sampler| context.set_utilisation_sampler(sampler))
+    };
+
+    if let Err(error) = result {
+        eprintln!("{error:?}");
+        return SimError::Undefined;
+    }
+
+    SimError::Success
+}
+
+/// Relay the propagations (see [`netsim_socket_send_to_tracked`]) inside
+/// the simulator: every node that receives a propagation for the first
+/// time sends it on to its neighbours, without the application
+///
+/// The nodes that relay do not receive the messages of the propagations,
+/// use [`netsim_propagation`] to follow them. The relayed copies of the
+/// messages have the size of the message but not its content (they are
+/// received as [`EventKind::Sized`] by the nodes that do not relay). The
+/// messages consumed by the relays are given to the `on_drop` callback.
+/// `fanout` is used by [`RelayKind::Random`] only.
+///
+/// # Safety
+///
+/// The function checks for the context to be a nullpointer before trying
+/// to utilise it. However if the value points to a random value then
+/// the function may have unexpected behaviour.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_context_relay(
+    context: *mut SimContext,
+    kind: RelayKind,
+    fanout: usize,
+) -> SimError {
+    let Some(context) = context.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+
+    match context.set_default_relay_with(kind.relay(fanout), Payload::relay) {
+        Ok(()) => SimError::Success,
+        Err(error) => {
+            eprintln!("{error:?}");
+            SimError::Undefined
+        }
+    }
+}
+
 /// Shutdown a NetSim context and release assets
 ///
 /// # Safety
@@ -135,6 +451,133 @@ pub unsafe extern "C" fn netsim_context_open(
     }
 }
 
+/// create `nodes` light nodes sharing a single [`SimMailbox`] in the
+/// given context
+///
+/// The nodes have consecutive identifiers, starting at `first`. Unlike
+/// the sockets of [`netsim_context_open`] they do not have their own
+/// channel: use [`netsim_mailbox_recv_event`] to receive the events of
+/// all the nodes and [`netsim_mailbox_writer`] to send from a node.
+///
+/// # Safety
+///
+/// This function allocate a pointer upon success and returns the pointer
+/// address. Call [`netsim_mailbox_release`] to release the resource.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_context_open_mailbox(
+    context: *mut SimContext,
+    nodes: usize,
+    output: *mut *mut SimMailbox,
+    first: *mut SimId,
+) -> SimError {
+    let Some(context) = context.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+    if output.is_null() || first.is_null() {
+        return SimError::NullPointerArgument;
+    }
+
+    match context.open_mailbox(nodes) {
+        Ok(mailbox) => {
+            if let Some(id) = mailbox.ids().next() {
+                *first = id;
+            }
+            *output = Box::into_raw(Box::new(SimMailbox(mailbox)));
+            SimError::Success
+        }
+        Err(error) => {
+            eprintln!("{error:?}");
+            SimError::Undefined
+        }
+    }
+}
+
+/// Create a new handle sending from the `node` of the [`SimMailbox`]
+///
+/// # Safety
+///
+/// This function allocate a pointer upon success and returns the pointer
+/// address. Call [`netsim_writer_release`] to release the resource.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_mailbox_writer(
+    mailbox: *mut SimMailbox,
+    node: SimId,
+    output: *mut *mut SimWriter,
+) -> SimError {
+    let Some(mailbox) = mailbox.as_ref() else {
+        return SimError::NullPointerArgument;
+    };
+    if output.is_null() {
+        return SimError::NullPointerArgument;
+    }
+
+    match mailbox.0.writer(node) {
+        Ok(writer) => {
+            *output = Box::into_raw(Box::new(SimWriter(writer)));
+            SimError::Success
+        }
+        Err(error) => {
+            eprintln!("{error:?}");
+            SimError::Undefined
+        }
+    }
+}
+
+/// Receive the next event of any node of the [`SimMailbox`], `to` is
+/// set to the node the event is for (see [`netsim_socket_recv_event`])
+///
+/// # Safety
+///
+/// The function checks the parameters to be non null before trying
+/// to utilise it. However if the pointers point to a random memory then
+/// the function may have unexpected behaviour.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_mailbox_recv_event(
+    mailbox: *mut SimMailbox,
+    to: *mut SimId,
+    event: *mut Event,
+) -> SimError {
+    let Some(mailbox) = mailbox.as_ref() else {
+        return SimError::NullPointerArgument;
+    };
+    let (Some(to), Some(event)) = (to.as_mut(), event.as_mut()) else {
+        return SimError::NullPointerArgument;
+    };
+
+    match mailbox.0.recv_event() {
+        Some(sim_event) => {
+            *to = sim_event.to();
+            *event = into_event(sim_event);
+            SimError::Success
+        }
+        None => SimError::SocketDisconnected,
+    }
+}
+
+/// Release the [`SimMailbox`] resources
+///
+/// The events not yet received are dropped, the nodes remain in the
+/// context but the events sent to them are dropped.
+///
+/// # Safety
+///
+/// The function checks for the mailbox to be a nullpointer before trying
+/// to utilise it. However if the value points to a random value then
+/// the function may have unexpected behaviour.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_mailbox_release(mailbox: *mut SimMailbox) -> SimError {
+    if mailbox.is_null() {
+        SimError::NullPointerArgument
+    } else {
+        let _ = Box::from_raw(mailbox);
+        SimError::Success
+    }
+}
+
 /// Access the unique identifier of the [`SimSocket`]
 ///
 /// # Safety
@@ -205,8 +648,61 @@ pub unsafe extern "C" fn netsim_socket_recv(
     };
 
     if let Some((id, data)) = socket.recv() {
-        *msg = data;
+        *msg = data.into_message();
+        *from = id;
+
+        SimError::Success
+    } else {
+        // this is usually to signal it is time to release
+        // the socket
+        SimError::SocketDisconnected
+    }
+}
+
+/// Receive a message from the [`SimSocket`] along with the timing of
+/// its journey through the simulated network
+///
+/// This is similar to [`netsim_socket_recv`] but also fills `meta`, so
+/// the latency of a message can be measured without embedding a
+/// timestamp in the payload.
+///
+/// # Safety
+///
+/// The function checks the parameters to be non null before trying
+/// to utilise it. However if the pointers point to a random memory then
+/// the function may have unexpected behaviour.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_socket_recv_ex(
+    socket: *mut SimSocket,
+    // pre-allocated byte array
+    msg: *mut Message,
+    // where we will put the sender ID
+    from: *mut SimId,
+    // where we will put the timing of the message
+    meta: *mut MessageMeta,
+) -> SimError {
+    let Some(socket) = socket.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+    let Some(msg) = msg.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+    let Some(from) = from.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+    let Some(meta) = meta.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+
+    if let Some((id, data, msg_meta)) = socket.recv_with_meta() {
+        *msg = data.into_message();
         *from = id;
+        *meta = MessageMeta {
+            sent: as_nanos(msg_meta.sent),
+            scheduled: as_nanos(msg_meta.scheduled),
+            delivered: as_nanos(msg_meta.delivered),
+        };
 
         SimError::Success
     } else {
@@ -237,7 +733,784 @@ pub unsafe extern "C" fn netsim_socket_send_to(
         return SimError::NullPointerArgument;
     };
 
-    if let Err(error) = socket.send_to(to, msg) {
+    if let Err(error) = socket.send_to(to, Payload::Message(msg)) {
+        eprintln!("{error:?}");
+        return SimError::Undefined;
+    }
+
+    SimError::Success
+}
+
+/// Send a message to the [`SimSocket`], with an optional timeout
+///
+/// On success the identifier of the message is written in `id`, it can be
+/// given to [`netsim_socket_cancel`] to abort the message while it is
+/// still in flight. If `timeout_ns` is not `0`, the message is dropped
+/// (see the `on_drop` callback of [`netsim_context_new`]) if it has not
+/// been delivered after `timeout_ns` nanoseconds of simulated time.
+///
+/// # Safety
+///
+/// The function checks the parameters to be non null before trying
+/// to utilise it. However if the pointers point to a random memory then
+/// the function may have unexpected behaviour.
+/// This function returns immediately.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_socket_send_to_ex(
+    socket: *mut SimSocket,
+    to: SimId,
+    // pre-allocated byte array
+    msg: Message,
+    timeout_ns: u64,
+    // where we will put the message ID
+    id: *mut MsgId,
+) -> SimError {
+    let Some(socket) = socket.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+    let Some(id) = id.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+
+    let result = if timeout_ns == 0 {
+        socket.send_to_cancellable(to, Payload::Message(msg))
+    } else {
+        socket.send_to_with_timeout(to, Payload::Message(msg), Duration::from_nanos(timeout_ns))
+    };
+
+    match result {
+        Ok(msg_id) => {
+            *id = msg_id;
+            SimError::Success
+        }
+        Err(error) => {
+            eprintln!("{error:?}");
+            SimError::Undefined
+        }
+    }
+}
+
+/// Cancel a message sent with [`netsim_socket_send_to_ex`]
+///
+/// If the message is still in flight it is dropped (see the `on_drop`
+/// callback of [`netsim_context_new`]) and stops consuming the bandwidth
+/// of the simulated network. Nothing happens if the message was already
+/// delivered, or if it was not sent by this socket.
+///
+/// # Safety
+///
+/// The function checks for the socket to be a nullpointer before trying
+/// to utilise it. However if the value points to a random value then
+/// the function may have unexpected behaviour.
+/// This function returns immediately.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_socket_cancel(socket: *mut SimSocket, id: MsgId) -> SimError {
+    let Some(socket) = socket.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+
+    if let Err(error) = socket.cancel(id) {
+        eprintln!("{error:?}");
+        return SimError::Undefined;
+    }
+
+    SimError::Success
+}
+
+/// Send a message to the [`SimSocket`] and be notified once it has left
+/// the socket
+///
+/// Once the last byte of the message has been uploaded by the sender, an
+/// event of kind [`EventKind::SendCompletion`] with the given `token` is
+/// delivered back to the sending socket (see [`netsim_socket_recv_event`]).
+/// This allows to schedule the uploads the way a real node would: start
+/// sending to the next peer once the previous upload has completed.
+///
+/// # Safety
+///
+/// The function checks for the context to be a nullpointer before trying
+/// to utilise it. However if the value points to a random value then
+/// the function may have unexpected behaviour.
+/// This function returns immediately.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_socket_send_to_notify(
+    socket: *mut SimSocket,
+    to: SimId,
+    // pre-allocated byte array
+    msg: Message,
+    token: u64,
+) -> SimError {
+    let Some(socket) = socket.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+
+    if let Err(error) = socket.send_to_notify(to, Payload::Message(msg), token) {
+        eprintln!("{error:?}");
+        return SimError::Undefined;
+    }
+
+    SimError::Success
+}
+
+/// Send a message of `size` bytes that carries a `tag` instead of a
+/// payload
+///
+/// The simulated network charges `size` bytes but no payload is stored:
+/// there is nothing to allocate nor to release (the `on_drop` callback is
+/// not called for these messages). The recipient receives an event of kind
+/// [`EventKind::Sized`] with the `tag` as token (see
+/// [`netsim_socket_recv_event`]), [`netsim_socket_recv`] gives a message
+/// with a null pointer.
+///
+/// # Safety
+///
+/// The function checks for the socket to be a nullpointer before trying
+/// to utilise it. However if the value points to a random value then
+/// the function may have unexpected behaviour.
+/// This function returns immediately.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_socket_send_sized(
+    socket: *mut SimSocket,
+    to: SimId,
+    size: u64,
+    tag: u64,
+) -> SimError {
+    let Some(socket) = socket.as_ref() else {
+        return SimError::NullPointerArgument;
+    };
+
+    if let Err(error) = socket.send_sized(to, size, tag) {
+        eprintln!("{error:?}");
+        return SimError::Undefined;
+    }
+
+    SimError::Success
+}
+
+/// Send a message to the [`SimSocket`] as part of the propagation
+/// `propagation` (a block or a transaction relayed from node to node)
+///
+/// The simulated network records the first delivery of the propagation
+/// to every node, see [`netsim_propagation`].
+///
+/// # Safety
+///
+/// The function checks for the socket to be a nullpointer before trying
+/// to utilise it. However if the value points to a random value then
+/// the function may have unexpected behaviour.
+/// This function returns immediately.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_socket_send_to_tracked(
+    socket: *mut SimSocket,
+    to: SimId,
+    // pre-allocated byte array
+    msg: Message,
+    propagation: u64,
+) -> SimError {
+    let Some(socket) = socket.as_ref() else {
+        return SimError::NullPointerArgument;
+    };
+
+    if let Err(error) = socket.send_to_tracked(to, Payload::Message(msg), propagation) {
+        eprintln!("{error:?}");
+        return SimError::Undefined;
+    }
+
+    SimError::Success
+}
+
+/// Get the coverage of the propagation `id`
+///
+/// The coverage of a propagation in progress is a snapshot, the
+/// propagation is forgotten once its coverage is received complete (all
+/// the nodes were reached), or 10 minutes after its start if it never
+/// completes (its late messages are then delivered to the relays as any
+/// other message).
+///
+/// # Safety
+///
+/// The function checks the parameters to be non null before trying
+/// to utilise it. However if the pointers point to a random memory then
+/// the function may have unexpected behaviour.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_propagation(
+    context: *mut SimContext,
+    id: u64,
+    coverage: *mut PropagationCoverage,
+) -> SimError {
+    let Some(context) = context.as_ref() else {
+        return SimError::NullPointerArgument;
+    };
+    let Some(coverage) = coverage.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+
+    let report = match context.propagation_report(id) {
+        Ok(Some(report)) => report,
+        Ok(None) => {
+            coverage.reached = 0;
+            return SimError::Success;
+        }
+        Err(error) => {
+            eprintln!("{error:?}");
+            return SimError::Undefined;
+        }
+    };
+
+    let time = |fraction| report.time_to_coverage(fraction).map_or(u64::MAX, as_nanos);
+    *coverage = PropagationCoverage {
+        origin: report.origin,
+        start: as_nanos(report.start),
+        nodes: report.nodes as u64,
+        reached: report.deliveries.len() as u64 + 1,
+        p50: time(0.5),
+        p90: time(0.9),
+        p100: time(1.0),
+    };
+
+    SimError::Success
+}
+
+/// Create a [`SimWriter`]: a handle to send messages from the
+/// [`SimSocket`] that can be used from another thread
+///
+/// Unlike the [`SimSocket`], that must not be used by two threads at the
+/// same time, a [`SimWriter`] can be given to a thread while another
+/// thread receives from the socket. Use [`netsim_writer_clone`] to give a
+/// handle to each of the sending threads. The handles share the same
+/// queue to the multiplexer.
+///
+/// # Safety
+///
+/// This function allocate a pointer upon success and returns the pointer
+/// address. Call [`netsim_writer_release`] to release the resource.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_socket_writer(
+    socket: *mut SimSocket,
+    output: *mut *mut SimWriter,
+) -> SimError {
+    let Some(socket) = socket.as_ref() else {
+        return SimError::NullPointerArgument;
+    };
+    if output.is_null() {
+        return SimError::NullPointerArgument;
+    }
+
+    *output = Box::into_raw(Box::new(SimWriter(socket.writer())));
+    SimError::Success
+}
+
+/// Create a new handle sending from the same socket as the [`SimWriter`]
+///
+/// # Safety
+///
+/// This function allocate a pointer upon success and returns the pointer
+/// address. Call [`netsim_writer_release`] to release the resource.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_writer_clone(
+    writer: *mut SimWriter,
+    output: *mut *mut SimWriter,
+) -> SimError {
+    let Some(writer) = writer.as_ref() else {
+        return SimError::NullPointerArgument;
+    };
+    if output.is_null() {
+        return SimError::NullPointerArgument;
+    }
+
+    *output = Box::into_raw(Box::new(SimWriter(writer.0.clone())));
+    SimError::Success
+}
+
+/// Release the [`SimWriter`] resources
+///
+/// The socket is still open, as well as the other handles.
+///
+/// # Safety
+///
+/// The function checks for the writer to be a nullpointer before trying
+/// to utilise it. However if the value points to a random value then
+/// the function may have unexpected behaviour.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_writer_release(writer: *mut SimWriter) -> SimError {
+    if writer.is_null() {
+        SimError::NullPointerArgument
+    } else {
+        let _ = Box::from_raw(writer);
+        SimError::Success
+    }
+}
+
+/// Send a message with the [`SimWriter`], see [`netsim_socket_send_to`]
+///
+/// # Safety
+///
+/// The function checks for the writer to be a nullpointer before trying
+/// to utilise it. However if the value points to a random value then
+/// the function may have unexpected behaviour.
+/// This function returns immediately.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_writer_send_to(
+    writer: *mut SimWriter,
+    to: SimId,
+    // pre-allocated byte array
+    msg: Message,
+) -> SimError {
+    let Some(writer) = writer.as_ref() else {
+        return SimError::NullPointerArgument;
+    };
+
+    if let Err(error) = writer.0.send_to(to, Payload::Message(msg)) {
+        eprintln!("{error:?}");
+        return SimError::Undefined;
+    }
+
+    SimError::Success
+}
+
+/// Send a message of `size` bytes with the [`SimWriter`], see
+/// [`netsim_socket_send_sized`]
+///
+/// # Safety
+///
+/// The function checks for the writer to be a nullpointer before trying
+/// to utilise it. However if the value points to a random value then
+/// the function may have unexpected behaviour.
+/// This function returns immediately.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_writer_send_sized(
+    writer: *mut SimWriter,
+    to: SimId,
+    size: u64,
+    tag: u64,
+) -> SimError {
+    let Some(writer) = writer.as_ref() else {
+        return SimError::NullPointerArgument;
+    };
+
+    if let Err(error) = writer.0.send_sized(to, size, tag) {
+        eprintln!("{error:?}");
+        return SimError::Undefined;
+    }
+
+    SimError::Success
+}
+
+/// Send a message with the [`SimWriter`] as part of a propagation, see
+/// [`netsim_socket_send_to_tracked`]
+///
+/// # Safety
+///
+/// The function checks for the writer to be a nullpointer before trying
+/// to utilise it. However if the value points to a random value then
+/// the function may have unexpected behaviour.
+/// This function returns immediately.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_writer_send_to_tracked(
+    writer: *mut SimWriter,
+    to: SimId,
+    // pre-allocated byte array
+    msg: Message,
+    propagation: u64,
+) -> SimError {
+    let Some(writer) = writer.as_ref() else {
+        return SimError::NullPointerArgument;
+    };
+
+    if let Err(error) = writer
+        .0
+        .send_to_tracked(to, Payload::Message(msg), propagation)
+    {
+        eprintln!("{error:?}");
+        return SimError::Undefined;
+    }
+
+    SimError::Success
+}
+
+/// Send a message with the [`SimWriter`], with an optional timeout, see
+/// [`netsim_socket_send_to_ex`]
+///
+/// # Safety
+///
+/// The function checks the parameters to be non null before trying
+/// to utilise it. However if the pointers point to a random memory then
+/// the function may have unexpected behaviour.
+/// This function returns immediately.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_writer_send_to_ex(
+    writer: *mut SimWriter,
+    to: SimId,
+    // pre-allocated byte array
+    msg: Message,
+    timeout_ns: u64,
+    // where we will put the message ID
+    id: *mut MsgId,
+) -> SimError {
+    let Some(writer) = writer.as_ref() else {
+        return SimError::NullPointerArgument;
+    };
+    let Some(id) = id.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+
+    let result = if timeout_ns == 0 {
+        writer.0.send_to(to, Payload::Message(msg))
+    } else {
+        writer
+            .0
+            .send_to_with_timeout(to, Payload::Message(msg), Duration::from_nanos(timeout_ns))
+    };
+
+    match result {
+        Ok(msg_id) => {
+            *id = msg_id;
+            SimError::Success
+        }
+        Err(error) => {
+            eprintln!("{error:?}");
+            SimError::Undefined
+        }
+    }
+}
+
+/// Receive the next event from the [`SimSocket`]
+///
+/// On success the function populate the pointed value `event`. Unlike
+/// [`netsim_socket_recv`] every kind of event is received, the caller must
+/// handle all the kinds of [`EventKind`]:
+///
+/// * [`EventKind::Message`]: a message from another node, in `msg`;
+/// * [`EventKind::Timer`]: an expired timer, its `token`;
+/// * [`EventKind::SendCompletion`]: a message sent with
+///   [`netsim_socket_send_to_notify`] left the socket, its `token`;
+/// * [`EventKind::Stream`]: another node opened a stream, its reading end
+///   in `stream`;
+/// * [`EventKind::Sized`]: a message without payload from another node,
+///   its size in `msg.size` and its tag in `token`.
+///
+/// # Safety
+///
+/// The function checks the parameters to be non null before trying
+/// to utilise it. However if the pointers point to a random memory then
+/// the function may have unexpected behaviour.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_socket_recv_event(
+    socket: *mut SimSocket,
+    event: *mut Event,
+) -> SimError {
+    let Some(socket) = socket.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+    let Some(event) = event.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+
+    match socket.recv_event() {
+        Some(sim_event) => {
+            *event = into_event(sim_event);
+            SimError::Success
+        }
+        // this is usually to signal it is time to release
+        // the socket
+        None => SimError::SocketDisconnected,
+    }
+}
+
+/// the C representation of the event, the stream reader is allocated
+/// (see [`netsim_stream_reader_release`])
+fn into_event(event: SimEvent<Payload>) -> Event {
+    match event {
+        SimEvent::Msg(msg) => {
+            let from = msg.from();
+            match msg.into_content() {
+                Payload::Message(msg) => Event {
+                    kind: EventKind::Message,
+                    from,
+                    msg,
+                    token: 0,
+                    stream: ptr::null_mut(),
+                },
+                Payload::Phantom(phantom) => Event {
+                    kind: EventKind::Sized,
+                    from,
+                    msg: Payload::Phantom(phantom).into_message(),
+                    token: phantom.tag,
+                    stream: ptr::null_mut(),
+                },
+            }
+        }
+        SimEvent::Timer(timer) => Event {
+            kind: EventKind::Timer,
+            from: timer.node(),
+            msg: Message::NULL,
+            token: timer.token(),
+            stream: ptr::null_mut(),
+        },
+        SimEvent::SendCompletion(completion) => Event {
+            kind: EventKind::SendCompletion,
+            from: completion.to(),
+            msg: Message::NULL,
+            token: completion.token(),
+            stream: ptr::null_mut(),
+        },
+        SimEvent::Stream(stream) => Event {
+            kind: EventKind::Stream,
+            from: stream.from(),
+            msg: Message::NULL,
+            token: 0,
+            stream: Box::into_raw(Box::new(SimStreamReader(stream))),
+        },
+    }
+}
+
+/// Get the current time of the simulation, in nanoseconds since the
+/// creation of the context
+///
+/// This is the clock of the multiplexer: use it instead of the system's
+/// clock so that the nodes' timers line up with the simulated network.
+///
+/// # Safety
+///
+/// The function checks for the context to be a nullpointer before trying
+/// to utilise it. However if the value points to a random value then
+/// the function may have unexpected behaviour.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_now(context: *mut SimContext, now: *mut u64) -> SimError {
+    let Some(context) = context.as_ref() else {
+        return SimError::NullPointerArgument;
+    };
+    let Some(now) = now.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+
+    *now = as_nanos(context.now());
+
+    SimError::Success
+}
+
+/// Open an ordered byte stream from the [`SimSocket`] to the node `to`
+///
+/// The recipient receives the reading end of the stream as an event of
+/// kind [`EventKind::Stream`] (see [`netsim_socket_recv_event`]). The
+/// stream is accounted by the multiplexer as a single flow, sharing the
+/// bandwidth of the network with the messages.
+///
+/// `window` is the maximum number of bytes written but not yet read by
+/// the recipient: once it is reached [`netsim_stream_write`] blocks until
+/// the recipient reads from the stream.
+///
+/// # Safety
+///
+/// This function allocate a pointer upon success and returns the pointer
+/// address. Call [`netsim_stream_close`] to release the resource.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_socket_stream_open(
+    socket: *mut SimSocket,
+    to: SimId,
+    window: u64,
+    output: *mut *mut SimStream,
+) -> SimError {
+    let Some(socket) = socket.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+    if output.is_null() {
+        return SimError::NullPointerArgument;
+    }
+
+    match socket.open_stream(to, window) {
+        Ok(stream) => {
+            *output = Box::into_raw(Box::new(SimStream(stream)));
+            SimError::Success
+        }
+        Err(error) => {
+            eprintln!("{error:?}");
+            SimError::Undefined
+        }
+    }
+}
+
+/// Close the [`SimStream`] and release its resources
+///
+/// The recipient reads the end of the stream once all the bytes written
+/// have been delivered (see [`netsim_stream_reader_read`]).
+///
+/// # Safety
+///
+/// The function checks for the stream to be a nullpointer before trying
+/// to utilise it. However if the value points to a random value then
+/// the function may have unexpected behaviour.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_stream_close(stream: *mut SimStream) -> SimError {
+    if stream.is_null() {
+        return SimError::NullPointerArgument;
+    }
+
+    let stream = Box::from_raw(stream);
+    if let Err(error) = stream.0.close() {
+        eprintln!("{error:?}");
+        return SimError::Undefined;
+    }
+
+    SimError::Success
+}
+
+/// Write up to `len` bytes of `data` to the [`SimStream`]
+///
+/// The function blocks until there is room in the stream's window and
+/// sets `written` to the number of bytes written (at least one unless
+/// `len` is `0`).
+///
+/// # Safety
+///
+/// The function checks the parameters to be non null before trying
+/// to utilise it. However if the pointers point to a random memory then
+/// the function may have unexpected behaviour. `data` must point to at
+/// least `len` bytes.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_stream_write(
+    stream: *mut SimStream,
+    data: *const u8,
+    len: u64,
+    written: *mut u64,
+) -> SimError {
+    let Some(stream) = stream.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+    if data.is_null() {
+        return SimError::NullPointerArgument;
+    }
+    let Some(written) = written.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+
+    let data = slice::from_raw_parts(data, len as usize);
+    match io::Write::write(&mut stream.0, data) {
+        Ok(len) => {
+            *written = len as u64;
+            SimError::Success
+        }
+        // the recipient has released the stream
+        Err(error) if error.kind() == io::ErrorKind::BrokenPipe => SimError::SocketDisconnected,
+        Err(error) => {
+            eprintln!("{error:?}");
+            SimError::Undefined
+        }
+    }
+}
+
+/// Read up to `len` bytes from the [`SimStreamReader`] into `buffer`
+///
+/// The function blocks until some bytes are available and sets `read` to
+/// the number of bytes read. `read` is set to `0` once the stream is
+/// closed and all its bytes have been read. If the network dropped the
+/// stream before its end (or the context was shut down), the function
+/// returns [`SimError::SocketDisconnected`] once the bytes delivered
+/// have been read.
+///
+/// # Safety
+///
+/// The function checks the parameters to be non null before trying
+/// to utilise it. However if the pointers point to a random memory then
+/// the function may have unexpected behaviour. `buffer` must point to at
+/// least `len` bytes.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_stream_reader_read(
+    stream: *mut SimStreamReader,
+    buffer: *mut u8,
+    len: u64,
+    read: *mut u64,
+) -> SimError {
+    let Some(stream) = stream.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+    if buffer.is_null() {
+        return SimError::NullPointerArgument;
+    }
+    let Some(read) = read.as_mut() else {
+        return SimError::NullPointerArgument;
+    };
+
+    let buffer = slice::from_raw_parts_mut(buffer, len as usize);
+    match stream.0.read(buffer) {
+        Ok(len) => {
+            *read = len as u64;
+            SimError::Success
+        }
+        Err(error) if error.kind() == io::ErrorKind::ConnectionReset => {
+            SimError::SocketDisconnected
+        }
+        Err(error) => {
+            eprintln!("{error:?}");
+            SimError::Undefined
+        }
+    }
+}
+
+/// Release the [`SimStreamReader`] resources
+///
+/// The writer of the stream will fail to write any more bytes.
+///
+/// # Safety
+///
+/// The function checks for the stream to be a nullpointer before trying
+/// to utilise it. However if the value points to a random value then
+/// the function may have unexpected behaviour.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_stream_reader_release(stream: *mut SimStreamReader) -> SimError {
+    if stream.is_null() {
+        SimError::NullPointerArgument
+    } else {
+        let _ = Box::from_raw(stream);
+        SimError::Success
+    }
+}
+
+/// Request a timer on the [`SimSocket`]
+///
+/// After `delay_ns` nanoseconds of simulated time, the timer is delivered
+/// to the socket as an event of kind [`EventKind::Timer`] with the given
+/// `token` (see [`netsim_socket_recv_event`]). The timers are kept by the
+/// multiplexer and do not cost a thread.
+///
+/// # Safety
+///
+/// The function checks for the socket to be a nullpointer before trying
+/// to utilise it. However if the value points to a random value then
+/// the function may have unexpected behaviour.
+/// This function returns immediately.
+///
+#[no_mangle]
+pub unsafe extern "C" fn netsim_timer_after(
+    socket: *mut SimSocket,
+    delay_ns: u64,
+    token: u64,
+) -> SimError {
+    let Some(socket) = socket.as_ref() else {
+        return SimError::NullPointerArgument;
+    };
+
+    if let Err(error) = socket.timer_after(Duration::from_nanos(delay_ns), token) {
         eprintln!("{error:?}");
         return SimError::Undefined;
     }
@@ -246,7 +1519,7 @@ pub unsafe extern "C" fn netsim_socket_send_to(
 }
 
 impl Deref for SimContext {
-    type Target = OSimContext<Message>;
+    type Target = OSimContext<Payload>;
     fn deref(&self) -> &Self::Target {
         &self.0
     }
@@ -258,7 +1531,7 @@ impl DerefMut for SimContext {
 }
 
 impl Deref for SimSocket {
-    type Target = OSimSocket<Message>;
+    type Target = OSimSocket<Payload>;
     fn deref(&self) -> &Self::Target {
         &self.0
     }
@@ -0,0 +1,103 @@
+/*!
+# NetSim Proxy
+
+Expose the nodes of a simulated network as local Unix datagram sockets so
+that processes that cannot link against `netsim.h` can still talk through
+the simulator.
+
+For every node `N` the proxy binds the socket `<dir>/N.sock`. The process
+playing node `N` binds its own socket at `<dir>/N.app`:
+
+* a datagram sent from `<dir>/A.app` to `<dir>/B.sock` is a message from
+  `A` to `B` in the simulated network;
+* once delivered by the simulation, the message is sent from `<dir>/A.sock`
+  to `<dir>/B.app`, so the receiver finds the sender in the source address
+  and may reply to it directly.
+
+Datagrams are never modified. If the recipient has not bound its `.app`
+socket when the message is delivered, the datagram is dropped, as it would
+be on a real network. If its receive buffer is full, the datagram is kept
+and written again later; past 1024 kept datagrams per recipient the
+following ones are dropped.
+
+*/
+
+#[cfg(target_os = "linux")]
+mod proxy;
+
+use clap::Parser;
+use netsim_core::{time::Duration, Bandwidth, EdgePolicy, Latency, NodePolicy, SimConfiguration};
+use std::path::PathBuf;
+
+#[derive(Parser)]
+struct Command {
+    /// directory where the unix sockets are created
+    #[arg(long, default_value = "netsim")]
+    dir: PathBuf,
+
+    /// the number of nodes in the simulated network
+    #[arg(long, default_value = "2")]
+    nodes: usize,
+
+    /// stop the proxy after the given duration (runs until interrupted
+    /// otherwise)
+    #[arg(long)]
+    time: Option<Duration>,
+
+    /// parameter for the simulator's routing
+    #[arg(long, default_value = "500us")]
+    idle: Duration,
+
+    #[arg(long, default_value = "1gbps")]
+    bandwidth_down: Bandwidth,
+    #[arg(long, default_value = "1gbps")]
+    bandwidth_up: Bandwidth,
+
+    /// the default latency for all messages
+    #[arg(long, default_value = "5ms")]
+    latency: Latency,
+}
+
+fn main() -> anyhow::Result<()> {
+    let cmd = Command::parse();
+
+    let mut configuration = SimConfiguration {
+        idle_duration: cmd.idle.into_duration(),
+        ..SimConfiguration::default()
+    };
+    configuration.policy.set_default_node_policy(NodePolicy {
+        bandwidth_down: cmd.bandwidth_down,
+        bandwidth_up: cmd.bandwidth_up,
+        ..Default::default()
+    });
+    configuration.policy.set_default_edge_policy(EdgePolicy {
+        latency: cmd.latency,
+        ..Default::default()
+    });
+
+    run(cmd, configuration)
+}
+
+#[cfg(target_os = "linux")]
+fn run(cmd: Command, configuration: SimConfiguration<Box<[u8]>>) -> anyhow::Result<()> {
+    let stats = proxy::run(proxy::Options {
+        dir: cmd.dir,
+        nodes: cmd.nodes,
+        time: cmd.time.map(Duration::into_duration),
+        configuration,
+    })?;
+
+    println!(
+        "received {received} datagrams, delivered {delivered}, dropped {dropped}",
+        received = stats.received,
+        delivered = stats.delivered,
+        dropped = stats.dropped,
+    );
+
+    Ok(())
+}
+
+#[cfg(not(target_os = "linux"))]
+fn run(_cmd: Command, _configuration: SimConfiguration<Box<[u8]>>) -> anyhow::Result<()> {
+    anyhow::bail!("netsim-proxy relies on epoll and recvmmsg/sendmmsg and only runs on Linux")
+}
@@ -0,0 +1,776 @@
+use anyhow::{anyhow, bail, Context as _, Result};
+use netsim_core::{
+    sim_context::{Link, SimContextCore},
+    BusSender, Msg, SimConfiguration, SimEvent, SimId,
+};
+use std::{
+    io, mem,
+    os::{
+        fd::{AsRawFd, FromRawFd, OwnedFd, RawFd},
+        unix::ffi::OsStrExt,
+    },
+    path::{Path, PathBuf},
+    ptr,
+    sync::{Arc, Mutex},
+    time::{Duration, Instant},
+};
+
+/// the content of the messages travelling through the simulated network
+type Datagram = Box<[u8]>;
+
+/// maximum number of datagrams read or written with a single syscall
+const BATCH: usize = 64;
+
+/// largest datagram the proxy will accept, larger datagrams are dropped
+const MAX_DATAGRAM: usize = 64 * 1_024;
+
+/// epoll token of the [`Outbox`]'s event file descriptor
+const TOKEN_OUTBOX: u64 = u64::MAX;
+/// epoll token of the signal file descriptor
+const TOKEN_SIGNAL: u64 = u64::MAX - 1;
+
+/// how long to wait before trying again to write to an application whose
+/// receive queue was full
+const RETRY: Duration = Duration::from_millis(1);
+
+/// maximum number of datagrams kept for an application whose receive
+/// queue is full, the following ones are dropped
+const MAX_RETAINED: usize = 1_024;
+
+pub struct Options {
+    pub dir: PathBuf,
+    pub nodes: usize,
+    pub time: Option<Duration>,
+    pub configuration: SimConfiguration<Datagram>,
+}
+
+#[derive(Debug, Default, Clone, Copy)]
+pub struct Stats {
+    /// datagrams read from the applications
+    pub received: u64,
+    /// datagrams written to the applications
+    pub delivered: u64,
+    /// datagrams that could not be handled (truncated, unknown sender,
+    /// recipient not listening...)
+    pub dropped: u64,
+}
+
+/// messages delivered by the multiplexer, waiting to be written
+/// by the proxy's thread.
+///
+/// The multiplexer and the proxy's thread only contend on the lock
+/// for as long as it takes to swap the `Vec`s.
+struct Outbox {
+    queue: Mutex<Vec<Msg<Datagram>>>,
+    wake: OwnedFd,
+}
+
+/// the [`Link`] of every node: all the messages end up in the same
+/// [`Outbox`]
+struct ProxyLink {
+    outbox: Arc<Outbox>,
+}
+
+struct Node {
+    id: SimId,
+    socket: OwnedFd,
+    path: PathBuf,
+    /// address of the application's socket (`<dir>/<id>.app`)
+    app: libc::sockaddr_un,
+    app_len: libc::socklen_t,
+}
+
+/// pre-allocated buffers for `recvmmsg`
+struct Ingress {
+    buffers: Box<[u8]>,
+    addresses: Box<[libc::sockaddr_un; BATCH]>,
+    iovecs: Box<[libc::iovec; BATCH]>,
+    headers: Box<[libc::mmsghdr; BATCH]>,
+}
+
+/// pre-allocated buffers for `sendmmsg`
+struct Egress {
+    /// messages to write, the ones that could not be written yet
+    /// first and then the ones freshly delivered by the multiplexer
+    pending: Vec<Msg<Datagram>>,
+    incoming: Vec<Msg<Datagram>>,
+    /// `retain[i]` is set if `pending[i]` needs to be tried again later
+    retain: Vec<bool>,
+    /// destinations whose receive queue was full during the current flush,
+    /// indexed by node
+    blocked: Vec<bool>,
+    blocked_nodes: Vec<usize>,
+    /// the number of messages kept for every node during the current
+    /// flush, indexed by node
+    retained: Vec<usize>,
+    /// indices in `pending` of the messages of the current `sendmmsg`
+    batch: Vec<usize>,
+    iovecs: Box<[libc::iovec; BATCH]>,
+    headers: Box<[libc::mmsghdr; BATCH]>,
+}
+
+struct Proxy {
+    nodes: Vec<Node>,
+    bus: BusSender<ProxyLink>,
+    outbox: Arc<Outbox>,
+    ingress: Ingress,
+    egress: Egress,
+    stats: Stats,
+}
+
+/// run the proxy until interrupted (`SIGINT` or `SIGTERM`) or until
+/// the optional [`Options::time`] has elapsed.
+pub fn run(options: Options) -> Result<Stats> {
+    let Options {
+        dir,
+        nodes,
+        time,
+        configuration,
+    } = options;
+
+    // signals need to be blocked before the multiplexer's thread is
+    // started so it inherits the signal mask
+    let signals = block_signals().context("Failed to setup the signal handling")?;
+
+    std::fs::create_dir_all(&dir)
+        .with_context(|| format!("Failed to create directory {}", dir.display()))?;
+    let outbox = Arc::new(Outbox::new()?);
+
+    let mut context = SimContextCore::with_config(configuration);
+    let mut sockets = Vec::with_capacity(nodes);
+    for _ in 0..nodes {
+        let id = context.new_link(ProxyLink {
+            outbox: Arc::clone(&outbox),
+        })?;
+        sockets.push(Node::bind(&dir, id)?);
+    }
+
+    let epoll = epoll_create()?;
+    for (index, node) in sockets.iter().enumerate() {
+        epoll_add(&epoll, node.socket.as_raw_fd(), index as u64)?;
+    }
+    epoll_add(&epoll, outbox.wake.as_raw_fd(), TOKEN_OUTBOX)?;
+    epoll_add(&epoll, signals.as_raw_fd(), TOKEN_SIGNAL)?;
+
+    let mut proxy = Proxy {
+        nodes: sockets,
+        bus: context.bus(),
+        outbox,
+        ingress: Ingress::new(),
+        egress: Egress::new(nodes),
+        stats: Stats::default(),
+    };
+
+    let result = proxy.event_loop(&epoll, time.map(|time| Instant::now() + time));
+
+    for node in proxy.nodes.iter() {
+        let _ = std::fs::remove_file(&node.path);
+    }
+    context.shutdown()?;
+
+    result.map(|()| proxy.stats)
+}
+
+impl Proxy {
+    fn event_loop(&mut self, epoll: &OwnedFd, deadline: Option<Instant>) -> Result<()> {
+        let mut events = vec![libc::epoll_event { events: 0, u64: 0 }; 256];
+
+        loop {
+            let mut wait = match deadline {
+                None => None,
+                Some(deadline) => {
+                    let Some(remaining) = deadline.checked_duration_since(Instant::now()) else {
+                        return Ok(());
+                    };
+                    Some(remaining)
+                }
+            };
+            if self.egress.has_pending() {
+                wait = Some(wait.map_or(RETRY, |wait| wait.min(RETRY)));
+            }
+            let timeout = match wait {
+                None => -1,
+                // round up so we don't spin on a sub-millisecond remainder
+                Some(wait) => wait.as_millis().saturating_add(1).min(i32::MAX as u128) as i32,
+            };
+
+            let ready = unsafe {
+                libc::epoll_wait(
+                    epoll.as_raw_fd(),
+                    events.as_mut_ptr(),
+                    events.len() as i32,
+                    timeout,
+                )
+            };
+            if ready < 0 {
+                let error = io::Error::last_os_error();
+                if error.kind() == io::ErrorKind::Interrupted {
+                    continue;
+                }
+                return Err(error).context("Failed to wait for events");
+            }
+
+            let mut deliver = self.egress.has_pending();
+            for event in &events[..ready as usize] {
+                match event.u64 {
+                    TOKEN_SIGNAL => return Ok(()),
+                    TOKEN_OUTBOX => deliver = true,
+                    index => self.receive(index as usize)?,
+                }
+            }
+
+            if deliver {
+                self.deliver()?;
+            }
+        }
+    }
+
+    /// read all the pending datagrams of the given node and send them
+    /// in the simulated network
+    fn receive(&mut self, index: usize) -> Result<()> {
+        let fd = self.nodes[index].socket.as_raw_fd();
+        let to = self.nodes[index].id;
+
+        loop {
+            let count = match self.ingress.recv(fd) {
+                Ok(count) => count,
+                Err(error) if error.kind() == io::ErrorKind::WouldBlock => return Ok(()),
+                Err(error) if error.kind() == io::ErrorKind::Interrupted => continue,
+                Err(error) => return Err(error).context("Failed to receive datagrams"),
+            };
+
+            for i in 0..count {
+                self.stats.received += 1;
+
+                let Some((address, payload)) = self.ingress.datagram(i) else {
+                    self.stats.dropped += 1;
+                    continue;
+                };
+                let Some(from) = app_index(address)
+                    .and_then(|index| self.nodes.get(index))
+                    .map(|node| node.id)
+                else {
+                    self.stats.dropped += 1;
+                    continue;
+                };
+
+                self.bus.send_msg(Msg::new(from, to, payload.into()))?;
+            }
+
+            if count < BATCH {
+                return Ok(());
+            }
+        }
+    }
+
+    /// write the messages the multiplexer has delivered to the
+    /// applications' sockets
+    fn deliver(&mut self) -> Result<()> {
+        self.outbox.acknowledge()?;
+        self.outbox.swap(&mut self.egress.incoming)?;
+        self.egress.pending.append(&mut self.egress.incoming);
+
+        let (delivered, dropped) = self.egress.flush(&self.nodes);
+        self.stats.delivered += delivered;
+        self.stats.dropped += dropped;
+
+        Ok(())
+    }
+}
+
+impl Outbox {
+    fn new() -> Result<Self> {
+        let fd = unsafe { libc::eventfd(0, libc::EFD_NONBLOCK | libc::EFD_CLOEXEC) };
+        if fd < 0 {
+            return Err(io::Error::last_os_error()).context("Failed to create eventfd");
+        }
+
+        Ok(Self {
+            queue: Mutex::new(Vec::new()),
+            wake: unsafe { OwnedFd::from_raw_fd(fd) },
+        })
+    }
+
+    fn push(&self, msg: Msg<Datagram>) -> Result<()> {
+        let was_empty = {
+            let mut queue = self
+                .queue
+                .lock()
+                .map_err(|_| anyhow!("The proxy's outbox is poisoned"))?;
+            queue.push(msg);
+            queue.len() == 1
+        };
+
+        // only wake the proxy's thread on the first message, the
+        // following ones will be collected with the same `swap`
+        if was_empty {
+            let one: u64 = 1;
+            let written = unsafe {
+                libc::write(
+                    self.wake.as_raw_fd(),
+                    ptr::addr_of!(one).cast(),
+                    mem::size_of::<u64>(),
+                )
+            };
+            if written < 0 {
+                return Err(io::Error::last_os_error()).context("Failed to wake the proxy");
+            }
+        }
+
+        Ok(())
+    }
+
+    /// reset the event counter, this needs to be done before calling
+    /// [`Outbox::swap`] so that messages pushed in between are not missed
+    fn acknowledge(&self) -> Result<()> {
+        let mut counter: u64 = 0;
+        let read = unsafe {
+            libc::read(
+                self.wake.as_raw_fd(),
+                ptr::addr_of_mut!(counter).cast(),
+                mem::size_of::<u64>(),
+            )
+        };
+        if read < 0 {
+            let error = io::Error::last_os_error();
+            if error.kind() != io::ErrorKind::WouldBlock {
+                return Err(error).context("Failed to read the proxy's eventfd");
+            }
+        }
+        Ok(())
+    }
+
+    fn swap(&self, pending: &mut Vec<Msg<Datagram>>) -> Result<()> {
+        debug_assert!(pending.is_empty());
+        let mut queue = self
+            .queue
+            .lock()
+            .map_err(|_| anyhow!("The proxy's outbox is poisoned"))?;
+        mem::swap(&mut *queue, pending);
+        Ok(())
+    }
+}
+
+impl Link for ProxyLink {
+    type Msg = Datagram;
+
+    fn send(&self, event: SimEvent<Self::Msg>) -> Result<()> {
+        match event {
+            SimEvent::Msg(msg) => self.outbox.push(msg),
+            // the proxy does not request timers nor send completions and
+            // does not open streams
+            SimEvent::Timer(_) | SimEvent::SendCompletion(_) | SimEvent::Stream(_) => Ok(()),
+        }
+    }
+}
+
+impl Node {
+    fn bind(dir: &Path, id: SimId) -> Result<Self> {
+        let path = dir.join(format!("{id}.sock"));
+        let (address, address_len) = unix_address(&path)?;
+        let (app, app_len) = unix_address(&dir.join(format!("{id}.app")))?;
+
+        let fd = unsafe {
+            libc::socket(
+                libc::AF_UNIX,
+                libc::SOCK_DGRAM | libc::SOCK_NONBLOCK | libc::SOCK_CLOEXEC,
+                0,
+            )
+        };
+        if fd < 0 {
+            return Err(io::Error::last_os_error()).context("Failed to create unix socket");
+        }
+        let socket = unsafe { OwnedFd::from_raw_fd(fd) };
+
+        // remove the left over of a previous run
+        let _ = std::fs::remove_file(&path);
+        let bound = unsafe {
+            libc::bind(
+                socket.as_raw_fd(),
+                ptr::addr_of!(address).cast(),
+                address_len,
+            )
+        };
+        if bound < 0 {
+            return Err(io::Error::last_os_error())
+                .with_context(|| format!("Failed to bind {}", path.display()));
+        }
+
+        Ok(Self {
+            id,
+            socket,
+            path,
+            app,
+            app_len,
+        })
+    }
+}
+
+impl Ingress {
+    fn new() -> Self {
+        Self {
+            buffers: vec![0; BATCH * MAX_DATAGRAM].into_boxed_slice(),
+            addresses: Box::new(unsafe { mem::zeroed() }),
+            iovecs: Box::new(unsafe { mem::zeroed() }),
+            headers: Box::new(unsafe { mem::zeroed() }),
+        }
+    }
+
+    fn recv(&mut self, fd: RawFd) -> io::Result<usize> {
+        for i in 0..BATCH {
+            self.iovecs[i] = libc::iovec {
+                iov_base: self.buffers[i * MAX_DATAGRAM..].as_mut_ptr().cast(),
+                iov_len: MAX_DATAGRAM,
+            };
+            let header = &mut self.headers[i].msg_hdr;
+            header.msg_name = ptr::addr_of_mut!(self.addresses[i]).cast();
+            header.msg_namelen = mem::size_of::<libc::sockaddr_un>() as libc::socklen_t;
+            header.msg_iov = ptr::addr_of_mut!(self.iovecs[i]);
+            header.msg_iovlen = 1;
+            header.msg_flags = 0;
+        }
+
+        let count = unsafe {
+            libc::recvmmsg(
+                fd,
+                self.headers.as_mut_ptr(),
+                BATCH as _,
+                libc::MSG_DONTWAIT as _,
+                ptr::null_mut(),
+            )
+        };
+        if count < 0 {
+            Err(io::Error::last_os_error())
+        } else {
+            Ok(count as usize)
+        }
+    }
+
+    /// access the `i`th datagram of the last call to [`Ingress::recv`]
+    ///
+    /// returns `None` if the datagram was truncated
+    fn datagram(&self, i: usize) -> Option<(&[u8], &[u8])> {
+        let header = &self.headers[i];
+        if header.msg_hdr.msg_flags & libc::MSG_TRUNC != 0 {
+            return None;
+        }
+
+        let path = &self.addresses[i].sun_path;
+        let path_len = (header.msg_hdr.msg_namelen as usize)
+            .saturating_sub(mem::size_of::<libc::sa_family_t>())
+            .min(path.len());
+        // SAFETY: `c_char` and `u8` have the same layout
+        let path: &[u8] = unsafe { std::slice::from_raw_parts(path.as_ptr().cast(), path_len) };
+
+        let start = i * MAX_DATAGRAM;
+        let payload = &self.buffers[start..start + header.msg_len as usize];
+
+        Some((path, payload))
+    }
+}
+
+impl Egress {
+    fn new(nodes: usize) -> Self {
+        Self {
+            pending: Vec::new(),
+            incoming: Vec::new(),
+            retain: Vec::new(),
+            blocked: vec![false; nodes],
+            blocked_nodes: Vec::new(),
+            retained: vec![0; nodes],
+            batch: Vec::with_capacity(BATCH),
+            iovecs: Box::new(unsafe { mem::zeroed() }),
+            headers: Box::new(unsafe { mem::zeroed() }),
+        }
+    }
+
+    fn has_pending(&self) -> bool {
+        !self.pending.is_empty()
+    }
+
+    /// write as many pending messages as possible
+    ///
+    /// Messages whose recipient's receive queue is full are kept, in order,
+    /// to be tried again with the next flush. Once a recipient is full, the
+    /// following messages for it are kept too so they are not reordered.
+    /// At most [`MAX_RETAINED`] messages are kept per recipient, the others
+    /// are dropped.
+    ///
+    /// returns the number of datagrams delivered and dropped
+    fn flush(&mut self, nodes: &[Node]) -> (u64, u64) {
+        // group the messages per sender so they can be written with
+        // the sender's socket in as few syscalls as possible. The sort
+        // is stable so the order between two nodes is preserved.
+        self.pending.sort_by_key(|msg| msg.from());
+        self.retain.clear();
+        self.retain.resize(self.pending.len(), false);
+
+        let mut delivered = 0;
+        let mut dropped = 0;
+
+        let mut start = 0;
+        while start < self.pending.len() {
+            let from = self.pending[start].from();
+            let end = start
+                + self.pending[start..]
+                    .iter()
+                    .take_while(|msg| msg.from() == from)
+                    .count();
+            let fd = nodes[u64::from(from) as usize].socket.as_raw_fd();
+
+            let mut cursor = start;
+            while cursor < end {
+                self.batch.clear();
+                let mut next = cursor;
+                while next < end && self.batch.len() < BATCH {
+                    let to = u64::from(self.pending[next].to()) as usize;
+                    if self.blocked[to] {
+                        self.retain[next] = true;
+                    } else {
+                        self.batch.push(next);
+                    }
+                    next += 1;
+                }
+                if self.batch.is_empty() {
+                    cursor = next;
+                    continue;
+                }
+
+                let sent = match self.send(fd, nodes) {
+                    Ok(sent) => sent,
+                    Err(error) if error.kind() == io::ErrorKind::Interrupted => continue,
+                    Err(error) => {
+                        // the message at the head of the batch could not be
+                        // written at all.
+                        let failed = self.batch[0];
+                        if error.kind() == io::ErrorKind::WouldBlock {
+                            let to = u64::from(self.pending[failed].to()) as usize;
+                            self.blocked[to] = true;
+                            self.blocked_nodes.push(to);
+                            self.retain[failed] = true;
+                        } else {
+                            // the application is not listening
+                            dropped += 1;
+                        }
+                        cursor = failed + 1;
+                        continue;
+                    }
+                };
+
+                delivered += sent as u64;
+                // the following messages of the batch were not tried, start
+                // again from there (the remaining of the batch will fail
+                // and be handled on the next iteration).
+                cursor = self.batch.get(sent).copied().unwrap_or(next);
+            }
+
+            start = end;
+        }
+
+        for to in self.blocked_nodes.drain(..) {
+            self.blocked[to] = false;
+        }
+        dropped += self.bound();
+        let mut retain = self.retain.iter();
+        self.pending
+            .retain(|_| retain.next().copied().unwrap_or(false));
+
+        (delivered, dropped)
+    }
+
+    /// do not keep more than [`MAX_RETAINED`] messages per recipient, so
+    /// an application that never reads does not grow the proxy's memory
+    ///
+    /// returns the number of messages dropped
+    fn bound(&mut self) -> u64 {
+        let mut dropped = 0;
+
+        for (msg, retain) in self.pending.iter().zip(self.retain.iter_mut()) {
+            if !*retain {
+                continue;
+            }
+            let to = u64::from(msg.to()) as usize;
+            self.retained[to] += 1;
+            if self.retained[to] > MAX_RETAINED {
+                *retain = false;
+                dropped += 1;
+            }
+        }
+        for msg in &self.pending {
+            self.retained[u64::from(msg.to()) as usize] = 0;
+        }
+
+        dropped
+    }
+
+    /// write the messages of `batch` with the given socket
+    ///
+    /// returns the number of messages written, if it is less than the
+    /// size of the batch the following message will fail on the next call.
+    fn send(&mut self, fd: RawFd, nodes: &[Node]) -> io::Result<usize> {
+        for (i, index) in self.batch.iter().copied().enumerate() {
+            let msg = &self.pending[index];
+            let to = &nodes[u64::from(msg.to()) as usize];
+
+            self.iovecs[i] = libc::iovec {
+                iov_base: msg.content().as_ptr() as *mut libc::c_void,
+                iov_len: msg.content().len(),
+            };
+            let header = &mut self.headers[i].msg_hdr;
+            header.msg_name = ptr::addr_of!(to.app) as *mut libc::c_void;
+            header.msg_namelen = to.app_len;
+            header.msg_iov = ptr::addr_of_mut!(self.iovecs[i]);
+            header.msg_iovlen = 1;
+        }
+
+        let sent = unsafe {
+            libc::sendmmsg(
+                fd,
+                self.headers.as_mut_ptr(),
+                self.batch.len() as _,
+                libc::MSG_DONTWAIT as _,
+            )
+        };
+        if sent < 0 {
+            Err(io::Error::last_os_error())
+        } else {
+            Ok(sent as usize)
+        }
+    }
+}
+
+/// parse the node index of the application's socket path
+/// (`<dir>/<index>.app`).
+///
+/// Only the file name is considered so it does not matter if the
+/// application bound its socket with a relative or an absolute path.
+fn app_index(path: &[u8]) -> Option<usize> {
+    // unnamed addresses are empty, named ones may have a trailing NUL
+    let path = match path.iter().position(|b| *b == 0) {
+        Some(end) => &path[..end],
+        None => path,
+    };
+
+    let name = match path.iter().rposition(|b| *b == b'/') {
+        Some(separator) => &path[separator + 1..],
+        None => path,
+    };
+    let index = name.strip_suffix(b".app")?;
+    if index.is_empty() || index.len() > 19 {
+        return None;
+    }
+
+    index.iter().try_fold(0usize, |acc, digit| {
+        digit
+            .is_ascii_digit()
+            .then(|| acc * 10 + (digit - b'0') as usize)
+    })
+}
+
+fn unix_address(path: &Path) -> Result<(libc::sockaddr_un, libc::socklen_t)> {
+    let mut address: libc::sockaddr_un = unsafe { mem::zeroed() };
+    address.sun_family = libc::AF_UNIX as libc::sa_family_t;
+
+    let bytes = path.as_os_str().as_bytes();
+    if bytes.len() >= address.sun_path.len() {
+        bail!(
+            "Path {} is too long for a unix socket address",
+            path.display()
+        )
+    }
+    for (dst, src) in address.sun_path.iter_mut().zip(bytes) {
+        *dst = *src as libc::c_char;
+    }
+
+    let len = mem::size_of::<libc::sa_family_t>() + bytes.len() + 1;
+    Ok((address, len as libc::socklen_t))
+}
+
+fn epoll_create() -> Result<OwnedFd> {
+    let fd = unsafe { libc::epoll_create1(libc::EPOLL_CLOEXEC) };
+    if fd < 0 {
+        return Err(io::Error::last_os_error()).context("Failed to create epoll instance");
+    }
+    Ok(unsafe { OwnedFd::from_raw_fd(fd) })
+}
+
+fn epoll_add(epoll: &OwnedFd, fd: RawFd, token: u64) -> Result<()> {
+    let mut event = libc::epoll_event {
+        events: libc::EPOLLIN as u32,
+        u64: token,
+    };
+    let result = unsafe { libc::epoll_ctl(epoll.as_raw_fd(), libc::EPOLL_CTL_ADD, fd, &mut event) };
+    if result < 0 {
+        return Err(io::Error::last_os_error()).context("Failed to register to epoll");
+    }
+    Ok(())
+}
+
+/// block `SIGINT` and `SIGTERM` and returns a `signalfd` to receive
+/// them in the event loop instead
+fn block_signals() -> Result<OwnedFd> {
+    unsafe {
+        let mut mask: libc::sigset_t = mem::zeroed();
+        libc::sigemptyset(&mut mask);
+        libc::sigaddset(&mut mask, libc::SIGINT);
+        libc::sigaddset(&mut mask, libc::SIGTERM);
+
+        if libc::pthread_sigmask(libc::SIG_BLOCK, &mask, ptr::null_mut()) != 0 {
+            return Err(io::Error::last_os_error()).context("Failed to block signals");
+        }
+
+        let fd = libc::signalfd(-1, &mask, libc::SFD_NONBLOCK | libc::SFD_CLOEXEC);
+        if fd < 0 {
+            return Err(io::Error::last_os_error()).context("Failed to create signalfd");
+        }
+        Ok(OwnedFd::from_raw_fd(fd))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn parse_app_index() {
+        assert_eq!(app_index(b"/tmp/netsim/42.app"), Some(42));
+        assert_eq!(app_index(b"netsim/42.app\0"), Some(42));
+        assert_eq!(app_index(b"42.app"), Some(42));
+        assert_eq!(app_index(b"/tmp/netsim/42.sock"), None);
+        assert_eq!(app_index(b"/tmp/netsim/4a.app"), None);
+        assert_eq!(app_index(b"/tmp/netsim/.app"), None);
+        assert_eq!(app_index(b""), None);
+    }
+
+    #[test]
+    fn bound_retained() {
+        let id = |id: u64| id.to_string().parse::<SimId>().unwrap();
+        let (slow, other) = (id(1), id(2));
+        let mut egress = Egress::new(3);
+        for _ in 0..MAX_RETAINED + 10 {
+            egress
+                .pending
+                .push(Msg::new(id(0), slow, Datagram::default()));
+        }
+        egress
+            .pending
+            .push(Msg::new(id(0), other, Datagram::default()));
+        egress.retain = vec![true; egress.pending.len()];
+
+        assert_eq!(egress.bound(), 10);
+        let kept = |to| {
+            egress
+                .pending
+                .iter()
+                .zip(&egress.retain)
+                .filter(|(msg, retain)| msg.to() == to && **retain)
+                .count()
+        };
+        assert_eq!(kept(slow), MAX_RETAINED);
+        assert_eq!(kept(other), 1);
+
+        // the counts start again on the next flush
+        egress.retain.fill(true);
+        assert_eq!(egress.bound(), 10);
+    }
+}
@@ -0,0 +1,218 @@
+//! How close the simulated delivery times are to their analytic values
+//!
+//! Every scenario has a delivery time known from a formula:
+//!
+//! * `bottleneck`: one message at a time through nodes of `bandwidth`,
+//!   delivered after `latency + size / bandwidth`;
+//! * `shared`: `flows` messages sent at once to the same node, sharing
+//!   its download: they all complete by `latency + flows * size / bandwidth`
+//!   (the report is for the last one);
+//! * `chain`: a message relayed through `hops` nodes without congestion,
+//!   delivered after `hops * latency`.
+//!
+//! The scenarios run for every idle duration of the multiplexer and the
+//! report is the distribution of the deviation of the actual delivery
+//! time from the formula (negative when early), so a change of the
+//! multiplexer shows its cost in accuracy.
+//!
+//! ```sh
+//! cargo run --release --example fidelity -- --idle 100us,500us,2ms --flows 1,4,16
+//! ```
+
+use clap::Parser;
+use netsim::{
+    EdgePolicy, HasBytesSize, Latency, NodePolicy, PacketLoss, SimConfiguration, SimSocket,
+};
+use netsim_core::{time::Duration, Bandwidth, Policy};
+use std::time;
+
+type SimContext = netsim::SimContext<Msg>;
+
+#[derive(Parser)]
+struct Command {
+    /// the idle durations of the multiplexer
+    #[arg(long, value_delimiter = ',', default_value = "100us,500us,2ms")]
+    idle: Vec<Duration>,
+
+    /// the numbers of flows of the shared scenario
+    #[arg(long, value_delimiter = ',', default_value = "1,4,16")]
+    flows: Vec<usize>,
+
+    /// the number of nodes the message of the chain scenario goes through
+    #[arg(long, default_value = "8")]
+    hops: usize,
+
+    /// the number of samples of every scenario
+    #[arg(long, default_value = "20")]
+    samples: usize,
+
+    /// the size of the messages in bytes
+    #[arg(long, default_value = "65536")]
+    size: u64,
+
+    /// the bandwidth of the nodes
+    #[arg(long, default_value = "1mbps")]
+    bandwidth: Bandwidth,
+
+    #[arg(long, default_value = "5ms")]
+    latency: Duration,
+}
+
+fn main() {
+    let mut cmd = Command::parse();
+    cmd.samples = cmd.samples.max(1);
+
+    println!(
+        "{:<10} {:>7} {:>5} {:>10} {:>10} {:>10} {:>10} {:>10}",
+        "scenario", "idle", "load", "expected", "min", "p50", "p99", "max",
+    );
+
+    for idle in cmd.idle.iter().copied() {
+        let (expected, deviations) = bottleneck(&cmd, idle);
+        report("bottleneck", idle, 1, expected, deviations);
+
+        for flows in cmd.flows.iter().copied() {
+            let (expected, deviations) = shared(&cmd, idle, flows);
+            report("shared", idle, flows, expected, deviations);
+        }
+
+        let (expected, deviations) = chain(&cmd, idle);
+        report("chain", idle, cmd.hops, expected, deviations);
+    }
+}
+
+fn bottleneck(cmd: &Command, idle: Duration) -> (time::Duration, Vec<f64>) {
+    let (context, mut sockets) = network(cmd, idle, 2);
+    let expected = cmd.latency.into_duration() + transfer_time(cmd, cmd.size);
+
+    let deviations = (0..cmd.samples)
+        .map(|_| {
+            sockets[0].send_to(sockets[1].id(), Msg(cmd.size)).unwrap();
+            let (_, _, meta) = sockets[1].recv_with_meta().unwrap();
+            deviation(meta.delivered - meta.sent, expected)
+        })
+        .collect();
+
+    context.shutdown().unwrap();
+    (expected, deviations)
+}
+
+fn shared(cmd: &Command, idle: Duration, flows: usize) -> (time::Duration, Vec<f64>) {
+    let (context, mut sockets) = network(cmd, idle, flows + 1);
+    let expected = cmd.latency.into_duration() + transfer_time(cmd, cmd.size * flows as u64);
+    let sink = sockets[0].id();
+
+    let deviations = (0..cmd.samples)
+        .map(|_| {
+            let start = sockets[0].now();
+            for sender in &sockets[1..] {
+                sender.send_to(sink, Msg(cmd.size)).unwrap();
+            }
+
+            let mut last = start;
+            for _ in 0..flows {
+                let (_, _, meta) = sockets[0].recv_with_meta().unwrap();
+                last = last.max(meta.delivered);
+            }
+            deviation(last - start, expected)
+        })
+        .collect();
+
+    context.shutdown().unwrap();
+    (expected, deviations)
+}
+
+fn chain(cmd: &Command, idle: Duration) -> (time::Duration, Vec<f64>) {
+    let (context, mut sockets) = network(cmd, idle, cmd.hops + 1);
+    let expected = cmd.latency.into_duration() * cmd.hops as u32;
+
+    let deviations = (0..cmd.samples)
+        .map(|_| {
+            let start = sockets[0].now();
+            let mut delivered = start;
+            for hop in 0..cmd.hops {
+                let to = sockets[hop + 1].id();
+                // small enough to not be slowed down by the bandwidth
+                sockets[hop].send_to(to, Msg(1)).unwrap();
+                let (_, _, meta) = sockets[hop + 1].recv_with_meta().unwrap();
+                delivered = meta.delivered;
+            }
+            deviation(delivered - start, expected)
+        })
+        .collect();
+
+    context.shutdown().unwrap();
+    (expected, deviations)
+}
+
+/// a context of `nodes` nodes where every node and edge has the
+/// bandwidth and latency of the command
+fn network(cmd: &Command, idle: Duration, nodes: usize) -> (SimContext, Vec<SimSocket<Msg>>) {
+    let mut policy = Policy::new();
+    policy.set_default_node_policy(NodePolicy {
+        bandwidth_down: cmd.bandwidth,
+        bandwidth_up: cmd.bandwidth,
+        location: None,
+    });
+    // the edges are faster than the nodes, the bottleneck is the nodes
+    let fast = Bandwidth::bits_per_second(cmd.bandwidth.into_inner().saturating_mul(1_024));
+    policy.set_default_edge_policy(EdgePolicy {
+        latency: Latency::new(cmd.latency.into_duration()),
+        bandwidth_down: fast,
+        bandwidth_up: fast,
+        packet_loss: PacketLoss::NONE,
+    });
+    let configuration = SimConfiguration {
+        policy,
+        idle_duration: idle.into_duration(),
+        ..SimConfiguration::default()
+    };
+
+    let mut context = SimContext::with_config(configuration);
+    let sockets = (0..nodes).map(|_| context.open().unwrap()).collect();
+    (context, sockets)
+}
+
+/// the time to transfer `size` bytes at the bandwidth of the nodes
+fn transfer_time(cmd: &Command, size: u64) -> time::Duration {
+    time::Duration::from_secs_f64(size as f64 / cmd.bandwidth.into_inner() as f64)
+}
+
+/// the deviation from the expected duration, in milliseconds
+fn deviation(actual: time::Duration, expected: time::Duration) -> f64 {
+    (actual.as_secs_f64() - expected.as_secs_f64()) * 1_000.0
+}
+
+fn report(
+    scenario: &str,
+    idle: Duration,
+    load: usize,
+    expected: time::Duration,
+    mut deviations: Vec<f64>,
+) {
+    deviations.sort_by(f64::total_cmp);
+    let percentile = |fraction: f64| {
+        let index = ((deviations.len() - 1) as f64 * fraction).round() as usize;
+        format!("{:+.3}ms", deviations[index])
+    };
+
+    println!(
+        "{:<10} {:>7} {:>5} {:>10} {:>10} {:>10} {:>10} {:>10}",
+        scenario,
+        idle.to_string(),
+        load,
+        format!("{:.1?}", expected),
+        percentile(0.0),
+        percentile(0.5),
+        percentile(0.99),
+        percentile(1.0),
+    );
+}
+
+struct Msg(u64);
+
+impl HasBytesSize for Msg {
+    fn bytes_size(&self) -> u64 {
+        self.0
+    }
+}
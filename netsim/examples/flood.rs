@@ -1,10 +1,7 @@
 use clap::Parser;
 use netsim::{HasBytesSize, SimConfiguration, SimId, SimSocket};
 use netsim_core::{time::Duration, Bandwidth, Edge, EdgePolicy, Latency, NodePolicy, PacketLoss};
-use std::{
-    thread::{self, sleep},
-    time::Instant,
-};
+use std::thread::{self, sleep};
 
 type SimContext = netsim::SimContext<Msg>;
 
@@ -115,8 +112,8 @@ impl Sink {
     fn work(mut self) {
         let mut delays = Vec::with_capacity(1_000_000);
 
-        while let Some((_from, msg)) = self.socket.recv() {
-            let latency = msg.time.elapsed();
+        while let Some((_from, _msg, meta)) = self.socket.recv_with_meta() {
+            let latency = meta.delivered - meta.sent;
 
             let diff = if latency < self.latency.into_duration() {
                 self.latency.into_duration() - latency
@@ -160,16 +157,12 @@ impl Tap {
 }
 
 struct Msg {
-    time: Instant,
     size: u64,
 }
 
 impl Msg {
     fn new(size: u64) -> Self {
-        Self {
-            time: Instant::now(),
-            size,
-        }
+        Self { size }
     }
 }
 
@@ -0,0 +1,181 @@
+//! The memory of the idle nodes: the sockets against the nodes of a mailbox
+//!
+//! Every run starts a context, adds the nodes and reports:
+//!
+//! * the startup time: adding the nodes to the multiplexer;
+//! * the resident memory added per node (Linux only), this is the cost of
+//!   an idle node: its link in the multiplexer and its receiving end.
+//!
+//! The run of the mailbox fails if its nodes cost more than `budget`
+//! bytes each. Once measured, a message goes from the first node to the
+//! last one to check the nodes work.
+//!
+//! ```sh
+//! cargo run --release --example footprint -- --nodes 1000000 --sockets 10000
+//! ```
+
+use clap::{Parser, ValueEnum};
+use netsim::{HasBytesSize, SimEvent};
+use std::{
+    env, fs,
+    process::{self, Command as Process},
+    time::Instant,
+};
+
+type SimContext = netsim::SimContext<Msg>;
+
+#[derive(Parser)]
+struct Command {
+    /// the number of nodes of the mailbox
+    #[arg(long, default_value = "1000000")]
+    nodes: usize,
+
+    /// the number of sockets (they are opened one by one, each one is a
+    /// round trip to the multiplexer)
+    #[arg(long, default_value = "10000")]
+    sockets: usize,
+
+    /// the maximum bytes per node of the mailbox
+    #[arg(long, default_value = "200")]
+    budget: usize,
+
+    /// run a single configuration without the header (every
+    /// configuration runs in its own process so the memory of the
+    /// previous runs does not hide the memory of the next ones)
+    #[arg(long, hide = true)]
+    child: Option<Mode>,
+}
+
+#[derive(Clone, Copy, ValueEnum)]
+enum Mode {
+    Sockets,
+    Mailbox,
+}
+
+fn main() {
+    let cmd = Command::parse();
+
+    if let Some(mode) = cmd.child {
+        run(&cmd, mode);
+        return;
+    }
+
+    println!(
+        "{:<8} {:>8} {:>10} {:>10}",
+        "mode", "nodes", "startup", "rss/node"
+    );
+
+    let program = env::current_exe().unwrap();
+    for mode in [Mode::Sockets, Mode::Mailbox] {
+        let status = Process::new(&program)
+            .args(["--child", mode.name()])
+            .args(["--nodes", &cmd.nodes.to_string()])
+            .args(["--sockets", &cmd.sockets.to_string()])
+            .args(["--budget", &cmd.budget.to_string()])
+            .status()
+            .unwrap();
+        if !status.success() {
+            eprintln!("{} failed: {status}", mode.name());
+            process::exit(1);
+        }
+    }
+}
+
+fn run(cmd: &Command, mode: Mode) {
+    let memory_per_node = match mode {
+        Mode::Sockets => sockets(cmd.sockets),
+        Mode::Mailbox => mailbox(cmd.nodes),
+    };
+
+    if let (Mode::Mailbox, Some(bytes)) = (mode, memory_per_node) {
+        if bytes > cmd.budget {
+            eprintln!("{bytes}B per node is over the budget of {}B", cmd.budget);
+            process::exit(1);
+        }
+    }
+}
+
+fn sockets(nodes: usize) -> Option<usize> {
+    let mut context = SimContext::new();
+    let memory = resident_memory();
+    let start = Instant::now();
+
+    let mut sockets: Vec<_> = (0..nodes.max(2)).map(|_| context.open().unwrap()).collect();
+    let startup = start.elapsed();
+    let memory_per_node = per_node(memory, sockets.len());
+    report(Mode::Sockets, sockets.len(), startup, memory_per_node);
+
+    let (first, last) = (sockets[0].id(), sockets[sockets.len() - 1].id());
+    sockets[0].send_to(last, Msg).unwrap();
+    let (from, _) = sockets.last_mut().unwrap().recv().unwrap();
+    assert_eq!(from, first);
+
+    drop(sockets);
+    context.shutdown().unwrap();
+    memory_per_node
+}
+
+fn mailbox(nodes: usize) -> Option<usize> {
+    let mut context = SimContext::new();
+    let memory = resident_memory();
+    let start = Instant::now();
+
+    let mailbox = context.open_mailbox(nodes.max(2)).unwrap();
+    let startup = start.elapsed();
+    let memory_per_node = per_node(memory, mailbox.len());
+    report(Mode::Mailbox, mailbox.len(), startup, memory_per_node);
+
+    let (first, last) = (mailbox.ids().next().unwrap(), mailbox.ids().last().unwrap());
+    mailbox.writer(first).unwrap().send_to(last, Msg).unwrap();
+    match mailbox.recv_event() {
+        Some(SimEvent::Msg(msg)) => assert_eq!((msg.from(), msg.to()), (first, last)),
+        _ => panic!("the message should have been delivered"),
+    }
+
+    drop(mailbox);
+    context.shutdown().unwrap();
+    memory_per_node
+}
+
+fn report(mode: Mode, nodes: usize, startup: std::time::Duration, memory_per_node: Option<usize>) {
+    let memory = memory_per_node.map_or_else(|| "-".to_owned(), |bytes| format!("{bytes}B"));
+    println!(
+        "{:<8} {:>8} {:>10} {:>10}",
+        mode.name(),
+        nodes,
+        format!("{startup:.1?}"),
+        memory,
+    );
+}
+
+fn per_node(before: Option<usize>, nodes: usize) -> Option<usize> {
+    let after = resident_memory()?;
+    Some(after.saturating_sub(before?) / nodes.max(1))
+}
+
+/// the resident memory of the process, in bytes (Linux only)
+fn resident_memory() -> Option<usize> {
+    let status = fs::read_to_string("/proc/self/status").ok()?;
+    let line = status.lines().find(|line| line.starts_with("VmRSS:"))?;
+    let kilobytes: usize = line.split_whitespace().nth(1)?.parse().ok()?;
+
+    Some(kilobytes * 1024)
+}
+
+impl Mode {
+    fn name(self) -> &'static str {
+        match self {
+            Self::Sockets => "sockets",
+            Self::Mailbox => "mailbox",
+        }
+    }
+}
+
+/// an empty message, the nodes are idle
+struct Msg;
+
+impl HasBytesSize for Msg {
+    fn bytes_size(&self) -> u64 {
+        64
+    }
+}
@@ -0,0 +1,287 @@
+//! How fast a propagation covers a large network, relayed by the
+//! multiplexer or by the application
+//!
+//! The nodes are the nodes of a mailbox on a random regular graph. Every
+//! propagation starts from a random node and is relayed by every node to
+//! all its neighbours (flood) or to `fanout` random ones (gossip):
+//!
+//! * `mux`: the multiplexer relays the messages (see `Relay`), the
+//!   application only starts the propagations;
+//! * `app`: a thread receives the messages of all the nodes, checks they
+//!   were not seen already and sends them on.
+//!
+//! Each run reports the time to reach 50%, 90% and all the nodes (in
+//! simulated time, `-` if not reached), the share of
+//! the nodes reached and the wall clock time of the propagations.
+//!
+//! ```sh
+//! cargo run --release --example gossip -- --nodes 100000 --degree 8 --fanout 4
+//! ```
+
+use clap::{Parser, ValueEnum};
+use netsim::{
+    EdgePolicy, HasBytesSize, Latency, NodePolicy, PacketLoss, PropagationReport, Relay,
+    SimConfiguration, SimEvent, SimId, SimMailbox, TopologyGenerator,
+};
+use netsim_core::{time::Duration, Bandwidth, Policy};
+use rand::{rngs::StdRng, RngCore as _, SeedableRng};
+use std::{thread, time::Instant};
+
+type SimContext = netsim::SimContext<Block>;
+
+#[derive(Parser)]
+struct Command {
+    #[arg(long, default_value = "10000")]
+    nodes: usize,
+
+    /// the number of neighbours of every node
+    #[arg(long, default_value = "8")]
+    degree: usize,
+
+    /// the number of neighbours a node relays to, all of them if not set
+    #[arg(long)]
+    fanout: Option<usize>,
+
+    /// who relays the messages
+    #[arg(long, value_delimiter = ',', default_value = "mux,app")]
+    mode: Vec<Mode>,
+
+    /// the number of propagations, one after the other
+    #[arg(long, default_value = "5")]
+    propagations: u64,
+
+    /// the size of the messages in bytes
+    #[arg(long, default_value = "1024")]
+    size: u64,
+
+    #[arg(long, default_value = "100mbps")]
+    bandwidth: Bandwidth,
+
+    #[arg(long, default_value = "20ms")]
+    latency: Duration,
+
+    #[arg(long, default_value = "500us")]
+    idle: Duration,
+
+    /// the maximum duration of a propagation
+    #[arg(long, default_value = "30s")]
+    timeout: Duration,
+
+    #[arg(long, default_value = "42")]
+    seed: u64,
+}
+
+#[derive(Clone, Copy, PartialEq, Eq, ValueEnum)]
+enum Mode {
+    Mux,
+    App,
+}
+
+fn main() {
+    let cmd = Command::parse();
+
+    println!(
+        "{:<4} {:>8} {:>10} {:>10} {:>10} {:>8} {:>10}",
+        "mode", "nodes", "p50", "p90", "p100", "reached", "wall"
+    );
+    for mode in cmd.mode.iter().copied() {
+        run(&cmd, mode);
+    }
+}
+
+fn run(cmd: &Command, mode: Mode) {
+    let mut context = network(cmd);
+    let nodes = context.open_mailbox(cmd.nodes).unwrap();
+    // the nodes of the topology are the first nodes of the context
+    let ids: Vec<SimId> = nodes.ids().collect();
+    assert_eq!(u64::from(ids[0]), 0);
+    let topology = TopologyGenerator::new(cmd.nodes, cmd.seed)
+        .random_regular(cmd.degree.min(cmd.nodes - 1))
+        .unwrap();
+    let peers: Vec<Vec<SimId>> = ids
+        .iter()
+        .map(|id| topology.neighbours(*id).collect())
+        .collect();
+    context.set_topology(topology).unwrap();
+
+    if mode == Mode::Mux {
+        let relay = cmd.fanout.map_or(Relay::Flood, Relay::Random);
+        context.set_default_relay(Some(relay)).unwrap();
+    }
+
+    let mut rng = StdRng::seed_from_u64(cmd.seed);
+    thread::scope(|scope| {
+        if mode == Mode::App {
+            let (nodes, peers) = (&nodes, &peers);
+            scope.spawn(move || relay(cmd, nodes, peers));
+        }
+
+        for propagation in 0..cmd.propagations {
+            let start = Instant::now();
+            let origin = rng.next_u64() as usize % cmd.nodes;
+            let writer = nodes.writer(ids[origin]).unwrap();
+            for peer in pick(&mut rng, &peers[origin], None, cmd.fanout) {
+                let block = Block { size: cmd.size };
+                writer.send_to_tracked(peer, block, propagation).unwrap();
+            }
+
+            let (report, end) = wait(&context, propagation, cmd.timeout.into_duration());
+            print(mode, cmd.nodes, report, end - start);
+        }
+
+        // the relaying thread stops once the mailbox is disconnected
+        context.shutdown().unwrap();
+    });
+}
+
+/// the context where every node and edge has the bandwidth and latency of
+/// the command
+fn network(cmd: &Command) -> SimContext {
+    let mut policy = Policy::new();
+    policy.set_default_node_policy(NodePolicy {
+        bandwidth_down: cmd.bandwidth,
+        bandwidth_up: cmd.bandwidth,
+        location: None,
+    });
+    policy.set_default_edge_policy(EdgePolicy {
+        latency: Latency::new(cmd.latency.into_duration()),
+        bandwidth_down: cmd.bandwidth,
+        bandwidth_up: cmd.bandwidth,
+        packet_loss: PacketLoss::NONE,
+    });
+
+    SimContext::with_config(SimConfiguration {
+        policy,
+        idle_duration: cmd.idle.into_duration(),
+        ..SimConfiguration::default()
+    })
+}
+
+/// relay the propagations from all the nodes, as the multiplexer does
+fn relay(cmd: &Command, nodes: &SimMailbox<Block>, peers: &[Vec<SimId>]) {
+    let mut rng = StdRng::seed_from_u64(cmd.seed);
+    // one bit per node and propagation
+    let mut seen = vec![0u64; (cmd.nodes * cmd.propagations as usize).div_ceil(64)];
+
+    while let Some(event) = nodes.recv_event() {
+        let SimEvent::Msg(msg) = event else {
+            continue;
+        };
+        let Some(propagation) = msg.propagation() else {
+            continue;
+        };
+
+        let node = u64::from(msg.to()) as usize;
+        let bit = propagation as usize * cmd.nodes + node;
+        if seen[bit / 64] & (1 << (bit % 64)) != 0 {
+            continue;
+        }
+        seen[bit / 64] |= 1 << (bit % 64);
+
+        let writer = nodes.writer(msg.to()).unwrap();
+        for peer in pick(&mut rng, &peers[node], Some(msg.from()), cmd.fanout) {
+            let block = Block { size: cmd.size };
+            let _ = writer.send_to_tracked(peer, block, propagation);
+        }
+    }
+}
+
+/// `fanout` random peers (or all of them), but `from`
+fn pick(
+    rng: &mut StdRng,
+    peers: &[SimId],
+    from: Option<SimId>,
+    fanout: Option<usize>,
+) -> Vec<SimId> {
+    let mut peers: Vec<SimId> = peers
+        .iter()
+        .copied()
+        .filter(|peer| Some(*peer) != from)
+        .collect();
+
+    if let Some(fanout) = fanout {
+        let fanout = fanout.min(peers.len());
+        for i in 0..fanout {
+            let j = i + rng.next_u64() as usize % (peers.len() - i);
+            peers.swap(i, j);
+        }
+        peers.truncate(fanout);
+    }
+
+    peers
+}
+
+/// poll the report of the propagation until complete, the timeout or no
+/// new node was reached for a second (a gossip may miss some nodes)
+///
+/// returns the report with the instant the last node was reached
+fn wait(
+    context: &SimContext,
+    id: u64,
+    timeout: std::time::Duration,
+) -> (Option<PropagationReport>, Instant) {
+    let deadline = Instant::now() + timeout;
+    let (mut report, mut reached, mut progress) = (None, 0, Instant::now());
+
+    while Instant::now() < deadline && progress.elapsed().as_secs() < 1 {
+        report = context.propagation_report(id).unwrap();
+        let Some(current) = report.as_ref() else {
+            thread::sleep(std::time::Duration::from_millis(10));
+            continue;
+        };
+        if current.is_complete() {
+            progress = Instant::now();
+            break;
+        }
+        if current.deliveries.len() > reached {
+            (reached, progress) = (current.deliveries.len(), Instant::now());
+        }
+        thread::sleep(std::time::Duration::from_millis(10));
+    }
+
+    (report, progress)
+}
+
+fn print(mode: Mode, nodes: usize, report: Option<PropagationReport>, wall: std::time::Duration) {
+    let coverage = |fraction: f64| {
+        report
+            .as_ref()
+            .and_then(|report| report.time_to_coverage(fraction))
+            .map_or_else(|| "-".to_owned(), |time| format!("{time:.1?}"))
+    };
+    let reached = report
+        .as_ref()
+        .map_or(0, |report| report.deliveries.len() + 1);
+
+    println!(
+        "{:<4} {:>8} {:>10} {:>10} {:>10} {:>7.1}% {:>10}",
+        mode.name(),
+        nodes,
+        coverage(0.5),
+        coverage(0.9),
+        coverage(1.0),
+        reached as f64 * 100.0 / nodes as f64,
+        format!("{wall:.1?}"),
+    );
+}
+
+impl Mode {
+    fn name(self) -> &'static str {
+        match self {
+            Self::Mux => "mux",
+            Self::App => "app",
+        }
+    }
+}
+
+/// a block of `size` bytes
+#[derive(Clone)]
+struct Block {
+    size: u64,
+}
+
+impl HasBytesSize for Block {
+    fn bytes_size(&self) -> u64 {
+        self.size
+    }
+}
@@ -0,0 +1,402 @@
+//! How the simulation behaves as the number of nodes grows
+//!
+//! For every topology and every number of nodes a new context is started
+//! and loaded with small messages between random peers, keeping at most
+//! `window` messages in flight, for `time`. Each run reports:
+//!
+//! * the startup time: creating the context, opening the sockets and
+//!   setting the topology;
+//! * the resident memory added per node (Linux only);
+//! * the round trip (rtt) of a request to the multiplexer under load, an
+//!   upper bound of the duration of a step, not the step itself (it
+//!   includes waiting for the multiplexer to wake up, up to the idle
+//!   duration; build with the `tracing` feature to time the `mux.step`
+//!   spans);
+//! * the messages delivered per second;
+//! * the delivery error: the time it took a message to reach the
+//!   recipient, beyond the latency of the edge (under the full load of
+//!   the window, so it includes the queueing in the multiplexer).
+//!
+//! Opening a socket is a round trip to the multiplexer, so the startup
+//! time grows with the idle duration.
+//!
+//! ```sh
+//! cargo run --release --example scale -- --nodes 10,1000,100000 --topology star,regular
+//! ```
+
+use clap::{Parser, ValueEnum};
+use netsim::{
+    EdgePolicy, HasBytesSize, Latency, NodePolicy, PacketLoss, SimConfiguration, SimId, SimSocket,
+    Topology, TopologyGenerator, TryRecv,
+};
+use netsim_core::{time::Duration, Bandwidth, Policy};
+use rand::{rngs::StdRng, RngCore as _, SeedableRng};
+use std::{
+    env, fs,
+    process::{self, Command as Process},
+    sync::atomic::{AtomicBool, AtomicU64, Ordering},
+    thread,
+    time::Instant,
+};
+
+type SimContext = netsim::SimContext<Probe>;
+
+#[derive(Parser)]
+struct Command {
+    /// the numbers of nodes to simulate
+    #[arg(
+        long,
+        value_delimiter = ',',
+        default_value = "10,100,1000,10000,100000"
+    )]
+    nodes: Vec<usize>,
+
+    /// the topologies to simulate
+    #[arg(long, value_delimiter = ',', default_value = "star,mesh,regular")]
+    topology: Vec<Shape>,
+
+    /// the number of neighbours of every node of the random regular graphs
+    #[arg(long, default_value = "8")]
+    degree: usize,
+
+    /// the duration of the load of every run
+    #[arg(long, default_value = "2s")]
+    time: Duration,
+
+    /// the maximum number of messages in flight
+    #[arg(long, default_value = "10000")]
+    window: u64,
+
+    /// the number of threads receiving the messages
+    #[arg(long, default_value = "2")]
+    readers: usize,
+
+    #[arg(long, default_value = "500us")]
+    idle: Duration,
+
+    #[arg(long, default_value = "10gbps")]
+    bandwidth: Bandwidth,
+
+    #[arg(long, default_value = "5ms")]
+    latency: Duration,
+
+    #[arg(long, default_value = "42")]
+    seed: u64,
+
+    /// run a single configuration without the header (every
+    /// configuration runs in its own process so the memory of the
+    /// previous runs does not hide the memory of the next ones)
+    #[arg(long, hide = true)]
+    child: bool,
+}
+
+#[derive(Clone, Copy, ValueEnum)]
+enum Shape {
+    /// every node is connected to the first node only
+    Star,
+    /// every node is connected to all the others, the messages go to
+    /// random nodes
+    Mesh,
+    /// every node has `degree` random neighbours
+    Regular,
+}
+
+struct Report {
+    startup: std::time::Duration,
+    memory_per_node: Option<usize>,
+    round_trips: Vec<std::time::Duration>,
+    delivered: u64,
+    throughput: f64,
+    errors: Vec<std::time::Duration>,
+}
+
+fn main() {
+    let cmd = Command::parse();
+
+    if cmd.child {
+        print(&cmd, cmd.topology[0], cmd.nodes[0]);
+        return;
+    }
+
+    println!(
+        "{:<8} {:>7} {:>10} {:>9} {:>10} {:>10} {:>10} {:>10} {:>10}",
+        "topology",
+        "nodes",
+        "startup",
+        "rss/node",
+        "rtt p50",
+        "rtt p99",
+        "msgs/s",
+        "error p50",
+        "error p99",
+    );
+
+    let program = env::current_exe().unwrap();
+    for shape in cmd.topology.iter().copied() {
+        for nodes in &cmd.nodes {
+            let status = Process::new(&program)
+                .args(["--child", "--topology", shape.name()])
+                .args(["--nodes", &nodes.to_string()])
+                .args(["--degree", &cmd.degree.to_string()])
+                .args(["--time", &nanos(cmd.time)])
+                .args(["--window", &cmd.window.to_string()])
+                .args(["--readers", &cmd.readers.to_string()])
+                .args(["--idle", &nanos(cmd.idle)])
+                .args(["--bandwidth", &cmd.bandwidth.to_string()])
+                .args(["--latency", &nanos(cmd.latency)])
+                .args(["--seed", &cmd.seed.to_string()])
+                .status()
+                .unwrap();
+            if !status.success() {
+                eprintln!("{} with {nodes} nodes failed: {status}", shape.name());
+                process::exit(1);
+            }
+        }
+    }
+}
+
+fn print(cmd: &Command, shape: Shape, nodes: usize) {
+    let mut report = run(cmd, shape, nodes);
+    report.round_trips.sort();
+    report.errors.sort();
+
+    let memory = report
+        .memory_per_node
+        .map_or_else(|| "-".to_owned(), |bytes| format!("{bytes}B"));
+    println!(
+        "{:<8} {:>7} {:>10} {:>9} {:>10} {:>10} {:>10.0} {:>10} {:>10}",
+        shape.name(),
+        nodes,
+        format!("{:.1?}", report.startup),
+        memory,
+        percentile(&report.round_trips, 0.5),
+        percentile(&report.round_trips, 0.99),
+        report.throughput,
+        percentile(&report.errors, 0.5),
+        percentile(&report.errors, 0.99),
+    );
+    if report.delivered == 0 {
+        println!("  no message delivered");
+    }
+}
+
+fn run(cmd: &Command, shape: Shape, nodes: usize) -> Report {
+    let latency = cmd.latency.into_duration();
+    let memory = resident_memory();
+    let start = Instant::now();
+
+    let mut policy = Policy::new();
+    policy.set_default_node_policy(NodePolicy {
+        bandwidth_down: cmd.bandwidth,
+        bandwidth_up: cmd.bandwidth,
+        location: None,
+    });
+    policy.set_default_edge_policy(EdgePolicy {
+        latency: Latency::new(latency),
+        bandwidth_down: cmd.bandwidth,
+        bandwidth_up: cmd.bandwidth,
+        packet_loss: PacketLoss::NONE,
+    });
+    let configuration = SimConfiguration {
+        policy,
+        idle_duration: cmd.idle.into_duration(),
+        ..SimConfiguration::default()
+    };
+    let mut context = SimContext::with_config(configuration);
+
+    let sockets: Vec<SimSocket<Probe>> = (0..nodes).map(|_| context.open().unwrap()).collect();
+    let ids: Vec<SimId> = sockets.iter().map(|socket| socket.id()).collect();
+    let topology = match shape {
+        Shape::Star => {
+            Some(Topology::new(nodes, ids.iter().skip(1).map(|leaf| (ids[0], *leaf))).unwrap())
+        }
+        Shape::Mesh => None,
+        Shape::Regular => Some(
+            TopologyGenerator::new(nodes, cmd.seed)
+                .random_regular(cmd.degree.min(nodes - 1))
+                .unwrap(),
+        ),
+    };
+    // the neighbours of every node, `None` if connected to all the others
+    let peers: Option<Vec<Vec<SimId>>> = topology.as_ref().map(|topology| {
+        ids.iter()
+            .map(|id| topology.neighbours(*id).collect())
+            .collect()
+    });
+    if let Some(topology) = topology {
+        context.set_topology(topology).unwrap();
+    }
+
+    let startup = start.elapsed();
+    let memory_per_node = resident_memory()
+        .zip(memory)
+        .map(|(after, before)| after.saturating_sub(before) / nodes);
+
+    let writers: Vec<_> = sockets.iter().map(|socket| socket.writer()).collect();
+    let sent = AtomicU64::new(0);
+    let received = AtomicU64::new(0);
+    let stop = AtomicBool::new(false);
+    let mut rng = StdRng::seed_from_u64(cmd.seed);
+    let mut round_trips = Vec::new();
+    let mut delivered = 0;
+
+    let readers = cmd.readers.max(1);
+    let mut groups: Vec<Vec<SimSocket<Probe>>> = (0..readers).map(|_| Vec::new()).collect();
+    for (index, socket) in sockets.into_iter().enumerate() {
+        groups[index % readers].push(socket);
+    }
+
+    let (errors, throughput) = thread::scope(|scope| {
+        let readers: Vec<_> = groups
+            .into_iter()
+            .map(|group| scope.spawn(|| receive(group, latency, &received, &stop)))
+            .collect();
+
+        let start = Instant::now();
+        let deadline = start + cmd.time.into_duration();
+        let mut probe = start;
+        while Instant::now() < deadline {
+            if probe <= Instant::now() {
+                let instant = Instant::now();
+                context.propagation_report(u64::MAX).unwrap();
+                round_trips.push(instant.elapsed());
+                probe = Instant::now() + std::time::Duration::from_millis(10);
+            }
+
+            // a reader may count a delivery before the send is counted
+            let in_flight = sent
+                .load(Ordering::Relaxed)
+                .saturating_sub(received.load(Ordering::Relaxed));
+            if in_flight >= cmd.window {
+                thread::yield_now();
+                continue;
+            }
+
+            let (from, to) = pick(&mut rng, &ids, peers.as_deref());
+            let writer = &writers[from];
+            let probe = Probe { sent: writer.now() };
+            if writer.send_to(to, probe).is_ok() {
+                sent.fetch_add(1, Ordering::Relaxed);
+            }
+        }
+        delivered = received.load(Ordering::Relaxed);
+        let elapsed = start.elapsed();
+
+        // give the messages in flight a chance to arrive
+        let drain = Instant::now() + std::time::Duration::from_secs(1);
+        while received.load(Ordering::Relaxed) < sent.load(Ordering::Relaxed)
+            && Instant::now() < drain
+        {
+            thread::yield_now();
+        }
+        stop.store(true, Ordering::Relaxed);
+
+        let throughput = delivered as f64 / elapsed.as_secs_f64();
+        let errors = readers
+            .into_iter()
+            .flat_map(|reader| reader.join().unwrap())
+            .collect();
+        (errors, throughput)
+    });
+
+    drop(writers);
+    context.shutdown().unwrap();
+
+    Report {
+        startup,
+        memory_per_node,
+        round_trips,
+        delivered,
+        throughput,
+        errors,
+    }
+}
+
+/// the index of a random sender and a random recipient among its peers
+fn pick(rng: &mut StdRng, ids: &[SimId], peers: Option<&[Vec<SimId>]>) -> (usize, SimId) {
+    loop {
+        let mut index = |len: usize| rng.next_u64() as usize % len;
+        let from = index(ids.len());
+        let to = match peers {
+            Some(peers) if peers[from].is_empty() => continue,
+            Some(peers) => peers[from][index(peers[from].len())],
+            None => ids[index(ids.len())],
+        };
+        if to != ids[from] {
+            return (from, to);
+        }
+    }
+}
+
+/// poll the sockets until stopped, returns the delivery errors
+fn receive(
+    mut sockets: Vec<SimSocket<Probe>>,
+    latency: std::time::Duration,
+    received: &AtomicU64,
+    stop: &AtomicBool,
+) -> Vec<std::time::Duration> {
+    let mut errors = Vec::new();
+
+    loop {
+        let mut idle = true;
+        for socket in sockets.iter_mut() {
+            while let TryRecv::Some((_, probe)) = socket.try_recv() {
+                let elapsed = socket.now().saturating_sub(probe.sent);
+                errors.push(elapsed.saturating_sub(latency));
+                received.fetch_add(1, Ordering::Relaxed);
+                idle = false;
+            }
+        }
+
+        if idle {
+            if stop.load(Ordering::Relaxed) {
+                return errors;
+            }
+            thread::yield_now();
+        }
+    }
+}
+
+/// the resident memory of the process, in bytes (Linux only)
+fn resident_memory() -> Option<usize> {
+    let status = fs::read_to_string("/proc/self/status").ok()?;
+    let line = status.lines().find(|line| line.starts_with("VmRSS:"))?;
+    let kilobytes: usize = line.split_whitespace().nth(1)?.parse().ok()?;
+
+    Some(kilobytes * 1024)
+}
+
+/// the duration in a form the command line parses back
+fn nanos(duration: Duration) -> String {
+    format!("{}ns", duration.into_duration().as_nanos())
+}
+
+fn percentile(sorted: &[std::time::Duration], fraction: f64) -> String {
+    if sorted.is_empty() {
+        return "-".to_owned();
+    }
+
+    let index = ((sorted.len() - 1) as f64 * fraction).round() as usize;
+    format!("{:.1?}", sorted[index])
+}
+
+impl Shape {
+    fn name(self) -> &'static str {
+        match self {
+            Self::Star => "star",
+            Self::Mesh => "mesh",
+            Self::Regular => "regular",
+        }
+    }
+}
+
+/// a small message that carries the time it was sent
+struct Probe {
+    sent: std::time::Duration,
+}
+
+impl HasBytesSize for Probe {
+    fn bytes_size(&self) -> u64 {
+        64
+    }
+}
@@ -0,0 +1,75 @@
+use netsim::{SimContext, SimEvent};
+use netsim_core::{Bandwidth, Edge, EdgePolicy, Latency, NodePolicy};
+use std::{
+    io::Write as _,
+    thread,
+    time::{Duration, Instant},
+};
+
+/// the number of bytes streamed from NET1 to NET2
+const SIZE: usize = 10 * 1024 * 1024;
+/// the window of the stream
+const WINDOW: u64 = 256 * 1024;
+
+fn main() {
+    let mut context: SimContext<&'static str> = SimContext::default();
+
+    let net1 = context.open().unwrap();
+    let mut net2 = context.open().unwrap();
+
+    let bandwidth: Bandwidth = "100mbps".parse().unwrap();
+    context
+        .set_node_policy(
+            net1.id(),
+            NodePolicy {
+                bandwidth_up: bandwidth,
+                ..Default::default()
+            },
+        )
+        .unwrap();
+    context
+        .set_edge_policy(
+            Edge::new((net1.id(), net2.id())),
+            EdgePolicy {
+                latency: Latency::new(Duration::from_millis(50)),
+                ..Default::default()
+            },
+        )
+        .unwrap();
+
+    let mut stream = net1.open_stream(net2.id(), WINDOW).unwrap();
+    let writer = thread::spawn(move || {
+        let data = vec![0xAB; SIZE];
+        stream.write_all(&data).unwrap();
+        stream.close().unwrap();
+    });
+
+    let Some(SimEvent::Stream(mut reader)) = net2.recv_event() else {
+        panic!("expecting a stream from NET1")
+    };
+
+    let instant = Instant::now();
+    let mut received = 0;
+    let mut buffer = vec![0; 64 * 1024];
+    loop {
+        let len = reader.read(&mut buffer).unwrap();
+        if len == 0 {
+            break;
+        }
+        assert!(buffer[..len].iter().all(|byte| *byte == 0xAB));
+        received += len;
+    }
+    let elapsed = instant.elapsed();
+
+    writer.join().unwrap();
+    assert_eq!(received, SIZE);
+
+    println!(
+        "{from} -> {net2}: {received} bytes in {}ms ({bandwidth} upload)",
+        elapsed.as_millis(),
+        from = reader.from(),
+        net2 = net2.id(),
+    );
+
+    context.shutdown().unwrap();
+}
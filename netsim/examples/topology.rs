@@ -0,0 +1,67 @@
+use netsim::{SimContext, SimId, TopologyGenerator, TryRecv};
+use std::{
+    thread,
+    time::{Duration, Instant},
+};
+
+/// the number of nodes of the peer graph
+const NODES: usize = 1_000;
+/// the number of peers a new node connects to
+const PEERS: usize = 3;
+
+fn main() {
+    let mut context: SimContext<&'static str> = SimContext::default();
+
+    let instant = Instant::now();
+    let topology = TopologyGenerator::new(NODES, 42)
+        .barabasi_albert(PEERS)
+        .unwrap();
+    println!(
+        "generated {} edges between {} nodes in {}ms",
+        topology.edges(),
+        topology.nodes(),
+        instant.elapsed().as_millis()
+    );
+
+    let mut sockets: Vec<_> = (0..NODES).map(|_| context.open().unwrap()).collect();
+    let index = |id: SimId| u64::from(id) as usize;
+
+    let hub = sockets
+        .iter()
+        .map(|socket| socket.id())
+        .max_by_key(|node| topology.degree(*node))
+        .unwrap();
+    let peers: Vec<SimId> = topology.neighbours(hub).collect();
+    let stranger = sockets
+        .iter()
+        .map(|socket| socket.id())
+        .find(|node| *node != hub && !topology.connected(hub, *node))
+        .unwrap();
+    context.set_topology(topology).unwrap();
+
+    for peer in peers.iter().copied() {
+        sockets[index(hub)].send_to(peer, "gossip").unwrap();
+    }
+    sockets[index(hub)].send_to(stranger, "gossip").unwrap();
+
+    for peer in peers.iter().copied() {
+        let Some((from, _)) = sockets[index(peer)].recv() else {
+            panic!("expecting a message from {hub}")
+        };
+        assert_eq!(from, hub);
+    }
+
+    // the message to a node that is not a peer is dropped
+    thread::sleep(Duration::from_millis(100));
+    assert!(matches!(
+        sockets[index(stranger)].try_recv(),
+        TryRecv::NoMsg
+    ));
+
+    println!(
+        "{hub} reached its {} peers, {stranger} is not a peer",
+        peers.len()
+    );
+
+    context.shutdown().unwrap();
+}
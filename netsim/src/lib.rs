@@ -8,13 +8,18 @@ network simulation framework.
 
 mod sim_context;
 mod sim_link;
+mod sim_mailbox;
 mod sim_socket;
 
 pub use crate::{
     sim_context::SimContext,
-    sim_socket::{SimSocket, SimSocketReadHalf, SimSocketWriteHalf, TryRecv},
+    sim_mailbox::SimMailbox,
+    sim_socket::{SimSocket, SimSocketReadHalf, SimSocketWriteHalf, SimStreamWriter, TryRecv},
 };
 pub use netsim_core::{
-    Bandwidth, Edge, EdgePolicy, HasBytesSize, Latency, NodePolicy, PacketLoss, SimConfiguration,
-    SimId,
+    Bandwidth, CapacityTrace, Constellation, DelayTrace, Delivery, Edge, EdgePolicy, EdgeTrace,
+    FailureProcess, HasBytesSize, Latency, LatencyDistribution, Lifetime, Location, Movement, Msg,
+    MsgId, MsgMeta, NodePolicy, OnDrop, Orbit, PacketLoss, Phantom, PropagationReport, Relay,
+    Segment, SendCompletion, SimClock, SimConfiguration, SimEvent, SimId, StreamId,
+    StreamReader as SimStreamReader, Timer, Topology, TopologyGenerator, UtilisationSampler,
 };
@@ -1,9 +1,14 @@
 use crate::{
     sim_link::{link, SimUpLink},
-    SimConfiguration, SimSocket,
+    SimConfiguration, SimMailbox, SimSocket,
 };
 use anyhow::{Context as _, Result};
-use netsim_core::{sim_context::SimContextCore, Edge, EdgePolicy, HasBytesSize, NodePolicy, SimId};
+use netsim_core::{
+    sim_context::SimContextCore, Constellation, Edge, EdgePolicy, EdgeTrace, FailureProcess,
+    HasBytesSize, LatencyDistribution, Movement, NodePolicy, PropagationReport, Relay, Segment,
+    SimId, Topology, UtilisationSampler,
+};
+use std::time::Duration;
 
 pub struct SimContext<T: HasBytesSize> {
     core: SimContextCore<SimUpLink<T>>,
@@ -23,7 +28,30 @@ where
             .new_link(up)
             .context("Failed to reserve a new SimId")?;
 
-        Ok(SimSocket::new(address, self.core.bus(), down))
+        Ok(SimSocket::new(
+            address,
+            self.core.bus(),
+            down,
+            self.core.clock(),
+        ))
+    }
+
+    /// Open `nodes` light nodes sharing a single [`SimMailbox`]
+    ///
+    /// The nodes are added with a single request to the multiplexer and
+    /// have consecutive identifiers (see [`SimMailbox::ids`]). Use this
+    /// instead of [`SimContext::open`] to simulate a very large network.
+    pub fn open_mailbox(&mut self, nodes: usize) -> Result<SimMailbox<T>> {
+        SimMailbox::open(&mut self.core, nodes)
+    }
+
+    /// the current time of the simulation
+    ///
+    /// This is the time of the multiplexer, the timers requested with
+    /// [`SimSocket::timer_after`] and the delivery of the messages are
+    /// scheduled against this clock.
+    pub fn now(&self) -> Duration {
+        self.core.now()
     }
 
     pub fn new() -> Self {
@@ -59,6 +87,144 @@ where
     pub fn reset_edge_policy(&mut self, edge: Edge) -> Result<()> {
         self.core.reset_edge_policy(edge)
     }
+
+    /// play the traces on the edge, see [`SimContextCore::set_edge_trace`]
+    pub fn set_edge_trace(&mut self, edge: Edge, trace: EdgeTrace) -> Result<()> {
+        self.core.set_edge_trace(edge, trace)
+    }
+
+    pub fn reset_edge_trace(&mut self, edge: Edge) -> Result<()> {
+        self.core.reset_edge_trace(edge)
+    }
+
+    /// draw the latency of the edge from the distribution, see
+    /// [`SimContextCore::set_edge_distribution`]
+    pub fn set_edge_distribution(
+        &mut self,
+        edge: Edge,
+        distribution: LatencyDistribution,
+    ) -> Result<()> {
+        self.core.set_edge_distribution(edge, distribution)
+    }
+
+    pub fn reset_edge_distribution(&mut self, edge: Edge) -> Result<()> {
+        self.core.reset_edge_distribution(edge)
+    }
+
+    pub fn set_node_region(&mut self, node: SimId, region: u32) -> Result<()> {
+        self.core.set_node_region(node, region)
+    }
+
+    /// draw the latency of the edges between the regions from the
+    /// distribution, see [`SimContextCore::set_region_distribution`]
+    pub fn set_region_distribution(
+        &mut self,
+        a: u32,
+        b: u32,
+        distribution: LatencyDistribution,
+    ) -> Result<()> {
+        self.core.set_region_distribution(a, b, distribution)
+    }
+
+    /// make the edges fail and recover randomly, see
+    /// [`SimContextCore::set_edge_failures`]
+    pub fn set_edge_failures(
+        &mut self,
+        edges: impl IntoIterator<Item = Edge>,
+        process: FailureProcess,
+    ) -> Result<()> {
+        self.core.set_edge_failures(edges, process)
+    }
+
+    pub fn reset_edge_failures(&mut self, edges: impl IntoIterator<Item = Edge>) -> Result<()> {
+        self.core.reset_edge_failures(edges)
+    }
+
+    /// move the node, see [`SimContextCore::set_node_movement`]
+    pub fn set_node_movement(&mut self, node: SimId, movement: Movement) -> Result<()> {
+        self.core.set_node_movement(node, movement)
+    }
+
+    pub fn reset_node_movement(&mut self, node: SimId) -> Result<()> {
+        self.core.reset_node_movement(node)
+    }
+
+    /// add the satellites and ground stations to the network, see
+    /// [`SimContextCore::set_constellation`]
+    pub fn set_constellation(&mut self, constellation: Constellation) -> Result<()> {
+        self.core.set_constellation(constellation)
+    }
+
+    pub fn reset_constellation(&mut self) -> Result<()> {
+        self.core.reset_constellation()
+    }
+
+    /// set the shared segment `id`, see [`SimContextCore::set_segment`]
+    pub fn set_segment(&mut self, id: u32, segment: Segment) -> Result<()> {
+        self.core.set_segment(id, segment)
+    }
+
+    pub fn reset_segment(&mut self, id: u32) -> Result<()> {
+        self.core.reset_segment(id)
+    }
+
+    /// the report of the propagation `id`, see
+    /// [`SimContextCore::propagation_report`]
+    pub fn propagation_report(&self, id: u64) -> Result<Option<PropagationReport>> {
+        self.core.propagation_report(id)
+    }
+
+    /// restrict the network to the edges of the [`Topology`], see
+    /// [`SimContextCore::set_topology`]
+    pub fn set_topology(&mut self, topology: Topology) -> Result<()> {
+        self.core.set_topology(topology)
+    }
+
+    pub fn reset_topology(&mut self) -> Result<()> {
+        self.core.reset_topology()
+    }
+
+    /// sample the utilisation of the network periodically, see
+    /// [`SimContextCore::set_utilisation_sampler`]
+    pub fn set_utilisation_sampler(&mut self, sampler: UtilisationSampler) -> Result<()> {
+        self.core.set_utilisation_sampler(sampler)
+    }
+
+    pub fn reset_utilisation_sampler(&mut self) -> Result<()> {
+        self.core.reset_utilisation_sampler()
+    }
+
+    /// relay the propagations inside the multiplexer, `copy` makes the
+    /// copies of the messages relayed (see [`SimContext::set_default_relay`]
+    /// for the messages that can be cloned)
+    pub fn set_default_relay_with(
+        &mut self,
+        relay: Option<Relay>,
+        copy: fn(&T) -> T,
+    ) -> Result<()> {
+        self.core.set_default_relay(relay, copy)
+    }
+}
+
+impl<T> SimContext<T>
+where
+    T: HasBytesSize + Clone,
+{
+    /// relay the propagations inside the multiplexer, see
+    /// [`SimContextCore::set_default_relay`]
+    pub fn set_default_relay(&mut self, relay: Option<Relay>) -> Result<()> {
+        self.set_default_relay_with(relay, T::clone)
+    }
+
+    /// relay the propagations of the node inside the multiplexer, see
+    /// [`SimContextCore::set_node_relay`]
+    pub fn set_node_relay(&mut self, node: SimId, relay: Option<Relay>) -> Result<()> {
+        self.core.set_node_relay(node, relay, T::clone)
+    }
+
+    pub fn reset_node_relay(&mut self, node: SimId) -> Result<()> {
+        self.core.reset_node_relay(node)
+    }
 }
 
 /* DELETE */
@@ -1,22 +1,32 @@
+use crate::sim_mailbox::MailboxLink;
 use anyhow::{anyhow, Result};
-use netsim_core::{sim_context::Link, HasBytesSize, Msg};
-use std::sync::mpsc;
+use netsim_core::{sim_context::Link, HasBytesSize, SimEvent};
+use std::sync::{mpsc, Arc};
 
 pub fn link<T>() -> (SimUpLink<T>, SimDownLink<T>) {
     let (sender, receiver) = mpsc::channel();
 
-    let up = SimUpLink { sender };
+    let up = SimUpLink {
+        inner: Up::Channel(sender),
+    };
     let down = SimDownLink { receiver };
 
     (up, down)
 }
 
 pub struct SimUpLink<T> {
-    sender: mpsc::Sender<Msg<T>>,
+    inner: Up<T>,
+}
+
+enum Up<T> {
+    /// the channel of a [`crate::SimSocket`]
+    Channel(mpsc::Sender<SimEvent<T>>),
+    /// a node of a [`crate::SimMailbox`], all of them share the same link
+    Mailbox(Arc<MailboxLink<T>>),
 }
 
 pub struct SimDownLink<T> {
-    receiver: mpsc::Receiver<Msg<T>>,
+    receiver: mpsc::Receiver<SimEvent<T>>,
 }
 
 impl<T> Link for SimUpLink<T>
@@ -24,15 +34,47 @@ where
     T: HasBytesSize,
 {
     type Msg = T;
-    fn send(&self, msg: Msg<Self::Msg>) -> Result<()> {
-        self.sender.send(msg).map_err(|error| {
-            anyhow!(
-                "Failed to send Msg ({size} bytes) from {from}, to {to}",
-                from = error.0.from(),
-                to = error.0.to(),
-                size = error.0.content().bytes_size(),
-            )
-        })
+    fn send(&self, event: SimEvent<Self::Msg>) -> Result<()> {
+        match &self.inner {
+            Up::Channel(sender) => sender.send(event).map_err(|error| disconnected(error.0)),
+            Up::Mailbox(mailbox) => mailbox.send(event).map_err(disconnected),
+        }
+    }
+}
+
+impl<T> SimUpLink<T> {
+    pub(crate) fn mailbox(link: Arc<MailboxLink<T>>) -> Self {
+        Self {
+            inner: Up::Mailbox(link),
+        }
+    }
+}
+
+/// the error of an event that could not be delivered
+fn disconnected<T: HasBytesSize>(event: SimEvent<T>) -> anyhow::Error {
+    match event {
+        SimEvent::Msg(msg) => anyhow!(
+            "Failed to send Msg ({size} bytes) from {from}, to {to}",
+            from = msg.from(),
+            to = msg.to(),
+            size = msg.content().bytes_size(),
+        ),
+        SimEvent::Timer(timer) => anyhow!(
+            "Failed to send Timer ({token}) to {to}",
+            token = timer.token(),
+            to = timer.node(),
+        ),
+        SimEvent::SendCompletion(completion) => anyhow!(
+            "Failed to send SendCompletion ({token}) to {to}",
+            token = completion.token(),
+            to = completion.from(),
+        ),
+        SimEvent::Stream(stream) => anyhow!(
+            "Failed to send Stream ({id}) from {from}, to {to}",
+            id = stream.id(),
+            from = stream.from(),
+            to = stream.to(),
+        ),
     }
 }
 
@@ -43,19 +85,21 @@ where
     /// blocking call to receiving message on the channel
     ///
     /// returns `None` if the sending end has disconnected (no more senders)
-    pub fn recv(&mut self) -> Option<Msg<T>> {
+    pub fn recv(&mut self) -> Option<SimEvent<T>> {
         self.receiver.recv().ok()
     }
 
-    pub fn try_recv(&mut self) -> std::result::Result<Msg<T>, mpsc::TryRecvError> {
+    pub fn try_recv(&mut self) -> std::result::Result<SimEvent<T>, mpsc::TryRecvError> {
         self.receiver.try_recv()
     }
 }
 
 impl<T> Clone for SimUpLink<T> {
     fn clone(&self) -> Self {
-        Self {
-            sender: self.sender.clone(),
-        }
+        let inner = match &self.inner {
+            Up::Channel(sender) => Up::Channel(sender.clone()),
+            Up::Mailbox(mailbox) => Up::Mailbox(Arc::clone(mailbox)),
+        };
+        Self { inner }
     }
 }
@@ -0,0 +1,263 @@
+use crate::{sim_link::SimUpLink, sim_socket::SimSocketWriteHalf, HasBytesSize, SimId, TryRecv};
+use anyhow::{bail, ensure, Context as _, Result};
+use netsim_core::{sim_context::SimContextCore, BusSender, SimClock, SimEvent};
+use std::{
+    collections::VecDeque,
+    iter,
+    sync::{Arc, Condvar, Mutex, MutexGuard, Weak},
+};
+
+/// Many light nodes sharing the same receiving end, see
+/// [`crate::SimContext::open_mailbox`]
+///
+/// A node of the mailbox does not have a channel or a socket: the events
+/// delivered to the nodes are kept in a single slab of queues indexed by
+/// [`SimId`], and the handles to send from a node are made on demand (see
+/// [`SimMailbox::writer`]). An idle node costs about a hundred bytes, so
+/// a process can simulate millions of them.
+///
+/// The events of all the nodes are received in turn with
+/// [`SimMailbox::recv_event`] (the recipient is [`SimEvent::to`]), or
+/// node by node with [`SimMailbox::try_recv_event_for`].
+pub struct SimMailbox<T>
+where
+    T: HasBytesSize,
+{
+    first: SimId,
+    len: usize,
+    slab: Arc<Slab<T>>,
+    up: BusSender<SimUpLink<T>>,
+    clock: SimClock,
+}
+
+/// the link of the multiplexer to the nodes of a mailbox, shared by all
+/// the nodes
+///
+/// The mailbox is disconnected once the multiplexer drops it.
+pub(crate) struct MailboxLink<T> {
+    slab: Weak<Slab<T>>,
+}
+
+struct Slab<T> {
+    state: Mutex<State<T>>,
+    ready: Condvar,
+}
+
+struct State<T> {
+    /// the identifier of the first node, `None` until the multiplexer
+    /// has added the nodes
+    first: Option<SimId>,
+    /// the events not yet received, by node
+    queues: Box<[VecDeque<SimEvent<T>>]>,
+    /// the nodes with events, in turn
+    pending: VecDeque<u32>,
+    /// one bit per node, set if the node is in `pending`
+    scheduled: Box<[u64]>,
+    disconnected: bool,
+}
+
+impl<T> SimMailbox<T>
+where
+    T: HasBytesSize,
+{
+    /// add `len` nodes to the context, with a single request to the
+    /// multiplexer
+    pub(crate) fn open(core: &mut SimContextCore<SimUpLink<T>>, len: usize) -> Result<Self> {
+        ensure!(
+            len <= u32::MAX as usize,
+            "A mailbox cannot have more than {} nodes",
+            u32::MAX
+        );
+
+        let slab = Arc::new(Slab {
+            state: Mutex::new(State {
+                first: None,
+                queues: (0..len).map(|_| VecDeque::new()).collect(),
+                pending: VecDeque::new(),
+                scheduled: vec![0; len.div_ceil(64)].into_boxed_slice(),
+                disconnected: false,
+            }),
+            ready: Condvar::new(),
+        });
+        let link = Arc::new(MailboxLink {
+            slab: Arc::downgrade(&slab),
+        });
+        let links = (0..len)
+            .map(|_| SimUpLink::mailbox(Arc::clone(&link)))
+            .collect();
+        drop(link);
+
+        let first = core
+            .new_links(links)
+            .context("Failed to reserve the SimIds of the mailbox")?;
+        slab.lock().first = Some(first);
+
+        Ok(Self {
+            first,
+            len,
+            slab,
+            up: core.bus(),
+            clock: core.clock(),
+        })
+    }
+
+    /// the identifiers of the nodes, in order
+    pub fn ids(&self) -> impl Iterator<Item = SimId> {
+        iter::successors(Some(self.first), |id| Some(id.next())).take(self.len)
+    }
+
+    /// the number of nodes of the mailbox
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// whether the node `id` is one of the nodes of the mailbox
+    pub fn contains(&self, id: SimId) -> bool {
+        self.index(id).is_some()
+    }
+
+    fn index(&self, id: SimId) -> Option<usize> {
+        let index = u64::from(id).checked_sub(u64::from(self.first))?;
+        (index < self.len as u64).then_some(index as usize)
+    }
+
+    /// a handle to send from the node `id`
+    ///
+    /// The handle is not kept by the mailbox: make one when the node has
+    /// something to send and drop it afterward.
+    pub fn writer(&self, id: SimId) -> Result<SimSocketWriteHalf<T>> {
+        ensure!(self.contains(id), "The node {id} is not in the mailbox");
+
+        Ok(SimSocketWriteHalf::new(
+            id,
+            self.up.clone(),
+            self.clock.clone(),
+        ))
+    }
+
+    /// blocking call to receive the next event of any node of the mailbox
+    ///
+    /// The nodes with events are served in turn, one event at a time, so
+    /// a busy node does not hold back the others.
+    ///
+    /// returns None if the mailbox has been disconnected (the
+    /// [`crate::SimContext`] has been dropped or shutdown)
+    pub fn recv_event(&self) -> Option<SimEvent<T>> {
+        let mut state = self.slab.lock();
+        loop {
+            if let Some(event) = state.pop() {
+                return Some(event);
+            }
+            if state.disconnected {
+                return None;
+            }
+            state = self
+                .slab
+                .ready
+                .wait(state)
+                .unwrap_or_else(|error| error.into_inner());
+        }
+    }
+
+    /// Non blocking call to receive the next event of any node of the
+    /// mailbox, see [`SimMailbox::recv_event`]
+    pub fn try_recv_event(&self) -> TryRecv<SimEvent<T>> {
+        let mut state = self.slab.lock();
+        match state.pop() {
+            Some(event) => TryRecv::Some(event),
+            None if state.disconnected => TryRecv::Disconnected,
+            None => TryRecv::NoMsg,
+        }
+    }
+
+    /// Non blocking call to receive the next event of the node `id`
+    pub fn try_recv_event_for(&self, id: SimId) -> Result<TryRecv<SimEvent<T>>> {
+        let Some(index) = self.index(id) else {
+            bail!("The node {id} is not in the mailbox");
+        };
+
+        let mut state = self.slab.lock();
+        Ok(match state.queues[index].pop_front() {
+            Some(event) => TryRecv::Some(event),
+            None if state.disconnected => TryRecv::Disconnected,
+            None => TryRecv::NoMsg,
+        })
+    }
+}
+
+impl<T> MailboxLink<T> {
+    /// queue the event for its recipient, the event is given back if the
+    /// mailbox was dropped
+    pub(crate) fn send(&self, event: SimEvent<T>) -> Result<(), SimEvent<T>> {
+        let Some(slab) = self.slab.upgrade() else {
+            return Err(event);
+        };
+
+        slab.lock().push(event)?;
+        slab.ready.notify_one();
+        Ok(())
+    }
+}
+
+impl<T> Drop for MailboxLink<T> {
+    fn drop(&mut self) {
+        if let Some(slab) = self.slab.upgrade() {
+            slab.lock().disconnected = true;
+            slab.ready.notify_all();
+        }
+    }
+}
+
+impl<T> Slab<T> {
+    fn lock(&self) -> MutexGuard<'_, State<T>> {
+        // the state is consistent between the calls, even after a panic
+        self.state.lock().unwrap_or_else(|error| error.into_inner())
+    }
+}
+
+impl<T> State<T> {
+    fn push(&mut self, event: SimEvent<T>) -> Result<(), SimEvent<T>> {
+        let index = self
+            .first
+            .and_then(|first| u64::from(event.to()).checked_sub(u64::from(first)))
+            .filter(|index| *index < self.queues.len() as u64);
+        let Some(index) = index else {
+            return Err(event);
+        };
+        let index = index as usize;
+
+        self.queues[index].push_back(event);
+        self.schedule(index);
+        Ok(())
+    }
+
+    /// the next event of the next node in turn
+    fn pop(&mut self) -> Option<SimEvent<T>> {
+        while let Some(index) = self.pending.pop_front() {
+            let index = index as usize;
+            self.scheduled[index / 64] &= !(1 << (index % 64));
+
+            // the events may have been received with `try_recv_event_for`
+            if let Some(event) = self.queues[index].pop_front() {
+                if !self.queues[index].is_empty() {
+                    self.schedule(index);
+                }
+                return Some(event);
+            }
+        }
+
+        None
+    }
+
+    fn schedule(&mut self, index: usize) {
+        let (word, bit) = (index / 64, 1 << (index % 64));
+        if self.scheduled[word] & bit == 0 {
+            self.scheduled[word] |= bit;
+            self.pending.push_back(index as u32);
+        }
+    }
+}
@@ -3,8 +3,10 @@ use crate::{
     HasBytesSize, SimId,
 };
 use anyhow::Result;
-use netsim_core::{BusSender, Msg};
-use std::sync::mpsc;
+use netsim_core::{
+    BusSender, Msg, MsgId, MsgMeta, Phantom, SimClock, SimEvent, StreamWriter, Timer,
+};
+use std::{io, sync::mpsc, time::Duration};
 
 pub struct SimSocket<T>
 where
@@ -17,14 +19,31 @@ where
 pub struct SimSocketReadHalf<T> {
     id: SimId,
     down: SimDownLink<T>,
+    clock: SimClock,
 }
 
+/// The writing end of a socket
+///
+/// The handles are cheap to clone and can be moved to other threads, so
+/// several threads can send from the same socket. All the handles of a
+/// context share the same queue to the multiplexer.
 pub struct SimSocketWriteHalf<T>
 where
     T: HasBytesSize,
 {
     id: SimId,
     up: BusSender<SimUpLink<T>>,
+    clock: SimClock,
+}
+
+/// The writing end of an ordered byte stream, see [`SimSocket::open_stream`]
+///
+/// Dropping the writer closes the stream.
+pub struct SimStreamWriter<T>
+where
+    T: HasBytesSize,
+{
+    inner: StreamWriter<SimUpLink<T>>,
 }
 
 /// Result from [`SimSocket::try_recv`] or [`SimSocketReadHalf::try_recv`]
@@ -48,10 +67,19 @@ where
         id: SimId,
         to_bus: BusSender<SimUpLink<T>>,
         receiver: SimDownLink<T>,
+        clock: SimClock,
     ) -> Self {
         Self {
-            reader: SimSocketReadHalf { id, down: receiver },
-            writer: SimSocketWriteHalf { id, up: to_bus },
+            reader: SimSocketReadHalf {
+                id,
+                down: receiver,
+                clock: clock.clone(),
+            },
+            writer: SimSocketWriteHalf {
+                id,
+                up: to_bus,
+                clock,
+            },
         }
     }
 
@@ -60,6 +88,12 @@ where
         self.reader.id()
     }
 
+    /// a new handle on the writing end of the socket, see
+    /// [`SimSocketWriteHalf`]
+    pub fn writer(&self) -> SimSocketWriteHalf<T> {
+        self.writer.clone()
+    }
+
     pub fn into_split(self) -> (SimSocketReadHalf<T>, SimSocketWriteHalf<T>) {
         let Self { reader, writer } = self;
 
@@ -71,10 +105,55 @@ impl<T> SimSocket<T>
 where
     T: HasBytesSize,
 {
-    pub fn send_to(&self, to: SimId, msg: T) -> Result<()> {
+    pub fn send_to(&self, to: SimId, msg: T) -> Result<MsgId> {
         self.writer.send_to(to, msg)
     }
 
+    /// send a message and be notified once it has left this socket,
+    /// see [`SimSocketWriteHalf::send_to_notify`]
+    pub fn send_to_notify(&self, to: SimId, msg: T, token: u64) -> Result<MsgId> {
+        self.writer.send_to_notify(to, msg, token)
+    }
+
+    /// send a message that may be cancelled, see
+    /// [`SimSocketWriteHalf::send_to_cancellable`]
+    pub fn send_to_cancellable(&self, to: SimId, msg: T) -> Result<MsgId> {
+        self.writer.send_to_cancellable(to, msg)
+    }
+
+    /// send a message that is dropped if not delivered in time,
+    /// see [`SimSocketWriteHalf::send_to_with_timeout`]
+    pub fn send_to_with_timeout(&self, to: SimId, msg: T, timeout: Duration) -> Result<MsgId> {
+        self.writer.send_to_with_timeout(to, msg, timeout)
+    }
+
+    /// send a message that is part of a propagation, see
+    /// [`SimSocketWriteHalf::send_to_tracked`]
+    pub fn send_to_tracked(&self, to: SimId, msg: T, propagation: u64) -> Result<MsgId> {
+        self.writer.send_to_tracked(to, msg, propagation)
+    }
+
+    /// cancel a message, see [`SimSocketWriteHalf::cancel`]
+    pub fn cancel(&self, id: MsgId) -> Result<()> {
+        self.writer.cancel(id)
+    }
+
+    /// open a stream to another node, see [`SimSocketWriteHalf::open_stream`]
+    pub fn open_stream(&self, to: SimId, window: u64) -> Result<SimStreamWriter<T>> {
+        self.writer.open_stream(to, window)
+    }
+
+    /// the current time of the simulation (see [`SimClock::now`])
+    #[inline]
+    pub fn now(&self) -> Duration {
+        self.writer.now()
+    }
+
+    /// request a timer, see [`SimSocketWriteHalf::timer_after`]
+    pub fn timer_after(&self, delay: Duration, token: u64) -> Result<()> {
+        self.writer.timer_after(delay, token)
+    }
+
     /// blocking call to receiving message on the channel
     ///
     /// returns None if the sending end has disconnected (no more senders)
@@ -87,9 +166,68 @@ where
     pub fn try_recv(&mut self) -> TryRecv<(SimId, T)> {
         self.reader.try_recv()
     }
+
+    /// blocking call to receiving message on the channel, along with
+    /// the timing of the message's journey (see [`MsgMeta`])
+    ///
+    /// returns None if the sending end has disconnected (no more senders)
+    pub fn recv_with_meta(&mut self) -> Option<(SimId, T, MsgMeta)> {
+        self.reader.recv_with_meta()
+    }
+
+    /// blocking call to receiving the next event (message, timer, send
+    /// completion or stream)
+    ///
+    /// returns None if the sending end has disconnected (no more senders)
+    pub fn recv_event(&mut self) -> Option<SimEvent<T>> {
+        self.reader.recv_event()
+    }
+
+    /// Non blocking call to receiving the next event (message, timer, send
+    /// completion or stream)
+    ///
+    pub fn try_recv_event(&mut self) -> TryRecv<SimEvent<T>> {
+        self.reader.try_recv_event()
+    }
+}
+
+impl<T> SimSocket<T>
+where
+    T: HasBytesSize + Clone,
+{
+    /// broadcast a message on a shared segment, see
+    /// [`SimSocketWriteHalf::broadcast`]
+    pub fn broadcast(&self, segment: u32, msg: T) -> Result<MsgId> {
+        self.writer.broadcast(segment, msg)
+    }
+}
+
+impl<T> SimSocket<T>
+where
+    T: HasBytesSize + From<Phantom>,
+{
+    /// send a message that only has a size, see
+    /// [`SimSocketWriteHalf::send_sized`]
+    pub fn send_sized(&self, to: SimId, size: u64, tag: u64) -> Result<MsgId> {
+        self.writer.send_sized(to, size, tag)
+    }
+}
+
+impl<T: HasBytesSize> Clone for SimSocketWriteHalf<T> {
+    fn clone(&self) -> Self {
+        Self {
+            id: self.id,
+            up: self.up.clone(),
+            clock: self.clock.clone(),
+        }
+    }
 }
 
 impl<T: HasBytesSize> SimSocketWriteHalf<T> {
+    pub(crate) fn new(id: SimId, up: BusSender<SimUpLink<T>>, clock: SimClock) -> Self {
+        Self { id, up, clock }
+    }
+
     #[inline]
     pub fn id(&self) -> SimId {
         self.id
@@ -100,10 +238,134 @@ impl<T> SimSocketWriteHalf<T>
 where
     T: HasBytesSize,
 {
-    pub fn send_to(&self, to: SimId, msg: T) -> Result<()> {
+    pub fn send_to(&self, to: SimId, msg: T) -> Result<MsgId> {
         let msg = Msg::new(self.id, to, msg);
         self.up.send_msg(msg)
     }
+
+    /// send a message and be notified once its last byte has left this
+    /// socket (i.e. the upload of the message is complete)
+    ///
+    /// The notification is delivered back to this socket as a
+    /// [`SimEvent::SendCompletion`] with the given `token`. Use
+    /// [`SimSocket::recv_event`] to receive it.
+    pub fn send_to_notify(&self, to: SimId, msg: T, token: u64) -> Result<MsgId> {
+        let msg = Msg::new(self.id, to, msg).with_send_completion(token);
+        self.up.send_msg(msg)
+    }
+
+    /// send a message that may be cancelled with
+    /// [`SimSocketWriteHalf::cancel`] while it is in flight
+    pub fn send_to_cancellable(&self, to: SimId, msg: T) -> Result<MsgId> {
+        let msg = Msg::new(self.id, to, msg).with_cancellation();
+        self.up.send_msg(msg)
+    }
+
+    /// send a message that must be delivered within `timeout` of
+    /// simulated time
+    ///
+    /// If the message is still in flight once the timeout has elapsed it
+    /// is dropped (see [`SimConfiguration::on_drop`]). It may also be
+    /// cancelled with [`SimSocketWriteHalf::cancel`].
+    ///
+    /// [`SimConfiguration::on_drop`]: crate::SimConfiguration::on_drop
+    pub fn send_to_with_timeout(&self, to: SimId, msg: T, timeout: Duration) -> Result<MsgId> {
+        let deadline = self.clock.instant(self.clock.now() + timeout);
+        let msg = Msg::new(self.id, to, msg)
+            .with_deadline(deadline)
+            .with_cancellation();
+        self.up.send_msg(msg)
+    }
+
+    /// send a message that is part of the propagation `propagation`
+    /// (a block or a transaction relayed from node to node)
+    ///
+    /// The multiplexer records the first delivery of the propagation to
+    /// every node: use [`SimContext::propagation_report`] to know how long
+    /// it took to reach the nodes.
+    ///
+    /// [`SimContext::propagation_report`]: crate::SimContext::propagation_report
+    pub fn send_to_tracked(&self, to: SimId, msg: T, propagation: u64) -> Result<MsgId> {
+        let msg = Msg::new(self.id, to, msg).with_propagation(propagation);
+        self.up.send_msg(msg)
+    }
+
+    /// cancel a message previously sent by this socket with
+    /// [`SimSocketWriteHalf::send_to_cancellable`] or
+    /// [`SimSocketWriteHalf::send_to_with_timeout`]
+    ///
+    /// If the message is still in flight it is dropped (see
+    /// [`SimConfiguration::on_drop`]) and stops consuming the bandwidth
+    /// of the network. Nothing happens if it was already delivered, if it
+    /// was sent by another node or if it was not sent cancellable.
+    ///
+    /// [`SimConfiguration::on_drop`]: crate::SimConfiguration::on_drop
+    pub fn cancel(&self, id: MsgId) -> Result<()> {
+        self.up.send_cancel(self.id, id)
+    }
+
+    /// open an ordered byte stream to the node `to`
+    ///
+    /// The recipient receives the reading end of the stream as a
+    /// [`SimEvent::Stream`] (use [`SimSocket::recv_event`]). The stream is
+    /// accounted by the multiplexer as a single flow, sharing the bandwidth
+    /// of the network with the messages.
+    ///
+    /// `window` is the maximum number of bytes written but not yet read
+    /// by the recipient: once it is reached the writes block until the
+    /// recipient reads from the stream.
+    pub fn open_stream(&self, to: SimId, window: u64) -> Result<SimStreamWriter<T>> {
+        let inner = StreamWriter::open(self.up.clone(), self.id, to, window)?;
+        Ok(SimStreamWriter { inner })
+    }
+
+    /// the current time of the simulation (see [`SimClock::now`])
+    #[inline]
+    pub fn now(&self) -> Duration {
+        self.clock.now()
+    }
+
+    /// request a timer that will expire after `delay` of simulated time
+    ///
+    /// The timer is kept by the multiplexer (it does not cost a thread)
+    /// and is delivered back to this socket as a [`SimEvent::Timer`]
+    /// with the given `token`. Use [`SimSocket::recv_event`] to receive it.
+    pub fn timer_after(&self, delay: Duration, token: u64) -> Result<()> {
+        let deadline = self.clock.instant(self.clock.now() + delay);
+        self.up.send_timer(Timer::new(self.id, token, deadline))
+    }
+}
+
+impl<T> SimSocketWriteHalf<T>
+where
+    T: HasBytesSize + Clone,
+{
+    /// broadcast a message on the shared segment this socket is a member
+    /// of (see [`Segment`]): it is transmitted once and delivered to all
+    /// the other members of the segment
+    ///
+    /// The message is dropped if this socket is not a member of the
+    /// segment.
+    ///
+    /// [`Segment`]: netsim_core::Segment
+    pub fn broadcast(&self, segment: u32, msg: T) -> Result<MsgId> {
+        let msg = Msg::new(self.id, self.id, msg);
+        self.up.send_broadcast(segment, msg, T::clone)
+    }
+}
+
+impl<T> SimSocketWriteHalf<T>
+where
+    T: HasBytesSize + From<Phantom>,
+{
+    /// send a message of `size` bytes that carries a `tag` instead of a
+    /// payload (see [`Phantom`])
+    ///
+    /// The network charges `size` bytes, but only the tag is kept while
+    /// the message is in flight.
+    pub fn send_sized(&self, to: SimId, size: u64, tag: u64) -> Result<MsgId> {
+        self.send_to(to, T::from(Phantom { size, tag }))
+    }
 }
 
 impl<T> SimSocketReadHalf<T> {
@@ -113,22 +375,98 @@ impl<T> SimSocketReadHalf<T> {
     }
 }
 
+impl<T> SimStreamWriter<T>
+where
+    T: HasBytesSize,
+{
+    /// the recipient of the stream
+    pub fn to(&self) -> SimId {
+        self.inner.to()
+    }
+
+    /// close the stream, the recipient reads the end of the stream once
+    /// all the bytes written have been delivered (or fails to read with
+    /// [`std::io::ErrorKind::ConnectionReset`] if the network drops the
+    /// stream first)
+    pub fn close(mut self) -> Result<()> {
+        Ok(self.inner.close()?)
+    }
+}
+
+impl<T> io::Write for SimStreamWriter<T>
+where
+    T: HasBytesSize,
+{
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.inner.write(buf)
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        // the bytes are sent to the multiplexer on write
+        Ok(())
+    }
+}
+
 impl<T> SimSocketReadHalf<T>
 where
     T: HasBytesSize,
 {
     /// blocking call to receiving a message from the network
+    ///
+    /// Other events (timers, send completions, streams) are discarded, use
+    /// [`SimSocketReadHalf::recv_event`] to receive them.
     pub fn recv(&mut self) -> Option<(SimId, T)> {
-        let msg = self.down.recv()?;
+        let msg = self.recv_msg()?;
 
         Some((msg.from(), msg.into_content()))
     }
 
+    /// blocking call to receiving a message from the network along with
+    /// the timing of its journey through the simulated network
+    ///
+    /// Other events (timers, send completions, streams) are discarded.
+    pub fn recv_with_meta(&mut self) -> Option<(SimId, T, MsgMeta)> {
+        let msg = self.recv_msg()?;
+        let meta = msg.meta(&self.clock);
+
+        Some((msg.from(), msg.into_content(), meta))
+    }
+
+    fn recv_msg(&mut self) -> Option<Msg<T>> {
+        loop {
+            if let Some(msg) = self.recv_event()?.into_msg() {
+                return Some(msg);
+            }
+        }
+    }
+
     /// non blocking call to receiving message on the channel
     ///
+    /// Other events (timers, send completions, streams) are discarded, use
+    /// [`SimSocketReadHalf::try_recv_event`] to receive them.
     pub fn try_recv(&mut self) -> TryRecv<(SimId, T)> {
+        loop {
+            match self.try_recv_event() {
+                TryRecv::Some(SimEvent::Msg(msg)) => {
+                    return TryRecv::Some((msg.from(), msg.into_content()))
+                }
+                TryRecv::Some(_) => continue,
+                TryRecv::NoMsg => return TryRecv::NoMsg,
+                TryRecv::Disconnected => return TryRecv::Disconnected,
+            }
+        }
+    }
+
+    /// blocking call to receiving the next event from the network
+    pub fn recv_event(&mut self) -> Option<SimEvent<T>> {
+        self.down.recv()
+    }
+
+    /// non blocking call to receiving the next event on the channel
+    ///
+    pub fn try_recv_event(&mut self) -> TryRecv<SimEvent<T>> {
         match self.down.try_recv() {
-            Ok(msg) => TryRecv::Some((msg.from(), msg.into_content())),
+            Ok(event) => TryRecv::Some(event),
             Err(mpsc::TryRecvError::Empty) => TryRecv::NoMsg,
             Err(mpsc::TryRecvError::Disconnected) => TryRecv::Disconnected,
         }